@@ -0,0 +1,199 @@
+//
+//  benchmark.cpp
+//  OpenCLDijkstra
+//
+
+#include "benchmark.hpp"
+#include <fstream>
+#include <string>
+#include <string.h>
+
+///
+//  Namespaces
+//
+using namespace std;
+
+///
+/// The standard workloads. Names are what results are matched by against a baseline, so a workload that changes
+/// has to be renamed.
+///
+static const BenchmarkWorkload standardWorkloadArray[] = {
+    //  name                      vertices  nbrs  max   samples  sources  exponent  acyclic
+    {"uniform-cyclic",            10000,    4,    0.2f, 100,     10,      0.0f,     false},
+    {"uniform-acyclic",           10000,    4,    0.2f, 100,     10,      0.0f,     true},
+    {"uniform-dense-cyclic",      10000,    16,   0.2f, 100,     10,      0.0f,     false},
+    {"uniform-and-heavy-acyclic", 10000,    4,    0.6f, 100,     10,      0.0f,     true},
+    {"power-law-cyclic",          10000,    4,    0.2f, 100,     10,      2.1f,     false},
+    {"power-law-acyclic",         10000,    4,    0.2f, 100,     10,      2.1f,     true},
+    {"many-samples-acyclic",      2000,     4,    0.2f, 1000,    10,      0.0f,     true},
+    {"large-acyclic",             200000,   4,    0.2f, 10,      10,      0.0f,     true},
+};
+
+int getStandardWorkloads(const BenchmarkWorkload **workloadArray)
+{
+    *workloadArray = standardWorkloadArray;
+    return sizeof(standardWorkloadArray) / sizeof(standardWorkloadArray[0]);
+}
+
+///
+/// Generate the graph of workload with the parallel generator, from a fixed seed, so that the graph is the same on
+/// every run. config is set to what it was generated with, for drawing new weights with generateWeights.
+///
+void generateBenchmarkGraph(GraphData *graph, const BenchmarkWorkload *workload, GeneratorConfig *config)
+{
+    bool powerLaw = workload->powerLawExponent > 0;
+    initializeGeneratorConfig(config, powerLaw ? TOPOLOGY_POWER_LAW : TOPOLOGY_UNIFORM, workload->vertexCount, workload->neighborsPerVertex, workload->graphCount, workload->sourceCount);
+    config->andFraction = workload->probOfMax;
+    if (powerLaw) {
+        config->powerLawExponent = workload->powerLawExponent;
+    }
+    generateGraph(graph, config, defaultThreadPool());
+    completeReadGraph(graph);
+    if (workload->acyclic) {
+        makeGraphAcyclic(graph);
+    }
+}
+
+int compareDoubles(const void *a, const void *b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+double getMedianComputeSeconds(BenchmarkResult *result)
+{
+    double sortedArray[BENCHMARK_MAX_REPETITIONS];
+    memcpy(sortedArray, result->computeSecondsArray, result->repetitionCount * sizeof(double));
+    qsort(sortedArray, result->repetitionCount, sizeof(double), compareDoubles);
+    int middle = result->repetitionCount / 2;
+    return (result->repetitionCount % 2 == 1) ? sortedArray[middle] : (sortedArray[middle - 1] + sortedArray[middle]) / 2;
+}
+
+double getBestComputeSeconds(BenchmarkResult *result)
+{
+    double best = result->computeSecondsArray[0];
+    for (int iRepetition = 1; iRepetition < result->repetitionCount; iRepetition++) {
+        if (result->computeSecondsArray[iRepetition] < best) {
+            best = result->computeSecondsArray[iRepetition];
+        }
+    }
+    return best;
+}
+
+double getMeanSeconds(double *secondsArray, int count)
+{
+    double sum = 0;
+    for (int i = 0; i < count; i++) {
+        sum += secondsArray[i];
+    }
+    return count > 0 ? sum / count : 0;
+}
+
+// Every sample relaxes each edge at least once, so this is a lower bound on the relaxations of a computation
+double getEdgeRelaxationsPerSecond(BenchmarkResult *result)
+{
+    return (double)result->workload->graphCount * result->edgeCount / getMedianComputeSeconds(result);
+}
+
+void printBenchmarkResults(BenchmarkResult *resultArray, int resultCount)
+{
+    printf("\nworkload                    vertices     edges samples levels cyclic   median ms     best ms  samples/s  edges/s\n");
+    for (int iResult = 0; iResult < resultCount; iResult++) {
+        BenchmarkResult *result = &resultArray[iResult];
+        const BenchmarkWorkload *workload = result->workload;
+        double median = getMedianComputeSeconds(result);
+        printf("%-26s %9i %9i %7i %6i %6i %11.2f %11.2f %10.1f %8.3g\n", workload->name, workload->vertexCount, result->edgeCount, workload->graphCount, result->levelCount, result->cyclicLevelCount, 1000 * median, 1000 * getBestComputeSeconds(result), workload->graphCount / median, getEdgeRelaxationsPerSecond(result));
+    }
+}
+
+///
+/// Write the results as JSON, one workload per line, so that two runs can be compared with diff as well as by
+/// compareToBenchmarkBaseline. Returns false if the file cannot be written.
+///
+bool writeBenchmarkResults(BenchmarkResult *resultArray, int resultCount, const char *backendName, const char *filePath)
+{
+    FILE *file = fopen(filePath, "w");
+    if (file == NULL) {
+        printf("Unable to write %s.\n", filePath);
+        return false;
+    }
+    fprintf(file, "{\n  \"backend\": \"%s\",\n  \"workload_version\": %i,\n  \"warmup_count\": %i,\n  \"workloads\": [\n", backendName, BENCHMARK_WORKLOAD_VERSION, BENCHMARK_WARMUP_COUNT);
+    for (int iResult = 0; iResult < resultCount; iResult++) {
+        BenchmarkResult *result = &resultArray[iResult];
+        const BenchmarkWorkload *workload = result->workload;
+        double median = getMedianComputeSeconds(result);
+        fprintf(file, "    {\"name\": \"%s\", \"vertex_count\": %i, \"edge_count\": %i, \"neighbors_per_vertex\": %i, \"prob_of_max\": %.2f, \"sample_count\": %i, \"power_law_exponent\": %.2f, \"acyclic\": %s, \"level_count\": %i, \"cyclic_level_count\": %i, ", workload->name, workload->vertexCount, result->edgeCount, workload->neighborsPerVertex, workload->probOfMax, workload->graphCount, workload->powerLawExponent, workload->acyclic ? "true" : "false", result->levelCount, result->cyclicLevelCount);
+        fprintf(file, "\"repetition_count\": %i, \"generate_seconds\": %.6f, \"setup_seconds\": %.6f, \"weight_seconds\": %.6f, \"median_seconds\": %.6f, \"best_seconds\": %.6f, \"mean_seconds\": %.6f, \"samples_per_second\": %.1f, \"edge_relaxations_per_second\": %.1f}%s\n", result->repetitionCount, result->generateSeconds, result->setupSeconds, getMeanSeconds(result->weightSecondsArray, result->repetitionCount), median, getBestComputeSeconds(result), getMeanSeconds(result->computeSecondsArray, result->repetitionCount), workload->graphCount / median, getEdgeRelaxationsPerSecond(result), (iResult + 1 < resultCount) ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    bool written = !ferror(file);
+    written &= fclose(file) == 0;
+    if (!written) {
+        printf("Unable to write %s.\n", filePath);
+    }
+    return written;
+}
+
+///
+/// Compare the median compute times of the results to those of the same workloads in a file written by
+/// writeBenchmarkResults, and print the ratios. Returns the number of workloads that are more than tolerance
+/// slower than in the baseline, or -1 if it cannot be read, or was measured on another backend than backendName or
+/// on other versions of the workloads. Workloads missing from the baseline are skipped.
+///
+int compareToBenchmarkBaseline(BenchmarkResult *resultArray, int resultCount, const char *backendName, const char *filePath, double tolerance)
+{
+    ifstream myfile;
+    myfile.open(filePath);
+    if (!myfile.is_open()) {
+        printf("Unable to open baseline %s.\n", filePath);
+        return -1;
+    }
+    double *baselineArray = (double*) malloc(resultCount * sizeof(double));
+    for (int iResult = 0; iResult < resultCount; iResult++) {
+        baselineArray[iResult] = -1;
+    }
+    string backend;
+    int workloadVersion = -1;
+    string line;
+    while (getline(myfile, line)) {
+        size_t backendStart = line.find("\"backend\": \"");
+        if (backendStart != string::npos) {
+            backendStart += strlen("\"backend\": \"");
+            backend = line.substr(backendStart, line.find('"', backendStart) - backendStart);
+        }
+        const char *version = strstr(line.c_str(), "\"workload_version\": ");
+        if (version != NULL) {
+            workloadVersion = atoi(version + strlen("\"workload_version\": "));
+        }
+        const char *median = strstr(line.c_str(), "\"median_seconds\": ");
+        for (int iResult = 0; iResult < resultCount && median != NULL; iResult++) {
+            string name = string("\"name\": \"") + resultArray[iResult].workload->name + "\"";
+            if (line.find(name) != string::npos) {
+                baselineArray[iResult] = atof(median + strlen("\"median_seconds\": "));
+            }
+        }
+    }
+    myfile.close();
+    if (backend != backendName || workloadVersion != BENCHMARK_WORKLOAD_VERSION) {
+        printf("Baseline %s was measured on backend %s with workload version %i rather than on %s with version %i.\n", filePath, backend.empty() ? "unknown" : backend.c_str(), workloadVersion, backendName, BENCHMARK_WORKLOAD_VERSION);
+        free(baselineArray);
+        return -1;
+    }
+
+    int regressionCount = 0;
+    printf("\nworkload                   baseline ms  median ms  ratio\n");
+    for (int iResult = 0; iResult < resultCount; iResult++) {
+        if (baselineArray[iResult] <= 0) {
+            printf("%-26s not in baseline\n", resultArray[iResult].workload->name);
+            continue;
+        }
+        double median = getMedianComputeSeconds(&resultArray[iResult]);
+        double ratio = median / baselineArray[iResult];
+        bool regressed = ratio > 1 + tolerance;
+        regressionCount += regressed;
+        printf("%-26s %11.2f %10.2f %6.2f%s\n", resultArray[iResult].workload->name, 1000 * baselineArray[iResult], 1000 * median, ratio, regressed ? "  REGRESSION" : "");
+    }
+    free(baselineArray);
+    return regressionCount;
+}
@@ -0,0 +1,69 @@
+//
+//  benchmark.hpp
+//  OpenCLDijkstra
+//
+
+#ifndef benchmark_hpp
+#define benchmark_hpp
+
+#include <stdio.h>
+#include "graph.hpp"
+#include "generator.hpp"
+
+#define BENCHMARK_WARMUP_COUNT 1
+#define BENCHMARK_REPETITION_COUNT 5
+#define BENCHMARK_MAX_REPETITIONS 64
+
+// A median this much slower than the baseline's counts as a regression
+#define BENCHMARK_DEFAULT_TOLERANCE 0.20
+
+// Bump this when the graphs or weights of the workloads change, so that results are not compared to a baseline of
+// other graphs
+#define BENCHMARK_WORKLOAD_VERSION 2
+
+///
+//  Types
+//
+
+// A synthetic attack graph to time the computation of, generated the same way on every run
+typedef struct
+{
+    const char *name;
+    int vertexCount;
+    int neighborsPerVertex;
+    float probOfMax;
+    int graphCount;
+    int sourceCount;
+
+    // Out-degrees follow a power law with this exponent, or are all neighborsPerVertex if it is 0
+    float powerLawExponent;
+
+    // Every edge points from a lower to a higher numbered vertex, so that the graph has no cycles
+    bool acyclic;
+} BenchmarkWorkload;
+
+typedef struct
+{
+    const BenchmarkWorkload *workload;
+    int edgeCount;
+    int levelCount;
+    int cyclicLevelCount;
+
+    // Wall-clock seconds of generating the graph, including its inverse and levels, and of setting up the backend
+    double generateSeconds;
+    double setupSeconds;
+
+    // Wall-clock seconds of each timed repetition, drawing new weights and computing all samples
+    int repetitionCount;
+    double weightSecondsArray[BENCHMARK_MAX_REPETITIONS];
+    double computeSecondsArray[BENCHMARK_MAX_REPETITIONS];
+} BenchmarkResult;
+
+int getStandardWorkloads(const BenchmarkWorkload **workloadArray);
+void generateBenchmarkGraph(GraphData *graph, const BenchmarkWorkload *workload, GeneratorConfig *config);
+double getMedianComputeSeconds(BenchmarkResult *result);
+void printBenchmarkResults(BenchmarkResult *resultArray, int resultCount);
+bool writeBenchmarkResults(BenchmarkResult *resultArray, int resultCount, const char *backendName, const char *filePath);
+int compareToBenchmarkBaseline(BenchmarkResult *resultArray, int resultCount, const char *backendName, const char *filePath, double tolerance);
+
+#endif /* benchmark_hpp */
@@ -0,0 +1,704 @@
+//
+//  cpuengine.cpp
+//  OpenCLDijkstra
+//
+
+#include "cpuengine.hpp"
+#include "metric.hpp"
+#include <string.h>
+
+// The vector block evaluators are compiled for their instruction sets with function attributes, and only
+// selected at runtime if the CPU supports them
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAS_X86_INTRINSICS
+#include <immintrin.h>
+#endif
+
+#define MAX_BLOCK_LANES 16  // Samples per block of the widest block evaluator
+
+///
+//  Namespaces
+//
+using namespace std;
+
+///
+/// A block of laneCount consecutive samples from firstSample, evaluated side by side. Entry lane of vertex or edge
+/// i is at i*laneCount + lane, so that the costs of a vertex in all samples of the block fill one vector register.
+/// Only the first sampleCount lanes hold samples. The rest have no sources and stay unreached.
+///
+typedef struct
+{
+    int firstSample;
+    int sampleCount;
+    int laneCount;
+    int *costArray;
+    int *weightArray;
+
+    // -1 in the lanes in which the vertex is a source, otherwise 0
+    int *sourceMaskArray;
+} SampleBlock;
+
+// Pull the costs of vertex in all lanes of block from the costs of its parents. Returns true if any of them changed.
+typedef bool (*BlockPull)(GraphData *graph, SampleBlock *block, int vertex);
+
+typedef struct
+{
+    GraphData *graph;
+    DijkstraWorkspace **workspaceArray;
+
+    // Block evaluation of acyclic graphs: one block per thread, and the evaluator chosen for the CPU
+    SampleBlock **blockArray;
+    BlockPull pull;
+
+    // Whether shortestParentsArray is marked. Whether the sum costs are computed is a template parameter of the tasks.
+    bool shortestParents;
+} CPUEngineContext;
+
+
+///
+/// Cost of vertex in sample iGraph pulled from the costs of its parents in costArray, as pullVertexCost does, and
+/// its value under SecondMetric, folded in the same pass over its edges into secondValue. The second value is only
+/// final once the costs of the parents are.
+///
+template <typename SecondMetric>
+int pullVertexMetrics(GraphData *graph, int iGraph, int vertex, int *costArray, int *secondValue)
+{
+    int vertexCount = graph->vertexCount;
+    int edgeCount = graph->edgeCount;
+    int *weightArray = graph->weightArray + (long)iGraph * edgeCount;
+    int inverseEdgeStart = graph->inverseVertexArray[vertex];
+    int inverseEdgeEnd = (vertex + 1 < vertexCount) ? graph->inverseVertexArray[vertex + 1] : edgeCount;
+
+    if (graph->sourceArray[(long)iGraph * vertexCount + vertex] == 1) {
+        *secondValue = 0;
+        return 0;
+    }
+    if (graph->maxVertexArray[vertex] < 0) {
+        int cost = INT_MAX;
+        int second = INT_MAX;
+        for (int inverseEdge = inverseEdgeStart; inverseEdge < inverseEdgeEnd; inverseEdge++) {
+            int parentCost = costArray[graph->inverseEdgeArray[inverseEdge]];
+            if (parentCost == INT_MAX) {
+                continue;
+            }
+            int weight = weightArray[graph->inverseEdgeMapArray[inverseEdge]];
+            cost = MaxCostMetric::combineOr(cost, MaxCostMetric::extend(parentCost, weight));
+            if (SecondMetric::enabled && !SecondMetric::followsCostAtOr) {
+                second = SecondMetric::combineOr(second, SecondMetric::extend(parentCost, weight));
+            }
+        }
+        *secondValue = SecondMetric::followsCostAtOr ? cost : second;
+        return cost;
+    }
+    // A max vertex is only reached if all of its parents are
+    if (inverseEdgeEnd == inverseEdgeStart) {
+        *secondValue = INT_MAX;
+        return INT_MAX;
+    }
+    int cost = MaxCostMetric::initialAnd(graph->maxVertexArray[vertex]);
+    int second = SecondMetric::initialAnd(graph->maxVertexArray[vertex]);
+    for (int inverseEdge = inverseEdgeStart; inverseEdge < inverseEdgeEnd; inverseEdge++) {
+        int parentCost = costArray[graph->inverseEdgeArray[inverseEdge]];
+        if (parentCost == INT_MAX) {
+            *secondValue = INT_MAX;
+            return INT_MAX;
+        }
+        int weight = weightArray[graph->inverseEdgeMapArray[inverseEdge]];
+        cost = MaxCostMetric::combineAnd(cost, MaxCostMetric::extend(parentCost, weight));
+        if (SecondMetric::enabled) {
+            second = SecondMetric::combineAnd(second, SecondMetric::extend(parentCost, weight));
+        }
+    }
+    *secondValue = second;
+    return cost;
+}
+
+///
+/// Value of vertex in sample iGraph under Metric, folded from the final costs in costArray.
+///
+template <typename Metric>
+int deriveVertexMetric(GraphData *graph, int iGraph, int vertex, int *costArray)
+{
+    if (Metric::followsCostAtOr && graph->maxVertexArray[vertex] < 0) {
+        return costArray[vertex];
+    }
+    int value;
+    pullVertexMetrics<Metric>(graph, iGraph, vertex, costArray, &value);
+    return value;
+}
+
+///
+/// Mark the edges into child through which it got its cost in sample iGraph, as SHORTEST_PARENTS does.
+///
+void markShortestParents(GraphData *graph, int iGraph, int child, int *costArray)
+{
+    int vertexCount = graph->vertexCount;
+    int edgeCount = graph->edgeCount;
+    int *weightArray = graph->weightArray + (long)iGraph * edgeCount;
+    int *shortestParentsArray = graph->shortestParentsArray + (long)iGraph * edgeCount;
+    int inverseEdgeEnd = (child + 1 < vertexCount) ? graph->inverseVertexArray[child + 1] : edgeCount;
+    for (int inverseEdge = graph->inverseVertexArray[child]; inverseEdge < inverseEdgeEnd; inverseEdge++) {
+        int parent = graph->inverseEdgeArray[inverseEdge];
+        int edge = graph->inverseEdgeMapArray[inverseEdge];
+        if (costArray[child] == INT_MAX || costArray[parent] == INT_MAX) {
+            shortestParentsArray[edge] = 0;
+        }
+        else if (graph->maxVertexArray[child] < 0) {
+            shortestParentsArray[edge] = (MaxCostMetric::extend(costArray[parent], weightArray[edge]) == costArray[child]) ? 1 : 0;
+        }
+        else {
+            shortestParentsArray[edge] = 1;
+        }
+    }
+}
+
+///
+/// Compute costArray of sample iGraph, and its values under SecondMetric, SumCostMetric or NoMetric, in
+/// sumCostArray. shortestParentsArray is marked if shortestParents is set.
+///
+/// Acyclic graphs are evaluated in one pass over their topological order, which needs no priority queue, and
+/// every vertex folds its cost and second value at once. The costs of graphs with cycles are computed by
+/// dijkstraWithWorkspace, and the second values then folded from them.
+///
+template <typename SecondMetric>
+void calculateSampleOnCPU(GraphData *graph, int iGraph, DijkstraWorkspace *workspace, bool shortestParents)
+{
+    int vertexCount = graph->vertexCount;
+    int *costArray = graph->costArray + (long)iGraph * vertexCount;
+    int *sumCostArray = graph->sumCostArray + (long)iGraph * vertexCount;
+
+    if (graph->cyclicLevelCount == 0) {
+        for (int iOrdered = 0; iOrdered < vertexCount; iOrdered++) {
+            int vertex = graph->topologicalOrderArray[iOrdered];
+            int second;
+            costArray[vertex] = pullVertexMetrics<SecondMetric>(graph, iGraph, vertex, costArray, &second);
+            if (SecondMetric::enabled) {
+                sumCostArray[vertex] = second;
+            }
+        }
+    }
+    else {
+        dijkstraWithWorkspace(graph, iGraph, workspace, costArray, false);
+        if (SecondMetric::enabled) {
+            for (int vertex = 0; vertex < vertexCount; vertex++) {
+                sumCostArray[vertex] = deriveVertexMetric<SecondMetric>(graph, iGraph, vertex, costArray);
+            }
+        }
+    }
+    if (shortestParents) {
+        for (int vertex = 0; vertex < vertexCount; vertex++) {
+            markShortestParents(graph, iGraph, vertex, costArray);
+        }
+    }
+}
+
+template <typename SecondMetric>
+void calculateGraphTask(int iGraph, int iThread, void *context)
+{
+    CPUEngineContext *engine = (CPUEngineContext*) context;
+    calculateSampleOnCPU<SecondMetric>(engine->graph, iGraph, engine->workspaceArray[iThread], engine->shortestParents);
+}
+
+SampleBlock* createSampleBlock(GraphData *graph, int laneCount)
+{
+    SampleBlock *block = (SampleBlock*) malloc(sizeof(SampleBlock));
+    block->laneCount = laneCount;
+    block->costArray = (int*) malloc((long)graph->vertexCount * laneCount * sizeof(int));
+    block->weightArray = (int*) malloc((long)graph->edgeCount * laneCount * sizeof(int));
+    block->sourceMaskArray = (int*) malloc((long)graph->vertexCount * laneCount * sizeof(int));
+    return block;
+}
+
+void releaseSampleBlock(SampleBlock *block)
+{
+    free(block->costArray);
+    free(block->weightArray);
+    free(block->sourceMaskArray);
+    free(block);
+}
+
+///
+/// Gather the weights and sources of samples [firstSample, firstSample + sampleCount) into the lanes of block.
+/// Returns false if a weight is negative, which the saturating arithmetic of the block evaluators does not allow.
+///
+bool loadSampleBlock(GraphData *graph, SampleBlock *block, int firstSample, int sampleCount)
+{
+    int vertexCount = graph->vertexCount;
+    int edgeCount = graph->edgeCount;
+    int laneCount = block->laneCount;
+    int signBits = 0;
+    block->firstSample = firstSample;
+    block->sampleCount = sampleCount;
+
+    // Padding lanes point at sample firstSample, and have their weights cleared below
+    int *weightArrayArray[MAX_BLOCK_LANES];
+    int *sourceArrayArray[MAX_BLOCK_LANES];
+    for (int lane = 0; lane < laneCount; lane++) {
+        int sample = firstSample + ((lane < sampleCount) ? lane : 0);
+        weightArrayArray[lane] = graph->weightArray + (long)sample * edgeCount;
+        sourceArrayArray[lane] = graph->sourceArray + (long)sample * vertexCount;
+    }
+
+    // Walk the samples side by side, so that each of them is read sequentially
+    for (int edge = 0; edge < edgeCount; edge++) {
+        int *blockWeightArray = block->weightArray + (long)edge * laneCount;
+        for (int lane = 0; lane < laneCount; lane++) {
+            blockWeightArray[lane] = (lane < sampleCount) ? weightArrayArray[lane][edge] : 0;
+            signBits |= blockWeightArray[lane];
+        }
+    }
+    for (int vertex = 0; vertex < vertexCount; vertex++) {
+        int *sourceMaskArray = block->sourceMaskArray + (long)vertex * laneCount;
+        for (int lane = 0; lane < laneCount; lane++) {
+            sourceMaskArray[lane] = (lane < sampleCount && sourceArrayArray[lane][vertex] == 1) ? -1 : 0;
+        }
+    }
+    return signBits >= 0;
+}
+
+///
+/// Portable block evaluator, pullVertexCost on every lane of block. With non-negative weights, the sum of a cost
+/// and a weight fits in an unsigned int, and clamping it to INT_MAX saturates it. An unreached parent thereby never
+/// lowers the cost of a min vertex and always leaves a max vertex unreached.
+///
+bool pullVertexBlock(GraphData *graph, SampleBlock *block, int vertex)
+{
+    int laneCount = block->laneCount;
+    int inverseEdgeStart = graph->inverseVertexArray[vertex];
+    int inverseEdgeEnd = (vertex + 1 < graph->vertexCount) ? graph->inverseVertexArray[vertex + 1] : graph->edgeCount;
+    bool isMinVertex = graph->maxVertexArray[vertex] < 0;
+    unsigned int costArray[MAX_BLOCK_LANES];
+    unsigned int initialCost = (isMinVertex || inverseEdgeEnd == inverseEdgeStart) ? INT_MAX : graph->maxVertexArray[vertex];
+    for (int lane = 0; lane < laneCount; lane++) {
+        costArray[lane] = initialCost;
+    }
+    for (int inverseEdge = inverseEdgeStart; inverseEdge < inverseEdgeEnd; inverseEdge++) {
+        unsigned int *parentCostArray = (unsigned int*) block->costArray + (long)graph->inverseEdgeArray[inverseEdge] * laneCount;
+        unsigned int *weightArray = (unsigned int*) block->weightArray + (long)graph->inverseEdgeMapArray[inverseEdge] * laneCount;
+        for (int lane = 0; lane < laneCount; lane++) {
+            unsigned int edgeCost = parentCostArray[lane] + weightArray[lane];
+            if (edgeCost > INT_MAX) {
+                edgeCost = INT_MAX;
+            }
+            if (isMinVertex ? edgeCost < costArray[lane] : edgeCost > costArray[lane]) {
+                costArray[lane] = edgeCost;
+            }
+        }
+    }
+    int *vertexCostArray = block->costArray + (long)vertex * laneCount;
+    int *sourceMaskArray = block->sourceMaskArray + (long)vertex * laneCount;
+    bool changed = false;
+    for (int lane = 0; lane < laneCount; lane++) {
+        int cost = (int)costArray[lane] & ~sourceMaskArray[lane];
+        changed |= cost != vertexCostArray[lane];
+        vertexCostArray[lane] = cost;
+    }
+    return changed;
+}
+
+#ifdef HAS_X86_INTRINSICS
+///
+/// pullVertexBlock on 8 lanes in AVX2 registers
+///
+__attribute__((target("avx2")))
+bool pullVertexBlockAVX2(GraphData *graph, SampleBlock *block, int vertex)
+{
+    int inverseEdgeStart = graph->inverseVertexArray[vertex];
+    int inverseEdgeEnd = (vertex + 1 < graph->vertexCount) ? graph->inverseVertexArray[vertex + 1] : graph->edgeCount;
+    __m256i infinity = _mm256_set1_epi32(INT_MAX);
+    __m256i cost;
+    if (graph->maxVertexArray[vertex] < 0) {
+        cost = infinity;
+        for (int inverseEdge = inverseEdgeStart; inverseEdge < inverseEdgeEnd; inverseEdge++) {
+            __m256i parentCost = _mm256_loadu_si256((__m256i*)(block->costArray + (long)graph->inverseEdgeArray[inverseEdge] * 8));
+            __m256i weight = _mm256_loadu_si256((__m256i*)(block->weightArray + (long)graph->inverseEdgeMapArray[inverseEdge] * 8));
+            cost = _mm256_min_epi32(cost, _mm256_min_epu32(_mm256_add_epi32(parentCost, weight), infinity));
+        }
+    }
+    else {
+        cost = (inverseEdgeEnd > inverseEdgeStart) ? _mm256_set1_epi32(graph->maxVertexArray[vertex]) : infinity;
+        for (int inverseEdge = inverseEdgeStart; inverseEdge < inverseEdgeEnd; inverseEdge++) {
+            __m256i parentCost = _mm256_loadu_si256((__m256i*)(block->costArray + (long)graph->inverseEdgeArray[inverseEdge] * 8));
+            __m256i weight = _mm256_loadu_si256((__m256i*)(block->weightArray + (long)graph->inverseEdgeMapArray[inverseEdge] * 8));
+            cost = _mm256_max_epi32(cost, _mm256_min_epu32(_mm256_add_epi32(parentCost, weight), infinity));
+        }
+    }
+    __m256i sourceMask = _mm256_loadu_si256((__m256i*)(block->sourceMaskArray + (long)vertex * 8));
+    cost = _mm256_andnot_si256(sourceMask, cost);
+    __m256i *vertexCost = (__m256i*)(block->costArray + (long)vertex * 8);
+    __m256i unchanged = _mm256_cmpeq_epi32(cost, _mm256_loadu_si256(vertexCost));
+    _mm256_storeu_si256(vertexCost, cost);
+    return _mm256_movemask_epi8(unchanged) != -1;
+}
+
+///
+/// pullVertexBlock on 16 lanes in AVX-512 registers
+///
+__attribute__((target("avx512f")))
+bool pullVertexBlockAVX512(GraphData *graph, SampleBlock *block, int vertex)
+{
+    int inverseEdgeStart = graph->inverseVertexArray[vertex];
+    int inverseEdgeEnd = (vertex + 1 < graph->vertexCount) ? graph->inverseVertexArray[vertex + 1] : graph->edgeCount;
+    __m512i infinity = _mm512_set1_epi32(INT_MAX);
+    __m512i cost;
+    if (graph->maxVertexArray[vertex] < 0) {
+        cost = infinity;
+        for (int inverseEdge = inverseEdgeStart; inverseEdge < inverseEdgeEnd; inverseEdge++) {
+            __m512i parentCost = _mm512_loadu_si512(block->costArray + (long)graph->inverseEdgeArray[inverseEdge] * 16);
+            __m512i weight = _mm512_loadu_si512(block->weightArray + (long)graph->inverseEdgeMapArray[inverseEdge] * 16);
+            cost = _mm512_min_epi32(cost, _mm512_min_epu32(_mm512_add_epi32(parentCost, weight), infinity));
+        }
+    }
+    else {
+        cost = (inverseEdgeEnd > inverseEdgeStart) ? _mm512_set1_epi32(graph->maxVertexArray[vertex]) : infinity;
+        for (int inverseEdge = inverseEdgeStart; inverseEdge < inverseEdgeEnd; inverseEdge++) {
+            __m512i parentCost = _mm512_loadu_si512(block->costArray + (long)graph->inverseEdgeArray[inverseEdge] * 16);
+            __m512i weight = _mm512_loadu_si512(block->weightArray + (long)graph->inverseEdgeMapArray[inverseEdge] * 16);
+            cost = _mm512_max_epi32(cost, _mm512_min_epu32(_mm512_add_epi32(parentCost, weight), infinity));
+        }
+    }
+    __m512i sourceMask = _mm512_loadu_si512(block->sourceMaskArray + (long)vertex * 16);
+    cost = _mm512_andnot_si512(sourceMask, cost);
+    int *vertexCost = block->costArray + (long)vertex * 16;
+    __mmask16 changed = _mm512_cmpneq_epi32_mask(cost, _mm512_loadu_si512(vertexCost));
+    _mm512_storeu_si512(vertexCost, cost);
+    return changed != 0;
+}
+#endif
+
+///
+/// The widest block evaluator the CPU supports, chosen at runtime: AVX-512 with 16 lanes, AVX2 with 8, or the
+/// portable one with 8, which the compiler may vectorize for the baseline instruction set.
+///
+BlockPull selectBlockPull(int *laneCount, const char **name)
+{
+#ifdef HAS_X86_INTRINSICS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        *laneCount = 16;
+        *name = "AVX-512";
+        return pullVertexBlockAVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        *laneCount = 8;
+        *name = "AVX2";
+        return pullVertexBlockAVX2;
+    }
+#endif
+    *laneCount = 8;
+    *name = "portable";
+    return pullVertexBlock;
+}
+
+///
+/// Compute the costs of all lanes of block in topological order of the strongly connected components, with pull
+/// evaluating a vertex in all lanes at once. The parents of a level are in earlier levels, or in the same cyclic
+/// component, so an acyclic level is final after a single pass. The vertices of a cyclic level start out unreached
+/// and are re-evaluated until none of them changes.
+///
+void evaluateBlockInTopologicalOrder(GraphData *graph, SampleBlock *block, BlockPull pull)
+{
+    for (int iLevel = 0; iLevel < graph->levelCount; iLevel++) {
+        int levelStart = graph->levelStartArray[iLevel];
+        int levelEnd = graph->levelStartArray[iLevel + 1];
+        if (!graph->cyclicLevelArray[iLevel]) {
+            for (int iOrdered = levelStart; iOrdered < levelEnd; iOrdered++) {
+                pull(graph, block, graph->topologicalOrderArray[iOrdered]);
+            }
+            continue;
+        }
+        for (int iOrdered = levelStart; iOrdered < levelEnd; iOrdered++) {
+            int *vertexCostArray = block->costArray + (long)graph->topologicalOrderArray[iOrdered] * block->laneCount;
+            for (int lane = 0; lane < block->laneCount; lane++) {
+                vertexCostArray[lane] = INT_MAX;
+            }
+        }
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (int iOrdered = levelStart; iOrdered < levelEnd; iOrdered++) {
+                changed |= pull(graph, block, graph->topologicalOrderArray[iOrdered]);
+            }
+        }
+    }
+}
+
+///
+/// deriveVertexMetric on every lane of block, writing the values of its samples into valueArray, which is laid out
+/// like sumCostArray from the first sample of block. The lanes of a vertex and its parents are contiguous in the
+/// block, where a sample at a time would gather them from all over costArray. An unreached parent is folded like
+/// any other, as INT_MAX, which combineOr passes over and combineAnd keeps.
+///
+template <typename Metric>
+void deriveBlockMetric(GraphData *graph, SampleBlock *block, int *valueArray)
+{
+    int vertexCount = graph->vertexCount;
+    int edgeCount = graph->edgeCount;
+    int laneCount = block->laneCount;
+    int sampleCount = block->sampleCount;
+    for (int vertex = 0; vertex < vertexCount; vertex++) {
+        int *costArray = block->costArray + (long)vertex * laneCount;
+        int inverseEdgeStart = graph->inverseVertexArray[vertex];
+        int inverseEdgeEnd = (vertex + 1 < vertexCount) ? graph->inverseVertexArray[vertex + 1] : edgeCount;
+        bool isMinVertex = graph->maxVertexArray[vertex] < 0;
+        // Without parents, a vertex is either a source or unreached, whatever the metric
+        if ((isMinVertex && Metric::followsCostAtOr) || inverseEdgeEnd == inverseEdgeStart) {
+            for (int lane = 0; lane < sampleCount; lane++) {
+                valueArray[(long)lane * vertexCount + vertex] = costArray[lane];
+            }
+            continue;
+        }
+        int foldArray[MAX_BLOCK_LANES];
+        int initialValue = isMinVertex ? INT_MAX : Metric::initialAnd(graph->maxVertexArray[vertex]);
+        for (int lane = 0; lane < laneCount; lane++) {
+            foldArray[lane] = initialValue;
+        }
+        for (int inverseEdge = inverseEdgeStart; inverseEdge < inverseEdgeEnd; inverseEdge++) {
+            int *parentCostArray = block->costArray + (long)graph->inverseEdgeArray[inverseEdge] * laneCount;
+            int *weightArray = block->weightArray + (long)graph->inverseEdgeMapArray[inverseEdge] * laneCount;
+            for (int lane = 0; lane < laneCount; lane++) {
+                int value = (parentCostArray[lane] == INT_MAX) ? INT_MAX : Metric::extend(parentCostArray[lane], weightArray[lane]);
+                foldArray[lane] = isMinVertex ? Metric::combineOr(foldArray[lane], value) : Metric::combineAnd(foldArray[lane], value);
+            }
+        }
+        // Sources keep their value of 0 whatever their parents
+        int *sourceMaskArray = block->sourceMaskArray + (long)vertex * laneCount;
+        for (int lane = 0; lane < sampleCount; lane++) {
+            valueArray[(long)lane * vertexCount + vertex] = foldArray[lane] & ~sourceMaskArray[lane];
+        }
+    }
+}
+
+///
+/// markShortestParents on every lane of block, writing the results of its samples into graph.
+///
+void markBlockShortestParents(GraphData *graph, SampleBlock *block)
+{
+    int vertexCount = graph->vertexCount;
+    int edgeCount = graph->edgeCount;
+    int laneCount = block->laneCount;
+    int sampleCount = block->sampleCount;
+    int *shortestParentsArray = graph->shortestParentsArray + (long)block->firstSample * edgeCount;
+
+    // The shortest parents are marked in the order of the forward edges, so that each sample is written sequentially
+    for (int parent = 0; parent < vertexCount; parent++) {
+        int *parentCostArray = block->costArray + (long)parent * laneCount;
+        int edgeEnd = (parent + 1 < vertexCount) ? graph->vertexArray[parent + 1] : edgeCount;
+        for (int edge = graph->vertexArray[parent]; edge < edgeEnd; edge++) {
+            int child = graph->edgeArray[edge];
+            int *costArray = block->costArray + (long)child * laneCount;
+            int *weightArray = block->weightArray + (long)edge * laneCount;
+            bool isMinVertex = graph->maxVertexArray[child] < 0;
+            for (int lane = 0; lane < sampleCount; lane++) {
+                bool reached = costArray[lane] != INT_MAX && parentCostArray[lane] != INT_MAX;
+                bool shortest = !isMinVertex || MaxCostMetric::extend(parentCostArray[lane], weightArray[lane]) == costArray[lane];
+                shortestParentsArray[(long)lane * edgeCount + edge] = (reached && shortest) ? 1 : 0;
+            }
+        }
+    }
+}
+
+///
+/// Compute the samples of block iBlock, as calculateSampleOnCPU would one at a time. Blocks with negative weights
+/// are left to calculateSampleOnCPU.
+///
+template <typename SecondMetric>
+void calculateBlockTask(int iBlock, int iThread, void *context)
+{
+    CPUEngineContext *engine = (CPUEngineContext*) context;
+    GraphData *graph = engine->graph;
+    SampleBlock *block = engine->blockArray[iThread];
+    int vertexCount = graph->vertexCount;
+    int firstSample = iBlock * block->laneCount;
+    int sampleCount = (graph->graphCount - firstSample < block->laneCount) ? graph->graphCount - firstSample : block->laneCount;
+
+    if (!loadSampleBlock(graph, block, firstSample, sampleCount)) {
+        for (int iGraph = firstSample; iGraph < firstSample + sampleCount; iGraph++) {
+            calculateSampleOnCPU<SecondMetric>(graph, iGraph, engine->workspaceArray[iThread], engine->shortestParents);
+        }
+        return;
+    }
+    evaluateBlockInTopologicalOrder(graph, block, engine->pull);
+    int *costArray = graph->costArray + (long)firstSample * vertexCount;
+    for (int vertex = 0; vertex < vertexCount; vertex++) {
+        int *blockCostArray = block->costArray + (long)vertex * block->laneCount;
+        for (int lane = 0; lane < sampleCount; lane++) {
+            costArray[(long)lane * vertexCount + vertex] = blockCostArray[lane];
+        }
+    }
+    if (SecondMetric::enabled) {
+        deriveBlockMetric<SecondMetric>(graph, block, graph->sumCostArray + (long)firstSample * vertexCount);
+    }
+    if (engine->shortestParents) {
+        markBlockShortestParents(graph, block);
+    }
+}
+
+///
+/// CPU counterpart of calculateGraphs. Fills costArray for all graphCount samples, which are distributed over the
+/// threads of the pool, and sumCostArray and shortestParentsArray if sumCosts and shortestParents are set. The
+/// others are left as they were.
+///
+/// The samples of an acyclic graph are evaluated in blocks of 8 or 16, one lane of a vector register per sample,
+/// as all samples share the topology. Graphs with cycles are left to dijkstraWithWorkspace one sample at a time,
+/// as a cyclic level could take many passes.
+///
+/// The tasks are instantiated for the sum costs being computed or not, so that skipping them costs nothing per
+/// vertex.
+///
+void calculateGraphsOnCPU(GraphData *graph, ThreadPool *pool, bool sumCosts, bool shortestParents, bool debug)
+{
+    CPUEngineContext engine;
+    engine.graph = graph;
+    engine.shortestParents = shortestParents;
+    engine.workspaceArray = (DijkstraWorkspace**) malloc(pool->threadCount * sizeof(DijkstraWorkspace*));
+    for (int iThread = 0; iThread < pool->threadCount; iThread++) {
+        engine.workspaceArray[iThread] = createDijkstraWorkspace(graph);
+    }
+
+    if (graph->cyclicLevelCount == 0) {
+        int laneCount;
+        const char *name;
+        engine.pull = selectBlockPull(&laneCount, &name);
+        engine.blockArray = (SampleBlock**) malloc(pool->threadCount * sizeof(SampleBlock*));
+        for (int iThread = 0; iThread < pool->threadCount; iThread++) {
+            engine.blockArray[iThread] = createSampleBlock(graph, laneCount);
+        }
+        if (debug) {
+            printf("Computing %i samples in blocks of %i (%s) on %i CPU threads.\n", graph->graphCount, laneCount, name, pool->threadCount);
+        }
+        ParallelTask task = sumCosts ? calculateBlockTask<SumCostMetric> : calculateBlockTask<NoMetric>;
+        parallelFor(pool, (graph->graphCount + laneCount - 1) / laneCount, task, &engine);
+        for (int iThread = 0; iThread < pool->threadCount; iThread++) {
+            releaseSampleBlock(engine.blockArray[iThread]);
+        }
+        free(engine.blockArray);
+    }
+    else {
+        if (debug) {
+            printf("Computing %i samples on %i CPU threads.\n", graph->graphCount, pool->threadCount);
+        }
+        ParallelTask task = sumCosts ? calculateGraphTask<SumCostMetric> : calculateGraphTask<NoMetric>;
+        parallelFor(pool, graph->graphCount, task, &engine);
+    }
+
+    for (int iThread = 0; iThread < pool->threadCount; iThread++) {
+        releaseDijkstraWorkspace(engine.workspaceArray[iThread]);
+    }
+    free(engine.workspaceArray);
+}
+
+///
+/// Bring the results of sample iGraph up to date after its weights changed, by re-evaluating only the affected
+/// vertices, as listed by collectAffectedVertices. The costs of every other vertex stay valid, as none of them can
+/// be reached from a changed edge. Affected vertices of acyclic levels pull their new costs once, in topological
+/// order, folding their sum costs in the same pass. Affected cyclic components are iterated, and their sum costs
+/// are folded from the converged costs. If reset, they are first made unreached, since a raised weight on a cycle
+/// could otherwise keep feeding the old costs back around it. Otherwise no weight was raised, so the old costs are
+/// upper bounds of the new ones, and relaxing them downwards converges to the same costs as starting over.
+///
+void updateGraphOnCPU(GraphData *graph, int iGraph, int *affectedArray, int affectedCount, bool reset)
+{
+    int *costArray = graph->costArray + (long)iGraph * graph->vertexCount;
+    int *sumCostArray = graph->sumCostArray + (long)iGraph * graph->vertexCount;
+
+    int iAffected = 0;
+    int iLevel = 0;
+    while (iAffected < affectedCount) {
+        // Affected vertices of the same level are consecutive in affectedArray
+        int position = graph->topologicalPositionArray[affectedArray[iAffected]];
+        while (graph->levelStartArray[iLevel + 1] <= position) {
+            iLevel++;
+        }
+        int segmentStart = iAffected;
+        while (iAffected < affectedCount && graph->topologicalPositionArray[affectedArray[iAffected]] < graph->levelStartArray[iLevel + 1]) {
+            iAffected++;
+        }
+        if (!graph->cyclicLevelArray[iLevel]) {
+            for (int iSegment = segmentStart; iSegment < iAffected; iSegment++) {
+                int vertex = affectedArray[iSegment];
+                costArray[vertex] = pullVertexMetrics<SumCostMetric>(graph, iGraph, vertex, costArray, &sumCostArray[vertex]);
+            }
+            continue;
+        }
+        for (int iSegment = segmentStart; iSegment < iAffected && reset; iSegment++) {
+            costArray[affectedArray[iSegment]] = INT_MAX;
+        }
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (int iSegment = segmentStart; iSegment < iAffected; iSegment++) {
+                int vertex = affectedArray[iSegment];
+                int cost = pullVertexCost(graph, iGraph, vertex, costArray);
+                if (cost != costArray[vertex]) {
+                    costArray[vertex] = cost;
+                    changed = true;
+                }
+            }
+        }
+        for (int iSegment = segmentStart; iSegment < iAffected; iSegment++) {
+            int vertex = affectedArray[iSegment];
+            sumCostArray[vertex] = deriveVertexMetric<SumCostMetric>(graph, iGraph, vertex, costArray);
+        }
+    }
+
+    // Shortest parents only depend on the costs of the vertex and its parents
+    for (int iSegment = 0; iSegment < affectedCount; iSegment++) {
+        markShortestParents(graph, iGraph, affectedArray[iSegment], costArray);
+    }
+}
+
+typedef struct
+{
+    GraphData *graph;
+    int *sampleArray;
+    int *affectedArray;
+    int affectedCount;
+    bool reset;
+} UpdateContext;
+
+void updateGraphTask(int iTask, int iThread, void *context)
+{
+    UpdateContext *update = (UpdateContext*) context;
+    updateGraphOnCPU(update->graph, update->sampleArray[iTask], update->affectedArray, update->affectedCount, update->reset);
+}
+
+///
+/// Apply the weight changes to graph and update the results of calculateGraphsOnCPU accordingly. The work is
+/// proportional to the part of the graph reachable from the changed edges, in the samples that were changed.
+///
+void updateGraphsOnCPU(GraphData *graph, WeightChange *changeArray, int changeCount, ThreadPool *pool, bool debug)
+{
+    UpdateContext update;
+    update.graph = graph;
+    update.sampleArray = (int*) malloc(changeCount * sizeof(int));
+    update.affectedArray = (int*) malloc(graph->vertexCount * sizeof(int));
+
+    // The affected vertices are found from the old weights
+    update.affectedCount = collectAffectedVertices(graph, changeArray, changeCount, update.affectedArray, &update.reset);
+    applyWeightChanges(graph, changeArray, changeCount);
+    int sampleCount = collectChangedSamples(changeArray, changeCount, update.sampleArray);
+    if (debug) {
+        printf("Updating %i affected vertices in %i samples.\n", update.affectedCount, sampleCount);
+    }
+    parallelFor(pool, sampleCount, updateGraphTask, &update);
+
+    free(update.sampleArray);
+    free(update.affectedArray);
+}
+
+///
+/// Translate a backend name ("opencl" or "cpu") as given on the command line. Returns false for unknown names.
+///
+bool parseComputeBackend(const char *name, ComputeBackend *backend)
+{
+    if (strcmp(name, "opencl") == 0 || strcmp(name, "gpu") == 0) {
+        *backend = BACKEND_OPENCL;
+        return true;
+    }
+    if (strcmp(name, "cpu") == 0) {
+        *backend = BACKEND_CPU;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,29 @@
+//
+//  cpuengine.hpp
+//  OpenCLDijkstra
+//
+
+#ifndef cpuengine_hpp
+#define cpuengine_hpp
+
+#include <stdio.h>
+#include "graph.hpp"
+#include "threadpool.hpp"
+
+
+///
+//  Types
+//
+
+// Where calculateGraphs-style computations are carried out
+typedef enum
+{
+    BACKEND_OPENCL,
+    BACKEND_CPU
+} ComputeBackend;
+
+void calculateGraphsOnCPU(GraphData *graph, ThreadPool *pool, bool sumCosts, bool shortestParents, bool debug);
+void updateGraphsOnCPU(GraphData *graph, WeightChange *changeArray, int changeCount, ThreadPool *pool, bool debug);
+bool parseComputeBackend(const char *name, ComputeBackend *backend);
+
+#endif /* cpuengine_hpp */
@@ -0,0 +1,302 @@
+//
+//  generator.cpp
+//  OpenCLDijkstra
+//
+
+#include "generator.hpp"
+#include "weightmodel.hpp"
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+
+#define GENERATOR_CHUNK_SIZE 65536  // Vertices, or edges, per parallel task; a multiple of 4
+#define GENERATOR_MAX_WEIGHT 1000   // Weights are uniform in [0, GENERATOR_MAX_WEIGHT), as in generateRandomGraph
+
+// Each kind of draw uses a key of its own, so that its counters never collide with those of another. The weight
+// model draws with key 0.
+typedef enum
+{
+    STREAM_VERTEX = 1,
+    STREAM_TARGET = 2,
+    STREAM_WEIGHT = 3,
+    STREAM_SOURCE = 4
+} GeneratorStream;
+
+typedef struct
+{
+    GraphData *graph;
+    GeneratorConfig *config;
+
+    // Degree of the vertices of TOPOLOGY_POWER_LAW before the one added to every vertex
+    float minimumDegree;
+
+    // Edge chunks per sample, for the weights
+    int edgeChunkCount;
+
+} GeneratorContext;
+
+
+void initializeGeneratorConfig(GeneratorConfig *config, GraphTopology topology, int vertexCount, int neighborsPerVertex, int graphCount, int sourceCount)
+{
+    config->topology = topology;
+    config->vertexCount = vertexCount;
+    config->neighborsPerVertex = neighborsPerVertex;
+    config->graphCount = graphCount;
+    config->sourceCount = sourceCount;
+    config->andFraction = 0.2f;
+    config->seed = 0;
+    config->powerLawExponent = 2.1f;
+    config->layerCount = 8;
+    config->clusterSize = 32;
+    config->clusterEdgeFraction = 0.8f;
+}
+
+///
+/// Parse a graph to generate given as topology:vertexCount:neighborsPerVertex[:graphCount[:sourceCount[:andFraction]]],
+/// e.g. "kill-chain:10000000:4" or "lateral:1000000:8:16:100:0.3", where topology is uniform, power-law, kill-chain or
+/// lateral. The rest of config is set to the defaults of initializeGeneratorConfig. Returns false for unknown
+/// topologies or missing or invalid counts. The generated graphs have no self-loops, but a vertex may have several
+/// edges to the same child, each an attack step with a weight of its own. There are sourceCount distinct sources, or
+/// all candidates if there are fewer, as kill chain sources are in its first stage.
+///
+bool parseGeneratorConfig(const char *text, GeneratorConfig *config)
+{
+    const char *nameArray[] = {"uniform", "power-law", "kill-chain", "lateral"};
+    const char *separator = strchr(text, ':');
+    if (separator == NULL) {
+        return false;
+    }
+    for (int iTopology = 0; iTopology < 4; iTopology++) {
+        if (strlen(nameArray[iTopology]) == (size_t)(separator - text) && strncmp(text, nameArray[iTopology], separator - text) == 0) {
+            int vertexCount, neighborsPerVertex;
+            int graphCount = 1;
+            int sourceCount = 10;
+            float andFraction = 0.2f;
+            int parsed = sscanf(separator + 1, "%i:%i:%i:%i:%f", &vertexCount, &neighborsPerVertex, &graphCount, &sourceCount, &andFraction);
+            if (parsed < 2 || vertexCount < 2 || neighborsPerVertex < 1 || graphCount < 1 || sourceCount < 1) {
+                return false;
+            }
+            initializeGeneratorConfig(config, (GraphTopology)iTopology, vertexCount, neighborsPerVertex, graphCount, sourceCount);
+            config->andFraction = andFraction;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Uniform integer in [0, n), from the high bits of bits
+int uniformBelow(uint32_t bits, int n)
+{
+    return (int)(((uint64_t)bits * (uint32_t)n) >> 32);
+}
+
+PhiloxCounter drawBits(GeneratorConfig *config, GeneratorStream stream, uint32_t index, uint32_t sample)
+{
+    PhiloxCounter counter = {index, sample, 0, 0};
+    return philox4x32_10(counter, config->seed, stream);
+}
+
+// Uniform vertex in [0, vertexCount) other than vertex, so that no edge is a self-loop
+int otherVertexBelow(uint32_t bits, int vertex, int vertexCount)
+{
+    int target = uniformBelow(bits, vertexCount - 1);
+    return (target >= vertex) ? target + 1 : target;
+}
+
+// First vertex of kill chain stage layer, with the vertices split over the stages as evenly as possible
+int getLayerStart(GeneratorConfig *config, int layer)
+{
+    return (int)(((long)layer * config->vertexCount + config->layerCount - 1) / config->layerCount);
+}
+
+int getLayer(GeneratorConfig *config, int vertex)
+{
+    return (int)((long)vertex * config->layerCount / config->vertexCount);
+}
+
+///
+/// Draw the out-degree and the kind of each vertex of a chunk. The degrees are stored in vertexArray, to be turned
+/// into offsets by the prefix sum.
+///
+void drawVerticesTask(int iTask, int iThread, void *context)
+{
+    GeneratorContext *generator = (GeneratorContext*) context;
+    GraphData *graph = generator->graph;
+    GeneratorConfig *config = generator->config;
+    int vertexStart = iTask * GENERATOR_CHUNK_SIZE;
+    int vertexEnd = (graph->vertexCount - vertexStart > GENERATOR_CHUNK_SIZE) ? vertexStart + GENERATOR_CHUNK_SIZE : graph->vertexCount;
+    for (int vertex = vertexStart; vertex < vertexEnd; vertex++) {
+        PhiloxCounter bits = drawBits(config, STREAM_VERTEX, vertex, 0);
+        int degree = config->neighborsPerVertex;
+        if (config->topology == TOPOLOGY_POWER_LAW) {
+            // P(extraDegree >= d) = (minimumDegree / d)^(exponent - 1), with the mean at neighborsPerVertex - 1
+            float extraDegree = generator->minimumDegree * powf(uniformFromBits(bits.x), -1.0f / (config->powerLawExponent - 1)) + 0.5f;
+            degree = (1 + extraDegree < graph->vertexCount - 1) ? 1 + (int)extraDegree : graph->vertexCount - 1;
+        }
+        else if (config->topology == TOPOLOGY_KILL_CHAIN && getLayer(config, vertex) == config->layerCount - 1) {
+            // The last stage is the goal of the chain
+            degree = 0;
+        }
+        graph->vertexArray[vertex] = degree;
+        graph->maxVertexArray[vertex] = (uniformFromBits(bits.y) < config->andFraction) ? 0 : -1;
+    }
+}
+
+///
+/// Draw the targets of the edges of a chunk of vertices
+///
+void drawEdgesTask(int iTask, int iThread, void *context)
+{
+    GeneratorContext *generator = (GeneratorContext*) context;
+    GraphData *graph = generator->graph;
+    GeneratorConfig *config = generator->config;
+    int vertexCount = graph->vertexCount;
+    int vertexStart = iTask * GENERATOR_CHUNK_SIZE;
+    int vertexEnd = (vertexCount - vertexStart > GENERATOR_CHUNK_SIZE) ? vertexStart + GENERATOR_CHUNK_SIZE : vertexCount;
+    for (int vertex = vertexStart; vertex < vertexEnd; vertex++) {
+        int edgeEnd = (vertex + 1 < vertexCount) ? graph->vertexArray[vertex + 1] : graph->edgeCount;
+        for (int edge = graph->vertexArray[vertex]; edge < edgeEnd; edge++) {
+            PhiloxCounter bits = drawBits(config, STREAM_TARGET, edge, 0);
+            int target;
+            if (config->topology == TOPOLOGY_KILL_CHAIN) {
+                // Three in four edges lead to the next stage, the rest skip ahead to any later one
+                int layer = getLayer(config, vertex);
+                int remainingLayerCount = config->layerCount - layer - 1;
+                int targetLayer = layer + 1;
+                if (bits.x >= 0xC0000000u) {
+                    targetLayer += uniformBelow(bits.y, remainingLayerCount);
+                }
+                int layerStart = getLayerStart(config, targetLayer);
+                target = layerStart + uniformBelow(bits.z, getLayerStart(config, targetLayer + 1) - layerStart);
+            }
+            else if (config->topology == TOPOLOGY_LATERAL && uniformFromBits(bits.x) < config->clusterEdgeFraction) {
+                // Another vertex of the same cluster
+                int clusterStart = vertex - vertex % config->clusterSize;
+                int clusterEnd = (vertexCount - clusterStart > config->clusterSize) ? clusterStart + config->clusterSize : vertexCount;
+                if (clusterEnd - clusterStart > 1) {
+                    target = clusterStart + otherVertexBelow(bits.y, vertex - clusterStart, clusterEnd - clusterStart);
+                }
+                else {
+                    target = otherVertexBelow(bits.z, vertex, vertexCount);
+                }
+            }
+            else {
+                target = otherVertexBelow(bits.z, vertex, vertexCount);
+            }
+            graph->edgeArray[edge] = target;
+        }
+    }
+}
+
+///
+/// Draw the weights of a chunk of edges of one sample. Each draw gives the weights of four consecutive edges.
+///
+void drawWeightsTask(int iTask, int iThread, void *context)
+{
+    GeneratorContext *generator = (GeneratorContext*) context;
+    GraphData *graph = generator->graph;
+    int iGraph = iTask / generator->edgeChunkCount;
+    int edgeStart = (iTask % generator->edgeChunkCount) * GENERATOR_CHUNK_SIZE;
+    int edgeEnd = (graph->edgeCount - edgeStart > GENERATOR_CHUNK_SIZE) ? edgeStart + GENERATOR_CHUNK_SIZE : graph->edgeCount;
+    int *weightArray = graph->weightArray + (long)iGraph * graph->edgeCount;
+    for (int edge = edgeStart; edge < edgeEnd; edge += 4) {
+        PhiloxCounter bits = drawBits(generator->config, STREAM_WEIGHT, edge / 4, iGraph);
+        uint32_t wordArray[4] = {bits.x, bits.y, bits.z, bits.w};
+        int wordCount = (edgeEnd - edge < 4) ? edgeEnd - edge : 4;
+        for (int iWord = 0; iWord < wordCount; iWord++) {
+            weightArray[edge + iWord] = uniformBelow(wordArray[iWord], GENERATOR_MAX_WEIGHT);
+        }
+    }
+}
+
+///
+/// Draw the weights of every sample of graph, generated from config, anew from config->seed, on the threads of pool.
+/// The weights only depend on the seed and the edge count, so changing the seed gives another set of samples of the
+/// same graph, also after its edges have been rearranged, e.g. by makeGraphAcyclic.
+///
+void generateWeights(GraphData *graph, GeneratorConfig *config, ThreadPool *pool)
+{
+    GeneratorContext generator;
+    generator.graph = graph;
+    generator.config = config;
+    generator.edgeChunkCount = (int)(((long)graph->edgeCount + GENERATOR_CHUNK_SIZE - 1) / GENERATOR_CHUNK_SIZE);
+    if ((long)generator.edgeChunkCount * graph->graphCount > INT_MAX) {
+        printf("Unable to generate more than %i chunks of weights.\n", INT_MAX);
+        exit(1);
+    }
+    parallelFor(pool, generator.edgeChunkCount * graph->graphCount, drawWeightsTask, &generator);
+}
+
+///
+/// Generate a graph as configured by config, drawing it on the threads of pool. Only the arrays that a graph file
+/// holds are drawn, as read by readGraphFromFile, so that a graph can be written to a file without deriving the
+/// rest. Call completeReadGraph to derive the inverse graph and the topological levels. The other arrays are NULL,
+/// so that the graph can be released with releaseGraph either way. Graphs of more than INT_MAX edges are fatal.
+///
+void generateGraph(GraphData *graph, GeneratorConfig *config, ThreadPool *pool)
+{
+    int vertexCount = config->vertexCount;
+    int graphCount = config->graphCount;
+    if (config->layerCount > vertexCount) {
+        config->layerCount = vertexCount;
+    }
+    if (config->layerCount < 2) {
+        config->layerCount = 2;
+    }
+    if (config->clusterSize < 1) {
+        config->clusterSize = 1;
+    }
+
+    memset(graph, 0, sizeof(GraphData));
+    GeneratorContext generator;
+    generator.graph = graph;
+    generator.config = config;
+    generator.minimumDegree = (config->neighborsPerVertex - 1) * (config->powerLawExponent - 2) / (config->powerLawExponent - 1);
+    int vertexChunkCount = (vertexCount + GENERATOR_CHUNK_SIZE - 1) / GENERATOR_CHUNK_SIZE;
+
+    graph->vertexCount = vertexCount;
+    graph->graphCount = graphCount;
+    graph->sourceCount = config->sourceCount;
+    graph->vertexArray = (int*) malloc(vertexCount * sizeof(int));
+    graph->maxVertexArray = (int*) malloc(vertexCount * sizeof(int));
+    parallelFor(pool, vertexChunkCount, drawVerticesTask, &generator);
+
+    // Exclusive prefix sum of the degrees gives where the edges of each vertex start
+    long edgeCount = 0;
+    for (int iVertex = 0; iVertex < vertexCount; iVertex++) {
+        int degree = graph->vertexArray[iVertex];
+        graph->vertexArray[iVertex] = (int)edgeCount;
+        edgeCount += degree;
+        if (edgeCount > INT_MAX) {
+            printf("Unable to generate more than %i edges.\n", INT_MAX);
+            exit(1);
+        }
+    }
+    graph->edgeCount = (int)edgeCount;
+
+    long totalVertexCount = (long)graphCount * vertexCount;
+    long totalEdgeCount = (long)graphCount * edgeCount;
+    graph->edgeArray = (int*) malloc(edgeCount * sizeof(int));
+    graph->weightArray = (int*) malloc(totalEdgeCount * sizeof(int));
+    parallelFor(pool, vertexChunkCount, drawEdgesTask, &generator);
+    generateWeights(graph, config, pool);
+
+    // Sources are min vertices and sources in every sample, and start a kill chain at its first stage. They are
+    // drawn without replacement with Floyd's algorithm, so there are sourceCount distinct ones, or as many as there
+    // are candidates.
+    graph->sourceArray = (int*) calloc(totalVertexCount, sizeof(int));
+    int candidateCount = (config->topology == TOPOLOGY_KILL_CHAIN) ? getLayerStart(config, 1) : vertexCount;
+    if (graph->sourceCount > candidateCount) {
+        graph->sourceCount = candidateCount;
+    }
+    for (int iCandidate = candidateCount - graph->sourceCount; iCandidate < candidateCount; iCandidate++) {
+        int localSource = uniformBelow(drawBits(config, STREAM_SOURCE, iCandidate, 0).x, iCandidate + 1);
+        if (graph->sourceArray[localSource] == 1) {
+            localSource = iCandidate;
+        }
+        graph->maxVertexArray[localSource] = -1;
+        for (int iGraph = 0; iGraph < graphCount; iGraph++) {
+            graph->sourceArray[(long)iGraph * vertexCount + localSource] = 1;
+        }
+    }
+}
@@ -0,0 +1,74 @@
+//
+//  generator.hpp
+//  OpenCLDijkstra
+//
+
+#ifndef generator_hpp
+#define generator_hpp
+
+#include <stdio.h>
+#include "graph.hpp"
+#include "threadpool.hpp"
+
+
+///
+//  Types
+//
+//
+//  A parallel generator of large synthetic attack graphs. Every random draw
+//  is made with Philox from (seed, stream, index) alone, so the vertices,
+//  edges and weights are drawn in parallel over chunks of the arrays, and the
+//  same configuration gives the same graph on any number of threads. The
+//  degrees are drawn first and turned into the CSR offsets with a prefix sum,
+//  and the edges and weights are then written straight into place. The
+//  graph is drawn without its inverse and topological levels, which are
+//  derived by completeReadGraph when it is used, as for a graph read from a
+//  file.
+//
+
+typedef enum
+{
+    TOPOLOGY_UNIFORM = 0,       // neighborsPerVertex edges from every vertex to uniform targets
+    TOPOLOGY_POWER_LAW = 1,     // Out-degrees of 1 plus a Pareto draw, with hubs of many edges
+    TOPOLOGY_KILL_CHAIN = 2,    // Acyclic: layerCount stages, with edges to later stages only
+    TOPOLOGY_LATERAL = 3        // Clusters of hosts with dense edges between them, so mostly cyclic
+} GraphTopology;
+
+typedef struct
+{
+    GraphTopology topology;
+
+    int vertexCount;
+
+    // Mean out-degree
+    int neighborsPerVertex;
+
+    int graphCount;
+
+    // Distinct source vertices, each a source in every sample
+    int sourceCount;
+
+    // Fraction of the vertices that are max (AND) vertices. Sources are always min.
+    float andFraction;
+
+    unsigned int seed;
+
+    // Exponent of the out-degrees of TOPOLOGY_POWER_LAW, above 2
+    float powerLawExponent;
+
+    // Stages of TOPOLOGY_KILL_CHAIN. Most edges lead to the next stage, the rest further on, and the sources are
+    // in the first.
+    int layerCount;
+
+    // Vertices per cluster of TOPOLOGY_LATERAL, and the fraction of the edges that stay within their cluster
+    int clusterSize;
+    float clusterEdgeFraction;
+
+} GeneratorConfig;
+
+void initializeGeneratorConfig(GeneratorConfig *config, GraphTopology topology, int vertexCount, int neighborsPerVertex, int graphCount, int sourceCount);
+bool parseGeneratorConfig(const char *text, GeneratorConfig *config);
+void generateGraph(GraphData *graph, GeneratorConfig *config, ThreadPool *pool);
+void generateWeights(GraphData *graph, GeneratorConfig *config, ThreadPool *pool);
+
+#endif /* generator_hpp */
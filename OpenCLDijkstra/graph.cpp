@@ -7,7 +7,27 @@
 //
 
 #include "graph.hpp"
+#include "metric.hpp"
+#include <string.h>
 
+#define INVERSE_CHUNK_SIZE 65536  // Vertices or edges per task of buildInverseGraphInParallel
+#define INVERSE_INSERTION_SORT_SIZE 32  // Parents of a child from which they are sorted with qsort
+
+typedef struct
+{
+    GraphData *graph;
+
+    // Parent count, and then next free inverse edge, of each child
+    int *nextInverseEdgeArray;
+
+} InverseGraphContext;
+
+// A parent of a child and the forward edge between them, while the parents are sorted
+typedef struct
+{
+    int edge;
+    int parent;
+} InverseEdge;
 
 ///
 //  Namespaces
@@ -40,12 +60,166 @@ void checkErrorFileLine(int errNum, int expected, const char* file, const int li
 }
 
 
+
+///
+//  Build inverseVertexArray, inverseEdgeArray and inverseEdgeMapArray from vertexArray and edgeArray.
+//
+//  The inverse edges are the forward edges counting-sorted by target vertex, so this is O(V+E). As the sort is
+//  stable, the parents of each child come in the order of their forward edges, just like when the inverse graph
+//  was built by scanning all parents of every child. inverseEdgeMapArray[i] is the forward edge that inverse
+//  edge i was made from.
+//
+void buildInverseGraph(GraphData *graph)
+{
+    int *nextInverseEdgeArray = (int*) malloc(graph->vertexCount * sizeof(int));
+    
+    for (int iVertex = 0; iVertex < graph->vertexCount; iVertex++) {
+        nextInverseEdgeArray[iVertex] = 0;
+    }
+    for (int iEdge = 0; iEdge < graph->edgeCount; iEdge++) {
+        nextInverseEdgeArray[graph->edgeArray[iEdge]]++;
+    }
+    
+    // Exclusive prefix sum of the parent counts gives where each child's parents start
+    int iInverseEdge = 0;
+    for (int iChild = 0; iChild < graph->vertexCount; iChild++) {
+        int parentCount = nextInverseEdgeArray[iChild];
+        graph->inverseVertexArray[iChild] = iInverseEdge;
+        nextInverseEdgeArray[iChild] = iInverseEdge;
+        iInverseEdge += parentCount;
+    }
+    
+    for (int iParent = 0; iParent < graph->vertexCount; iParent++) {
+        int edgeStart = graph->vertexArray[iParent];
+        int edgeEnd;
+        if (iParent + 1 < (graph->vertexCount))
+        {
+            edgeEnd = graph->vertexArray[iParent + 1];
+        }
+        else
+        {
+            edgeEnd = graph->edgeCount;
+        }
+        for (int edge = edgeStart; edge < edgeEnd; edge++) {
+            int position = nextInverseEdgeArray[graph->edgeArray[edge]]++;
+            graph->inverseEdgeArray[position] = iParent;
+            graph->inverseEdgeMapArray[position] = edge;
+        }
+    }
+    free(nextInverseEdgeArray);
+}
+
+void countParentsTask(int iTask, int iThread, void *context)
+{
+    InverseGraphContext *inverse = (InverseGraphContext*) context;
+    GraphData *graph = inverse->graph;
+    int edgeStart = iTask * INVERSE_CHUNK_SIZE;
+    int edgeEnd = (graph->edgeCount - edgeStart > INVERSE_CHUNK_SIZE) ? edgeStart + INVERSE_CHUNK_SIZE : graph->edgeCount;
+    for (int edge = edgeStart; edge < edgeEnd; edge++) {
+        __sync_fetch_and_add(&inverse->nextInverseEdgeArray[graph->edgeArray[edge]], 1);
+    }
+}
+
+void scatterParentsTask(int iTask, int iThread, void *context)
+{
+    InverseGraphContext *inverse = (InverseGraphContext*) context;
+    GraphData *graph = inverse->graph;
+    int vertexStart = iTask * INVERSE_CHUNK_SIZE;
+    int vertexEnd = (graph->vertexCount - vertexStart > INVERSE_CHUNK_SIZE) ? vertexStart + INVERSE_CHUNK_SIZE : graph->vertexCount;
+    for (int parent = vertexStart; parent < vertexEnd; parent++) {
+        int edgeEnd = (parent + 1 < graph->vertexCount) ? graph->vertexArray[parent + 1] : graph->edgeCount;
+        for (int edge = graph->vertexArray[parent]; edge < edgeEnd; edge++) {
+            int position = __sync_fetch_and_add(&inverse->nextInverseEdgeArray[graph->edgeArray[edge]], 1);
+            graph->inverseEdgeArray[position] = parent;
+            graph->inverseEdgeMapArray[position] = edge;
+        }
+    }
+}
+
+int compareInverseEdges(const void *a, const void *b)
+{
+    int edgeA = ((const InverseEdge*)a)->edge;
+    int edgeB = ((const InverseEdge*)b)->edge;
+    return (edgeA > edgeB) - (edgeA < edgeB);
+}
+
+// Put the parents of each child back in the order of their forward edges, which the scatter does not keep
+void sortParentsTask(int iTask, int iThread, void *context)
+{
+    GraphData *graph = ((InverseGraphContext*) context)->graph;
+    int vertexStart = iTask * INVERSE_CHUNK_SIZE;
+    int vertexEnd = (graph->vertexCount - vertexStart > INVERSE_CHUNK_SIZE) ? vertexStart + INVERSE_CHUNK_SIZE : graph->vertexCount;
+    for (int child = vertexStart; child < vertexEnd; child++) {
+        int inverseEdgeStart = graph->inverseVertexArray[child];
+        int inverseEdgeEnd = (child + 1 < graph->vertexCount) ? graph->inverseVertexArray[child + 1] : graph->edgeCount;
+        int *parentArray = graph->inverseEdgeArray + inverseEdgeStart;
+        int *edgeArray = graph->inverseEdgeMapArray + inverseEdgeStart;
+        int parentCount = inverseEdgeEnd - inverseEdgeStart;
+        if (parentCount <= INVERSE_INSERTION_SORT_SIZE) {
+            for (int i = 1; i < parentCount; i++) {
+                int edge = edgeArray[i];
+                int parent = parentArray[i];
+                int j = i;
+                while (j > 0 && edgeArray[j - 1] > edge) {
+                    edgeArray[j] = edgeArray[j - 1];
+                    parentArray[j] = parentArray[j - 1];
+                    j--;
+                }
+                edgeArray[j] = edge;
+                parentArray[j] = parent;
+            }
+        }
+        else {
+            InverseEdge *sortArray = (InverseEdge*) malloc(parentCount * sizeof(InverseEdge));
+            for (int i = 0; i < parentCount; i++) {
+                sortArray[i].edge = edgeArray[i];
+                sortArray[i].parent = parentArray[i];
+            }
+            qsort(sortArray, parentCount, sizeof(InverseEdge), compareInverseEdges);
+            for (int i = 0; i < parentCount; i++) {
+                edgeArray[i] = sortArray[i].edge;
+                parentArray[i] = sortArray[i].parent;
+            }
+            free(sortArray);
+        }
+    }
+}
+
+///
+//  buildInverseGraph on the threads of pool, with the same result. The parents are counted and scattered to their
+//  children with atomic increments, which leaves them in any order, and the parents of each child are then sorted
+//  by their forward edges.
+//
+void buildInverseGraphInParallel(GraphData *graph, ThreadPool *pool)
+{
+    InverseGraphContext inverse;
+    inverse.graph = graph;
+    inverse.nextInverseEdgeArray = (int*) calloc(graph->vertexCount, sizeof(int));
+    int vertexChunkCount = (graph->vertexCount + INVERSE_CHUNK_SIZE - 1) / INVERSE_CHUNK_SIZE;
+    int edgeChunkCount = (graph->edgeCount + INVERSE_CHUNK_SIZE - 1) / INVERSE_CHUNK_SIZE;
+    parallelFor(pool, edgeChunkCount, countParentsTask, &inverse);
+    
+    // Exclusive prefix sum of the parent counts gives where each child's parents start
+    int iInverseEdge = 0;
+    for (int iChild = 0; iChild < graph->vertexCount; iChild++) {
+        int parentCount = inverse.nextInverseEdgeArray[iChild];
+        graph->inverseVertexArray[iChild] = iInverseEdge;
+        inverse.nextInverseEdgeArray[iChild] = iInverseEdge;
+        iInverseEdge += parentCount;
+    }
+    
+    parallelFor(pool, vertexChunkCount, scatterParentsTask, &inverse);
+    parallelFor(pool, vertexChunkCount, sortParentsTask, &inverse);
+    free(inverse.nextInverseEdgeArray);
+}
+
 ///
 //  Generate a random graph
 //
 void generateRandomGraph(GraphData *graph, int vertexCount, int neighborsPerVertex, int graphCount, int sourceCount, float probOfMax)
 {
     float probOfSource = 1.0;
+    long totalVertexCount = (long)graphCount * vertexCount;
     
     graph->vertexCount = vertexCount;
     graph->graphCount = graphCount;
@@ -53,16 +227,16 @@ void generateRandomGraph(GraphData *graph, int vertexCount, int neighborsPerVert
     graph->vertexArray = (int*) malloc(graph->vertexCount * sizeof(int));
     graph->inverseVertexArray = (int*) malloc(graph->vertexCount * sizeof(int));
     graph->maxVertexArray = (int*) malloc(graph->vertexCount * sizeof(int));
-    graph->costArray = (int*) malloc(graph->graphCount * graph->vertexCount * sizeof(int));
-    graph->sumCostArray = (int*) malloc(graph->graphCount * graph->vertexCount * sizeof(int));
-    graph->sourceArray = (int*) malloc(graph->graphCount * graph->vertexCount * sizeof(int));
+    graph->costArray = (int*) malloc(totalVertexCount * sizeof(int));
+    graph->sumCostArray = (int*) malloc(totalVertexCount * sizeof(int));
+    graph->sourceArray = (int*) malloc(totalVertexCount * sizeof(int));
     graph->edgeCount = vertexCount * neighborsPerVertex;
     graph->edgeArray = (int*)malloc(graph->edgeCount * sizeof(int));
     graph->inverseEdgeArray = (int*)malloc(graph->edgeCount * sizeof(int));
-    graph->parentCountArray = (int*)malloc(graph->edgeCount * sizeof(int));
-    graph->weightArray = (int*)malloc(graphCount * graph->edgeCount * sizeof(int));
-    graph->inverseWeightArray = (int*)malloc(graphCount * graph->edgeCount * sizeof(int));
-    graph->shortestParentsArray = (int*)malloc(graphCount * graph->edgeCount * sizeof(int));
+    graph->inverseEdgeMapArray = (int*)malloc(graph->edgeCount * sizeof(int));
+    graph->parentCountArray = (int*)malloc(graph->vertexCount * sizeof(int));
+    graph->weightArray = (int*)malloc((long)graphCount * graph->edgeCount * sizeof(int));
+    graph->shortestParentsArray = (int*)malloc((long)graphCount * graph->edgeCount * sizeof(int));
     
     
     
@@ -76,6 +250,9 @@ void generateRandomGraph(GraphData *graph, int vertexCount, int neighborsPerVert
             graph->maxVertexArray[i]=-1;
         }
         graph->parentCountArray[i] = 0;
+    }
+    for(long i = 0; i < totalVertexCount; i++)
+    {
         graph->sourceArray[i] = 0;
     }
     
@@ -86,7 +263,7 @@ void generateRandomGraph(GraphData *graph, int vertexCount, int neighborsPerVert
         graph->parentCountArray[targetVertex]++;
         
     }
-    for(int i = 0; i < graphCount * graph->edgeCount; i++)
+    for(long i = 0; i < (long)graphCount * graph->edgeCount; i++)
     {
         graph->weightArray[i] = (rand() % 1000);
     }
@@ -96,310 +273,737 @@ void generateRandomGraph(GraphData *graph, int vertexCount, int neighborsPerVert
         int firstLocalSource = (rand() % graph->vertexCount);
         for (int iGraph = 0; iGraph < graph->graphCount; iGraph++) {
             if (iSource == 0 || (rand() % 100) < 100*probOfSource) {
-                graph->sourceArray[iGraph*graph->vertexCount + firstLocalSource] = 1;
-                graph->maxVertexArray[iGraph*graph->vertexCount + firstLocalSource] = -1;
+                graph->sourceArray[(long)iGraph*graph->vertexCount + firstLocalSource] = 1;
+                graph->maxVertexArray[firstLocalSource] = -1;
             }
             
         }
     }
     
-    int iEdge = 0;
-    for (int iChild = 0; iChild < graph->vertexCount; iChild++) {
-        graph->inverseVertexArray[iChild] = iEdge;
-        for (int iParent = 0; iParent < graph->vertexCount; iParent++) {
-            // Get the edges
-            int edgeStart = graph->vertexArray[iParent];
-            int edgeEnd;
-            if (iParent + 1 < (graph->vertexCount))
-            {
-                edgeEnd = graph->vertexArray[iParent + 1];
-            }
-            else
-            {
-                edgeEnd = graph->edgeCount;
-            }
-            for(int edge = edgeStart; edge < edgeEnd; edge++){
-                if (graph->edgeArray[edge]==iChild) {
-                    graph->inverseEdgeArray[iEdge]=iParent;
-                    for (int iGraph = 0; iGraph < graphCount; iGraph++) {
-                        graph->inverseWeightArray[iGraph * graph->edgeCount + iEdge]=graph->weightArray[iGraph * graph->edgeCount + edge];
-                    }
-                    iEdge ++;
-                }
-            }
-        }
-    }
+    buildInverseGraph(graph);
+    computeTopologicalLevels(graph);
 }
 
 ///
-//  Compute all values that can be derived from a graph as read by readGraphFromFile.
+//  Compute all values that can be derived from a graph as read by readGraphFromFile. The inverse graph is built
+//  on the default thread pool.
 //
 void completeReadGraph(GraphData *graph)
 {
+    long totalVertexCount = (long)graph->graphCount * graph->vertexCount;
     graph->inverseVertexArray = (int*) malloc(graph->vertexCount * sizeof(int));
-    graph->costArray = (int*) malloc(graph->graphCount * graph->vertexCount * sizeof(int));
-    graph->sumCostArray = (int*) malloc(graph->graphCount * graph->vertexCount * sizeof(int));
+    graph->costArray = (int*) malloc(totalVertexCount * sizeof(int));
+    graph->sumCostArray = (int*) malloc(totalVertexCount * sizeof(int));
     graph->inverseEdgeArray = (int*)malloc(graph->edgeCount * sizeof(int));
-    graph->parentCountArray = (int*)malloc(graph->edgeCount * sizeof(int));
-    graph->inverseWeightArray = (int*)malloc(graph->graphCount * graph->edgeCount * sizeof(int));
-    graph->shortestParentsArray = (int*)malloc(graph->graphCount * graph->edgeCount * sizeof(int));
+    graph->inverseEdgeMapArray = (int*)malloc(graph->edgeCount * sizeof(int));
+    graph->parentCountArray = (int*)malloc(graph->vertexCount * sizeof(int));
+    graph->shortestParentsArray = (int*)malloc((long)graph->graphCount * graph->edgeCount * sizeof(int));
+    
     
     
+    // The sources should be min. sourceArray flags the sources of every sample.
+    for(long i = 0; i < totalVertexCount; i++) {
+        if (graph->sourceArray[i] == 1) {
+            graph->maxVertexArray[i % graph->vertexCount]=-1;
+        }
+    }
     
+    buildInverseGraphInParallel(graph, defaultThreadPool());
     for(int i = 0; i < graph->vertexCount; i++)
     {
-        graph->parentCountArray[i] = 0;
+        int parentEnd = (i + 1 < graph->vertexCount) ? graph->inverseVertexArray[i + 1] : graph->edgeCount;
+        graph->parentCountArray[i] = parentEnd - graph->inverseVertexArray[i];
+    }
+    computeTopologicalLevels(graph);
+}
+
+
+///
+//  Turn graph into a directed acyclic graph with the same vertices and edge count, by pointing every edge from
+//  the lower to the higher numbered of its two vertices. A self edge of vertex i is moved to vertex i + 1 (or to 0
+//  for the last vertex) first. The edges are regrouped by their new parent, so the weights of a sample no longer
+//  belong to the edges they were drawn for, which only matters if they were not drawn at random.
+//
+void makeGraphAcyclic(GraphData *graph)
+{
+    int vertexCount = graph->vertexCount;
+    int edgeCount = graph->edgeCount;
+    int *parentArray = (int*) malloc(edgeCount * sizeof(int));
+    int *childArray = (int*) malloc(edgeCount * sizeof(int));
+    int *nextEdgeArray = (int*) calloc(vertexCount + 1, sizeof(int));
+    for (int parent = 0; parent < vertexCount; parent++) {
+        int edgeEnd = (parent + 1 < vertexCount) ? graph->vertexArray[parent + 1] : edgeCount;
+        for (int edge = graph->vertexArray[parent]; edge < edgeEnd; edge++) {
+            int child = graph->edgeArray[edge];
+            if (child == parent) {
+                child = (parent + 1) % vertexCount;
+            }
+            parentArray[edge] = (parent < child) ? parent : child;
+            childArray[edge] = (parent < child) ? child : parent;
+            nextEdgeArray[parentArray[edge] + 1]++;
+        }
     }
     
-    for(int i = 0; i < graph->edgeCount; i++)
+    // Group the edges by parent (counting sort), and recount the parents of each vertex
+    for (int iVertex = 0; iVertex < vertexCount; iVertex++) {
+        nextEdgeArray[iVertex + 1] += nextEdgeArray[iVertex];
+        graph->vertexArray[iVertex] = nextEdgeArray[iVertex];
+        graph->parentCountArray[iVertex] = 0;
+    }
+    for (int edge = 0; edge < edgeCount; edge++) {
+        graph->edgeArray[nextEdgeArray[parentArray[edge]]++] = childArray[edge];
+        graph->parentCountArray[childArray[edge]]++;
+    }
+    free(parentArray);
+    free(childArray);
+    free(nextEdgeArray);
+    
+    free(graph->topologicalOrderArray);
+    free(graph->topologicalPositionArray);
+    free(graph->levelStartArray);
+    free(graph->cyclicLevelArray);
+    buildInverseGraph(graph);
+    computeTopologicalLevels(graph);
+}
+
+///
+//  Free all arrays of a generated or completely read graph
+//
+void releaseGraph(GraphData *graph) {
+    releaseGraphSamples(graph);
+    free(graph->vertexArray);
+    free(graph->maxVertexArray);
+    free(graph->edgeArray);
+    free(graph->parentCountArray);
+    free(graph->inverseVertexArray);
+    free(graph->inverseEdgeArray);
+    free(graph->inverseEdgeMapArray);
+    free(graph->topologicalOrderArray);
+    free(graph->topologicalPositionArray);
+    free(graph->levelStartArray);
+    free(graph->cyclicLevelArray);
+}
+
+void updateGraphWithNewRandomWeights(GraphData *graph) {
+    for(long i = 0; i < (long)graph->graphCount * graph->edgeCount; i++)
     {
-        graph->parentCountArray[graph->edgeArray[i]]++;
+        graph->weightArray[i] = (rand() % 1000);
+    }
+}
+
+///
+//  Copy of graph that shares its topology but has per-sample arrays of its own, so that several sets of samples
+//  can be worked on at once. The sources and weights are copied. Release with releaseGraphSamples.
+//
+GraphData copyGraphSamples(GraphData *graph) {
+    GraphData copy = *graph;
+    long totalVertexCount = (long)graph->graphCount * graph->vertexCount;
+    long totalEdgeCount = (long)graph->graphCount * graph->edgeCount;
+    copy.sourceArray = (int*) malloc(totalVertexCount * sizeof(int));
+    copy.costArray = (int*) malloc(totalVertexCount * sizeof(int));
+    copy.sumCostArray = (int*) malloc(totalVertexCount * sizeof(int));
+    copy.weightArray = (int*) malloc(totalEdgeCount * sizeof(int));
+    copy.shortestParentsArray = (int*) malloc(totalEdgeCount * sizeof(int));
+    memcpy(copy.sourceArray, graph->sourceArray, totalVertexCount * sizeof(int));
+    memcpy(copy.weightArray, graph->weightArray, totalEdgeCount * sizeof(int));
+    return copy;
+}
+
+void releaseGraphSamples(GraphData *copy) {
+    free(copy->sourceArray);
+    free(copy->costArray);
+    free(copy->sumCostArray);
+    free(copy->weightArray);
+    free(copy->shortestParentsArray);
+}
+
+///
+//  Convert a per-sample array of count entries per sample from the sample-major layout of GraphData, entry i of
+//  sample g at g*count + i, to the interleaved layout, at i*graphCount + g, which lets the OpenCL kernels access
+//  the same entry of consecutive samples together. deinterleaveSamples converts back.
+//
+void interleaveSamples(int *interleavedArray, int *sampleArray, int graphCount, int count) {
+    for (int iGraph = 0; iGraph < graphCount; iGraph++) {
+        int *sample = sampleArray + (long)iGraph * count;
+        for (int i = 0; i < count; i++) {
+            interleavedArray[(long)i * graphCount + iGraph] = sample[i];
+        }
     }
+}
+
+void deinterleaveSamples(int *sampleArray, int *interleavedArray, int graphCount, int count) {
+    for (int iGraph = 0; iGraph < graphCount; iGraph++) {
+        int *sample = sampleArray + (long)iGraph * count;
+        for (int i = 0; i < count; i++) {
+            sample[i] = interleavedArray[(long)i * graphCount + iGraph];
+        }
+    }
+}
+
+
+///
+//  Find the strongly connected components of the graph with Tarjan's algorithm, run with an explicit stack so
+//  that long paths cannot overflow the call stack. componentArray[v] is set to the component of vertex v.
+//  Components are numbered in reverse topological order: every edge between two components goes from a higher
+//  to a lower number. Returns the number of components.
+//
+int computeStronglyConnectedComponents(GraphData *graph, int *componentArray)
+{
+    int vertexCount = graph->vertexCount;
+    int *indexArray = (int*) malloc(vertexCount * sizeof(int));
+    int *lowLinkArray = (int*) malloc(vertexCount * sizeof(int));
+    int *nextEdgeArray = (int*) malloc(vertexCount * sizeof(int));
+    // Vertices visited but not yet assigned to a component
+    int *componentStack = (int*) malloc(vertexCount * sizeof(int));
+    // Vertices of the current depth first search path
+    int *callStack = (int*) malloc(vertexCount * sizeof(int));
     
-    for(int iSource = 0; iSource < graph->sourceCount; iSource++) {
-        // The source should be min
-        graph->maxVertexArray[graph->sourceArray[iSource]]=-1;
+    for (int iVertex = 0; iVertex < vertexCount; iVertex++) {
+        indexArray[iVertex] = -1;
+        componentArray[iVertex] = -1;
     }
     
-    int iEdge = 0;
-    for (int iChild = 0; iChild < graph->vertexCount; iChild++) {
-        graph->inverseVertexArray[iChild] = iEdge;
-        for (int iParent = 0; iParent < graph->vertexCount; iParent++) {
-            // Get the edges
-            int edgeStart = graph->vertexArray[iParent];
-            int edgeEnd;
-            if (iParent + 1 < (graph->vertexCount))
-            {
-                edgeEnd = graph->vertexArray[iParent + 1];
+    int index = 0;
+    int componentCount = 0;
+    int componentStackSize = 0;
+    for (int root = 0; root < vertexCount; root++) {
+        if (indexArray[root] >= 0) {
+            continue;
+        }
+        int callStackSize = 0;
+        callStack[callStackSize++] = root;
+        indexArray[root] = lowLinkArray[root] = index++;
+        nextEdgeArray[root] = graph->vertexArray[root];
+        componentStack[componentStackSize++] = root;
+        
+        while (callStackSize > 0) {
+            int vertex = callStack[callStackSize - 1];
+            int edgeEnd = (vertex + 1 < vertexCount) ? graph->vertexArray[vertex + 1] : graph->edgeCount;
+            if (nextEdgeArray[vertex] < edgeEnd) {
+                int child = graph->edgeArray[nextEdgeArray[vertex]++];
+                if (indexArray[child] < 0) {
+                    // Descend into the child
+                    indexArray[child] = lowLinkArray[child] = index++;
+                    nextEdgeArray[child] = graph->vertexArray[child];
+                    componentStack[componentStackSize++] = child;
+                    callStack[callStackSize++] = child;
+                }
+                else if (componentArray[child] < 0 && indexArray[child] < lowLinkArray[vertex]) {
+                    // The child is on the component stack, so it is in the component of vertex
+                    lowLinkArray[vertex] = indexArray[child];
+                }
+                continue;
             }
-            else
-            {
-                edgeEnd = graph->edgeCount;
+            
+            // All children visited. A vertex that cannot reach further back is the root of a component.
+            if (lowLinkArray[vertex] == indexArray[vertex]) {
+                int member;
+                do {
+                    member = componentStack[--componentStackSize];
+                    componentArray[member] = componentCount;
+                } while (member != vertex);
+                componentCount++;
             }
-            for(int edge = edgeStart; edge < edgeEnd; edge++){
-                if (graph->edgeArray[edge]==iChild) {
-                    graph->inverseEdgeArray[iEdge]=iParent;
-                    for (int iGraph = 0; iGraph < graph->graphCount; iGraph++) {
-                        graph->inverseWeightArray[iGraph * graph->edgeCount + iEdge]=graph->weightArray[iGraph * graph->edgeCount + edge];
-                    }
-                    iEdge ++;
+            callStackSize--;
+            if (callStackSize > 0) {
+                int parent = callStack[callStackSize - 1];
+                if (lowLinkArray[vertex] < lowLinkArray[parent]) {
+                    lowLinkArray[parent] = lowLinkArray[vertex];
                 }
             }
         }
     }
+    
+    free(indexArray);
+    free(lowLinkArray);
+    free(nextEdgeArray);
+    free(componentStack);
+    free(callStack);
+    return componentCount;
 }
 
-
-
-void updateGraphWithNewRandomWeights(GraphData *graph) {
-    for(int i = 0; i < graph->graphCount * graph->edgeCount; i++)
-    {
-        graph->weightArray[i] = (rand() % 1000);
+///
+//  Sort the vertices into the topological levels of the condensation of the graph, in which each strongly
+//  connected component is contracted to a single vertex. Level 0 holds the components without parents, and
+//  every other component is in the level after its deepest parent component. Sets levelCount,
+//  topologicalOrderArray, levelStartArray, cyclicLevelArray and cyclicLevelCount, and returns true if the
+//  graph is acyclic, i.e. every component is a single vertex without a self edge.
+//
+bool computeTopologicalLevels(GraphData *graph)
+{
+    int vertexCount = graph->vertexCount;
+    int *componentArray = (int*) malloc(vertexCount * sizeof(int));
+    int componentCount = computeStronglyConnectedComponents(graph, componentArray);
+    
+    int *componentStartArray = (int*) calloc(componentCount + 1, sizeof(int));
+    int *componentVertexArray = (int*) malloc(vertexCount * sizeof(int));
+    int *componentLevelArray = (int*) calloc(componentCount, sizeof(int));
+    int *cyclicComponentArray = (int*) calloc(componentCount, sizeof(int));
+    
+    // Group the vertices by component (counting sort)
+    for (int iVertex = 0; iVertex < vertexCount; iVertex++) {
+        componentStartArray[componentArray[iVertex] + 1]++;
     }
-    int iEdge = 0;
-    for (int iChild = 0; iChild < graph->vertexCount; iChild++) {
-        for (int iParent = 0; iParent < graph->vertexCount; iParent++) {
-            // Get the edges
-            int edgeStart = graph->vertexArray[iParent];
-            int edgeEnd;
-            if (iParent + 1 < (graph->vertexCount))
-            {
-                edgeEnd = graph->vertexArray[iParent + 1];
-            }
-            else
-            {
-                edgeEnd = graph->edgeCount;
-            }
-            for(int edge = edgeStart; edge < edgeEnd; edge++){
-                if (graph->edgeArray[edge]==iChild) {
-                    for (int iGraph = 0; iGraph < graph->graphCount; iGraph++) {
-                        graph->inverseWeightArray[iGraph * graph->edgeCount + iEdge]=graph->weightArray[iGraph * graph->edgeCount + edge];
-                    }
-                    iEdge ++;
+    for (int iComponent = 0; iComponent < componentCount; iComponent++) {
+        componentStartArray[iComponent + 1] += componentStartArray[iComponent];
+        cyclicComponentArray[iComponent] = componentStartArray[iComponent + 1] - componentStartArray[iComponent] > 1;
+    }
+    int *nextArray = (int*) malloc((componentCount + 1) * sizeof(int));
+    memcpy(nextArray, componentStartArray, (componentCount + 1) * sizeof(int));
+    for (int iVertex = 0; iVertex < vertexCount; iVertex++) {
+        componentVertexArray[nextArray[componentArray[iVertex]]++] = iVertex;
+    }
+    
+    // Components in topological order, i.e. by decreasing number, push their level on to their children
+    int levelCount = 0;
+    for (int iComponent = componentCount - 1; iComponent >= 0; iComponent--) {
+        int level = componentLevelArray[iComponent];
+        if (level + 1 > levelCount) {
+            levelCount = level + 1;
+        }
+        for (int iMember = componentStartArray[iComponent]; iMember < componentStartArray[iComponent + 1]; iMember++) {
+            int parent = componentVertexArray[iMember];
+            int edgeEnd = (parent + 1 < vertexCount) ? graph->vertexArray[parent + 1] : graph->edgeCount;
+            for (int edge = graph->vertexArray[parent]; edge < edgeEnd; edge++) {
+                int childComponent = componentArray[graph->edgeArray[edge]];
+                if (childComponent == iComponent) {
+                    // Only a self edge makes a single vertex component cyclic
+                    cyclicComponentArray[iComponent] = 1;
+                }
+                else if (componentLevelArray[childComponent] < level + 1) {
+                    componentLevelArray[childComponent] = level + 1;
                 }
             }
         }
     }
+    
+    // Order the vertices by level, keeping the members of each component together (counting sort)
+    int *levelStartArray = (int*) calloc(levelCount + 1, sizeof(int));
+    int *cyclicLevelArray = (int*) calloc(levelCount, sizeof(int));
+    int *topologicalOrderArray = (int*) malloc(vertexCount * sizeof(int));
+    int *topologicalPositionArray = (int*) malloc(vertexCount * sizeof(int));
+    for (int iComponent = 0; iComponent < componentCount; iComponent++) {
+        int level = componentLevelArray[iComponent];
+        levelStartArray[level + 1] += componentStartArray[iComponent + 1] - componentStartArray[iComponent];
+        cyclicLevelArray[level] |= cyclicComponentArray[iComponent];
+    }
+    for (int iLevel = 0; iLevel < levelCount; iLevel++) {
+        levelStartArray[iLevel + 1] += levelStartArray[iLevel];
+    }
+    memcpy(nextArray, levelStartArray, levelCount * sizeof(int));
+    for (int iComponent = componentCount - 1; iComponent >= 0; iComponent--) {
+        int level = componentLevelArray[iComponent];
+        for (int iMember = componentStartArray[iComponent]; iMember < componentStartArray[iComponent + 1]; iMember++) {
+            topologicalPositionArray[componentVertexArray[iMember]] = nextArray[level];
+            topologicalOrderArray[nextArray[level]++] = componentVertexArray[iMember];
+        }
+    }
+    int cyclicLevelCount = 0;
+    for (int iLevel = 0; iLevel < levelCount; iLevel++) {
+        cyclicLevelCount += cyclicLevelArray[iLevel];
+    }
+    
+    free(componentArray);
+    free(componentStartArray);
+    free(componentVertexArray);
+    free(componentLevelArray);
+    free(cyclicComponentArray);
+    free(nextArray);
+    
+    graph->levelCount = levelCount;
+    graph->topologicalOrderArray = topologicalOrderArray;
+    graph->topologicalPositionArray = topologicalPositionArray;
+    graph->levelStartArray = levelStartArray;
+    graph->cyclicLevelArray = cyclicLevelArray;
+    graph->cyclicLevelCount = cyclicLevelCount;
+    return cyclicLevelCount == 0;
+}
+
+///
+//  Index in inverseEdgeArray of the forward edge, found among the inverse edges of its child
+//
+int getInverseEdge(GraphData *graph, int edge)
+{
+    int child = graph->edgeArray[edge];
+    int inverseEdgeEnd = (child + 1 < graph->vertexCount) ? graph->inverseVertexArray[child + 1] : graph->edgeCount;
+    for (int inverseEdge = graph->inverseVertexArray[child]; inverseEdge < inverseEdgeEnd; inverseEdge++) {
+        if (graph->inverseEdgeMapArray[inverseEdge] == edge) {
+            return inverseEdge;
+        }
+    }
+    return -1;
 }
 
+///
+//  Write the changed weights into weightArray
+//
+void applyWeightChanges(GraphData *graph, WeightChange *changeArray, int changeCount)
+{
+    for (int iChange = 0; iChange < changeCount; iChange++) {
+        WeightChange *change = &changeArray[iChange];
+        long sampleOffset = (long)change->sample * graph->edgeCount;
+        graph->weightArray[sampleOffset + change->edge] = change->weight;
+    }
+}
+
+int compareInts(const void *a, const void *b)
+{
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+///
+//  Whether change can alter the costs of the child of its edge, judged from the weights and costs of its sample
+//  before it is applied. A min vertex only depends on an edge that is one of its cheapest, or becomes at least as
+//  cheap, while a max vertex depends on every edge from a reached parent, as its sum cost adds them all up. The
+//  costs of sources, and the edges from unreached parents, do not depend on the weights.
+//
+bool changeAffectsChild(GraphData *graph, WeightChange *change)
+{
+    int child = graph->edgeArray[change->edge];
+    int parent = graph->inverseEdgeArray[getInverseEdge(graph, change->edge)];
+    long vertexOffset = (long)change->sample * graph->vertexCount;
+    int *costArray = graph->costArray + vertexOffset;
+    if (graph->sourceArray[vertexOffset + child] == 1 || costArray[parent] == INT_MAX) {
+        return false;
+    }
+    if (graph->maxVertexArray[child] >= 0) {
+        return true;
+    }
+    int oldWeight = graph->weightArray[(long)change->sample * graph->edgeCount + change->edge];
+    return MaxCostMetric::extend(costArray[parent], oldWeight) == costArray[child] || MaxCostMetric::extend(costArray[parent], change->weight) <= costArray[child];
+}
 
-// A utility function to find the vertex with minimum distance value, from
-// the set of vertices not yet included in shortest path tree
-int minDistance(int *dist, bool *sptSet, int vertexCount)
+///
+//  Find the vertices whose costs may depend on the changed edges, i.e. the children that changeAffectsChild picks
+//  out and everything reachable from them, in any sample. It must be called before the changes are applied, while
+//  costArray holds the results for the old weights. The vertices are written to affectedArray, which must hold
+//  vertexCount ints, in topological order, and their number is returned. As every cyclic component is strongly
+//  connected, an affected component is always affected as a whole. increased is set if any of the picked changes
+//  raises a weight. Otherwise no cost can rise, and the affected costs can be relaxed down from their old values.
+//
+int collectAffectedVertices(GraphData *graph, WeightChange *changeArray, int changeCount, int *affectedArray, bool *increased)
 {
-    // Initialize min value
-    int min = INT_MAX;
-    int min_index = 0;
+    int vertexCount = graph->vertexCount;
+    bool *affectedMarkArray = (bool*) calloc(vertexCount, sizeof(bool));
+    int affectedCount = 0;
+    *increased = false;
+    
+    // Depth first search from the children of the changed edges
+    int *stack = (int*) malloc(vertexCount * sizeof(int));
+    for (int iChange = 0; iChange < changeCount; iChange++) {
+        WeightChange *change = &changeArray[iChange];
+        if (!changeAffectsChild(graph, change)) {
+            continue;
+        }
+        if (change->weight > graph->weightArray[(long)change->sample * graph->edgeCount + change->edge]) {
+            *increased = true;
+        }
+        int child = graph->edgeArray[change->edge];
+        if (affectedMarkArray[child]) {
+            continue;
+        }
+        affectedMarkArray[child] = true;
+        int stackSize = 0;
+        stack[stackSize++] = child;
+        while (stackSize > 0) {
+            int vertex = stack[--stackSize];
+            affectedArray[affectedCount++] = vertex;
+            int edgeEnd = (vertex + 1 < vertexCount) ? graph->vertexArray[vertex + 1] : graph->edgeCount;
+            for (int edge = graph->vertexArray[vertex]; edge < edgeEnd; edge++) {
+                int next = graph->edgeArray[edge];
+                if (!affectedMarkArray[next]) {
+                    affectedMarkArray[next] = true;
+                    stack[stackSize++] = next;
+                }
+            }
+        }
+    }
+    
+    // Sort by position in the topological order
+    for (int iAffected = 0; iAffected < affectedCount; iAffected++) {
+        affectedArray[iAffected] = graph->topologicalPositionArray[affectedArray[iAffected]];
+    }
+    qsort(affectedArray, affectedCount, sizeof(int), compareInts);
+    for (int iAffected = 0; iAffected < affectedCount; iAffected++) {
+        affectedArray[iAffected] = graph->topologicalOrderArray[affectedArray[iAffected]];
+    }
     
-    for (int v = 0; v < vertexCount; v++) {
-        //        printf("Node %i costs %i ", v, dist[v]);
-        //        if (sptSet[v] == false) {
-        //            printf("and is unprocessed. ");
-        //        }
-        //        else {
-        //            printf("but is already proceessed. ");
-        //        }
-        if (sptSet[v] == false && dist[v] <= min) {
-            min = dist[v], min_index = v;
+    free(stack);
+    free(affectedMarkArray);
+    return affectedCount;
+}
+
+///
+//  Write the distinct samples of the changes to sampleArray in increasing order, and return their number
+//
+int collectChangedSamples(WeightChange *changeArray, int changeCount, int *sampleArray)
+{
+    for (int iChange = 0; iChange < changeCount; iChange++) {
+        sampleArray[iChange] = changeArray[iChange].sample;
+    }
+    qsort(sampleArray, changeCount, sizeof(int), compareInts);
+    int sampleCount = 0;
+    for (int iChange = 0; iChange < changeCount; iChange++) {
+        if (sampleCount == 0 || sampleArray[sampleCount - 1] != sampleArray[iChange]) {
+            sampleArray[sampleCount++] = sampleArray[iChange];
         }
-        //        printf("Lowest so far is %i with %i\n", min_index, min);
     }
-    return min_index;
+    return sampleCount;
 }
 
 
+///
+//  Indexed binary min-heap of vertices keyed by dist. heapIndexArray[v] is the position of v in heapArray,
+//  or -1 if v is not in the heap, so that the key of a queued vertex can be decreased in O(log V).
+//
+void heapSwap(DijkstraWorkspace *workspace, int i, int j)
+{
+    int vi = workspace->heapArray[i];
+    int vj = workspace->heapArray[j];
+    workspace->heapArray[i] = vj;
+    workspace->heapArray[j] = vi;
+    workspace->heapIndexArray[vj] = i;
+    workspace->heapIndexArray[vi] = j;
+}
 
-bool atLeastOneUnprocessedIsFinite(bool *sptSet, int vertexCount, int *dist) {
-    for (int i = 0; i < vertexCount; i++) {
-        if (!sptSet[i] && dist[i]<INT_MAX) {
-            return true;
+void heapSiftUp(DijkstraWorkspace *workspace, int *dist, int i)
+{
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (dist[workspace->heapArray[parent]] <= dist[workspace->heapArray[i]]) {
+            return;
         }
+        heapSwap(workspace, i, parent);
+        i = parent;
     }
-    return false;
 }
 
+void heapSiftDown(DijkstraWorkspace *workspace, int *dist, int i)
+{
+    while (true) {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < workspace->heapSize && dist[workspace->heapArray[left]] < dist[workspace->heapArray[smallest]]) {
+            smallest = left;
+        }
+        if (right < workspace->heapSize && dist[workspace->heapArray[right]] < dist[workspace->heapArray[smallest]]) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+        heapSwap(workspace, i, smallest);
+        i = smallest;
+    }
+}
 
-// Funtion that implements Dijkstra's single source shortest path algorithm
-// for a graph represented using adjacency matrix representation
-int* dijkstra(GraphData *graph, int iGraph, bool verbose){
-    int *dist = (int*) malloc(sizeof(int) * graph->vertexCount);     // The output array.  dist[i] will hold the shortest
-    // distance from src to i
-    bool *sptSet = (bool*) malloc(sizeof(bool) * graph->vertexCount); // sptSet[i] will true if vertex i is included in shortest
-    // path tree or shortest distance from src to i is finalized
-    
+// Insert vertex, or restore the heap order after its dist has been decreased
+void heapPushOrDecrease(DijkstraWorkspace *workspace, int *dist, int vertex)
+{
+    int i = workspace->heapIndexArray[vertex];
+    if (i < 0) {
+        i = workspace->heapSize;
+        workspace->heapSize++;
+        workspace->heapArray[i] = vertex;
+        workspace->heapIndexArray[vertex] = i;
+    }
+    heapSiftUp(workspace, dist, i);
+}
+
+int heapPop(DijkstraWorkspace *workspace, int *dist)
+{
+    int vertex = workspace->heapArray[0];
+    workspace->heapSize--;
+    if (workspace->heapSize > 0) {
+        heapSwap(workspace, 0, workspace->heapSize);
+        heapSiftDown(workspace, dist, 0);
+    }
+    workspace->heapIndexArray[vertex] = -1;
+    return vertex;
+}
+
+
+DijkstraWorkspace* createDijkstraWorkspace(GraphData *graph)
+{
+    DijkstraWorkspace *workspace = (DijkstraWorkspace*) malloc(sizeof(DijkstraWorkspace));
+    workspace->heapArray = (int*) malloc(graph->vertexCount * sizeof(int));
+    workspace->heapIndexArray = (int*) malloc(graph->vertexCount * sizeof(int));
+    workspace->remainingParentArray = (int*) malloc(graph->vertexCount * sizeof(int));
+    workspace->maxValueArray = (int*) malloc(graph->vertexCount * sizeof(int));
+    workspace->settledArray = (bool*) malloc(graph->vertexCount * sizeof(bool));
+    workspace->heapSize = 0;
+    return workspace;
+}
+
+void releaseDijkstraWorkspace(DijkstraWorkspace *workspace)
+{
+    free(workspace->heapArray);
+    free(workspace->heapIndexArray);
+    free(workspace->remainingParentArray);
+    free(workspace->maxValueArray);
+    free(workspace->settledArray);
+    free(workspace);
+}
+
+
+///
+//  Dijkstra's single source shortest path algorithm generalized to min (OR) and max (AND) vertices.
+//
+//  A min vertex gets the cheapest of its parents' costs plus edge weight, a max vertex the most expensive one,
+//  but only once all of its parents have been settled (parentCountArray). Sample iGraph is computed into
+//  dist[0..vertexCount) in O((V+E) log V), using only the memory of the workspace.
+//
+void dijkstraWithWorkspace(GraphData *graph, int iGraph, DijkstraWorkspace *workspace, int *dist, bool verbose)
+{
     int vertexCount = graph->vertexCount;
     int edgeCount = graph->edgeCount;
+    int *weightArray = graph->weightArray + (long)iGraph * edgeCount;
+    int *remainingParentArray = workspace->remainingParentArray;
+    int *maxValueArray = workspace->maxValueArray;
+    bool *settledArray = workspace->settledArray;
     
-    // Copy the appropriate graph from GraphData
-    int *vertexArray = (int*)malloc(vertexCount * sizeof(int));
-    int *parentCountArray = (int*)malloc(vertexCount * sizeof(int));
-    int *maxVertexArray = (int*)malloc(vertexCount * sizeof(int));
-    
-    for (int iVertex=0; iVertex<vertexCount; iVertex++) {
-        vertexArray[iVertex]=graph->vertexArray[iVertex];
-        parentCountArray[iVertex]=graph->parentCountArray[iVertex];
-        maxVertexArray[iVertex]=graph->maxVertexArray[iVertex];
-    }
-    
-    int *edgeArray = (int*)malloc(edgeCount * sizeof(int));
-    int *weightArray = (int*)malloc(edgeCount * sizeof(int));
-    int *traversedEdgeCountArray = (int*)malloc(edgeCount * sizeof(int));
-    
-    for (int iEdge=0; iEdge<edgeCount; iEdge++) {
-        edgeArray[iEdge] = graph->edgeArray[iEdge];
-        weightArray[iEdge] = graph->weightArray[iGraph*edgeCount + iEdge];
-        traversedEdgeCountArray[iEdge]=0;
+    workspace->heapSize = 0;
+    for (int iVertex = 0; iVertex < vertexCount; iVertex++) {
+        dist[iVertex] = INT_MAX;
+        settledArray[iVertex] = false;
+        workspace->heapIndexArray[iVertex] = -1;
+        remainingParentArray[iVertex] = graph->parentCountArray[iVertex];
+        maxValueArray[iVertex] = graph->maxVertexArray[iVertex];
     }
     
-    
-    // Initialize all distances as INFINITE and stpSet[] as false
-    for (int i = 0; i < vertexCount; i++)
-        dist[i] = INT_MAX, sptSet[i] = false;
-    
     // Distance of  vertex from itself is always 0
-    for (int iVertex = 0; iVertex < graph->vertexCount; iVertex++) {
-        if (graph->sourceArray[iGraph*graph->vertexCount + iVertex] == 1) {
+    for (int iVertex = 0; iVertex < vertexCount; iVertex++) {
+        if (graph->sourceArray[(long)iGraph*vertexCount + iVertex] == 1) {
             dist[iVertex] = 0;
+            heapPushOrDecrease(workspace, dist, iVertex);
             if (verbose) {
-                printf("Source vertex = %i in CPU.\n", iGraph*graph->vertexCount + graph->sourceArray[iVertex]);
+                printf("Source vertex = %i in CPU.\n", iGraph*vertexCount + iVertex);
             }
         }
     }
     
-    // Find shortest path for all vertices
-    while (atLeastOneUnprocessedIsFinite(sptSet, vertexCount, dist))
+    // Only vertices of finite distance are ever queued, so the heap runs dry when all reachable vertices are settled
+    while (workspace->heapSize > 0)
     {
-        
-        // Pick the minimum distance vertex from the set of vertices not
-        // yet processed. u is always equal to src in first iteration.
-        int source = minDistance(dist, sptSet, vertexCount);
+        int source = heapPop(workspace, dist);
+        settledArray[source] = true;
         if (verbose) {
             printf("Node %i (of cost %i) ...", source, dist[source]);
         }
-        if (maxVertexArray[source]<0 || parentCountArray[source]==0) {
-            // Mark the picked vertex as processed
-            sptSet[source] = true;
-            
-            // Get the edges
-            int edgeStart = vertexArray[source];
-            int edgeEnd;
-            if (source + 1 < (vertexCount))
-            {
-                edgeEnd = vertexArray[source + 1];
+        // Only expand min nodes, and max nodes of which all parents have been settled
+        if (graph->maxVertexArray[source] >= 0 && remainingParentArray[source] > 0) {
+            if (verbose) {
+                printf("\n");
             }
-            else
-            {
-                edgeEnd = edgeCount;
+            continue;
+        }
+        
+        int edgeStart = graph->vertexArray[source];
+        int edgeEnd;
+        if (source + 1 < (vertexCount))
+        {
+            edgeEnd = graph->vertexArray[source + 1];
+        }
+        else
+        {
+            edgeEnd = edgeCount;
+        }
+        
+        for(int edge = edgeStart; edge < edgeEnd; edge++) {
+            int target = graph->edgeArray[edge];
+            remainingParentArray[target]--;
+            
+            long longDist = dist[source];
+            longDist = longDist + weightArray[edge];
+            if (longDist > INT_MAX)
+                longDist = INT_MAX;
+            
+            // If min node
+            if (graph->maxVertexArray[target]<0) {
+                if (!settledArray[target] && longDist < dist[target]) {
+                    if (verbose) {
+                        printf(" min node %i updated from %i to %i.", target, dist[target], (int)longDist);
+                    }
+                    dist[target] = (int)longDist;
+                    heapPushOrDecrease(workspace, dist, target);
+                }
             }
-            // Iterate over the edges
             
-            for(int edge = edgeStart; edge < edgeEnd; edge++) {
-                int target = edgeArray[edge];
-                
-                if (traversedEdgeCountArray[edge]==0) {
-                    parentCountArray[target]--;
+            // If max node
+            else {
+                if (maxValueArray[target] < longDist) {
+                    maxValueArray[target] = (int)longDist;
                 }
-                traversedEdgeCountArray[edge]++;
-                
-                if (dist[source] != INT_MAX) {
-                    // If min node
-                    if (maxVertexArray[target]<0) {
-                        if (!sptSet[target]) {
-                            if (verbose) {
-                                printf(" looking at min node %i (with %i remainaing parents) by edge with weight %i.", target, parentCountArray[target], graph->weightArray[edge]);
-                            }
-                            long longDist = dist[source];
-                            longDist = longDist + weightArray[edge];
-                            if (longDist > INT_MAX)
-                                longDist = INT_MAX;
-                            
-                            if (longDist < dist[target]) {
-                                if (verbose) {
-                                    printf(".. updated from %i ", dist[target]);
-                                }
-                                dist[target] = (int)longDist;
-                                if (verbose) {
-                                    printf("to %i", dist[target]);
-                                }
-                            }
-                            if (verbose) {
-                                printf("\n");
-                            }
-                        }
+                if (remainingParentArray[target]==0) {
+                    if (verbose) {
+                        printf(" max node %i updated from %i to %i.", target, dist[target], maxValueArray[target]);
                     }
-                    
-                    // If max node
-                    else {
-                        if (verbose) {
-                            printf(" looking at max node %i (with %i remainaing parents, max: %i) by edge with weight %i.", target, parentCountArray[target], maxVertexArray[target], graph->weightArray[edge]);
-                        }
-                        long longDist = dist[source];
-                        longDist = longDist + weightArray[edge];
-                        if (longDist > INT_MAX)
-                            longDist = INT_MAX;
-                        if (maxVertexArray[target] < longDist) {
-                            maxVertexArray[target] = (int)longDist;
-                        }
-                        if (parentCountArray[target]==0) {
-                            if (verbose) {
-                                printf(".. updated from %i ", dist[target]);
-                            }
-                            dist[target] = maxVertexArray[target];
-                            if (verbose) {
-                                printf("to %i", dist[target]);
-                            }
-                        }
-                        if (verbose) {
-                            printf("\n");
-                        }
+                    dist[target] = maxValueArray[target];
+                    if (!settledArray[target] && dist[target] < INT_MAX) {
+                        heapPushOrDecrease(workspace, dist, target);
                     }
                 }
             }
-            
         }
         if (verbose) {
             printf("\n");
         }
     }
+}
+
+///
+//  Cost of vertex in sample iGraph given the current costs dist of its parents: 0 for a source, the cheapest
+//  reached parent plus edge weight for a min vertex, and the most expensive for a max vertex, which is only
+//  reached if all of its parents are.
+//
+int pullVertexCost(GraphData *graph, int iGraph, int vertex, int *dist)
+{
+    int vertexCount = graph->vertexCount;
+    int edgeCount = graph->edgeCount;
+    int *weightArray = graph->weightArray + (long)iGraph * edgeCount;
+    int inverseEdgeStart = graph->inverseVertexArray[vertex];
+    int inverseEdgeEnd = (vertex + 1 < vertexCount) ? graph->inverseVertexArray[vertex + 1] : edgeCount;
+    
+    if (graph->sourceArray[(long)iGraph*vertexCount + vertex] == 1) {
+        return 0;
+    }
+    if (graph->maxVertexArray[vertex] < 0) {
+        int minDist = INT_MAX;
+        for (int inverseEdge = inverseEdgeStart; inverseEdge < inverseEdgeEnd; inverseEdge++) {
+            int parentDist = dist[graph->inverseEdgeArray[inverseEdge]];
+            if (parentDist == INT_MAX) {
+                continue;
+            }
+            long longDist = (long)parentDist + weightArray[graph->inverseEdgeMapArray[inverseEdge]];
+            if (longDist < minDist) {
+                minDist = (int)longDist;
+            }
+        }
+        return minDist;
+    }
+    long maxDist = graph->maxVertexArray[vertex];
+    bool allParentsReached = inverseEdgeEnd > inverseEdgeStart;
+    for (int inverseEdge = inverseEdgeStart; inverseEdge < inverseEdgeEnd && allParentsReached; inverseEdge++) {
+        int parentDist = dist[graph->inverseEdgeArray[inverseEdge]];
+        long longDist = (long)parentDist + weightArray[graph->inverseEdgeMapArray[inverseEdge]];
+        allParentsReached = parentDist != INT_MAX;
+        if (longDist > maxDist) {
+            maxDist = longDist;
+        }
+    }
+    return (allParentsReached && maxDist < INT_MAX) ? (int)maxDist : INT_MAX;
+}
+
+///
+//  Compute sample iGraph with a workspace of its own. The returned array must be freed by the caller.
+//
+int* dijkstra(GraphData *graph, int iGraph, bool verbose){
+    int *dist = (int*) malloc(sizeof(int) * graph->vertexCount);
+    DijkstraWorkspace *workspace = createDijkstraWorkspace(graph);
+    dijkstraWithWorkspace(graph, iGraph, workspace, dist, verbose);
+    releaseDijkstraWorkspace(workspace);
     return dist;
-}
\ No newline at end of file
+}
@@ -14,6 +14,7 @@
 #include <iostream>
 #include <limits.h>
 #include <float.h>
+#include "threadpool.hpp"
 
 
 ///
@@ -68,16 +69,84 @@ typedef struct
 
     int *inverseEdgeArray;
 
-    int *inverseWeightArray;
+    // inverseEdgeMapArray[i] is the index in edgeArray of inverse edge i. The weight of inverse edge i in
+    // sample iGraph is weightArray[iGraph*edgeCount + inverseEdgeMapArray[i]].
+    int *inverseEdgeMapArray;
     
     int *shortestParentsArray;
     
+    // Number of topological levels of the strongly connected components. Set by computeTopologicalLevels.
+    int levelCount;
+    
+    // The vertices ordered by level. Every parent of a vertex is in an earlier level, or in the same component.
+    int *topologicalOrderArray;
+    
+    // Position of each vertex in topologicalOrderArray
+    int *topologicalPositionArray;
+    
+    // Level i consists of topologicalOrderArray[levelStartArray[i]..levelStartArray[i+1])
+    int *levelStartArray;
+    
+    // cyclicLevelArray[i] is 1 if level i holds a component with a cycle, which has to be iterated
+    int *cyclicLevelArray;
+    
+    // Number of cyclic levels. The graph is acyclic if this is 0.
+    int cyclicLevelCount;
+    
 } GraphData;
 
+// A new weight of a forward edge in one sample, for updating computed costs incrementally
+typedef struct
+{
+    int edge;
+    int sample;
+    int weight;
+} WeightChange;
+
+// Scratch memory for dijkstraWithWorkspace. Allocate once and reuse it for every sample of a graph.
+typedef struct
+{
+    // Binary min-heap of the vertices of finite but not yet settled distance
+    int *heapArray;
+
+    int heapSize;
+
+    // Position of each vertex in heapArray, or -1
+    int *heapIndexArray;
+
+    // Parents of each vertex that have not yet been settled
+    int *remainingParentArray;
+
+    // Highest cost so far of max vertices
+    int *maxValueArray;
+
+    bool *settledArray;
+
+} DijkstraWorkspace;
+
 void checkErrorFileLine(int errNum, int expected, const char* file, const int lineNumber);
 void generateRandomGraph(GraphData *graph, int vertexCount, int neighborsPerVertex, int graphCount, int sourceCount, float probOfMax);
 void completeReadGraph(GraphData *graph);
+void buildInverseGraph(GraphData *graph);
+void buildInverseGraphInParallel(GraphData *graph, ThreadPool *pool);
+void makeGraphAcyclic(GraphData *graph);
+void releaseGraph(GraphData *graph);
 void updateGraphWithNewRandomWeights(GraphData *graph);
+GraphData copyGraphSamples(GraphData *graph);
+void releaseGraphSamples(GraphData *copy);
+void interleaveSamples(int *interleavedArray, int *sampleArray, int graphCount, int count);
+void deinterleaveSamples(int *sampleArray, int *interleavedArray, int graphCount, int count);
+int computeStronglyConnectedComponents(GraphData *graph, int *componentArray);
+bool computeTopologicalLevels(GraphData *graph);
+int getInverseEdge(GraphData *graph, int edge);
+void applyWeightChanges(GraphData *graph, WeightChange *changeArray, int changeCount);
+bool changeAffectsChild(GraphData *graph, WeightChange *change);
+int collectAffectedVertices(GraphData *graph, WeightChange *changeArray, int changeCount, int *affectedArray, bool *increased);
+int collectChangedSamples(WeightChange *changeArray, int changeCount, int *sampleArray);
+DijkstraWorkspace* createDijkstraWorkspace(GraphData *graph);
+void releaseDijkstraWorkspace(DijkstraWorkspace *workspace);
+void dijkstraWithWorkspace(GraphData *graph, int iGraph, DijkstraWorkspace *workspace, int *dist, bool verbose);
 int* dijkstra(GraphData *graph, int iGraph, bool verbose);
+int pullVertexCost(GraphData *graph, int iGraph, int vertex, int *dist);
 
 #endif /* graph_hpp */
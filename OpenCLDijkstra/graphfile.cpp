@@ -0,0 +1,312 @@
+//
+//  graphfile.cpp
+//  OpenCLDijkstra
+//
+
+#include "graphfile.hpp"
+#include "utility.hpp"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define GRAPH_FILE_MAX_SECTIONS 8
+#define GRAPH_FILE_INPUT_SECTIONS 5     // The sections up to and including the weights
+
+typedef struct
+{
+    GraphSectionId id;
+    int *array;
+    long count;
+} SectionSource;
+
+
+uint64_t alignToGraphFile(uint64_t offset)
+{
+    return (offset + GRAPH_FILE_ALIGNMENT - 1) / GRAPH_FILE_ALIGNMENT * GRAPH_FILE_ALIGNMENT;
+}
+
+///
+/// Number of ints that section id must hold for a graph with the counts of header, or -1 for unknown ids.
+///
+long expectedSectionCount(GraphFileHeader *header, uint32_t id)
+{
+    long vertexCount = header->vertexCount;
+    long edgeCount = header->edgeCount;
+    long graphCount = header->graphCount;
+    switch (id) {
+        case GRAPH_SECTION_VERTEX:
+        case GRAPH_SECTION_MAX_VERTEX:
+            return vertexCount;
+        case GRAPH_SECTION_EDGE:
+            return edgeCount;
+        case GRAPH_SECTION_SOURCE:
+        case GRAPH_SECTION_COST:
+        case GRAPH_SECTION_SUM_COST:
+            return graphCount * vertexCount;
+        case GRAPH_SECTION_WEIGHT:
+        case GRAPH_SECTION_SHORTEST_PARENTS:
+            return graphCount * edgeCount;
+        default:
+            return -1;
+    }
+}
+
+bool isBinaryGraphFile(const char *filePath)
+{
+    char magic[8];
+    FILE *file = fopen(filePath, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    bool isBinary = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, GRAPH_FILE_MAGIC, sizeof(magic)) == 0;
+    fclose(file);
+    return isBinary;
+}
+
+///
+/// Write the topology, sources and weights of graph, and also costArray, sumCostArray and shortestParentsArray
+/// if includeResults is set, leaving out those that are NULL. The file is written under a name of its own and then
+/// renamed, so that filePath may be the file the graph is mapped from. Returns false if the file could not be
+/// written.
+///
+bool writeBinaryGraphFile(GraphData *graph, const char *filePath, bool includeResults)
+{
+    long totalVertexCount = (long)graph->graphCount * graph->vertexCount;
+    long totalEdgeCount = (long)graph->graphCount * graph->edgeCount;
+    SectionSource sourceArray[GRAPH_FILE_MAX_SECTIONS] = {
+        {GRAPH_SECTION_VERTEX, graph->vertexArray, graph->vertexCount},
+        {GRAPH_SECTION_MAX_VERTEX, graph->maxVertexArray, graph->vertexCount},
+        {GRAPH_SECTION_SOURCE, graph->sourceArray, totalVertexCount},
+        {GRAPH_SECTION_EDGE, graph->edgeArray, graph->edgeCount},
+        {GRAPH_SECTION_WEIGHT, graph->weightArray, totalEdgeCount},
+        {GRAPH_SECTION_COST, graph->costArray, totalVertexCount},
+        {GRAPH_SECTION_SUM_COST, graph->sumCostArray, totalVertexCount},
+        {GRAPH_SECTION_SHORTEST_PARENTS, graph->shortestParentsArray, totalEdgeCount}
+    };
+    int sectionCount = GRAPH_FILE_INPUT_SECTIONS;
+    for (int iSection = GRAPH_FILE_INPUT_SECTIONS; includeResults && iSection < GRAPH_FILE_MAX_SECTIONS; iSection++) {
+        if (sourceArray[iSection].array != NULL) {
+            sourceArray[sectionCount++] = sourceArray[iSection];
+        }
+    }
+
+    GraphFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GRAPH_FILE_MAGIC, sizeof(header.magic));
+    header.version = GRAPH_FILE_VERSION;
+    header.byteOrderMark = GRAPH_FILE_BYTE_ORDER_MARK;
+    header.graphCount = graph->graphCount;
+    header.vertexCount = graph->vertexCount;
+    header.edgeCount = graph->edgeCount;
+    header.sourceCount = graph->sourceCount;
+    header.sectionCount = sectionCount;
+
+    GraphFileSection sectionArray[GRAPH_FILE_MAX_SECTIONS];
+    memset(sectionArray, 0, sizeof(sectionArray));
+    uint64_t offset = alignToGraphFile(sizeof(GraphFileHeader) + sectionCount * sizeof(GraphFileSection));
+    for (int iSection = 0; iSection < sectionCount; iSection++) {
+        sectionArray[iSection].id = sourceArray[iSection].id;
+        sectionArray[iSection].elementSize = sizeof(int);
+        sectionArray[iSection].offset = offset;
+        sectionArray[iSection].size = sourceArray[iSection].count * sizeof(int);
+        offset = alignToGraphFile(offset + sectionArray[iSection].size);
+    }
+
+    char temporaryPath[1024];
+    snprintf(temporaryPath, sizeof(temporaryPath), "%s.%i.tmp", filePath, (int)getpid());
+    FILE *file = fopen(temporaryPath, "wb");
+    if (file == NULL) {
+        printf("Error: Unable to open %s for writing!\n", filePath);
+        return false;
+    }
+    static const char padding[GRAPH_FILE_ALIGNMENT] = {0};
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && fwrite(sectionArray, sizeof(GraphFileSection), sectionCount, file) == (size_t)sectionCount;
+    uint64_t position = sizeof(GraphFileHeader) + sectionCount * sizeof(GraphFileSection);
+    for (int iSection = 0; ok && iSection < sectionCount; iSection++) {
+        size_t paddingSize = sectionArray[iSection].offset - position;
+        ok = fwrite(padding, 1, paddingSize, file) == paddingSize;
+        ok = ok && fwrite(sourceArray[iSection].array, sizeof(int), sourceArray[iSection].count, file) == (size_t)sourceArray[iSection].count;
+        position = sectionArray[iSection].offset + sectionArray[iSection].size;
+    }
+    ok = (fclose(file) == 0) && ok;
+    ok = ok && rename(temporaryPath, filePath) == 0;
+    if (!ok) {
+        printf("Error: Failed to write %s!\n", filePath);
+        remove(temporaryPath);
+    }
+    return ok;
+}
+
+///
+/// Whether the edge offsets of every vertex are ascending and within the edges, and every edge leads to a vertex, so
+/// that the graph can be traversed without checks.
+///
+bool isValidTopology(GraphData *graph)
+{
+    int previousOffset = 0;
+    for (int iVertex = 0; iVertex < graph->vertexCount; iVertex++) {
+        if (graph->vertexArray[iVertex] < previousOffset || graph->vertexArray[iVertex] > graph->edgeCount) {
+            return false;
+        }
+        previousOffset = graph->vertexArray[iVertex];
+    }
+    for (int iEdge = 0; iEdge < graph->edgeCount; iEdge++) {
+        if (graph->edgeArray[iEdge] < 0 || graph->edgeArray[iEdge] >= graph->vertexCount) {
+            return false;
+        }
+    }
+    return true;
+}
+
+///
+/// Map a binary graph file and point the counts and input arrays of graph (vertexArray, maxVertexArray,
+/// sourceArray, edgeArray and weightArray) into it. The mapping is private, so the arrays may be modified
+/// without affecting the file. Call completeReadGraph to derive the rest of the graph, as after
+/// readGraphFromFile. The arrays must not be freed, and stay valid until unmapBinaryGraphFile.
+/// Returns NULL if the file cannot be mapped or is not a valid graph file, including one whose edges do not form a
+/// graph of its vertices.
+///
+MappedGraphFile* mapBinaryGraphFile(GraphData *graph, const char *filePath)
+{
+    int fd = open(filePath, O_RDONLY);
+    if (fd < 0) {
+        printf("Error: Unable to open %s!\n", filePath);
+        return NULL;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || (size_t)fileStat.st_size < sizeof(GraphFileHeader)) {
+        printf("Error: %s is not a graph file!\n", filePath);
+        close(fd);
+        return NULL;
+    }
+    size_t length = fileStat.st_size;
+    void *address = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED) {
+        printf("Error: Failed to map %s!\n", filePath);
+        return NULL;
+    }
+
+    MappedGraphFile *file = (MappedGraphFile*) malloc(sizeof(MappedGraphFile));
+    file->address = address;
+    file->length = length;
+    file->header = (GraphFileHeader*) address;
+    file->sectionArray = (GraphFileSection*) ((char*)address + sizeof(GraphFileHeader));
+
+    GraphFileHeader *header = file->header;
+    const char *error = NULL;
+    if (memcmp(header->magic, GRAPH_FILE_MAGIC, sizeof(header->magic)) != 0) {
+        error = "is not a graph file";
+    }
+    else if (header->version != GRAPH_FILE_VERSION) {
+        error = "has an unsupported version";
+    }
+    else if (header->byteOrderMark != GRAPH_FILE_BYTE_ORDER_MARK) {
+        error = "was written with a different byte order";
+    }
+    else if (header->graphCount < 0 || header->vertexCount < 0 || header->edgeCount < 0 ||
+             sizeof(GraphFileHeader) + (uint64_t)header->sectionCount * sizeof(GraphFileSection) > length) {
+        error = "has a corrupt header";
+    }
+    for (uint32_t iSection = 0; error == NULL && iSection < header->sectionCount; iSection++) {
+        GraphFileSection *section = &file->sectionArray[iSection];
+        long expectedCount = expectedSectionCount(header, section->id);
+        if (section->offset % GRAPH_FILE_ALIGNMENT != 0 || section->offset > length || section->size > length - section->offset) {
+            error = "has a section outside of the file";
+        }
+        else if (expectedCount >= 0 && (section->elementSize != sizeof(int) || section->size != expectedCount * sizeof(int))) {
+            error = "has a section that does not match the graph size";
+        }
+    }
+    if (error == NULL) {
+        graph->graphCount = header->graphCount;
+        graph->vertexCount = header->vertexCount;
+        graph->edgeCount = header->edgeCount;
+        graph->sourceCount = header->sourceCount;
+        graph->vertexArray = getGraphFileSection(file, GRAPH_SECTION_VERTEX);
+        graph->maxVertexArray = getGraphFileSection(file, GRAPH_SECTION_MAX_VERTEX);
+        graph->sourceArray = getGraphFileSection(file, GRAPH_SECTION_SOURCE);
+        graph->edgeArray = getGraphFileSection(file, GRAPH_SECTION_EDGE);
+        graph->weightArray = getGraphFileSection(file, GRAPH_SECTION_WEIGHT);
+        if (graph->vertexArray == NULL || graph->maxVertexArray == NULL || graph->sourceArray == NULL || graph->edgeArray == NULL || graph->weightArray == NULL) {
+            error = "lacks a required section";
+        }
+    }
+    if (error == NULL && !isValidTopology(graph)) {
+        error = "has edges outside of the graph";
+    }
+    if (error != NULL) {
+        printf("Error: %s %s!\n", filePath, error);
+        unmapBinaryGraphFile(file);
+        return NULL;
+    }
+    return file;
+}
+
+///
+/// Array of section id in a mapped file, or NULL if the file has no such section.
+///
+int* getGraphFileSection(MappedGraphFile *file, GraphSectionId id)
+{
+    for (uint32_t iSection = 0; iSection < file->header->sectionCount; iSection++) {
+        if (file->sectionArray[iSection].id == (uint32_t)id) {
+            return (int*) ((char*)file->address + file->sectionArray[iSection].offset);
+        }
+    }
+    return NULL;
+}
+
+void unmapBinaryGraphFile(MappedGraphFile *file)
+{
+    munmap(file->address, file->length);
+    free(file);
+}
+
+///
+/// Convert a graph from the CSV format of readGraphFromFile to the binary format.
+///
+bool convertCSVToBinaryGraphFile(const char *csvPath, const char *binaryPath)
+{
+    GraphData graph;
+    char path[512];
+    strncpy(path, csvPath, sizeof(path) - 1);
+    path[sizeof(path) - 1] = '\0';
+    graph.vertexArray = NULL;
+    readGraphFromFile(&graph, path);
+    if (graph.vertexArray == NULL) {
+        return false;
+    }
+    bool ok = writeBinaryGraphFile(&graph, binaryPath, false);
+    free(graph.vertexArray);
+    free(graph.maxVertexArray);
+    free(graph.sourceArray);
+    free(graph.edgeArray);
+    free(graph.weightArray);
+    return ok;
+}
+
+///
+/// Convert a binary graph file to the CSV format of writeGraphToFile. The costs and shortest parents are
+/// only written if the binary file holds results.
+///
+bool convertBinaryToCSVGraphFile(const char *binaryPath, const char *csvPath)
+{
+    GraphData graph;
+    MappedGraphFile *file = mapBinaryGraphFile(&graph, binaryPath);
+    if (file == NULL) {
+        return false;
+    }
+    graph.costArray = getGraphFileSection(file, GRAPH_SECTION_COST);
+    graph.sumCostArray = getGraphFileSection(file, GRAPH_SECTION_SUM_COST);
+    graph.shortestParentsArray = getGraphFileSection(file, GRAPH_SECTION_SHORTEST_PARENTS);
+
+    char path[512];
+    strncpy(path, csvPath, sizeof(path) - 1);
+    path[sizeof(path) - 1] = '\0';
+    bool ok = writeGraphToFile(&graph, path);
+    unmapBinaryGraphFile(file);
+    return ok;
+}
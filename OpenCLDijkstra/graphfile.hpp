@@ -0,0 +1,101 @@
+//
+//  graphfile.hpp
+//  OpenCLDijkstra
+//
+
+#ifndef graphfile_hpp
+#define graphfile_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include "graph.hpp"
+
+
+///
+//  Types
+//
+//
+//  Binary graph container. The file starts with a 64 byte header, followed
+//  by a table of sections. Each section holds one array of GraphData as raw
+//  native-endian ints and starts at a multiple of GRAPH_FILE_ALIGNMENT, so
+//  that a mapped file can be used in place without any parsing:
+//
+//      header | section table | pad | section | pad | section | ...
+//
+//  Readers skip sections with ids they do not know. New sections can
+//  therefore be added without changing the version, which is only bumped for
+//  incompatible changes of the layout.
+//
+
+#define GRAPH_FILE_MAGIC "AGRAPHB"
+#define GRAPH_FILE_VERSION 1
+#define GRAPH_FILE_ALIGNMENT 64
+#define GRAPH_FILE_BYTE_ORDER_MARK 0x01020304
+
+typedef enum
+{
+    GRAPH_SECTION_VERTEX = 1,
+    GRAPH_SECTION_MAX_VERTEX = 2,
+    GRAPH_SECTION_SOURCE = 3,
+    GRAPH_SECTION_EDGE = 4,
+    GRAPH_SECTION_WEIGHT = 5,
+    GRAPH_SECTION_COST = 6,
+    GRAPH_SECTION_SUM_COST = 7,
+    GRAPH_SECTION_SHORTEST_PARENTS = 8
+} GraphSectionId;
+
+typedef struct
+{
+    // GRAPH_FILE_MAGIC, zero terminated
+    char magic[8];
+
+    uint32_t version;
+
+    // GRAPH_FILE_BYTE_ORDER_MARK as written by the producing machine
+    uint32_t byteOrderMark;
+
+    int32_t graphCount;
+    int32_t vertexCount;
+    int32_t edgeCount;
+    int32_t sourceCount;
+
+    uint32_t sectionCount;
+    uint32_t reserved[7];
+
+} GraphFileHeader;
+
+typedef struct
+{
+    // A GraphSectionId
+    uint32_t id;
+
+    // Size in bytes of each element
+    uint32_t elementSize;
+
+    // Byte offset of the section from the start of the file, a multiple of GRAPH_FILE_ALIGNMENT
+    uint64_t offset;
+
+    // Size of the section in bytes, excluding padding
+    uint64_t size;
+
+    uint64_t reserved;
+
+} GraphFileSection;
+
+typedef struct
+{
+    void *address;
+    size_t length;
+    GraphFileHeader *header;
+    GraphFileSection *sectionArray;
+} MappedGraphFile;
+
+bool isBinaryGraphFile(const char *filePath);
+bool writeBinaryGraphFile(GraphData *graph, const char *filePath, bool includeResults);
+MappedGraphFile* mapBinaryGraphFile(GraphData *graph, const char *filePath);
+int* getGraphFileSection(MappedGraphFile *file, GraphSectionId id);
+void unmapBinaryGraphFile(MappedGraphFile *file);
+bool convertCSVToBinaryGraphFile(const char *csvPath, const char *binaryPath);
+bool convertBinaryToCSVGraphFile(const char *binaryPath, const char *csvPath);
+
+#endif /* graphfile_hpp */
@@ -1,5 +1,60 @@
 #define MAXTRACE 20000
 
+///
+/// Layout of the per-sample arrays, which hold count entries, one per vertex or edge, for each of graphCount
+/// samples. By default they are sample-major, entry local of sample iGraph at iGraph*count + local. Built with
+/// -D SAMPLE_INTERLEAVED they are interleaved instead, at local*graphCount + iGraph, and work-items are numbered
+/// the same way, so that consecutive work-items handle consecutive samples of the same vertex or edge. They then
+/// read the same topology and access adjacent state.
+///
+#ifdef SAMPLE_INTERLEAVED
+#define SAMPLE_INDEX(iGraph, local, count, graphCount) ((local)*(graphCount) + (iGraph))
+#define SAMPLE_OF(index, count, graphCount) ((index) % (graphCount))
+#define LOCAL_OF(index, count, graphCount) ((index) / (graphCount))
+#else
+#define SAMPLE_INDEX(iGraph, local, count, graphCount) ((iGraph)*(count) + (local))
+#define SAMPLE_OF(index, count, graphCount) ((index) / (count))
+#define LOCAL_OF(index, count, graphCount) ((index) % (count))
+#endif
+
+///
+/// Specialization. The program can be built for the dimensions of one session with -D VERTEX_COUNT=n,
+/// -D EDGE_COUNT=m and -D GRAPH_COUNT=g, and the kernels then replace the dimensions they are passed with these
+/// constants. The compiler can fold them into the index arithmetic, and turn the divisions and modulos of the
+/// sample layout into multiplications, or into shifts and masks for powers of two. Built with -D NO_SUM_COSTS,
+/// the sum costs are neither computed nor written, and their buffers may be NULL. The shortest parents need no such
+/// option, as only their own kernels compute them. traversedEdgeCountArray is not part of them: it counts down the
+/// parents of max nodes for the costs themselves, and is only touched on edges into max nodes.
+///
+#ifdef VERTEX_COUNT
+#define SPECIALIZED_VERTEX_COUNT(vertexCount) VERTEX_COUNT
+#else
+#define SPECIALIZED_VERTEX_COUNT(vertexCount) (vertexCount)
+#endif
+#ifdef EDGE_COUNT
+#define SPECIALIZED_EDGE_COUNT(edgeCount) EDGE_COUNT
+#else
+#define SPECIALIZED_EDGE_COUNT(edgeCount) (edgeCount)
+#endif
+#ifdef GRAPH_COUNT
+#define SPECIALIZED_GRAPH_COUNT(graphCount) GRAPH_COUNT
+#else
+#define SPECIALIZED_GRAPH_COUNT(graphCount) (graphCount)
+#endif
+#define SPECIALIZE_DIMENSIONS(vertexCount, edgeCount, graphCount) \
+    vertexCount = SPECIALIZED_VERTEX_COUNT(vertexCount); \
+    edgeCount = SPECIALIZED_EDGE_COUNT(edgeCount); \
+    graphCount = SPECIALIZED_GRAPH_COUNT(graphCount)
+
+///
+/// Metrics. The max costs and the sum costs are folded over the edges into each vertex with the MAX_COST_* and
+/// SUM_COST_* operations and saturatedAdd, which are not defined here: the host prepends them to this source when
+/// the program is built, generated from the definitions that MaxCostMetric and SumCostMetric of metric.hpp use. The
+/// cost of each reached parent is extended along its edge, and the extended costs are combined by *_COMBINE_OR at a
+/// min vertex and by *_COMBINE_AND, starting from *_INITIAL_AND, at a max vertex. INT_MAX is unreached. The
+/// combination at a min vertex is also applied atomically, by *_ATOMIC_COMBINE_OR, as the parents of the vertex are
+/// relaxed. The sum cost of a min vertex follows its max cost, as the two combine and extend the same way there.
+///
 
 int getEdgeEnd(int iVertex, int vertexCount, __global int *vertexArray, int edgeCount) {
     if (iVertex + 1 < (vertexCount))
@@ -60,205 +115,470 @@ int getEdgeEnd(int iVertex, int vertexCount, __global int *vertexArray, int edge
 //    return 0;
 //}
 
-__kernel void OCL_SSSP_KERNEL1(__global int *vertexArray, __global int *inverseVertexArray, __global int *edgeArray, __global int *inverseEdgeArray, __global int *weightArray, __global int *inverseWeightArray, __global int *maskArray, __global int *maxCostArray, __global int *maxUpdatingCostArray, __global int *sumCostArray, __global int *sumUpdatingCostArray, int vertexCount, int edgeCount, __global int *traversedEdgeCountArray, __global int *parentCountArray, __global int *maxVertexArray, __global int *influentialParentArray)
+///
+/// Propagate the cost of globalSource along its out-edge localEdge, in sample iGraph.
+///
+void relaxEdge(int iGraph, int globalSource, int localEdge, __global int *vertexArray, __global int *inverseVertexArray, __global int *edgeArray, __global int *inverseEdgeArray, __global int *weightArray, __global int *inverseEdgeMapArray, __global int *maskArray, __global int *maxCostArray, __global int *maxUpdatingCostArray, __global int *sumCostArray, __global int *sumUpdatingCostArray, int vertexCount, int edgeCount, __global int *traversedEdgeCountArray, __global int *parentCountArray, __global int *maxVertexArray, int graphCount)
 {
-    // access thread id
-    int globalSource = get_global_id(0);
+    int localTarget = edgeArray[localEdge];
+    int globalTarget = SAMPLE_INDEX(iGraph, localTarget, vertexCount, graphCount);
+    int globalEdge = SAMPLE_INDEX(iGraph, localEdge, edgeCount, graphCount);
+    int inverseEdgeStart = inverseVertexArray[localTarget];
+    int inverseEdgeEnd = getEdgeEnd(localTarget, vertexCount, inverseVertexArray, edgeCount);
     
-    int iGraph = globalSource / vertexCount;
-    int localSource = globalSource % vertexCount;
+    // If this is a min node ...
+    if (maxVertexArray[localTarget]<0) {
+        int sourceCost = maxCostArray[globalSource];
+        int weight = weightArray[globalEdge];
+        
+        // ...atomically combine the cost through this edge into the updating costs
+        MAX_COST_ATOMIC_COMBINE_OR(&maxUpdatingCostArray[globalTarget], MAX_COST_EXTEND(sourceCost, weight));
+#ifndef NO_SUM_COSTS
+        SUM_COST_ATOMIC_COMBINE_OR(&sumUpdatingCostArray[globalTarget], SUM_COST_EXTEND(sourceCost, weight));
+#endif
+        
+    }
     
-    // Only consider vertices that are marked for update
-    if ( maskArray[globalSource] != 0 ) {
-        // After attempting to update, don't do it again unless (i) a parent updated this, or (ii) recalculation is required due to kernel 2.
-        maskArray[globalSource] = 0;
-        // Only update if (i) this is a min node, or (ii) this is a max node and all parents have been visited.
-        if (maxVertexArray[globalSource]<0 || parentCountArray[globalSource]==0) {
-            {
-                // Get the edges
-                int edgeStart = vertexArray[localSource];
-                int edgeEnd = getEdgeEnd(localSource, vertexCount, vertexArray, edgeCount);
-                
-                // Iterate over the edges
-                for(int localEdge = edgeStart; localEdge < edgeEnd; localEdge++)
-                {
-                    int localTarget = edgeArray[localEdge];
-                    int globalTarget = iGraph*vertexCount + edgeArray[localEdge];
-                    int globalEdge = iGraph*edgeCount + localEdge;
-                    
-                    // If this edge has never been traversed, reduce the remaining parents of the target by one, so that they reach zero when all incoming edges have been visited.
-                    if (traversedEdgeCountArray[globalEdge] == 0) {
-                        atomic_dec(&parentCountArray[globalTarget]);
-                    }
-                    // Mark that this edge has been traversed.
-                    traversedEdgeCountArray[globalEdge] ++;
-                    int inverseEdgeStart = inverseVertexArray[localTarget];
-                    int inverseEdgeEnd = getEdgeEnd(localTarget, vertexCount, inverseVertexArray, edgeCount);
-                    
-                    // If this is a min node ...
-                    if (maxVertexArray[globalTarget]<0) {
-                        long currentMaxCost = maxCostArray[globalSource];
-                        long currentWeight = weightArray[globalEdge];
-                        if (currentMaxCost + currentWeight < INT_MAX)
-                            currentMaxCost = currentMaxCost + currentWeight;
-                        else
-                            currentMaxCost = INT_MAX;
-                        
-                        // ...atomically choose the lesser of the current and candidate updatingCost
-                        atomic_min(&maxUpdatingCostArray[globalTarget], currentMaxCost);
-                        atomic_min(&sumUpdatingCostArray[globalTarget], currentMaxCost);
-                        
-                    }
-                    
-                    // If this is a max node...
-                    else {
-                        if (parentCountArray[globalTarget]==0) {
-                            // If all parents have been visited ...
-                            // Iterate over the edges
-                            int maxEdgeVal = 0;
-                            int sumEdgeVal = 0;
-                            int trueValue = 0;
-                            
-                            for(int localInverseEdge = inverseEdgeStart; localInverseEdge < inverseEdgeEnd; localInverseEdge++) {
-                                int localInverseTarget = inverseEdgeArray[localInverseEdge];
-                                int globalInverseTarget = iGraph*vertexCount + localInverseTarget;
-                                int globalInverseEdge = iGraph*edgeCount + localInverseEdge;
-                                int currEdgeVal;
-                                long currentMaxCost = maxCostArray[globalInverseTarget];
-                                long currentWeight = inverseWeightArray[globalInverseEdge];
-                                if (currentMaxCost + currentWeight < INT_MAX)
-                                    currEdgeVal = currentMaxCost + currentWeight;
-                                else
-                                    currEdgeVal = INT_MAX;
-                                if (currEdgeVal>maxEdgeVal) {
-                                    maxEdgeVal = currEdgeVal;
-                                }
-                                long longSumEdgeVal = sumEdgeVal;
-                                longSumEdgeVal = longSumEdgeVal + currEdgeVal;
-                                if (longSumEdgeVal < INT_MAX)
-                                    sumEdgeVal = sumEdgeVal + currEdgeVal;
-                                else
-                                    sumEdgeVal = INT_MAX;
-                            }
-                            maxCostArray[globalTarget] = maxEdgeVal;
-                            maxUpdatingCostArray[globalTarget] = maxEdgeVal;
-                            sumCostArray[globalTarget] = sumEdgeVal;
-                            sumUpdatingCostArray[globalTarget] = sumEdgeVal;
-                            // Mark the target for update
-                            maskArray[globalTarget] = 1;
-                            
-                        }
-                    }
-                }
+    // If this is a max node...
+    else {
+        // Only max nodes wait for their parents, so only the edges into them are counted. If this edge has never been traversed, reduce the remaining parents of the target by one, so that they reach zero when all incoming edges have been visited.
+        if (traversedEdgeCountArray[globalEdge] == 0) {
+            atomic_dec(&parentCountArray[globalTarget]);
+        }
+        // Mark that this edge has been traversed.
+        traversedEdgeCountArray[globalEdge] ++;
+        if (parentCountArray[globalTarget]==0) {
+            // If all parents have been visited ...
+            // Iterate over the edges
+            int maxEdgeVal = MAX_COST_INITIAL_AND(maxVertexArray[localTarget]);
+            int sumEdgeVal = SUM_COST_INITIAL_AND(maxVertexArray[localTarget]);
+            
+            for(int localInverseEdge = inverseEdgeStart; localInverseEdge < inverseEdgeEnd; localInverseEdge++) {
+                int localInverseTarget = inverseEdgeArray[localInverseEdge];
+                int parentCost = maxCostArray[SAMPLE_INDEX(iGraph, localInverseTarget, vertexCount, graphCount)];
+                int weight = weightArray[SAMPLE_INDEX(iGraph, inverseEdgeMapArray[localInverseEdge], edgeCount, graphCount)];
+                maxEdgeVal = MAX_COST_COMBINE_AND(maxEdgeVal, MAX_COST_EXTEND(parentCost, weight));
+#ifndef NO_SUM_COSTS
+                sumEdgeVal = SUM_COST_COMBINE_AND(sumEdgeVal, SUM_COST_EXTEND(parentCost, weight));
+#endif
             }
+            maxCostArray[globalTarget] = maxEdgeVal;
+            maxUpdatingCostArray[globalTarget] = maxEdgeVal;
+#ifndef NO_SUM_COSTS
+            sumCostArray[globalTarget] = sumEdgeVal;
+            sumUpdatingCostArray[globalTarget] = sumEdgeVal;
+#endif
+            // Mark the target for update
+            maskArray[globalTarget] = 1;
+            
         }
     }
 }
 
+///
+/// Whether globalSource is to be relaxed, i.e. whether it is marked for update and, if it is a max node, all its
+/// parents have been visited. The mark is cleared.
+///
+bool takeVertexForRelaxation(int globalSource, __global int *maskArray, int vertexCount, __global int *parentCountArray, __global int *maxVertexArray, int graphCount)
+{
+    // Only consider vertices that are marked for update
+    if (maskArray[globalSource] == 0) {
+        return false;
+    }
+    // After attempting to update, don't do it again unless (i) a parent updated this, or (ii) recalculation is required due to kernel 2.
+    maskArray[globalSource] = 0;
+    // Only update if (i) this is a min node, or (ii) this is a max node and all parents have been visited.
+    int localSource = LOCAL_OF(globalSource, vertexCount, graphCount);
+    return maxVertexArray[localSource]<0 || parentCountArray[globalSource]==0;
+}
 
-__kernel void OCL_SSSP_KERNEL2(__global int *vertexArray, __global int *edgeArray, __global int *weightArray,
-                               __global int *maskArray, __global int *maxCostArray, __global int *maxUpdatingCostArray, __global int *sumCostArray, __global int *sumUpdatingCostArray, int vertexCount, __global int *maxVertexArray)
+///
+/// Propagate the cost of globalSource to its children. Shared by OCL_SSSP_KERNEL1, which runs it for every
+/// vertex, and OCL_SSSP_QUEUE_KERNEL1, which only runs it for the vertices in the frontier queue.
+///
+void relaxVertex(int globalSource, __global int *vertexArray, __global int *inverseVertexArray, __global int *edgeArray, __global int *inverseEdgeArray, __global int *weightArray, __global int *inverseEdgeMapArray, __global int *maskArray, __global int *maxCostArray, __global int *maxUpdatingCostArray, __global int *sumCostArray, __global int *sumUpdatingCostArray, int vertexCount, int edgeCount, __global int *traversedEdgeCountArray, __global int *parentCountArray, __global int *maxVertexArray, int graphCount)
 {
+    int iGraph = SAMPLE_OF(globalSource, vertexCount, graphCount);
+    int localSource = LOCAL_OF(globalSource, vertexCount, graphCount);
+    
+    if (takeVertexForRelaxation(globalSource, maskArray, vertexCount, parentCountArray, maxVertexArray, graphCount)) {
+        // Iterate over the edges
+        int edgeStart = vertexArray[localSource];
+        int edgeEnd = getEdgeEnd(localSource, vertexCount, vertexArray, edgeCount);
+        for(int localEdge = edgeStart; localEdge < edgeEnd; localEdge++) {
+            relaxEdge(iGraph, globalSource, localEdge, vertexArray, inverseVertexArray, edgeArray, inverseEdgeArray, weightArray, inverseEdgeMapArray, maskArray, maxCostArray, maxUpdatingCostArray, sumCostArray, sumUpdatingCostArray, vertexCount, edgeCount, traversedEdgeCountArray, parentCountArray, maxVertexArray, graphCount);
+        }
+    }
+}
+
+
+
+__kernel void OCL_SSSP_KERNEL1(__global int *vertexArray, __global int *inverseVertexArray, __global int *edgeArray, __global int *inverseEdgeArray, __global int *weightArray, __global int *inverseEdgeMapArray, __global int *maskArray, __global int *maxCostArray, __global int *maxUpdatingCostArray, __global int *sumCostArray, __global int *sumUpdatingCostArray, int vertexCount, int edgeCount, __global int *traversedEdgeCountArray, __global int *parentCountArray, __global int *maxVertexArray, __global int *influentialParentArray, int graphCount)
+{
+    SPECIALIZE_DIMENSIONS(vertexCount, edgeCount, graphCount);
     // access thread id
-    int tid = get_global_id(0);
+    int globalSource = get_global_id(0);
+    
+    relaxVertex(globalSource, vertexArray, inverseVertexArray, edgeArray, inverseEdgeArray, weightArray, inverseEdgeMapArray, maskArray, maxCostArray, maxUpdatingCostArray, sumCostArray, sumUpdatingCostArray, vertexCount, edgeCount, traversedEdgeCountArray, parentCountArray, maxVertexArray, graphCount);
+}
+
+///
+/// Worklist variant of OCL_SSSP_KERNEL1. It is launched over the frontierSize vertices that
+/// OCL_SSSP_QUEUE_KERNEL2 put in frontierArray rather than over all vertices.
+///
+__kernel void OCL_SSSP_QUEUE_KERNEL1(__global int *vertexArray, __global int *inverseVertexArray, __global int *edgeArray, __global int *inverseEdgeArray, __global int *weightArray, __global int *inverseEdgeMapArray, __global int *maskArray, __global int *maxCostArray, __global int *maxUpdatingCostArray, __global int *sumCostArray, __global int *sumUpdatingCostArray, int vertexCount, int edgeCount, __global int *traversedEdgeCountArray, __global int *parentCountArray, __global int *maxVertexArray, __global int *frontierArray, int frontierSize, int graphCount)
+{
+    SPECIALIZE_DIMENSIONS(vertexCount, edgeCount, graphCount);
+    // access thread id
+    int iFrontier = get_global_id(0);
+    
+    if (iFrontier < frontierSize) {
+        relaxVertex(frontierArray[iFrontier], vertexArray, inverseVertexArray, edgeArray, inverseEdgeArray, weightArray, inverseEdgeMapArray, maskArray, maxCostArray, maxUpdatingCostArray, sumCostArray, sumUpdatingCostArray, vertexCount, edgeCount, traversedEdgeCountArray, parentCountArray, maxVertexArray, graphCount);
+    }
+}
+
+
+///
+/// Worklist variant of OCL_SSSP_KERNEL1 for vertices of high out-degree, which OCL_SSSP_QUEUE_KERNEL2 put at the
+/// end of frontierArray, the last one first. Each work-group relaxes one of them, its work-items striding over the
+/// out-edges, so that a hub does not hold up a whole wavefront of low-degree vertices.
+///
+__kernel void OCL_SSSP_HUB_KERNEL1(__global int *vertexArray, __global int *inverseVertexArray, __global int *edgeArray, __global int *inverseEdgeArray, __global int *weightArray, __global int *inverseEdgeMapArray, __global int *maskArray, __global int *maxCostArray, __global int *maxUpdatingCostArray, __global int *sumCostArray, __global int *sumUpdatingCostArray, int vertexCount, int edgeCount, __global int *traversedEdgeCountArray, __global int *parentCountArray, __global int *maxVertexArray, __global int *frontierArray, int frontierCapacity, int graphCount)
+{
+    SPECIALIZE_DIMENSIONS(vertexCount, edgeCount, graphCount);
+    __local int relax;
+    int globalSource = frontierArray[frontierCapacity - 1 - get_group_id(0)];
+    int iGraph = SAMPLE_OF(globalSource, vertexCount, graphCount);
+    int localSource = LOCAL_OF(globalSource, vertexCount, graphCount);
+    
+    // One work-item takes the vertex, so that all of them agree on whether it is relaxed
+    if (get_local_id(0) == 0) {
+        relax = takeVertexForRelaxation(globalSource, maskArray, vertexCount, parentCountArray, maxVertexArray, graphCount);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
     
-    if (maxCostArray[tid] > maxUpdatingCostArray[tid])
+    if (relax) {
+        int edgeEnd = getEdgeEnd(localSource, vertexCount, vertexArray, edgeCount);
+        for (int localEdge = vertexArray[localSource] + get_local_id(0); localEdge < edgeEnd; localEdge += get_local_size(0)) {
+            relaxEdge(iGraph, globalSource, localEdge, vertexArray, inverseVertexArray, edgeArray, inverseEdgeArray, weightArray, inverseEdgeMapArray, maskArray, maxCostArray, maxUpdatingCostArray, sumCostArray, sumUpdatingCostArray, vertexCount, edgeCount, traversedEdgeCountArray, parentCountArray, maxVertexArray, graphCount);
+        }
+    }
+}
+
+///
+/// Commit the costs gathered in the updating arrays during OCL_SSSP_KERNEL1 and mark improved vertices.
+///
+void updateCosts(int tid, __global int *maskArray, __global int *maxCostArray, __global int *maxUpdatingCostArray, __global int *sumCostArray, __global int *sumUpdatingCostArray)
+{
+    int maxCost = MAX_COST_COMBINE_OR(maxCostArray[tid], maxUpdatingCostArray[tid]);
+    if (maxCost != maxCostArray[tid])
     {
-        maxCostArray[tid] = maxUpdatingCostArray[tid];
+        maxCostArray[tid] = maxCost;
         maskArray[tid] = 1;
     }
-    if (sumCostArray[tid] > sumUpdatingCostArray[tid])
+#ifndef NO_SUM_COSTS
+    int sumCost = SUM_COST_COMBINE_OR(sumCostArray[tid], sumUpdatingCostArray[tid]);
+    if (sumCost != sumCostArray[tid])
     {
-        sumCostArray[tid] = sumUpdatingCostArray[tid];
+        sumCostArray[tid] = sumCost;
         maskArray[tid] = 1;
     }
+#endif
     
     maxUpdatingCostArray[tid] = maxCostArray[tid];
+#ifndef NO_SUM_COSTS
     sumUpdatingCostArray[tid] = sumCostArray[tid];
+#endif
 }
 
+///
+/// changedFlag is set to 1 if any vertex remains marked for update after this iteration. The host resets it
+/// before the last iteration of a batch, so that it tells whether another batch is needed.
+///
+__kernel void OCL_SSSP_KERNEL2(__global int *vertexArray, __global int *edgeArray, __global int *weightArray,
+                               __global int *maskArray, __global int *maxCostArray, __global int *maxUpdatingCostArray, __global int *sumCostArray, __global int *sumUpdatingCostArray, int vertexCount, __global int *maxVertexArray, __global int *changedFlag)
+{
+    // access thread id
+    int tid = get_global_id(0);
+    
+    updateCosts(tid, maskArray, maxCostArray, maxUpdatingCostArray, sumCostArray, sumUpdatingCostArray);
+    if (maskArray[tid] != 0) {
+        *changedFlag = 1;
+    }
+}
 
-int getEdgeId(int globalParent, int globalChild, int weight, int vertexCount, int edgeCount, __global int *vertexArray, __global int *edgeArray, __global int *weightArray) {
-    int iGraph = globalParent / vertexCount;
-    int localParent = globalParent % vertexCount;
-    int edgeStart = vertexArray[localParent];
-    int edgeEnd = getEdgeEnd(localParent, vertexCount, vertexArray, edgeCount);
+///
+/// Worklist variant of OCL_SSSP_KERNEL2. Every vertex that is marked for update, either because its cost
+/// improved or because OCL_SSSP_QUEUE_KERNEL1 completed a max vertex, is put in frontierArray, which holds
+/// vertexCount entries, one per vertex of every sample. Vertices with fewer than hubDegree out-edges are appended
+/// from the front, for OCL_SSSP_QUEUE_KERNEL1, and the others from the back, for OCL_SSSP_HUB_KERNEL1.
+/// frontierCount[0] and frontierCount[1] must be zero on entry and hold the sizes of the two afterwards.
+///
+__kernel void OCL_SSSP_QUEUE_KERNEL2(__global int *maskArray, __global int *maxCostArray, __global int *maxUpdatingCostArray, __global int *sumCostArray, __global int *sumUpdatingCostArray, int vertexCount, __global int *frontierArray, __global int *frontierCount, __global int *sampleVertexArray, int sampleVertexCount, int sampleEdgeCount, int hubDegree, int graphCount)
+{
+    SPECIALIZE_DIMENSIONS(sampleVertexCount, sampleEdgeCount, graphCount);
+    // access thread id
+    int tid = get_global_id(0);
     
-    // Iterate over the edges
-    for(int localEdge = edgeStart; localEdge < edgeEnd; localEdge++)
-    {
-        int currentLocalChild = edgeArray[localEdge];
-        int currentGlobalChild = iGraph*vertexCount + currentLocalChild;
-        int globalEdge = iGraph*edgeCount + localEdge;
-        
-        if (currentGlobalChild == globalChild && weightArray[globalEdge] == weight) {
-            return globalEdge;
+    updateCosts(tid, maskArray, maxCostArray, maxUpdatingCostArray, sumCostArray, sumUpdatingCostArray);
+    if (maskArray[tid] != 0) {
+        int localVertex = LOCAL_OF(tid, sampleVertexCount, graphCount);
+        int degree = getEdgeEnd(localVertex, sampleVertexCount, sampleVertexArray, sampleEdgeCount) - sampleVertexArray[localVertex];
+        if (degree < hubDegree) {
+            frontierArray[atomic_inc(&frontierCount[0])] = tid;
+        }
+        else {
+            frontierArray[vertexCount - 1 - atomic_inc(&frontierCount[1])] = tid;
         }
     }
-    return -1;
 }
 
-__kernel void SHORTEST_PARENTS(int vertexCount, int edgeCount,
-                               __global int *vertexArray,
-                               __global int *inverseVertexArray,
-                               __global int *edgeArray,
-                               __global int *inverseEdgeArray,
-                               __global int *weightArray,
-                               __global int *inverseWeightArray,
-                               __global int *maxCostArray,
-                               __global int *maxUpdatingCostArray,
-                               __global int *maxVertexArray,
-                               __global int *shortestParentEdgeArray)
+
+///
+/// Costs of localVertex in sample iGraph of graphCount, pulled from the costs of its parents in maxCostArray, which
+/// holds the costs of instanceCount instances laid out like the samples, and of which iInstance is evaluated. An inverse edge whose bit is set in disabledEdgeMask counts as infinitely
+/// expensive: a min vertex ignores it, and a max vertex is not reached through it. disabledEdgeMask may be 0.
+///
+void pullVertexCosts(int localVertex, int iGraph, int graphCount, int iInstance, int instanceCount, __global int *inverseVertexArray, __global int *inverseEdgeArray, __global int *weightArray, __global int *inverseEdgeMapArray, __global int *sourceArray, __global int *maxCostArray, int vertexCount, int edgeCount, __global int *maxVertexArray, __global uint *disabledEdgeMask, int *maxCost, int *sumCost)
+{
+    int inverseEdgeStart = inverseVertexArray[localVertex];
+    int inverseEdgeEnd = getEdgeEnd(localVertex, vertexCount, inverseVertexArray, edgeCount);
+    int maxEdgeVal;
+    int sumEdgeVal;
+    
+    if (sourceArray[SAMPLE_INDEX(iGraph, localVertex, vertexCount, graphCount)] == 1) {
+        maxEdgeVal = 0;
+        sumEdgeVal = 0;
+    }
+    // If this is a min node, take the cheapest reached parent
+    else if (maxVertexArray[localVertex] < 0) {
+        maxEdgeVal = INT_MAX;
+        for(int localInverseEdge = inverseEdgeStart; localInverseEdge < inverseEdgeEnd; localInverseEdge++) {
+            if (disabledEdgeMask != 0 && ((disabledEdgeMask[localInverseEdge >> 5] >> (localInverseEdge & 31)) & 1)) {
+                continue;
+            }
+            int parentCost = maxCostArray[SAMPLE_INDEX(iInstance, inverseEdgeArray[localInverseEdge], vertexCount, instanceCount)];
+            if (parentCost != INT_MAX) {
+                int weight = weightArray[SAMPLE_INDEX(iGraph, inverseEdgeMapArray[localInverseEdge], edgeCount, graphCount)];
+                maxEdgeVal = MAX_COST_COMBINE_OR(maxEdgeVal, MAX_COST_EXTEND(parentCost, weight));
+            }
+        }
+        sumEdgeVal = maxEdgeVal;
+    }
+    // If this is a max node, it is only reached if all of its parents are
+    else {
+        maxEdgeVal = (inverseEdgeEnd > inverseEdgeStart) ? MAX_COST_INITIAL_AND(maxVertexArray[localVertex]) : INT_MAX;
+        sumEdgeVal = SUM_COST_INITIAL_AND(maxVertexArray[localVertex]);
+        for(int localInverseEdge = inverseEdgeStart; localInverseEdge < inverseEdgeEnd; localInverseEdge++) {
+            int parentCost = maxCostArray[SAMPLE_INDEX(iInstance, inverseEdgeArray[localInverseEdge], vertexCount, instanceCount)];
+            if (parentCost == INT_MAX || (disabledEdgeMask != 0 && ((disabledEdgeMask[localInverseEdge >> 5] >> (localInverseEdge & 31)) & 1))) {
+                maxEdgeVal = INT_MAX;
+                break;
+            }
+            int weight = weightArray[SAMPLE_INDEX(iGraph, inverseEdgeMapArray[localInverseEdge], edgeCount, graphCount)];
+            maxEdgeVal = MAX_COST_COMBINE_AND(maxEdgeVal, MAX_COST_EXTEND(parentCost, weight));
+#ifndef NO_SUM_COSTS
+            sumEdgeVal = SUM_COST_COMBINE_AND(sumEdgeVal, SUM_COST_EXTEND(parentCost, weight));
+#endif
+        }
+        if (maxEdgeVal == INT_MAX) {
+            sumEdgeVal = INT_MAX;
+        }
+    }
+    *maxCost = maxEdgeVal;
+    *sumCost = sumEdgeVal;
+}
+
+///
+/// Topological evaluation of the strongly connected components. OCL_LEVEL_KERNEL is launched over the levelSize
+/// vertices topologicalOrderArray[levelStart..levelStart+levelSize) of a level in every sample, and each vertex
+/// pulls its costs from its parents. In an acyclic level all parents are in earlier levels and thus final, so
+/// one launch suffices. A cyclic level starts out unreached and is launched until changedFlag stays 0. Either
+/// way the results are the same as iterating OCL_SSSP_KERNEL1 and OCL_SSSP_KERNEL2 to convergence.
+///
+__kernel void OCL_LEVEL_KERNEL(__global int *inverseVertexArray, __global int *inverseEdgeArray, __global int *inverseEdgeMapArray, __global int *sourceArray, __global int *maxCostArray, __global int *sumCostArray, int vertexCount, int edgeCount, __global int *maxVertexArray, __global int *topologicalOrderArray, int levelStart, int levelSize, __global int *changedFlag, __global int *weightArray, int graphCount)
+{
+    SPECIALIZE_DIMENSIONS(vertexCount, edgeCount, graphCount);
+    // access thread id
+    int tid = get_global_id(0);
+    int iGraph = SAMPLE_OF(tid, levelSize, graphCount);
+    int localVertex = topologicalOrderArray[levelStart + LOCAL_OF(tid, levelSize, graphCount)];
+    int globalVertex = SAMPLE_INDEX(iGraph, localVertex, vertexCount, graphCount);
+    int maxEdgeVal;
+    int sumEdgeVal;
+    
+    pullVertexCosts(localVertex, iGraph, graphCount, iGraph, graphCount, inverseVertexArray, inverseEdgeArray, weightArray, inverseEdgeMapArray, sourceArray, maxCostArray, vertexCount, edgeCount, maxVertexArray, 0, &maxEdgeVal, &sumEdgeVal);
+    if (maxCostArray[globalVertex] != maxEdgeVal) {
+        *changedFlag = 1;
+    }
+    maxCostArray[globalVertex] = maxEdgeVal;
+#ifndef NO_SUM_COSTS
+    sumCostArray[globalVertex] = sumEdgeVal;
+#endif
+}
+
+///
+/// Update variant of OCL_LEVEL_KERNEL, for incremental updates. It is launched over the levelSize vertices
+/// topologicalOrderArray[levelStart..levelStart+levelSize), here a run of the affected vertices, in only the
+/// sampleCount samples listed in sampleList, those whose weights changed.
+///
+__kernel void OCL_UPDATE_LEVEL_KERNEL(__global int *inverseVertexArray, __global int *inverseEdgeArray, __global int *inverseEdgeMapArray, __global int *sourceArray, __global int *maxCostArray, __global int *sumCostArray, int vertexCount, int edgeCount, __global int *maxVertexArray, __global int *topologicalOrderArray, int levelStart, int levelSize, __global int *changedFlag, __global int *weightArray, int graphCount, __global int *sampleList, int sampleCount)
 {
+    SPECIALIZE_DIMENSIONS(vertexCount, edgeCount, graphCount);
     // access thread id
-    int globalChild = get_global_id(0);
+    int tid = get_global_id(0);
+    int iGraph = sampleList[SAMPLE_OF(tid, levelSize, sampleCount)];
+    int localVertex = topologicalOrderArray[levelStart + LOCAL_OF(tid, levelSize, sampleCount)];
+    int globalVertex = SAMPLE_INDEX(iGraph, localVertex, vertexCount, graphCount);
+    int maxEdgeVal;
+    int sumEdgeVal;
     
-    int iGraph = globalChild / vertexCount;
-    int localChild = globalChild % vertexCount;
+    pullVertexCosts(localVertex, iGraph, graphCount, iGraph, graphCount, inverseVertexArray, inverseEdgeArray, weightArray, inverseEdgeMapArray, sourceArray, maxCostArray, vertexCount, edgeCount, maxVertexArray, 0, &maxEdgeVal, &sumEdgeVal);
+    if (maxCostArray[globalVertex] != maxEdgeVal) {
+        *changedFlag = 1;
+    }
+    maxCostArray[globalVertex] = maxEdgeVal;
+#ifndef NO_SUM_COSTS
+    sumCostArray[globalVertex] = sumEdgeVal;
+#endif
+}
+
+///
+/// Scenario variant of OCL_LEVEL_KERNEL. Every sample is evaluated under each of a batch of scenarios, which
+/// disable the inverse edges set in their maskWordCount words of disabledEdgeMaskArray. The instanceCount instances
+/// are numbered iScenario*graphCount + iGraph, and maxCostArray holds vertexCount costs for each of them, laid out
+/// like the samples, while the weights and sources are those of the sample. Only the costs are kept.
+///
+__kernel void OCL_SCENARIO_LEVEL_KERNEL(__global int *inverseVertexArray, __global int *inverseEdgeArray, __global int *inverseEdgeMapArray, __global int *sourceArray, __global int *maxCostArray, __global int *sumCostArray, int vertexCount, int edgeCount, __global int *maxVertexArray, __global int *topologicalOrderArray, int levelStart, int levelSize, __global int *changedFlag, int graphCount, __global uint *disabledEdgeMaskArray, int maskWordCount, __global int *weightArray, int instanceCount)
+{
+    SPECIALIZE_DIMENSIONS(vertexCount, edgeCount, graphCount);
+    // access thread id
+    int tid = get_global_id(0);
+    int iInstance = SAMPLE_OF(tid, levelSize, instanceCount);
+    int iScenario = iInstance / graphCount;
+    int iGraph = iInstance % graphCount;
+    int localVertex = topologicalOrderArray[levelStart + LOCAL_OF(tid, levelSize, instanceCount)];
+    int globalVertex = SAMPLE_INDEX(iInstance, localVertex, vertexCount, instanceCount);
+    int maxEdgeVal;
+    int sumEdgeVal;
     
+    pullVertexCosts(localVertex, iGraph, graphCount, iInstance, instanceCount, inverseVertexArray, inverseEdgeArray, weightArray, inverseEdgeMapArray, sourceArray, maxCostArray, vertexCount, edgeCount, maxVertexArray, disabledEdgeMaskArray + iScenario*maskWordCount, &maxEdgeVal, &sumEdgeVal);
+    if (maxCostArray[globalVertex] != maxEdgeVal) {
+        *changedFlag = 1;
+    }
+    maxCostArray[globalVertex] = maxEdgeVal;
+}
+
+///
+/// Copy the costs of the targetCount vertices of targetArray in every one of instanceCount instances to
+/// targetCostArray, instance-major whatever the layout of maxCostArray.
+///
+__kernel void OCL_GATHER_TARGETS(__global int *maxCostArray, int vertexCount, __global int *targetArray, int targetCount, __global int *targetCostArray, int instanceCount)
+{
+    vertexCount = SPECIALIZED_VERTEX_COUNT(vertexCount);
+    int tid = get_global_id(0);
+    int iInstance = tid / targetCount;
+    targetCostArray[tid] = maxCostArray[SAMPLE_INDEX(iInstance, targetArray[tid % targetCount], vertexCount, instanceCount)];
+}
+
+///
+/// Make the listSize vertices vertexList[listStart..listStart+listSize) unreached in the sampleCount samples listed
+/// in sampleList, so that a cyclic level can be evaluated from scratch by OCL_UPDATE_LEVEL_KERNEL.
+///
+__kernel void OCL_RESET_VERTICES(__global int *vertexList, int listStart, int listSize, int vertexCount, __global int *maxCostArray, int graphCount, __global int *sampleList, int sampleCount)
+{
+    vertexCount = SPECIALIZED_VERTEX_COUNT(vertexCount);
+    graphCount = SPECIALIZED_GRAPH_COUNT(graphCount);
+    int tid = get_global_id(0);
+    int iGraph = sampleList[SAMPLE_OF(tid, listSize, sampleCount)];
+    maxCostArray[SAMPLE_INDEX(iGraph, vertexList[listStart + LOCAL_OF(tid, listSize, sampleCount)], vertexCount, graphCount)] = INT_MAX;
+}
+
+///
+/// Write the changeCount weight changes of changeArray, pairs of an index into weightArray and a weight, to
+/// weightArray, one work-item per change. Changes to the same index must be to the same weight.
+///
+__kernel void OCL_SCATTER_WEIGHTS(__global int *changeArray, __global int *weightArray)
+{
+    int tid = get_global_id(0);
+    weightArray[changeArray[2*tid]] = changeArray[2*tid + 1];
+}
+
+///
+/// Mark the edges into localChild in sample iGraph that are shortest parents in shortestParentEdgeArray, given the
+/// costs of the child and its parents in maxCostArray.
+///
+void markShortestParents(int localChild, int iGraph, int vertexCount, int edgeCount, int graphCount, __global int *inverseVertexArray, __global int *inverseEdgeArray, __global int *weightArray, __global int *inverseEdgeMapArray, __global int *maxCostArray, __global int *maxVertexArray, __global int *shortestParentEdgeArray)
+{
+    int globalChild = SAMPLE_INDEX(iGraph, localChild, vertexCount, graphCount);
     int inverseEdgeStart = inverseVertexArray[localChild];
     int inverseEdgeEnd = getEdgeEnd(localChild, vertexCount, inverseVertexArray, edgeCount);
-    int minCost = INT_MAX-1;
-    
-        for(int localParentEdge = inverseEdgeStart; localParentEdge < inverseEdgeEnd; localParentEdge++) {
-            int localParent = inverseEdgeArray[localParentEdge];
-            int globalParent = iGraph*vertexCount + localParent;
-            int globalParentEdge = iGraph*edgeCount + localParentEdge;
-            int edge = getEdgeId(globalParent, globalChild, inverseWeightArray[globalParentEdge], vertexCount, edgeCount, vertexArray, edgeArray, weightArray);
-
-            // If this is a min node...
-            if (maxVertexArray[localChild] < 0) {
-                int currCost;
-                long currentMaxCost = maxCostArray[globalParent];
-                long currentWeight = inverseWeightArray[globalParentEdge];
-                if (currentMaxCost + currentWeight < INT_MAX)
-                    currCost = currentMaxCost + currentWeight;
-                else
-                    currCost = INT_MAX;
-                // shortestParentEdgeArray[i] is 1 if edge i (according to the inverseEdgeArray numbering scheme) is a shortest parent, otherwise 0.)
-                if (currCost==maxCostArray[globalChild] && maxCostArray[globalChild] != INT_MAX && currentMaxCost != INT_MAX && currentWeight != INT_MAX && currCost != INT_MAX) {
-                    minCost = currCost;
-                    shortestParentEdgeArray[edge] = 1;
-                }
-                else {
-                    shortestParentEdgeArray[edge] = 0;
-                }
+    for(int localParentEdge = inverseEdgeStart; localParentEdge < inverseEdgeEnd; localParentEdge++) {
+        int localParent = inverseEdgeArray[localParentEdge];
+        int globalParent = SAMPLE_INDEX(iGraph, localParent, vertexCount, graphCount);
+        int edge = SAMPLE_INDEX(iGraph, inverseEdgeMapArray[localParentEdge], edgeCount, graphCount);
+
+        // If this is a min node...
+        if (maxVertexArray[localChild] < 0) {
+            int currentMaxCost = maxCostArray[globalParent];
+            int currentWeight = weightArray[edge];
+            int currCost = MAX_COST_EXTEND(currentMaxCost, currentWeight);
+            // shortestParentEdgeArray[i] is 1 if edge i (in the forward numbering of edgeArray) is a shortest parent, otherwise 0.
+            if (currCost==maxCostArray[globalChild] && maxCostArray[globalChild] != INT_MAX && currentMaxCost != INT_MAX && currentWeight != INT_MAX && currCost != INT_MAX) {
+                shortestParentEdgeArray[edge] = 1;
             }
-            // If this is a max node...
             else {
-                // ...return all parents.
-                if (maxCostArray[globalChild] != INT_MAX && maxCostArray[globalParent]!= INT_MAX) {
-                    shortestParentEdgeArray[edge] = 1;
-                }
-                else  {
-                    shortestParentEdgeArray[edge] = 0;
-                }
+                shortestParentEdgeArray[edge] = 0;
             }
         }
+        // If this is a max node...
+        else {
+            // ...return all parents.
+            if (maxCostArray[globalChild] != INT_MAX && maxCostArray[globalParent]!= INT_MAX) {
+                shortestParentEdgeArray[edge] = 1;
+            }
+            else  {
+                shortestParentEdgeArray[edge] = 0;
+            }
+        }
+    }
+}
+
+__kernel void SHORTEST_PARENTS(int vertexCount, int edgeCount,
+                               __global int *vertexArray,
+                               __global int *inverseVertexArray,
+                               __global int *edgeArray,
+                               __global int *inverseEdgeArray,
+                               __global int *weightArray,
+                               __global int *inverseEdgeMapArray,
+                               __global int *maxCostArray,
+                               __global int *maxUpdatingCostArray,
+                               __global int *maxVertexArray,
+                               __global int *shortestParentEdgeArray,
+                               __global int *vertexList,
+                               int listSize,
+                               int graphCount)
+{
+    SPECIALIZE_DIMENSIONS(vertexCount, edgeCount, graphCount);
+    // access thread id. The children are the listSize vertices of vertexList in every sample.
+    int tid = get_global_id(0);
     
-    
-    
-    
+    int iGraph = SAMPLE_OF(tid, listSize, graphCount);
+    int localChild = vertexList[LOCAL_OF(tid, listSize, graphCount)];
+    markShortestParents(localChild, iGraph, vertexCount, edgeCount, graphCount, inverseVertexArray, inverseEdgeArray, weightArray, inverseEdgeMapArray, maxCostArray, maxVertexArray, shortestParentEdgeArray);
+}
+
+///
+/// Update variant of SHORTEST_PARENTS, over the listSize vertices of vertexList in only the sampleCount samples
+/// listed in sampleList.
+///
+__kernel void OCL_UPDATE_SHORTEST_PARENTS(int vertexCount, int edgeCount, __global int *inverseVertexArray, __global int *inverseEdgeArray, __global int *weightArray, __global int *inverseEdgeMapArray, __global int *maxCostArray, __global int *maxVertexArray, __global int *shortestParentEdgeArray, __global int *vertexList, int listSize, int graphCount, __global int *sampleList, int sampleCount)
+{
+    SPECIALIZE_DIMENSIONS(vertexCount, edgeCount, graphCount);
+    int tid = get_global_id(0);
+    int iGraph = sampleList[SAMPLE_OF(tid, listSize, sampleCount)];
+    int localChild = vertexList[LOCAL_OF(tid, listSize, sampleCount)];
+    markShortestParents(localChild, iGraph, vertexCount, edgeCount, graphCount, inverseVertexArray, inverseEdgeArray, weightArray, inverseEdgeMapArray, maxCostArray, maxVertexArray, shortestParentEdgeArray);
 }
 
 
@@ -273,27 +593,170 @@ __kernel void initializeBuffers(__global int *maskArray,
                                 int vertexCount,
                                 int sourceCount,
                                 __global int *sourceArray,
-                                __global int *influentialParentArray)
+                                __global int *parentCountArray,
+                                __global int *initialParentCountArray,
+                                int graphCount)
 {
+    vertexCount = SPECIALIZED_VERTEX_COUNT(vertexCount);
+    graphCount = SPECIALIZED_GRAPH_COUNT(graphCount);
     // access thread id
     int tid = get_global_id(0);
-    int iGraph = tid / vertexCount;
-    int localTid = tid % vertexCount;
+    int localTid = LOCAL_OF(tid, vertexCount, graphCount);
     
-    influentialParentArray[tid] = -1;
+    // Parents are counted down as their edges are traversed, so restore the counts of the topology
+    parentCountArray[tid] = initialParentCountArray[localTid];
 
     if (sourceArray[tid] == 1) {
         maskArray[tid] = 1;
         maxCostArray[tid] = 0;
         maxUpdatingCostArray[tid] = 0;
+#ifndef NO_SUM_COSTS
         sumCostArray[tid] = 0;
         sumUpdatingCostArray[tid] = 0;
+#endif
     }
     else {
         maskArray[tid] = 0;
         maxCostArray[tid] = INT_MAX;
         maxUpdatingCostArray[tid] = INT_MAX;
+#ifndef NO_SUM_COSTS
         sumCostArray[tid] = INT_MAX;
         sumUpdatingCostArray[tid] = INT_MAX;
+#endif
+    }
+}
+
+
+///
+/// Weight sampling. Each weight is drawn from the distribution of its edge with the counter-based
+/// Philox4x32-10 generator, keyed by the seed and counting over (edge, sample, attempt). A weight thus only
+/// depends on (seed, sample, edge), whichever work-item or device computes it. sampleEdgeWeight in
+/// weightmodel.cpp is the host twin of this code and must be kept in sync with it.
+///
+#define DISTRIBUTION_FIXED 0
+#define DISTRIBUTION_UNIFORM 1
+#define DISTRIBUTION_EXPONENTIAL 2
+#define DISTRIBUTION_LOGNORMAL 3
+#define DISTRIBUTION_GAMMA 4
+#define MAX_GAMMA_ATTEMPTS 32
+
+uint4 philox4x32_10(uint4 counter, uint2 key)
+{
+    for (int iRound = 0; iRound < 10; iRound++) {
+        uint hi0 = mul_hi(0xD2511F53u, counter.x);
+        uint lo0 = 0xD2511F53u * counter.x;
+        uint hi1 = mul_hi(0xCD9E8D57u, counter.z);
+        uint lo1 = 0xCD9E8D57u * counter.z;
+        uint4 next;
+        next.x = hi1 ^ counter.y ^ key.x;
+        next.y = lo1;
+        next.z = hi0 ^ counter.w ^ key.y;
+        next.w = lo0;
+        counter = next;
+        key.x += 0x9E3779B9u;
+        key.y += 0xBB67AE85u;
     }
+    return counter;
+}
+
+// Uniform float in the open interval (0, 1)
+float uniformFromBits(uint bits)
+{
+    return (float)(bits >> 8) * (1.0f / 16777216.0f) + (0.5f / 16777216.0f);
+}
+
+float standardNormal(float u1, float u2)
+{
+    return sqrt(-2.0f * log(u1)) * cos(6.28318530718f * u2);
+}
+
+int sampleEdgeWeight(uint seed, int sample, int edge, int distributionType, float parameter1, float parameter2)
+{
+    uint2 key;
+    key.x = seed;
+    key.y = 0;
+    uint4 counter;
+    counter.x = edge;
+    counter.y = sample;
+    counter.z = 0;
+    counter.w = 0;
+    float value;
+    
+    if (distributionType == DISTRIBUTION_FIXED) {
+        value = parameter1;
+    }
+    else if (distributionType == DISTRIBUTION_UNIFORM) {
+        // parameter1 is the lower bound, parameter2 the (exclusive) upper bound, of integer weights
+        uint4 bits = philox4x32_10(counter, key);
+        value = floor(parameter1 + uniformFromBits(bits.x) * (parameter2 - parameter1));
+    }
+    else if (distributionType == DISTRIBUTION_EXPONENTIAL) {
+        // parameter1 is the mean
+        uint4 bits = philox4x32_10(counter, key);
+        value = -parameter1 * log(uniformFromBits(bits.x));
+    }
+    else if (distributionType == DISTRIBUTION_LOGNORMAL) {
+        // parameter1 and parameter2 are the mean and standard deviation of the logarithm
+        uint4 bits = philox4x32_10(counter, key);
+        value = exp(parameter1 + parameter2 * standardNormal(uniformFromBits(bits.x), uniformFromBits(bits.y)));
+    }
+    else {
+        // parameter1 is the shape, parameter2 the scale. Marsaglia and Tsang's method, where a shape below 1
+        // is boosted by one and corrected by a factor u^(1/shape). Each attempt uses a fresh counter.
+        float shape = parameter1 < 1.0f ? parameter1 + 1.0f : parameter1;
+        float d = shape - 1.0f / 3.0f;
+        float c = 1.0f / sqrt(9.0f * d);
+        value = d;
+        for (int attempt = 0; attempt < MAX_GAMMA_ATTEMPTS; attempt++) {
+            counter.z = attempt;
+            uint4 bits = philox4x32_10(counter, key);
+            float x = standardNormal(uniformFromBits(bits.x), uniformFromBits(bits.y));
+            float v = 1.0f + c * x;
+            if (v <= 0.0f) {
+                continue;
+            }
+            v = v * v * v;
+            value = d * v;
+            float u = uniformFromBits(bits.z);
+            if (log(u) < 0.5f * x * x + d - d * v + d * log(v)) {
+                if (parameter1 < 1.0f) {
+                    value = value * pow(uniformFromBits(bits.w), 1.0f / parameter1);
+                }
+                break;
+            }
+        }
+        value = value * parameter2;
+    }
+    
+    // Round to the nearest integer weight. INT_MAX is an infinite weight.
+    if (!(value > 0.0f)) {
+        return 0;
+    }
+    if (value >= 2147483520.0f) {
+        return INT_MAX;
+    }
+    return (int)rint(value);
+}
+
+///
+/// Fill weightArray of all samples. Launched with one work-item per sample and edge. sampleOffset is the index of
+/// sample 0 in the overall sequence of samples.
+///
+__kernel void SAMPLE_WEIGHTS(int edgeCount,
+                             uint seed,
+                             int sampleOffset,
+                             __global int *distributionTypeArray,
+                             __global float *distributionParameterArray,
+                             __global int *weightArray,
+                             int graphCount)
+{
+    edgeCount = SPECIALIZED_EDGE_COUNT(edgeCount);
+    graphCount = SPECIALIZED_GRAPH_COUNT(graphCount);
+    // access thread id
+    int tid = get_global_id(0);
+    int iGraph = SAMPLE_OF(tid, edgeCount, graphCount);
+    int localEdge = LOCAL_OF(tid, edgeCount, graphCount);
+    
+    weightArray[tid] = sampleEdgeWeight(seed, sampleOffset + iGraph, localEdge, distributionTypeArray[localEdge],
+                                        distributionParameterArray[2 * localEdge], distributionParameterArray[2 * localEdge + 1]);
 }
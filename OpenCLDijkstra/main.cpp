@@ -13,24 +13,15 @@
 #include<time.h>
 #include "graph.hpp"
 #include "utility.hpp"
-
-#define __CL_ENABLE_EXCEPTIONS
-#if defined(__APPLE__) || defined(__MACOSX)
-#include <OpenCL/cl.h>
-#else
-#include <CL/cl.hpp>
-#endif
-
-
-#define kernelPath "/Users/pontus/Documents/Pontus Program Files/XCode/OpenCLDijkstra/OpenCLDijkstra/kernel.cl"
-#define checkError(a, b) checkErrorFileLine(a, b, __FILE__ , __LINE__)
-#define NUM_ASYNCHRONOUS_ITERATIONS 20  // Number of async loop iterations before attempting to read results back
-
-///
-//  Utility functions adapted from NVIDIA GPU Computing SDK
-//
-void checkErrorFileLine(int errNum, int expected, const char* file, const int lineNumber);
-cl_device_id getFirstDev(cl_context cxGPUContext);
+#include "cpuengine.hpp"
+#include "oclengine.hpp"
+#include "oclcluster.hpp"
+#include "graphfile.hpp"
+#include "weightmodel.hpp"
+#include "statistics.hpp"
+#include "benchmark.hpp"
+#include "generator.hpp"
+#include "oclprogramcache.hpp"
 
 ///
 //  Namespaces
@@ -40,622 +31,442 @@ using namespace std;
 ///
 //  Globals
 //
-pthread_mutex_t mutex1 = PTHREAD_MUTEX_INITIALIZER;
+ComputeBackend computeBackend = BACKEND_OPENCL;
+bool useWorklist = false;
+bool useDegreeBuckets = false;
+bool useTopologicalLevels = true;
+bool useInterleavedLayout = false;
+bool useGenericKernels = false;
+bool computeCostsOnly = false;
+bool useAllDevices = false;
+int pipelineDepth = 2;
+const char *weightDistribution = NULL;
+unsigned int weightSeed = 0;
+const char *scenarioFilePath = NULL;
+const char *targetList = NULL;
+bool runBenchmarkSuite = false;
+bool runPowerLawBenchmark = false;
+const char *benchmarkOutputPath = NULL;
+const char *benchmarkBaselinePath = NULL;
+const char *profileTracePath = NULL;
+const char *generatorSpec = NULL;
+const char *generatorOutputPath = NULL;
+int verifiedSampleCount = 10;  // Samples checked against the sequential implementation, all of them with -verify
+OCLProfiler *profiler = NULL;
 
 
 
 ///
-///  Allocate memory for input CUDA buffers and copy the data into device memory
+/// Weight model for graph as given on the command line, or NULL if the weights are not drawn from a distribution
 ///
-void allocateOCLBuffers(cl_context gpuContext, cl_command_queue commandQueue, GraphData *graph, cl_mem *vertexArrayDevice, cl_mem *inverseVertexArrayDevice, cl_mem *edgeArrayDevice, cl_mem *inverseEdgeArrayDevice, cl_mem *weightArrayDevice, cl_mem *inverseWeightArrayDevice, cl_mem *maskArrayDevice, cl_mem *maxCostArrayDevice, cl_mem *maxUpdatingCostArrayDevice, cl_mem *sumCostArrayDevice, cl_mem *sumUpdatingCostArrayDevice, cl_mem *traversedEdgeArrayDevice, cl_mem *sourceArrayDevice, cl_mem *parentCountArrayDevice, cl_mem *maxVertexArrayDevice, cl_mem *shortestParentsArrayDevice)
-{
-    cl_int errNum;
-    cl_mem hostVertexArrayBuffer;
-    cl_mem hostInverseVertexArrayBuffer;
-    cl_mem hostEdgeArrayBuffer;
-    cl_mem hostInverseEdgeArrayBuffer;
-    cl_mem hostWeightArrayBuffer;
-    cl_mem hostInverseWeightArrayBuffer;
-    cl_mem hostAggregatedWeightArrayBuffer;
-    cl_mem hostTraversedEdgeCountArrayBuffer;
-    cl_mem hostSourceArrayBuffer;
-    cl_mem hostParentCountArrayBuffer;
-    cl_mem hostMaxVertexArrayBuffer;
-    int totalVertexCount = graph->graphCount * graph->vertexCount;
-    int totalEdgeCount = graph->graphCount * graph->edgeCount;
-    
-    
-    // Initially, no edges have been travelled
-    int *traversedEdgeCountArray = (int*)malloc(totalEdgeCount * sizeof(int));
-    for (int iEdge=0; iEdge<totalEdgeCount; iEdge++) {
-        traversedEdgeCountArray[iEdge]=0;
-    }
-    
-    int *aggregatedWeightArray = (int*)malloc(totalEdgeCount * sizeof(int));
-    for (int iEdge=0; iEdge<totalEdgeCount; iEdge++) {
-        aggregatedWeightArray[iEdge]=0;
-    }
-    
-    int *parentCountArray = (int*)malloc(totalVertexCount * sizeof(int));
-    for (int iVertex=0; iVertex<totalVertexCount; iVertex++) {
-        parentCountArray[iVertex]=graph->parentCountArray[iVertex % graph->vertexCount];
-    }
-    
-    int *maxVertexArray = (int*)malloc(totalVertexCount * sizeof(int));
-    for (int iGraph=0; iGraph<graph->graphCount; iGraph++) {
-        for (int iVertex=0; iVertex<graph->vertexCount; iVertex++) {
-            maxVertexArray[iGraph*graph->vertexCount + iVertex]=graph->maxVertexArray[iVertex];
-        }
-    }
-    
-    
-    // First, need to create OpenCL Host buffers that can be copied to device buffers
-    hostVertexArrayBuffer = clCreateBuffer(gpuContext, CL_MEM_COPY_HOST_PTR | CL_MEM_ALLOC_HOST_PTR,
-                                           sizeof(int) * graph->vertexCount, graph->vertexArray, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    hostInverseVertexArrayBuffer = clCreateBuffer(gpuContext, CL_MEM_COPY_HOST_PTR | CL_MEM_ALLOC_HOST_PTR,
-                                                  sizeof(int) * graph->vertexCount, graph->inverseVertexArray, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    hostEdgeArrayBuffer = clCreateBuffer(gpuContext, CL_MEM_COPY_HOST_PTR | CL_MEM_ALLOC_HOST_PTR,
-                                         sizeof(int) * graph->edgeCount, graph->edgeArray, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    hostInverseEdgeArrayBuffer = clCreateBuffer(gpuContext, CL_MEM_COPY_HOST_PTR | CL_MEM_ALLOC_HOST_PTR,
-                                                sizeof(int) * graph->edgeCount, graph->inverseEdgeArray, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    hostWeightArrayBuffer = clCreateBuffer(gpuContext, CL_MEM_COPY_HOST_PTR | CL_MEM_ALLOC_HOST_PTR,
-                                           sizeof(int) * totalEdgeCount, graph->weightArray, &errNum);
-    
-    checkError(errNum, CL_SUCCESS);
-    hostInverseWeightArrayBuffer = clCreateBuffer(gpuContext, CL_MEM_COPY_HOST_PTR | CL_MEM_ALLOC_HOST_PTR,
-                                                  sizeof(int) * totalEdgeCount, graph->inverseWeightArray, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    hostAggregatedWeightArrayBuffer = clCreateBuffer(gpuContext, CL_MEM_COPY_HOST_PTR | CL_MEM_ALLOC_HOST_PTR,
-                                                     sizeof(int) * totalEdgeCount, aggregatedWeightArray, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    hostTraversedEdgeCountArrayBuffer = clCreateBuffer(gpuContext, CL_MEM_COPY_HOST_PTR | CL_MEM_ALLOC_HOST_PTR,
-                                                       sizeof(int) * totalEdgeCount, traversedEdgeCountArray, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    hostSourceArrayBuffer = clCreateBuffer(gpuContext, CL_MEM_COPY_HOST_PTR | CL_MEM_ALLOC_HOST_PTR,
-                                           sizeof(int) * totalVertexCount, graph->sourceArray, &errNum);
-    
-    checkError(errNum, CL_SUCCESS);
-    hostParentCountArrayBuffer = clCreateBuffer(gpuContext, CL_MEM_COPY_HOST_PTR | CL_MEM_ALLOC_HOST_PTR,
-                                                sizeof(int) * totalVertexCount, parentCountArray, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    hostMaxVertexArrayBuffer = clCreateBuffer(gpuContext, CL_MEM_COPY_HOST_PTR | CL_MEM_ALLOC_HOST_PTR,
-                                              sizeof(int) * totalVertexCount, maxVertexArray, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    
-    // Now create all of the GPU buffers
-    *vertexArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_ONLY, sizeof(int) * graph->vertexCount, NULL, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    *inverseVertexArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_ONLY, sizeof(int) * graph->vertexCount, NULL, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    *edgeArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_ONLY, sizeof(int) * graph->edgeCount, NULL, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    *inverseEdgeArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_ONLY, sizeof(int) * graph->edgeCount, NULL, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    *weightArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_ONLY, sizeof(int) * totalEdgeCount, NULL, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    *inverseWeightArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_ONLY, sizeof(int) * totalEdgeCount, NULL, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    *maskArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_WRITE, sizeof(int) * totalVertexCount, NULL, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    *maxCostArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_WRITE, sizeof(int) * totalVertexCount, NULL, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    *maxUpdatingCostArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_WRITE, sizeof(int) * totalVertexCount, NULL, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    *sumCostArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_WRITE, sizeof(int) * totalVertexCount, NULL, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    *sumUpdatingCostArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_WRITE, sizeof(int) * totalVertexCount, NULL, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    *parentCountArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_WRITE, sizeof(int) * totalVertexCount, NULL, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    *maxVertexArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_WRITE, sizeof(int) * totalVertexCount, NULL, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    *traversedEdgeArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_WRITE, sizeof(int) * totalEdgeCount, NULL, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    *sourceArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_WRITE, sizeof(int) * totalVertexCount, NULL, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    *shortestParentsArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_WRITE, sizeof(int) * totalEdgeCount, NULL, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    
-    
-    //
-    
-    // Now queue up the data to be copied to the device
-    errNum = clEnqueueCopyBuffer(commandQueue, hostVertexArrayBuffer, *vertexArrayDevice, 0, 0,
-                                 sizeof(int) * graph->vertexCount, 0, NULL, NULL);
-    checkError(errNum, CL_SUCCESS);
-    
-    errNum = clEnqueueCopyBuffer(commandQueue, hostInverseVertexArrayBuffer, *inverseVertexArrayDevice, 0, 0,
-                                 sizeof(int) * graph->vertexCount, 0, NULL, NULL);
-    checkError(errNum, CL_SUCCESS);
-    
-    errNum = clEnqueueCopyBuffer(commandQueue, hostEdgeArrayBuffer, *edgeArrayDevice, 0, 0,
-                                 sizeof(int) * graph->edgeCount, 0, NULL, NULL);
-    checkError(errNum, CL_SUCCESS);
-    
-    errNum = clEnqueueCopyBuffer(commandQueue, hostInverseEdgeArrayBuffer, *inverseEdgeArrayDevice, 0, 0,
-                                 sizeof(int) * graph->edgeCount, 0, NULL, NULL);
-    checkError(errNum, CL_SUCCESS);
-    
-    errNum = clEnqueueCopyBuffer(commandQueue, hostWeightArrayBuffer, *weightArrayDevice, 0, 0,
-                                 sizeof(int) * totalEdgeCount, 0, NULL, NULL);
-    checkError(errNum, CL_SUCCESS);
-    
-    errNum = clEnqueueCopyBuffer(commandQueue, hostInverseWeightArrayBuffer, *inverseWeightArrayDevice, 0, 0,
-                                 sizeof(int) * totalEdgeCount, 0, NULL, NULL);
-    checkError(errNum, CL_SUCCESS);
-    
-    errNum = clEnqueueCopyBuffer(commandQueue, hostParentCountArrayBuffer, *parentCountArrayDevice, 0, 0,
-                                 sizeof(int) * totalVertexCount, 0, NULL, NULL);
-    checkError(errNum, CL_SUCCESS);
-    
-    errNum = clEnqueueCopyBuffer(commandQueue, hostMaxVertexArrayBuffer, *maxVertexArrayDevice, 0, 0,
-                                 sizeof(int) * totalVertexCount, 0, NULL, NULL);
-    checkError(errNum, CL_SUCCESS);
-    
-    errNum = clEnqueueCopyBuffer(commandQueue, hostTraversedEdgeCountArrayBuffer, *traversedEdgeArrayDevice, 0, 0,
-                                 sizeof(int) * graph->edgeCount, 0, NULL, NULL);
-    checkError(errNum, CL_SUCCESS);
-    
-    errNum = clEnqueueCopyBuffer(commandQueue, hostSourceArrayBuffer, *sourceArrayDevice, 0, 0,
-                                 sizeof(int) * totalVertexCount, 0, NULL, NULL);
-    if (errNum != CL_SUCCESS)
-    {
-        printf("Error: Failed to enqueue buffer!\n");
-        exit(1);
+WeightModel* createConfiguredWeightModel(GraphData *graph) {
+    DistributionType type;
+    float parameter1, parameter2;
+    if (weightDistribution == NULL || !parseDistribution(weightDistribution, &type, &parameter1, &parameter2)) {
+        return NULL;
     }
-    checkError(errNum, CL_SUCCESS);
-    
-    free(traversedEdgeCountArray);
-    free(aggregatedWeightArray);
-    free(parentCountArray);
-    free(maxVertexArray);
-    clReleaseMemObject(hostVertexArrayBuffer);
-    clReleaseMemObject(hostInverseVertexArrayBuffer);
-    clReleaseMemObject(hostEdgeArrayBuffer);
-    clReleaseMemObject(hostInverseEdgeArrayBuffer);
-    clReleaseMemObject(hostWeightArrayBuffer);
-    clReleaseMemObject(hostInverseWeightArrayBuffer);
-    clReleaseMemObject(hostAggregatedWeightArrayBuffer);
-    clReleaseMemObject(hostTraversedEdgeCountArrayBuffer);
-    clReleaseMemObject(hostParentCountArrayBuffer);
-    clReleaseMemObject(hostMaxVertexArrayBuffer);
-    clReleaseMemObject(hostSourceArrayBuffer);
+    return createWeightModel(graph->edgeCount, weightSeed, type, parameter1, parameter2);
 }
 
-
 ///
-/// Load and build an OpenCL program from source file
-/// \param gpuContext GPU context on which to load and build the program
-/// \param fileName File name of source file that holds the kernels
-/// \return Handle to the program
+/// Create an OpenCL cluster for graph, on the default device or on all devices, configured from the command line
 ///
-cl_program loadAndBuildProgram( cl_context gpuContext, const char *fileName )
-{
-    pthread_mutex_lock(&mutex1);
-    
-    cl_int errNum;
-    cl_program program;
-    
-    // Load the OpenCL source code from the .cl file
-    std::ifstream kernelFile(fileName, std::ios::in);
-    if (!kernelFile.is_open())
-    {
-        std::cerr << "Failed to open file for reading: " << fileName << std::endl;
-        return NULL;
+OCLCluster* createConfiguredCluster(GraphData *graph, WeightModel *weightModel) {
+    OCLCluster *cluster = createOCLCluster(graph, useAllDevices);
+    for (int iSession = 0; iSession < cluster->sessionCount; iSession++) {
+        OCLSession *session = cluster->sessionArray[iSession];
+        session->useWorklist = useWorklist;
+        session->useDegreeBuckets = useDegreeBuckets;
+        session->useLevels = session->useLevels && useTopologicalLevels;
+        setOCLInterleavedLayout(session, useInterleavedLayout);
+        setOCLSpecialization(session, !useGenericKernels);
+        setOCLResults(session, !computeCostsOnly, !computeCostsOnly);
+        if (profiler != NULL) {
+            setOCLProfiler(session, profiler, iSession);
+        }
     }
-    
-    std::ostringstream oss;
-    oss << kernelFile.rdbuf();
-    
-    std::string srcStdStr = oss.str();
-    const char *source = srcStdStr.c_str();
-    
-    checkError(source != NULL, true);
-    
-    // Create the program for all GPUs in the context
-    program = clCreateProgramWithSource(gpuContext, 1, (const char **)&source, NULL, &errNum);
-    checkError(errNum, CL_SUCCESS);
-    // build the program for all devices on the context
-    errNum = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-    if (errNum != CL_SUCCESS)
-    {
-        char cBuildLog[20240];
-        clGetProgramBuildInfo(program, getFirstDev(gpuContext), CL_PROGRAM_BUILD_LOG,
-                              sizeof(cBuildLog), cBuildLog, NULL );
-        
-        cerr << cBuildLog << endl;
-        printf("%i\n\n", errNum);
-        checkError(errNum, CL_SUCCESS);
+    if (weightModel != NULL) {
+        setOCLClusterWeightModel(cluster, weightModel);
     }
-    
-    pthread_mutex_unlock(&mutex1);
-    return program;
-}
-
-///
-/// Gets the id of the first device from the context (from the NVIDIA SDK)
-///
-cl_device_id getFirstDev(cl_context cxGPUContext)
-{
-    size_t szParmDataBytes;
-    cl_device_id* cdDevices;
-    
-    // get the list of GPU devices associated with context
-    clGetContextInfo(cxGPUContext, CL_CONTEXT_DEVICES, 0, NULL, &szParmDataBytes);
-    cdDevices = (cl_device_id*) malloc(szParmDataBytes);
-    
-    clGetContextInfo(cxGPUContext, CL_CONTEXT_DEVICES, szParmDataBytes, cdDevices, NULL);
-    
-    cl_device_id first = cdDevices[0];
-    free(cdDevices);
-    
-    return first;
+    return cluster;
 }
 
-
 ///
-/// Check whether the mask array is empty.  This tells the algorithm whether
-/// it needs to continue running or not.
+/// Compute costArray, sumCostArray and shortestParentsArray with the backend selected at runtime. The OpenCL
+/// backend runs on cluster if one is given, and sets up and tears down its own otherwise. If weightModel is
+/// given, the weights are drawn from it by the backend, and the weight arrays of graph are left as they were
+/// by the OpenCL backend.
 ///
-bool maskArrayEmpty(int *maskArray, int count)
-{
-    for(int i = 0; i < count; i++ )
-    {
-        if (maskArray[i] == 1)
-        {
-            return false;
+void computeGraphs(GraphData *graph, OCLCluster *cluster, WeightModel *weightModel, bool debug) {
+    if (computeBackend == BACKEND_CPU) {
+        if (weightModel != NULL) {
+            sampleWeightsOnCPU(graph, weightModel);
         }
+        calculateGraphsOnCPU(graph, defaultThreadPool(), !computeCostsOnly, !computeCostsOnly, debug);
     }
-    
-    return true;
-}
-
-
-int  initializeComputing(cl_device_id *device_id, cl_context *context, cl_command_queue *commands, cl_program *program) {
-    // Connect to a compute device
-    //
-    int gpu = 1;
-    int err = clGetDeviceIDs(NULL, gpu ? CL_DEVICE_TYPE_GPU : CL_DEVICE_TYPE_CPU, 1, device_id, NULL);
-    if (err != CL_SUCCESS)
-    {
-        printf("Error: Failed to create a device group!\n");
-        return EXIT_FAILURE;
-    }
-    
-    // Create a compute context
-    //
-    *context = clCreateContext(0, 1, device_id, NULL, NULL, &err);
-    if (!context)
-    {
-        printf("Error: Failed to create a compute context!\n");
-        return EXIT_FAILURE;
-    }
-    
-    // Create a command commands
-    //
-    *commands = clCreateCommandQueue(*context, *device_id, CL_QUEUE_PROFILING_ENABLE, &err);
-    if (!commands)
-    {
-        printf("Error: Failed to create a command commands!\n");
-        return EXIT_FAILURE;
-    }
-    
-    // Create the compute program from the source file
-    *program = loadAndBuildProgram(*context, kernelPath);
-    if (!program)
-    {
-        printf("Error: Failed to create compute program!\n");
-        return EXIT_FAILURE;
-    }
-    
-    // Build the program executable
-    //
-    err = clBuildProgram(*program, 0, NULL, NULL, NULL, NULL);
-    if (err != CL_SUCCESS)
-    {
-        size_t len;
-        char buffer[2048];
-        
-        printf("Error: Failed to build program executable!\n");
-        clGetProgramBuildInfo(*program, *device_id, CL_PROGRAM_BUILD_LOG, sizeof(buffer), buffer, &len);
-        printf("%s\n", buffer);
-        exit(1);
+    else if (cluster != NULL) {
+        runOCLCluster(cluster, graph, debug);
+    }
+    else {
+        cluster = createConfiguredCluster(graph, weightModel);
+        runOCLCluster(cluster, graph, debug);
+        releaseOCLCluster(cluster);
     }
-    
-    return err;
 }
 
-int createKernels(cl_kernel *initializeKernel, cl_kernel *ssspKernel1, cl_kernel *ssspKernel2, cl_kernel *shortestParentsKernel, cl_program *program) {
-    
-    int errNum;
-    
-    // Create the compute kernel in the program we wish to run
-    *initializeKernel = clCreateKernel(*program, "initializeBuffers", &errNum);
-    if (!initializeKernel || errNum != CL_SUCCESS)
-    {
-        printf("Error: Failed to create initializeKernel initializeBuffers!\n");
-        exit(1);
+///
+/// Check the incremental updates of the selected backend against a full computation. The samples of graph are
+/// computed, changeCount random weights, raised and lowered alike, are changed and the results updated with
+/// updateOCLCluster or updateGraphsOnCPU, and these are then compared with those of computeGraphs for the new
+/// weights. The weights of graph are left as they were.
+///
+void testWeightUpdates(GraphData *graph, int changeCount) {
+    GraphData updated = copyGraphSamples(graph);
+    OCLCluster *cluster = (computeBackend == BACKEND_OPENCL) ? createConfiguredCluster(&updated, NULL) : NULL;
+    computeGraphs(&updated, cluster, NULL, false);
+    
+    WeightChange *changeArray = (WeightChange*) malloc(changeCount * sizeof(WeightChange));
+    for (int iChange = 0; iChange < changeCount; iChange++) {
+        changeArray[iChange].sample = rand() % graph->graphCount;
+        changeArray[iChange].edge = rand() % graph->edgeCount;
+        changeArray[iChange].weight = rand() % 1000;
     }
-    
-    // Kernel 1
-    *ssspKernel1 = clCreateKernel(*program, "OCL_SSSP_KERNEL1", &errNum);
-    if (!ssspKernel1 || errNum != CL_SUCCESS)
-    {
-        printf("Error: Failed to create ssspKernel1 initializeBuffers!\n");
-        exit(1);
+    printf("Checking incremental updates of %i weights against a full computation.\n", changeCount);
+    if (cluster != NULL) {
+        updateOCLCluster(cluster, &updated, changeArray, changeCount, false);
+    }
+    else {
+        updateGraphsOnCPU(&updated, changeArray, changeCount, defaultThreadPool(), false);
     }
     
-    // Kernel 2
-    *ssspKernel2 = clCreateKernel(*program, "OCL_SSSP_KERNEL2", &errNum);
-    if (!ssspKernel2 || errNum != CL_SUCCESS)
-    {
-        printf("Error: Failed to create ssspKernel2 initializeBuffers!\n");
-        exit(1);
+    GraphData full = copyGraphSamples(&updated);
+    computeGraphs(&full, cluster, NULL, false);
+    long totalVertexCount = (long)graph->graphCount * graph->vertexCount;
+    long totalEdgeCount = (long)graph->graphCount * graph->edgeCount;
+    int iErrors = 0;
+    for (long i = 0; i < totalVertexCount; i++) {
+        if (updated.costArray[i] != full.costArray[i] || (!computeCostsOnly && updated.sumCostArray[i] != full.sumCostArray[i])) {
+            iErrors++;
+        }
     }
-
-    // Shortest parent kernel
-    *shortestParentsKernel = clCreateKernel(*program, "SHORTEST_PARENTS", &errNum);
-    if (!shortestParentsKernel || errNum != CL_SUCCESS)
-    {
-        printf("Error: Failed to create ssspKernel2 initializeBuffers!\n");
-        exit(1);
+    for (long i = 0; i < totalEdgeCount && !computeCostsOnly; i++) {
+        if (updated.shortestParentsArray[i] != full.shortestParentsArray[i]) {
+            iErrors++;
+        }
     }
-return errNum;
-}
-
-
-int setKernelArguments(cl_kernel *initializeKernel, cl_kernel *ssspKernel1, cl_kernel *ssspKernel2, cl_kernel *shortestParentsKernel, int graphCount, int vertexCount, int edgeCount, int sourceCount,  cl_mem *maskArrayDevice, cl_mem *vertexArrayDevice, cl_mem *inverseVertexArrayDevice, cl_mem *edgeArrayDevice, cl_mem *inverseEdgeArrayDevice, cl_mem *maxCostArrayDevice, cl_mem *maxUpdatingCostArrayDevice, cl_mem *sumCostArrayDevice, cl_mem *sumUpdatingCostArrayDevice, cl_mem *sourceArrayDevice, cl_mem *weightArrayDevice, cl_mem *inverseWeightArrayDevice, cl_mem *traversedEdgeCountArrayDevice, cl_mem *parentCountArrayDevice, cl_mem *maxVerticeArrayDevice, cl_mem *shortestParentsArrayDevice) {
-    
-    int totalVertexCount = graphCount*vertexCount;
-    
-    // Set the arguments to initializeKernel
-    //
-    int errNum = 0;
-    errNum |= clSetKernelArg(*initializeKernel, 0, sizeof(cl_mem), maskArrayDevice);
-    errNum |= clSetKernelArg(*initializeKernel, 1, sizeof(cl_mem), maxCostArrayDevice);
-    errNum |= clSetKernelArg(*initializeKernel, 2, sizeof(cl_mem), maxUpdatingCostArrayDevice);
-    errNum |= clSetKernelArg(*initializeKernel, 3, sizeof(cl_mem), sumCostArrayDevice);
-    errNum |= clSetKernelArg(*initializeKernel, 4, sizeof(cl_mem), sumUpdatingCostArrayDevice);
-    errNum |= clSetKernelArg(*initializeKernel, 5, sizeof(int), &vertexCount);
-    errNum |= clSetKernelArg(*initializeKernel, 6, sizeof(int), &sourceCount);
-    errNum |= clSetKernelArg(*initializeKernel, 7, sizeof(cl_mem), sourceArrayDevice);
-    errNum |= clSetKernelArg(*initializeKernel, 8, sizeof(cl_mem), shortestParentsArrayDevice);
-    
-    // Set the arguments to ssspKernel1
-    errNum |= clSetKernelArg(*ssspKernel1, 0, sizeof(cl_mem), vertexArrayDevice);
-    errNum |= clSetKernelArg(*ssspKernel1, 1, sizeof(cl_mem), inverseVertexArrayDevice);
-    errNum |= clSetKernelArg(*ssspKernel1, 2, sizeof(cl_mem), edgeArrayDevice);
-    errNum |= clSetKernelArg(*ssspKernel1, 3, sizeof(cl_mem), inverseEdgeArrayDevice);
-    errNum |= clSetKernelArg(*ssspKernel1, 4, sizeof(cl_mem), weightArrayDevice);
-    errNum |= clSetKernelArg(*ssspKernel1, 5, sizeof(cl_mem), inverseWeightArrayDevice);
-    errNum |= clSetKernelArg(*ssspKernel1, 6, sizeof(cl_mem), maskArrayDevice);
-    errNum |= clSetKernelArg(*ssspKernel1, 7, sizeof(cl_mem), maxCostArrayDevice);
-    errNum |= clSetKernelArg(*ssspKernel1, 8, sizeof(cl_mem), maxUpdatingCostArrayDevice);
-    errNum |= clSetKernelArg(*ssspKernel1, 9, sizeof(cl_mem), sumCostArrayDevice);
-    errNum |= clSetKernelArg(*ssspKernel1, 10, sizeof(cl_mem), sumUpdatingCostArrayDevice);
-    errNum |= clSetKernelArg(*ssspKernel1, 11, sizeof(int), &vertexCount);
-    errNum |= clSetKernelArg(*ssspKernel1, 12, sizeof(int), &edgeCount);
-    errNum |= clSetKernelArg(*ssspKernel1, 13, sizeof(cl_mem), traversedEdgeCountArrayDevice);
-    errNum |= clSetKernelArg(*ssspKernel1, 14, sizeof(cl_mem), parentCountArrayDevice);
-    errNum |= clSetKernelArg(*ssspKernel1, 15, sizeof(cl_mem), maxVerticeArrayDevice);
-    errNum |= clSetKernelArg(*ssspKernel1, 16, sizeof(cl_mem), shortestParentsArrayDevice);
-    
-    // Set the arguments to ssspKernel2
-    errNum |= clSetKernelArg(*ssspKernel2, 0, sizeof(cl_mem), vertexArrayDevice);
-    errNum |= clSetKernelArg(*ssspKernel2, 1, sizeof(cl_mem), edgeArrayDevice);
-    errNum |= clSetKernelArg(*ssspKernel2, 2, sizeof(cl_mem), weightArrayDevice);
-    errNum |= clSetKernelArg(*ssspKernel2, 3, sizeof(cl_mem), maskArrayDevice);
-    errNum |= clSetKernelArg(*ssspKernel2, 4, sizeof(cl_mem), maxCostArrayDevice);
-    errNum |= clSetKernelArg(*ssspKernel2, 5, sizeof(cl_mem), maxUpdatingCostArrayDevice);
-    errNum |= clSetKernelArg(*ssspKernel2, 6, sizeof(cl_mem), sumCostArrayDevice);
-    errNum |= clSetKernelArg(*ssspKernel2, 7, sizeof(cl_mem), sumUpdatingCostArrayDevice);
-    errNum |= clSetKernelArg(*ssspKernel2, 8, sizeof(int), &totalVertexCount);
-    errNum |= clSetKernelArg(*ssspKernel2, 9, sizeof(cl_mem), maxVerticeArrayDevice);
-
-    // Set the arguments to shortestParentsKernel
-    errNum |= clSetKernelArg(*shortestParentsKernel, 0, sizeof(int), &vertexCount);
-    errNum |= clSetKernelArg(*shortestParentsKernel, 1, sizeof(int), &edgeCount);
-    errNum |= clSetKernelArg(*shortestParentsKernel, 2, sizeof(cl_mem), vertexArrayDevice);
-    errNum |= clSetKernelArg(*shortestParentsKernel, 3, sizeof(cl_mem), inverseVertexArrayDevice);
-    errNum |= clSetKernelArg(*shortestParentsKernel, 4, sizeof(cl_mem), edgeArrayDevice);
-    errNum |= clSetKernelArg(*shortestParentsKernel, 5, sizeof(cl_mem), inverseEdgeArrayDevice);
-    errNum |= clSetKernelArg(*shortestParentsKernel, 6, sizeof(cl_mem), weightArrayDevice);
-    errNum |= clSetKernelArg(*shortestParentsKernel, 7, sizeof(cl_mem), inverseWeightArrayDevice);
-    errNum |= clSetKernelArg(*shortestParentsKernel, 8, sizeof(cl_mem), maxCostArrayDevice);
-    errNum |= clSetKernelArg(*shortestParentsKernel, 9, sizeof(cl_mem), maxUpdatingCostArrayDevice);
-    errNum |= clSetKernelArg(*shortestParentsKernel, 10, sizeof(cl_mem), maxVerticeArrayDevice);
-    errNum |= clSetKernelArg(*shortestParentsKernel, 11, sizeof(cl_mem), shortestParentsArrayDevice);
-
-    if (errNum != CL_SUCCESS)
-    {
-        printf("Error: Failed to set kernel arguments! %d\n", errNum);
+    printf("%i errors.\n", iErrors);
+    
+    if (cluster != NULL) {
+        releaseOCLCluster(cluster);
     }
-    return errNum;
+    releaseGraphSamples(&full);
+    releaseGraphSamples(&updated);
+    free(changeArray);
 }
 
-void calculateGraphs(GraphData *graph, bool debug) {
-    
-    
-    int errNum;                            // error code returned from api calls
-    size_t global;                      // global domain size for our calculation
+void testRandomGraphs(int graphSetCount, int graphCount, int sourceCount, int verticeCount, int edgePerVerticeCount, float probOfMax) {
     
-    cl_device_id device_id;             // compute device id
-    cl_context context;                 // compute context
-    cl_command_queue commandQueue;          // compute command queue
-    cl_program program;                 // compute program
-    cl_kernel initializeKernel;                   // compute kernel
-    cl_kernel ssspKernel1;
-    cl_kernel ssspKernel2;
-    cl_kernel shortestParentsKernel;
-    cl_event readDone;
-    cl_event kernel1event, kernel2event;
+    GraphData graph;
     
-    cl_mem vertexArrayDevice;                       // device memory used for the input array
-    cl_mem inverseVertexArrayDevice;                       // device memory used for the input array
-    cl_mem edgeArrayDevice;                       // device memory used for the input array
-    cl_mem inverseEdgeArrayDevice;                       // device memory used for the input array
-    cl_mem weightArrayDevice;                       // device memory used for the input array
-    cl_mem inverseWeightArrayDevice;                       // device memory used for the input array
-    cl_mem maskArrayDevice;                       // device memory used for the input array
-    cl_mem maxCostArrayDevice;                       // device memory used for the input array
-    cl_mem maxUpdatingCostArrayDevice;                       // device memory used for the input array
-    cl_mem sumCostArrayDevice;                       // device memory used for the input array
-    cl_mem sumUpdatingCostArrayDevice;                       // device memory used for the input array
-    cl_mem traversedEdgeCountArrayDevice;
-    cl_mem sourceArrayDevice;
-    cl_mem parentCountArrayDevice;
-    cl_mem maxVerticeArrayDevice;
-    cl_mem shortestParentsArrayDevice;
+    printf("Performing tests on randomly generated graphs.\n");
     
+    srand(0);
+    double start = getMonotonicSeconds();
+    generateRandomGraph(&graph, verticeCount, edgePerVerticeCount, graphCount, sourceCount, probOfMax);
+    printf("Time to generate graph, including overhead: %.2f seconds.\n", getMonotonicSeconds() - start);
+    printf("%i vertices. %i attack steps per sample. %i samples divided into %i sets.\n", graph.vertexCount*graph.graphCount*graphSetCount, graph.vertexCount, graph.graphCount*graphSetCount, graphSetCount);
     
-    int totalVertexCount = graph->graphCount * graph->vertexCount;
-    int totalEdgeCount = graph->graphCount * graph->edgeCount;
-    int *maskArrayHost = (int*) malloc(sizeof(int) * totalVertexCount);
+    start = getMonotonicSeconds();
+    // The costs of each set are folded into per-vertex statistics, so memory does not grow with the set count
+    VertexStatistics *maxCostStatistics = createVertexStatistics(graph.vertexCount, STATISTICS_DEFAULT_BUCKETS_PER_OCTAVE);
+    VertexStatistics *sumCostStatistics = createVertexStatistics(graph.vertexCount, STATISTICS_DEFAULT_BUCKETS_PER_OCTAVE);
     
+    // All graph sets share the topology, so the OpenCL setup is only done once
+    WeightModel *weightModel = createConfiguredWeightModel(&graph);
+    OCLCluster *cluster = NULL;
+    if (computeBackend == BACKEND_OPENCL) {
+        cluster = createConfiguredCluster(&graph, weightModel);
+    }
     
-    // Set up OpenCL computing environment, getting GPU device ID, command queue, context, and program
-    initializeComputing(&device_id, &context, &commandQueue, &program);
+    // With the OpenCL backend, set k+1 is prepared and uploaded and set k-1 is read back and reduced while set k
+    // computes. Every set in flight has per-sample arrays of its own, the first those of graph.
+    int depth = (cluster != NULL) ? pipelineDepth : 1;
+    if (depth > graphSetCount) {
+        depth = graphSetCount > 0 ? graphSetCount : 1;
+    }
+    GraphData setArray[OCL_MAX_PIPELINE_DEPTH];
+    setArray[0] = graph;
+    for (int iSlot = 1; iSlot < depth; iSlot++) {
+        setArray[iSlot] = copyGraphSamples(&graph);
+    }
+    if (cluster != NULL) {
+        setOCLClusterPipelineDepth(cluster, depth);
+    }
     
-    // Create kernels from the program (kernel.cl)
-    createKernels(&initializeKernel, &ssspKernel1, &ssspKernel2, &shortestParentsKernel, &program);
+    for (int iGraphSet = 0; iGraphSet < graphSetCount + depth - 1; iGraphSet++) {
+        if (iGraphSet < graphSetCount) {
+            GraphData *set = &setArray[iGraphSet % depth];
+            if (weightModel != NULL) {
+                weightModel->sampleOffset = iGraphSet * graph.graphCount;
+            }
+            else {
+                updateGraphWithNewRandomWeights(set);
+            }
+            if (depth > 1) {
+                enqueueOCLCluster(cluster, set, iGraphSet % depth, false);
+            }
+            else {
+                computeGraphs(set, cluster, weightModel, false);
+            }
+        }
+        int iDoneSet = iGraphSet - (depth - 1);
+        if (iDoneSet >= 0) {
+            GraphData *set = &setArray[iDoneSet % depth];
+            if (depth > 1) {
+                finishOCLCluster(cluster, iDoneSet % depth);
+            }
+            accumulateVertexStatistics(maxCostStatistics, set->costArray, set->graphCount);
+            if (!computeCostsOnly) {
+                accumulateVertexStatistics(sumCostStatistics, set->sumCostArray, set->graphCount);
+            }
+        }
+    }
     
-    // Allocate buffers in Device memory
-    allocateOCLBuffers(context, commandQueue, graph, &vertexArrayDevice, &inverseVertexArrayDevice, &edgeArrayDevice, &inverseEdgeArrayDevice, &weightArrayDevice, &inverseWeightArrayDevice, &maskArrayDevice, &maxCostArrayDevice, &maxUpdatingCostArrayDevice, &sumCostArrayDevice, &sumUpdatingCostArrayDevice, &traversedEdgeCountArrayDevice, &sourceArrayDevice, &parentCountArrayDevice, &maxVerticeArrayDevice, &shortestParentsArrayDevice);
+    // The results of the last set are checked below
+    GraphData lastSet = setArray[(graphSetCount - 1 + depth) % depth];
+    if (cluster != NULL) {
+        releaseOCLCluster(cluster);
+        // The weights of the last set were only drawn on the device. Draw them again for the comparison below.
+        if (weightModel != NULL) {
+            sampleWeightsOnCPU(&lastSet, weightModel);
+        }
+    }
+    if (weightModel != NULL) {
+        releaseWeightModel(weightModel);
+    }
+    printf("\nTime to calculate graph, including overhead: %.2f seconds.\n", getMonotonicSeconds() - start);
     
-    // Setting the kernel arguments
-    errNum = setKernelArguments(&initializeKernel, &ssspKernel1, &ssspKernel2, &shortestParentsKernel, graph->graphCount, graph->vertexCount, graph->edgeCount, graph->sourceCount, &maskArrayDevice, &vertexArrayDevice, &inverseVertexArrayDevice, &edgeArrayDevice, &inverseEdgeArrayDevice, &maxCostArrayDevice, &maxUpdatingCostArrayDevice, &sumCostArrayDevice, &sumUpdatingCostArrayDevice, &sourceArrayDevice, &weightArrayDevice, &inverseWeightArrayDevice, &traversedEdgeCountArrayDevice, &parentCountArrayDevice, &maxVerticeArrayDevice, &shortestParentsArrayDevice);
+    printVertexStatistics(maxCostStatistics, "Max cost", 10);
+    if (!computeCostsOnly) {
+        printVertexStatistics(sumCostStatistics, "Sum cost", 10);
+    }
+    releaseVertexStatistics(maxCostStatistics);
+    releaseVertexStatistics(sumCostStatistics);
     
-    // Execute the kernel over the entire range of our 1d input data set
-    // using the maximum number of work group items for this device
-    //
-    global = totalVertexCount;
+    if (!computeCostsOnly) {
+        maxSumDifference(&lastSet);
+    }
+    compareToCPUComputation(&lastSet, false, verifiedSampleCount);
+    testWeightUpdates(&lastSet, 100);
+    for (int iSlot = 1; iSlot < depth; iSlot++) {
+        releaseGraphSamples(&setArray[iSlot]);
+    }
+    //printMathematicaString(&graph, 0, false);
     
-    errNum = clEnqueueNDRangeKernel(commandQueue, initializeKernel, 1, NULL, &global, NULL, 0, NULL, NULL);
-    checkError(errNum, CL_SUCCESS);
     
     
     
-    errNum = clEnqueueReadBuffer( commandQueue, maskArrayDevice, CL_FALSE, 0, sizeof(int) * totalVertexCount, maskArrayHost, 0, NULL, &readDone);
-    checkError(errNum, CL_SUCCESS);
     
-    clWaitForEvents(1, &readDone);
+}
+
+///
+/// Time runCount runs of the OpenCL iteration modes on a power-law graph, where a few hub vertices have most of
+/// the edges: the worklist with one work-item per frontier vertex, the worklist with degree buckets, and the
+/// topological levels.
+///
+void benchmarkPowerLawGraphs(int graphCount, int vertexCount, int neighborsPerVertex, float exponent, int runCount) {
+    GraphData graph;
+    GeneratorConfig config;
+    initializeGeneratorConfig(&config, TOPOLOGY_POWER_LAW, vertexCount, neighborsPerVertex, graphCount, 10);
+    config.powerLawExponent = exponent;
+    generateGraph(&graph, &config, defaultThreadPool());
+    completeReadGraph(&graph);
+    int highestDegree = 0;
+    for (int iVertex = 0; iVertex < graph.vertexCount; iVertex++) {
+        int degree = getEdgeEnd(iVertex, graph.vertexCount, graph.vertexArray, graph.edgeCount) - graph.vertexArray[iVertex];
+        if (degree > highestDegree) {
+            highestDegree = degree;
+        }
+    }
+    printf("Power-law graph with exponent %.2f: %i vertices, %i edges, highest out-degree %i, %i samples.\n", exponent, graph.vertexCount, graph.edgeCount, highestDegree, graph.graphCount);
     
-    int count = 0;
-    while(!maskArrayEmpty(maskArrayHost, totalVertexCount))
-    {
-        
-        // In order to improve performance, we run some number of iterations
-        // without reading the results.  This might result in running more iterations
-        // than necessary at times, but it will in most cases be faster because
-        // we are doing less stalling of the GPU waiting for results.
-        
-        for(int asyncIter = 0; asyncIter < NUM_ASYNCHRONOUS_ITERATIONS; asyncIter++)
-        {
-            count ++;
-            
-            errNum = clEnqueueNDRangeKernel(commandQueue, ssspKernel1, 1, 0, &global, NULL, 0, NULL, &kernel1event);
-            checkError(errNum, CL_SUCCESS);
-            
-            errNum = clEnqueueNDRangeKernel(commandQueue, ssspKernel2, 1, 0, &global, NULL, 0, NULL, &kernel2event);
-            checkError(errNum, CL_SUCCESS);
-            
+    OCLSession *session = createOCLSession(&graph);
+    if (profiler != NULL) {
+        setOCLProfiler(session, profiler, 0);
+    }
+    const char *modeNameArray[] = {"Worklist, one work-item per vertex", "Worklist, degree buckets", "Topological levels"};
+    for (int iMode = 0; iMode < 3; iMode++) {
+        session->useWorklist = iMode < 2;
+        session->useDegreeBuckets = iMode == 1;
+        session->useLevels = iMode == 2;
+        // The first run includes building the kernels' device code on some platforms
+        runOCLSession(session, &graph, false);
+        double start = getMonotonicSeconds();
+        for (int iRun = 0; iRun < runCount; iRun++) {
+            runOCLSession(session, &graph, false);
         }
+        printf("%s: %.2f ms per run.\n", modeNameArray[iMode], 1000 * (getMonotonicSeconds() - start) / runCount);
+        compareToCPUComputation(&graph, false, verifiedSampleCount);
+    }
+    releaseOCLSession(session);
+}
+
+///
+/// Time the standard workloads of getStandardWorkloads on the selected backend, each after BENCHMARK_WARMUP_COUNT
+/// untimed runs, which include building the kernels' device code on some platforms. The results are written as
+/// JSON to outputPath and compared to baselinePath, if given. Returns the number of regressions against the
+/// baseline, or -1 if the results cannot be written or the baseline cannot be compared to.
+///
+int runBenchmarks(const char *outputPath, const char *baselinePath) {
+    const BenchmarkWorkload *workloadArray;
+    int workloadCount = getStandardWorkloads(&workloadArray);
+    BenchmarkResult *resultArray = (BenchmarkResult*) calloc(workloadCount, sizeof(BenchmarkResult));
+    for (int iWorkload = 0; iWorkload < workloadCount; iWorkload++) {
+        BenchmarkResult *result = &resultArray[iWorkload];
+        result->workload = &workloadArray[iWorkload];
+        printf("Benchmarking %s...\n", result->workload->name);
         
-        errNum = clEnqueueReadBuffer(commandQueue, maskArrayDevice, CL_FALSE, 0, sizeof(int) * totalVertexCount, maskArrayHost, 0, NULL, &readDone);
-        checkError(errNum, CL_SUCCESS);
-        clWaitForEvents(1, &readDone);
+        GraphData graph;
+        GeneratorConfig config;
+        double start = getMonotonicSeconds();
+        generateBenchmarkGraph(&graph, result->workload, &config);
+        result->generateSeconds = getMonotonicSeconds() - start;
+        result->edgeCount = graph.edgeCount;
+        result->levelCount = graph.levelCount;
+        result->cyclicLevelCount = graph.cyclicLevelCount;
         
+        start = getMonotonicSeconds();
+        OCLCluster *cluster = (computeBackend == BACKEND_OPENCL) ? createConfiguredCluster(&graph, NULL) : NULL;
+        result->setupSeconds = getMonotonicSeconds() - start;
+        
+        result->repetitionCount = BENCHMARK_REPETITION_COUNT;
+        for (int iRun = -BENCHMARK_WARMUP_COUNT; iRun < result->repetitionCount; iRun++) {
+            // Every repetition draws its weights from a seed of its own, the same on every run
+            start = getMonotonicSeconds();
+            config.seed++;
+            generateWeights(&graph, &config, defaultThreadPool());
+            double weightSeconds = getMonotonicSeconds() - start;
+            start = getMonotonicSeconds();
+            computeGraphs(&graph, cluster, NULL, false);
+            if (iRun >= 0) {
+                result->weightSecondsArray[iRun] = weightSeconds;
+                result->computeSecondsArray[iRun] = getMonotonicSeconds() - start;
+            }
+        }
+        if (cluster != NULL) {
+            releaseOCLCluster(cluster);
+        }
+        releaseGraph(&graph);
     }
-    // Wait for the command commands to get serviced before reading back results
-    clFinish(commandQueue);
     
-    // Read back the results from the device to verify the output
-    
-    errNum = clEnqueueReadBuffer( commandQueue, maxCostArrayDevice, CL_TRUE, 0, sizeof(int) * totalVertexCount, graph->costArray, 0, NULL, &readDone );
-    checkError(errNum, CL_SUCCESS);
-    errNum = clEnqueueReadBuffer( commandQueue, sumCostArrayDevice, CL_TRUE, 0, sizeof(int) * totalVertexCount, graph->sumCostArray, 0, NULL, &readDone );
-    checkError(errNum, CL_SUCCESS);
-    clFinish(commandQueue);
-    
-    errNum = clEnqueueNDRangeKernel(commandQueue, shortestParentsKernel, 1, 0, &global, NULL, 0, NULL, NULL);
-    checkError(errNum, CL_SUCCESS);
-    clFinish(commandQueue);
-
-    errNum = clEnqueueReadBuffer(commandQueue, shortestParentsArrayDevice, CL_FALSE, 0, sizeof(int) * totalEdgeCount, graph->shortestParentsArray, 0, NULL, &readDone);
-    checkError(errNum, CL_SUCCESS);
-    clFinish(commandQueue);
+    printBenchmarkResults(resultArray, workloadCount);
+    const char *backendName = (computeBackend == BACKEND_CPU) ? "cpu" : "opencl";
+    int regressionCount = 0;
+    if (outputPath != NULL && !writeBenchmarkResults(resultArray, workloadCount, backendName, outputPath)) {
+        regressionCount = -1;
+    }
+    if (baselinePath != NULL && regressionCount == 0) {
+        regressionCount = compareToBenchmarkBaseline(resultArray, workloadCount, backendName, baselinePath, BENCHMARK_DEFAULT_TOLERANCE);
+    }
+    free(resultArray);
+    return regressionCount;
+}
 
+///
+/// Generate the graph described by spec (see parseGeneratorConfig), seeded by weightSeed, and write it to
+/// outputPath as a binary graph file without results. Returns false if spec is malformed or the file cannot be
+/// written.
+///
+bool generateGraphFile(const char *spec, const char *outputPath) {
+    GeneratorConfig config;
+    if (!parseGeneratorConfig(spec, &config)) {
+        printf("Unknown graph %s.\n", spec);
+        return false;
+    }
+    config.seed = weightSeed;
+    GraphData graph;
+    double start = getMonotonicSeconds();
+    generateGraph(&graph, &config, defaultThreadPool());
+    printf("Generated %i vertices, %i edges and %i sources in %i samples in %.2f seconds.\n", graph.vertexCount, graph.edgeCount, graph.sourceCount, graph.graphCount, getMonotonicSeconds() - start);
+    bool written = writeBinaryGraphFile(&graph, outputPath, false);
+    releaseGraph(&graph);
+    return written;
+}
 
-    
-    // Shutdown and cleanup
-    //
-    free(maskArrayHost);
-    
-    clReleaseMemObject(vertexArrayDevice);
-    clReleaseMemObject(inverseVertexArrayDevice);
-    clReleaseMemObject(edgeArrayDevice);
-    clReleaseMemObject(inverseEdgeArrayDevice);
-    clReleaseMemObject(weightArrayDevice);
-    clReleaseMemObject(inverseWeightArrayDevice);
-    clReleaseMemObject(maskArrayDevice);
-    clReleaseMemObject(maxCostArrayDevice);
-    clReleaseMemObject(maxUpdatingCostArrayDevice);
-    clReleaseMemObject(sumCostArrayDevice);
-    clReleaseMemObject(sumUpdatingCostArrayDevice);
-    clReleaseMemObject(traversedEdgeCountArrayDevice);
-    clReleaseMemObject(sourceArrayDevice);
-    clReleaseMemObject(parentCountArrayDevice);
-    clReleaseMemObject(maxVerticeArrayDevice);
-    
-    clReleaseProgram(program);
-    clReleaseKernel(initializeKernel);
-    clReleaseKernel(ssspKernel1);
-    clReleaseKernel(ssspKernel2);
-    clReleaseCommandQueue(commandQueue);
-    clReleaseContext(context);
-    clReleaseEvent(readDone);
-    clReleaseDevice(device_id);
-    
+///
+/// Print the time the OpenCL devices spent in each phase, and write the trace to profileTracePath, if profiling
+///
+void finishProfiling() {
+    if (profiler == NULL) {
+        return;
+    }
+    collectOCLProfile(profiler, -1, true);
+    printOCLProfileSummary(profiler);
+    if (writeOCLProfileTrace(profiler, profileTracePath)) {
+        printf("Wrote the OpenCL trace to %s.\n", profileTracePath);
+    }
+    releaseOCLProfiler(profiler);
+    profiler = NULL;
 }
 
-void testRandomGraphs(int graphSetCount, int graphCount, int sourceCount, int verticeCount, int edgePerVerticeCount, float probOfMax) {
-    
-    GraphData graph;
-    
-    printf("Performing tests on randomly generated graphs.\n");
-    
-    srand(0);
-    clock_t start_time = clock();
-    generateRandomGraph(&graph, verticeCount, edgePerVerticeCount, graphCount, sourceCount, probOfMax);
-    printf("Time to generate graph, including overhead: %.2f seconds.\n", (float)(clock()-start_time)/1000000);
-    printf("%i vertices. %i attack steps per sample. %i samples divided into %i sets.\n", graph.vertexCount*graph.graphCount*graphSetCount, graph.vertexCount, graph.graphCount*graphSetCount, graphSetCount);
-    
-    start_time = clock();
-    int *maxCostArray = (int*) malloc(graphSetCount* graph.graphCount * graph.vertexCount * sizeof(int));
-    int *sumCostArray = (int*) malloc(graphSetCount* graph.graphCount * graph.vertexCount * sizeof(int));
-    
-    for (int iGraphSet = 0; iGraphSet < graphSetCount; iGraphSet++) {
-        updateGraphWithNewRandomWeights(&graph);
-        calculateGraphs(&graph, false);
-        for (int iGlobalVertex=0; iGlobalVertex < graph.graphCount * graph.vertexCount; iGlobalVertex++) {
-            maxCostArray[iGraphSet * graph.graphCount * graph.vertexCount + iGlobalVertex] = graph.costArray[iGlobalVertex];
-            sumCostArray[iGraphSet * graph.graphCount * graph.vertexCount + iGlobalVertex] = graph.sumCostArray[iGlobalVertex];
+///
+/// Parse a comma-separated list of vertices such as "4,17,23" into targetArray, which holds vertexCount entries.
+/// Returns the number of targets, or -1 if the list is malformed or names a vertex outside the graph.
+///
+int parseTargetList(const char *list, int vertexCount, int *targetArray) {
+    int targetCount = 0;
+    const char *item = list;
+    while (*item != '\0') {
+        char *end;
+        long target = strtol(item, &end, 10);
+        if (end == item || target < 0 || target >= vertexCount || targetCount == vertexCount || (*end != ',' && *end != '\0')) {
+            return -1;
         }
+        targetArray[targetCount++] = (int)target;
+        item = (*end == ',') ? end + 1 : end;
     }
-    printf("\nTime to calculate graph, including overhead: %.2f seconds.\n", (float)(clock()-start_time)/1000000);
-    
-    maxSumDifference(&graph);
-    compareToCPUComputation(&graph, false, 10);
-    //printMathematicaString(&graph, 0, false);
-    
-    
-    
-    
-    
+    return targetCount;
+}
+
+///
+/// Rank the scenarios of scenarioFilePath by how well they keep the attacker from the vertices of targetList,
+/// over the samples of graph, on the OpenCL device
+///
+void evaluateScenarios(GraphData *graph, bool debug) {
+    int *targetArray = (int*) malloc(graph->vertexCount * sizeof(int));
+    int targetCount = targetList != NULL ? parseTargetList(targetList, graph->vertexCount, targetArray) : -1;
+    if (targetCount <= 0) {
+        printf("Scenarios need a list of target vertices in the graph, given by -targets.\n");
+        exit(1);
+    }
+    if (computeBackend != BACKEND_OPENCL) {
+        printf("Scenarios can only be evaluated by the OpenCL backend.\n");
+        exit(1);
+    }
+    ScenarioBatch *batch = readScenarioFile(graph, scenarioFilePath, targetArray, targetCount);
+    if (batch == NULL) {
+        exit(1);
+    }
+    printf("Evaluating %i scenarios...\n", batch->scenarioCount);
+    double start = getMonotonicSeconds();
+    WeightModel *weightModel = createConfiguredWeightModel(graph);
+    OCLSession *session = createOCLSession(graph);
+    if (weightModel != NULL) {
+        setOCLWeightModel(session, weightModel);
+    }
+    if (profiler != NULL) {
+        setOCLProfiler(session, profiler, 0);
+    }
+    runOCLScenarios(session, graph, batch, debug);
+    printf("Time to evaluate scenarios, including overhead: %.2f seconds.\n", getMonotonicSeconds() - start);
+    printScenarioRanking(batch);
+
+    releaseOCLSession(session);
+    if (weightModel != NULL) {
+        releaseWeightModel(weightModel);
+    }
+    releaseScenarioBatch(batch);
+    free(targetArray);
 }
 
 void computeGraphsFromFile(char filePathToInData[], char filePathToOutData[], char filePathToNames[]) {
@@ -663,38 +474,225 @@ void computeGraphsFromFile(char filePathToInData[], char filePathToOutData[], ch
     srand(0);
     
     
+    // Binary graph files are mapped and used in place, and their results are written in binary as well
+    MappedGraphFile *mappedFile = NULL;
     printf("\nReading graph from file.\n");
-    readGraphFromFile(&graph, filePathToInData);
+    if (isBinaryGraphFile(filePathToInData)) {
+        mappedFile = mapBinaryGraphFile(&graph, filePathToInData);
+        if (mappedFile == NULL) {
+            exit(1);
+        }
+    }
+    else {
+        readGraphFromFile(&graph, filePathToInData);
+    }
     completeReadGraph(&graph);
+    if (scenarioFilePath != NULL) {
+        evaluateScenarios(&graph, false);
+        if (mappedFile != NULL) {
+            unmapBinaryGraphFile(mappedFile);
+        }
+        return;
+    }
     printf("Computing...\n");
-    clock_t start_time = clock();
-    calculateGraphs(&graph, false);
-    printf("Time to calculate graph, including overhead: %.2f seconds.\n", (float)(clock()-start_time)/1000000);
+    double start = getMonotonicSeconds();
+    WeightModel *weightModel = createConfiguredWeightModel(&graph);
+    computeGraphs(&graph, NULL, weightModel, false);
+    printf("Time to calculate graph, including overhead: %.2f seconds.\n", getMonotonicSeconds() - start);
+    
+    // Store the weights that the results were computed with
+    if (weightModel != NULL) {
+        if (computeBackend == BACKEND_OPENCL) {
+            sampleWeightsOnCPU(&graph, weightModel);
+        }
+        releaseWeightModel(weightModel);
+    }
     
-    writeGraphToFile(&graph, filePathToOutData);
+    // Sum costs and shortest parents that were not computed are left out rather than written uninitialized
+    GraphData results = graph;
+    if (computeCostsOnly) {
+        results.sumCostArray = NULL;
+        results.shortestParentsArray = NULL;
+    }
+    bool written;
+    if (mappedFile != NULL) {
+        written = writeBinaryGraphFile(&results, filePathToOutData, true);
+    }
+    else {
+        written = writeGraphToFile(&results, filePathToOutData);
+    }
+    if (!written) {
+        exit(1);
+    }
     
     char **verticeNameArray = (char**) malloc(graph.vertexCount * sizeof(char*));
     for (int i = 0; i < graph.vertexCount; i++)
         verticeNameArray[i] = (char*) malloc((512) * sizeof(char));
     //readVerticeNames(filePathToNames, verticeNameArray);
     
-    compareToCPUComputation(&graph, false, 10);
+    compareToCPUComputation(&graph, false, verifiedSampleCount);
 
     printMathematicaString(&graph, 0, false);
     
-    
+    if (mappedFile != NULL) {
+        unmapBinaryGraphFile(mappedFile);
+    }
 }
 
 
 int main(int argc, char** argv)
 {
-    
-//    testRandomGraphs(10, 10, 20, 200, 2, 0.2);
-    
     char filePathToInData[512] = "/Users/pontus/Documents/service.graph";
     char filePathToOutData[512] = "/Users/pontus/Documents/service.gpu";
     char filePathToNames[512] = "/Users/pontus/Documents/nodeNames.cvs";
+    
+    // -backend opencl|cpu selects where the graphs are computed, -threads n the number of CPU threads,
+    // -worklist makes the OpenCL backend relax only the frontier of each iteration,
+    // -degree-buckets makes the worklist relax vertices of high out-degree with a work-group each,
+    // -pipeline n sets how many sets of random graphs it keeps in flight at once (1 to run them one at a time),
+    // -all-devices makes it split the samples over all OpenCL devices rather than use the first GPU,
+    // -no-levels makes it iterate over the whole graph rather than level by level over its strongly connected components,
+    // -interleaved lays the samples out side by side on the device, so that work-items on the same vertex are adjacent,
+    // -generic-kernels builds the kernels for any graph rather than as constants for the dimensions of each session,
+    // -costs-only makes the backends skip the sum costs and shortest parents, which are left out of the results,
+    // -verify checks the results of every sample against the sequential implementation rather than the first 10,
+    // -in and -out override the graph and result files (CSV or binary, detected from the contents),
+    // -weights name:parameters draws the weights from a distribution (see parseDistribution), seeded by -seed n,
+    // -scenarios file ranks the countermeasure scenarios of file (see readScenarioFile) instead of writing results,
+    // scored at the comma-separated vertices of -targets list,
+    // -profile file records every OpenCL command, prints the device time per phase and writes a Chrome trace to file,
+    // -program-cache dir keeps the compiled kernels in dir rather than the user's cache directory, -no-program-cache
+    // compiles them on every run,
+    // -power-law-benchmark times the iteration modes on a generated power-law graph and exits,
+    // -benchmark times the standard workloads (see getStandardWorkloads) and exits, writing the results as JSON to
+    // -benchmark-out file and failing if they are slower than those of -benchmark-baseline file,
+    // -to-binary in out and -to-csv in out convert between the two graph formats and exit,
+    // -generate topology:vertices:neighbors[:samples[:sources[:andFraction]]] out writes a generated graph (see
+    // parseGeneratorConfig), seeded by -seed n, to out as a binary graph file and exits. Generated graphs have
+    // distinct sources and no self-loops, but may have duplicate edges.
+    for (int iArg = 1; iArg < argc; iArg++) {
+        if (strcmp(argv[iArg], "-backend") == 0 && iArg + 1 < argc) {
+            if (!parseComputeBackend(argv[++iArg], &computeBackend)) {
+                printf("Unknown backend %s.\n", argv[iArg]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[iArg], "-threads") == 0 && iArg + 1 < argc) {
+            setDefaultThreadCount(atoi(argv[++iArg]));
+        }
+        else if (strcmp(argv[iArg], "-worklist") == 0) {
+            useWorklist = true;
+        }
+        else if (strcmp(argv[iArg], "-degree-buckets") == 0) {
+            useWorklist = true;
+            useDegreeBuckets = true;
+        }
+        else if (strcmp(argv[iArg], "-all-devices") == 0) {
+            useAllDevices = true;
+        }
+        else if (strcmp(argv[iArg], "-pipeline") == 0 && iArg + 1 < argc) {
+            pipelineDepth = atoi(argv[++iArg]);
+            if (pipelineDepth < 1 || pipelineDepth > OCL_MAX_PIPELINE_DEPTH) {
+                printf("Pipeline depth must be between 1 and %i.\n", OCL_MAX_PIPELINE_DEPTH);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[iArg], "-no-levels") == 0) {
+            useTopologicalLevels = false;
+        }
+        else if (strcmp(argv[iArg], "-interleaved") == 0) {
+            useInterleavedLayout = true;
+        }
+        else if (strcmp(argv[iArg], "-generic-kernels") == 0) {
+            useGenericKernels = true;
+        }
+        else if (strcmp(argv[iArg], "-costs-only") == 0) {
+            computeCostsOnly = true;
+        }
+        else if (strcmp(argv[iArg], "-verify") == 0) {
+            verifiedSampleCount = INT_MAX;
+        }
+        else if (strcmp(argv[iArg], "-weights") == 0 && iArg + 1 < argc) {
+            DistributionType type;
+            float parameter1, parameter2;
+            weightDistribution = argv[++iArg];
+            if (!parseDistribution(weightDistribution, &type, &parameter1, &parameter2)) {
+                printf("Unknown weight distribution %s.\n", weightDistribution);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[iArg], "-seed") == 0 && iArg + 1 < argc) {
+            weightSeed = (unsigned int)strtoul(argv[++iArg], NULL, 10);
+        }
+        else if (strcmp(argv[iArg], "-in") == 0 && iArg + 1 < argc) {
+            strncpy(filePathToInData, argv[++iArg], sizeof(filePathToInData) - 1);
+        }
+        else if (strcmp(argv[iArg], "-out") == 0 && iArg + 1 < argc) {
+            strncpy(filePathToOutData, argv[++iArg], sizeof(filePathToOutData) - 1);
+        }
+        else if (strcmp(argv[iArg], "-scenarios") == 0 && iArg + 1 < argc) {
+            scenarioFilePath = argv[++iArg];
+        }
+        else if (strcmp(argv[iArg], "-targets") == 0 && iArg + 1 < argc) {
+            targetList = argv[++iArg];
+        }
+        else if (strcmp(argv[iArg], "-profile") == 0 && iArg + 1 < argc) {
+            profileTracePath = argv[++iArg];
+            if (profiler == NULL) {
+                profiler = createOCLProfiler();
+            }
+        }
+        else if (strcmp(argv[iArg], "-program-cache") == 0 && iArg + 1 < argc) {
+            setOCLProgramCacheDirectory(argv[++iArg]);
+        }
+        else if (strcmp(argv[iArg], "-no-program-cache") == 0) {
+            setOCLProgramCacheDirectory(NULL);
+        }
+        else if (strcmp(argv[iArg], "-power-law-benchmark") == 0) {
+            runPowerLawBenchmark = true;
+        }
+        else if (strcmp(argv[iArg], "-benchmark") == 0) {
+            runBenchmarkSuite = true;
+        }
+        else if (strcmp(argv[iArg], "-benchmark-out") == 0 && iArg + 1 < argc) {
+            benchmarkOutputPath = argv[++iArg];
+        }
+        else if (strcmp(argv[iArg], "-benchmark-baseline") == 0 && iArg + 1 < argc) {
+            benchmarkBaselinePath = argv[++iArg];
+        }
+        else if (strcmp(argv[iArg], "-to-binary") == 0 && iArg + 2 < argc) {
+            return convertCSVToBinaryGraphFile(argv[iArg + 1], argv[iArg + 2]) ? 0 : EXIT_FAILURE;
+        }
+        else if (strcmp(argv[iArg], "-to-csv") == 0 && iArg + 2 < argc) {
+            return convertBinaryToCSVGraphFile(argv[iArg + 1], argv[iArg + 2]) ? 0 : EXIT_FAILURE;
+        }
+        else if (strcmp(argv[iArg], "-generate") == 0 && iArg + 2 < argc) {
+            generatorSpec = argv[++iArg];
+            generatorOutputPath = argv[++iArg];
+        }
+    }
+    
+    // The graph is generated once the seed and thread count are known
+    if (generatorSpec != NULL) {
+        return generateGraphFile(generatorSpec, generatorOutputPath) ? 0 : EXIT_FAILURE;
+    }
+    
+    // The benchmarks run once all options are known, as they depend on the backend and its configuration
+    if (runPowerLawBenchmark) {
+        benchmarkPowerLawGraphs(100, 10000, 4, 2.1, 10);
+        finishProfiling();
+        return 0;
+    }
+    if (runBenchmarkSuite) {
+        int regressionCount = runBenchmarks(benchmarkOutputPath, benchmarkBaselinePath);
+        finishProfiling();
+        return regressionCount == 0 ? 0 : EXIT_FAILURE;
+    }
+    
+//    testRandomGraphs(10, 10, 20, 200, 2, 0.2);
+    
     computeGraphsFromFile(filePathToInData, filePathToOutData, filePathToNames);
+    finishProfiling();
     
 
     
@@ -0,0 +1,129 @@
+//
+//  metric.hpp
+//  OpenCLDijkstra
+//
+
+#ifndef metric_hpp
+#define metric_hpp
+
+#include <limits.h>
+
+
+///
+//  Metrics
+//
+//  A metric assigns a value to every vertex of a sample by folding over the
+//  edges into it. The cost of each reached parent is extended along its
+//  edge, and the extended costs are combined by combineOr at a min vertex
+//  and by combineAnd, starting from initialAnd, at a max vertex. Sources
+//  have the value 0 and INT_MAX is unreached: a min vertex ignores its
+//  unreached parents, and a max vertex with an unreached parent is
+//  unreached. INT_MAX must thus be the identity of combineOr and absorb
+//  combineAnd, so that a fold may treat an unreached parent like any other.
+//  The values are folded from the costs of the parents, the values of
+//  MaxCostMetric, so that every metric is computed alongside the costs in
+//  the same traversal.
+//
+//  The policies are plain structs of static inline functions, and the
+//  engines are templated on them, so that every fold compiles down to the
+//  arithmetic of its metrics. A disabled metric is NoMetric, whose code is
+//  dropped at compile time.
+//
+//  The engines are not generic over any set of metrics. They compute the
+//  costs, under MaxCostMetric, and one second metric into sumCostArray,
+//  which is SumCostMetric or NoMetric. The CPU engine can be instantiated
+//  with another second metric, but the kernels only know the MAX_COST_* and
+//  SUM_COST_* operations, so a metric for both backends replaces the
+//  SUM_COST_* definitions rather than adding to them.
+//
+//  The operations are defined once, as the macros below, which must be
+//  valid both as C++ and as OpenCL C. The policies call them, and the
+//  kernels get them from getMetricKernelPrelude, which is prepended to
+//  kernel.cl when the program is built. The atomic forms of combineOr are
+//  only used by the kernels.
+//
+
+// Sum of a and b, INT_MAX if it does not fit, added in wideInt, a 64-bit type: long long in C++, long in OpenCL C
+#define SATURATED_ADD_FUNCTION(wideInt) \
+    int saturatedAdd(int a, int b) { wideInt sum = (wideInt)a + (wideInt)b; return (sum < INT_MAX) ? (int)sum : INT_MAX; }
+
+#define MAX_COST_EXTEND(cost, weight) saturatedAdd(cost, weight)
+#define MAX_COST_COMBINE_OR(a, b) ((a) < (b) ? (a) : (b))
+#define MAX_COST_ATOMIC_COMBINE_OR(pointer, value) atomic_min(pointer, value)
+#define MAX_COST_COMBINE_AND(a, b) ((a) > (b) ? (a) : (b))
+#define MAX_COST_INITIAL_AND(maxVertexValue) (maxVertexValue)
+
+#define SUM_COST_EXTEND(cost, weight) saturatedAdd(cost, weight)
+#define SUM_COST_COMBINE_OR(a, b) ((a) < (b) ? (a) : (b))
+#define SUM_COST_ATOMIC_COMBINE_OR(pointer, value) atomic_min(pointer, value)
+#define SUM_COST_COMBINE_AND(a, b) saturatedAdd(a, b)
+#define SUM_COST_INITIAL_AND(maxVertexValue) ((void)(maxVertexValue), 0)
+
+inline SATURATED_ADD_FUNCTION(long long)
+
+// Time to compromise: the cheapest parent of a min vertex, and the most expensive of a max vertex
+struct MaxCostMetric
+{
+    static const bool enabled = true;
+
+    // Whether the value of a min vertex is its cost, so that it need not be folded
+    static const bool followsCostAtOr = true;
+
+    static inline int extend(int cost, int weight) { return MAX_COST_EXTEND(cost, weight); }
+    static inline int combineOr(int a, int b) { return MAX_COST_COMBINE_OR(a, b); }
+    static inline int combineAnd(int a, int b) { return MAX_COST_COMBINE_AND(a, b); }
+
+    // A max vertex starts from the highest value so far in maxVertexArray
+    static inline int initialAnd(int maxVertexValue) { return MAX_COST_INITIAL_AND(maxVertexValue); }
+};
+
+// Total effort: as MaxCostMetric, but a max vertex adds up the costs through all of its parents
+struct SumCostMetric
+{
+    static const bool enabled = true;
+    static const bool followsCostAtOr = true;
+
+    static inline int extend(int cost, int weight) { return SUM_COST_EXTEND(cost, weight); }
+    static inline int combineOr(int a, int b) { return SUM_COST_COMBINE_OR(a, b); }
+    static inline int combineAnd(int a, int b) { return SUM_COST_COMBINE_AND(a, b); }
+    static inline int initialAnd(int maxVertexValue) { return SUM_COST_INITIAL_AND(maxVertexValue); }
+};
+
+// A metric that is not computed
+struct NoMetric
+{
+    static const bool enabled = false;
+    static const bool followsCostAtOr = true;
+
+    static inline int extend(int, int) { return 0; }
+    static inline int combineOr(int, int) { return 0; }
+    static inline int combineAnd(int, int) { return 0; }
+    static inline int initialAnd(int) { return 0; }
+};
+
+#define METRIC_STRING(text) #text
+#define METRIC_EXPANDED_STRING(text) METRIC_STRING(text)
+
+// The definition of operation as an OpenCL macro, with its body expanded from the macro of the same name above
+#define METRIC_KERNEL_DEFINITION(operation, parameters) "#define " #operation #parameters " " METRIC_EXPANDED_STRING(operation parameters) "\n"
+
+///
+/// OpenCL source defining saturatedAdd and the MAX_COST_* and SUM_COST_* operations for kernel.cl, generated from
+/// the definitions above.
+///
+inline const char* getMetricKernelPrelude()
+{
+    return METRIC_EXPANDED_STRING(SATURATED_ADD_FUNCTION(long)) "\n"
+        METRIC_KERNEL_DEFINITION(MAX_COST_EXTEND, (cost, weight))
+        METRIC_KERNEL_DEFINITION(MAX_COST_COMBINE_OR, (a, b))
+        METRIC_KERNEL_DEFINITION(MAX_COST_ATOMIC_COMBINE_OR, (pointer, value))
+        METRIC_KERNEL_DEFINITION(MAX_COST_COMBINE_AND, (a, b))
+        METRIC_KERNEL_DEFINITION(MAX_COST_INITIAL_AND, (maxVertexValue))
+        METRIC_KERNEL_DEFINITION(SUM_COST_EXTEND, (cost, weight))
+        METRIC_KERNEL_DEFINITION(SUM_COST_COMBINE_OR, (a, b))
+        METRIC_KERNEL_DEFINITION(SUM_COST_ATOMIC_COMBINE_OR, (pointer, value))
+        METRIC_KERNEL_DEFINITION(SUM_COST_COMBINE_AND, (a, b))
+        METRIC_KERNEL_DEFINITION(SUM_COST_INITIAL_AND, (maxVertexValue));
+}
+
+#endif /* metric_hpp */
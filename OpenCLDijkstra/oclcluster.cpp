@@ -0,0 +1,306 @@
+//
+//  oclcluster.cpp
+//  OpenCLDijkstra
+//
+
+#include "oclcluster.hpp"
+#include "utility.hpp"
+#include <pthread.h>
+#include <math.h>
+
+#define MAX_CLUSTER_DEVICES 16
+#define REBALANCE_THRESHOLD 1.1  // Ratio of the slowest to the fastest run time above which shares are rebalanced
+
+typedef struct
+{
+    OCLSession *session;
+    GraphData shard;
+    int slot;
+    bool debug;
+    // Wait for the results, rather than return once the run is enqueued
+    bool finish;
+    double seconds;
+} ShardRun;
+
+
+///
+/// View of samples [start, start + count) of graph. The per-sample arrays point into those of graph, so that
+/// results written to the view end up in graph.
+///
+GraphData getShardGraph(GraphData *graph, int start, int count)
+{
+    GraphData shard = *graph;
+    long vertexOffset = (long)start * graph->vertexCount;
+    long edgeOffset = (long)start * graph->edgeCount;
+    shard.graphCount = count;
+    shard.sourceArray = graph->sourceArray + vertexOffset;
+    shard.costArray = graph->costArray + vertexOffset;
+    shard.sumCostArray = graph->sumCostArray + vertexOffset;
+    shard.weightArray = graph->weightArray + edgeOffset;
+    shard.shortestParentsArray = graph->shortestParentsArray + edgeOffset;
+    return shard;
+}
+
+///
+/// Split graphCount samples into sessionCount contiguous shares proportional to weightArray, with at least one
+/// sample each. Rounding remainders go to the largest fractions.
+///
+void partitionSamples(int graphCount, double *weightArray, int sessionCount, int *shardStartArray)
+{
+    double totalWeight = 0;
+    for (int iSession = 0; iSession < sessionCount; iSession++) {
+        totalWeight += weightArray[iSession];
+    }
+    int *countArray = (int*) malloc(sessionCount * sizeof(int));
+    double *fractionArray = (double*) malloc(sessionCount * sizeof(double));
+    int assignedCount = 0;
+    for (int iSession = 0; iSession < sessionCount; iSession++) {
+        double share = 1 + (graphCount - sessionCount) * weightArray[iSession] / totalWeight;
+        countArray[iSession] = (int)floor(share);
+        fractionArray[iSession] = share - countArray[iSession];
+        assignedCount += countArray[iSession];
+    }
+    for (; assignedCount < graphCount; assignedCount++) {
+        int largest = 0;
+        for (int iSession = 1; iSession < sessionCount; iSession++) {
+            if (fractionArray[iSession] > fractionArray[largest]) {
+                largest = iSession;
+            }
+        }
+        countArray[largest]++;
+        fractionArray[largest] = -1;
+    }
+    shardStartArray[0] = 0;
+    for (int iSession = 0; iSession < sessionCount; iSession++) {
+        shardStartArray[iSession + 1] = shardStartArray[iSession] + countArray[iSession];
+    }
+    free(countArray);
+    free(fractionArray);
+}
+
+///
+/// Rough relative speed of a device, used until its throughput has been measured
+///
+double estimateDeviceThroughput(cl_device_id deviceId)
+{
+    cl_uint computeUnitCount = 1;
+    cl_uint clockFrequency = 1;
+    clGetDeviceInfo(deviceId, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(computeUnitCount), &computeUnitCount, NULL);
+    clGetDeviceInfo(deviceId, CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(clockFrequency), &clockFrequency, NULL);
+    return (double)computeUnitCount * (clockFrequency > 0 ? clockFrequency : 1);
+}
+
+///
+/// Create a session for every device, each running its share of the samples of graph. Unless useAllDevices is
+/// set, the cluster only consists of the default device, and behaves like a single OCLSession. There are never
+/// more sessions than samples.
+///
+OCLCluster* createOCLCluster(GraphData *graph, bool useAllDevices)
+{
+    cl_device_id deviceArray[MAX_CLUSTER_DEVICES];
+    int deviceCount = 0;
+    if (useAllDevices) {
+        deviceCount = getComputeDevices(deviceArray, MAX_CLUSTER_DEVICES);
+        for (int iDevice = graph->graphCount; iDevice < deviceCount; iDevice++) {
+            clReleaseDevice(deviceArray[iDevice]);
+        }
+        if (deviceCount > graph->graphCount) {
+            deviceCount = graph->graphCount;
+        }
+    }
+    if (deviceCount == 0) {
+        if (getDefaultComputeDevice(&deviceArray[0]) != CL_SUCCESS) {
+            exit(1);
+        }
+        deviceCount = 1;
+    }
+
+    OCLCluster *cluster = (OCLCluster*) malloc(sizeof(OCLCluster));
+    cluster->graphCount = graph->graphCount;
+    cluster->vertexCount = graph->vertexCount;
+    cluster->edgeCount = graph->edgeCount;
+    cluster->sessionCount = deviceCount;
+    cluster->sessionArray = (OCLSession**) malloc(deviceCount * sizeof(OCLSession*));
+    cluster->shardStartArray = (int*) malloc((deviceCount + 1) * sizeof(int));
+    cluster->throughputArray = (double*) malloc(deviceCount * sizeof(double));
+    cluster->runTimeArray = (double*) calloc(deviceCount, sizeof(double));
+
+    for (int iSession = 0; iSession < deviceCount; iSession++) {
+        cluster->throughputArray[iSession] = estimateDeviceThroughput(deviceArray[iSession]);
+    }
+    partitionSamples(graph->graphCount, cluster->throughputArray, deviceCount, cluster->shardStartArray);
+
+    for (int iSession = 0; iSession < deviceCount; iSession++) {
+        int start = cluster->shardStartArray[iSession];
+        GraphData shard = getShardGraph(graph, start, cluster->shardStartArray[iSession + 1] - start);
+        cluster->sessionArray[iSession] = createOCLSessionOnDevice(&shard, deviceArray[iSession]);
+        cluster->sessionArray[iSession]->firstSample = start;
+    }
+    return cluster;
+}
+
+void setOCLClusterWeightModel(OCLCluster *cluster, WeightModel *model)
+{
+    for (int iSession = 0; iSession < cluster->sessionCount; iSession++) {
+        setOCLWeightModel(cluster->sessionArray[iSession], model);
+    }
+}
+
+void setOCLClusterPipelineDepth(OCLCluster *cluster, int pipelineDepth)
+{
+    for (int iSession = 0; iSession < cluster->sessionCount; iSession++) {
+        setOCLPipelineDepth(cluster->sessionArray[iSession], pipelineDepth);
+    }
+}
+
+void* runShard(void *argument)
+{
+    ShardRun *run = (ShardRun*) argument;
+    double start = getMonotonicSeconds();
+    enqueueOCLSession(run->session, &run->shard, run->slot, run->debug);
+    if (run->finish) {
+        finishOCLSession(run->session, run->slot);
+    }
+    run->seconds = getMonotonicSeconds() - start;
+    return NULL;
+}
+
+///
+/// Repartition the samples in proportion to the measured throughput if the sessions took unequally long
+///
+void rebalanceOCLCluster(OCLCluster *cluster)
+{
+    double fastest = cluster->runTimeArray[0];
+    double slowest = cluster->runTimeArray[0];
+    for (int iSession = 0; iSession < cluster->sessionCount; iSession++) {
+        int count = cluster->shardStartArray[iSession + 1] - cluster->shardStartArray[iSession];
+        double seconds = cluster->runTimeArray[iSession];
+        cluster->throughputArray[iSession] = count / (seconds > 1e-9 ? seconds : 1e-9);
+        fastest = fmin(fastest, seconds);
+        slowest = fmax(slowest, seconds);
+    }
+    if (slowest <= REBALANCE_THRESHOLD * fastest) {
+        return;
+    }
+    partitionSamples(cluster->graphCount, cluster->throughputArray, cluster->sessionCount, cluster->shardStartArray);
+    for (int iSession = 0; iSession < cluster->sessionCount; iSession++) {
+        OCLSession *session = cluster->sessionArray[iSession];
+        resizeOCLSession(session, cluster->shardStartArray[iSession + 1] - cluster->shardStartArray[iSession]);
+        session->firstSample = cluster->shardStartArray[iSession];
+    }
+}
+
+///
+/// Run every session on its share of graph in slot. Enqueueing may block on convergence checks, so each session
+/// is handled by a thread of its own, and the calling thread takes the first. Returns the seconds each session
+/// took in runTimeArray.
+///
+void runShards(OCLCluster *cluster, GraphData *graph, int slot, bool debug, bool finish)
+{
+    if (graph->graphCount != cluster->graphCount || graph->vertexCount != cluster->vertexCount || graph->edgeCount != cluster->edgeCount) {
+        printf("Error: Graph does not match the dimensions of the OpenCL cluster!\n");
+        exit(1);
+    }
+
+    ShardRun *runArray = (ShardRun*) malloc(cluster->sessionCount * sizeof(ShardRun));
+    pthread_t *threadArray = (pthread_t*) malloc(cluster->sessionCount * sizeof(pthread_t));
+    for (int iSession = 0; iSession < cluster->sessionCount; iSession++) {
+        int start = cluster->shardStartArray[iSession];
+        runArray[iSession].session = cluster->sessionArray[iSession];
+        runArray[iSession].shard = getShardGraph(graph, start, cluster->shardStartArray[iSession + 1] - start);
+        runArray[iSession].slot = slot;
+        runArray[iSession].debug = debug;
+        runArray[iSession].finish = finish;
+    }
+
+    for (int iSession = 1; iSession < cluster->sessionCount; iSession++) {
+        pthread_create(&threadArray[iSession], NULL, runShard, &runArray[iSession]);
+    }
+    runShard(&runArray[0]);
+    for (int iSession = 1; iSession < cluster->sessionCount; iSession++) {
+        pthread_join(threadArray[iSession], NULL);
+    }
+
+    for (int iSession = 0; iSession < cluster->sessionCount; iSession++) {
+        cluster->runTimeArray[iSession] = runArray[iSession].seconds;
+    }
+    free(runArray);
+    free(threadArray);
+}
+
+///
+/// Compute costArray, sumCostArray and shortestParentsArray of graph with all sessions of the cluster at once.
+/// The shares are first rebalanced by how long each session took in the previous run, rather than afterwards, so
+/// that the results stay on the devices for updateOCLCluster.
+///
+void runOCLCluster(OCLCluster *cluster, GraphData *graph, bool debug)
+{
+    bool timed = cluster->runTimeArray[0] > 0;
+    if (cluster->sessionCount > 1 && timed) {
+        rebalanceOCLCluster(cluster);
+    }
+    runShards(cluster, graph, 0, debug, true);
+    if (cluster->sessionCount > 1 && debug) {
+        for (int iSession = 0; iSession < cluster->sessionCount; iSession++) {
+            int count = cluster->shardStartArray[iSession + 1] - cluster->shardStartArray[iSession];
+            printf("Device %i: %i samples in %.3f seconds.\n", iSession, count, cluster->runTimeArray[iSession]);
+        }
+    }
+}
+
+///
+/// Enqueue the computation of graph in slot of every session, as enqueueOCLSession does. Pipelined runs are
+/// not timed, so the shares are only rebalanced by runOCLCluster.
+///
+void enqueueOCLCluster(OCLCluster *cluster, GraphData *graph, int slot, bool debug)
+{
+    runShards(cluster, graph, slot, debug, false);
+    for (int iSession = 0; iSession < cluster->sessionCount; iSession++) {
+        cluster->runTimeArray[iSession] = 0;
+    }
+}
+
+void finishOCLCluster(OCLCluster *cluster, int slot)
+{
+    for (int iSession = 0; iSession < cluster->sessionCount; iSession++) {
+        finishOCLSession(cluster->sessionArray[iSession], slot);
+    }
+}
+
+///
+/// Apply the weight changes to graph and update its results, as updateOCLSession does. Each change goes to the
+/// session running its sample, renumbered within the share of that session.
+///
+void updateOCLCluster(OCLCluster *cluster, GraphData *graph, WeightChange *changeArray, int changeCount, bool debug)
+{
+    WeightChange *shardChangeArray = (WeightChange*) malloc(changeCount * sizeof(WeightChange));
+    for (int iSession = 0; iSession < cluster->sessionCount; iSession++) {
+        int start = cluster->shardStartArray[iSession];
+        int end = cluster->shardStartArray[iSession + 1];
+        int shardChangeCount = 0;
+        for (int iChange = 0; iChange < changeCount; iChange++) {
+            if (changeArray[iChange].sample >= start && changeArray[iChange].sample < end) {
+                shardChangeArray[shardChangeCount] = changeArray[iChange];
+                shardChangeArray[shardChangeCount].sample -= start;
+                shardChangeCount++;
+            }
+        }
+        if (shardChangeCount > 0) {
+            GraphData shard = getShardGraph(graph, start, end - start);
+            updateOCLSession(cluster->sessionArray[iSession], &shard, shardChangeArray, shardChangeCount, debug);
+        }
+    }
+    free(shardChangeArray);
+}
+
+void releaseOCLCluster(OCLCluster *cluster)
+{
+    for (int iSession = 0; iSession < cluster->sessionCount; iSession++) {
+        releaseOCLSession(cluster->sessionArray[iSession]);
+    }
+    free(cluster->sessionArray);
+    free(cluster->shardStartArray);
+    free(cluster->throughputArray);
+    free(cluster->runTimeArray);
+    free(cluster);
+}
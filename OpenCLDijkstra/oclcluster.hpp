@@ -0,0 +1,60 @@
+//
+//  oclcluster.hpp
+//  OpenCLDijkstra
+//
+
+#ifndef oclcluster_hpp
+#define oclcluster_hpp
+
+#include <stdio.h>
+#include "graph.hpp"
+#include "oclengine.hpp"
+
+
+///
+//  Types
+//
+//
+//  A cluster spreads the samples of a graph over several OpenCL devices.
+//  Each device gets an OCLSession of its own, with its own copy of the
+//  topology, that runs a contiguous share of the samples. The sessions run
+//  concurrently, one host thread each, and write their results straight
+//  into the sample ranges of costArray, sumCostArray and shortestParentsArray.
+//
+//  Shares start out proportional to an estimate of each device's speed
+//  (compute units times clock). Before every run they are set proportional
+//  to the throughput measured in the previous one instead, if the devices
+//  took unequally long.
+//
+
+typedef struct
+{
+    // Dimensions of the whole graph
+    int graphCount;
+    int vertexCount;
+    int edgeCount;
+
+    int sessionCount;
+    OCLSession **sessionArray;
+
+    // Session i runs samples [shardStartArray[i], shardStartArray[i+1])
+    int *shardStartArray;
+
+    // Samples per second of each session, measured in the last run or estimated before the first one
+    double *throughputArray;
+
+    // Seconds each session took in the last run by runOCLCluster, or 0 if the last run was pipelined
+    double *runTimeArray;
+
+} OCLCluster;
+
+OCLCluster* createOCLCluster(GraphData *graph, bool useAllDevices);
+void setOCLClusterWeightModel(OCLCluster *cluster, WeightModel *model);
+void setOCLClusterPipelineDepth(OCLCluster *cluster, int pipelineDepth);
+void runOCLCluster(OCLCluster *cluster, GraphData *graph, bool debug);
+void enqueueOCLCluster(OCLCluster *cluster, GraphData *graph, int slot, bool debug);
+void finishOCLCluster(OCLCluster *cluster, int slot);
+void updateOCLCluster(OCLCluster *cluster, GraphData *graph, WeightChange *changeArray, int changeCount, bool debug);
+void releaseOCLCluster(OCLCluster *cluster);
+
+#endif /* oclcluster_hpp */
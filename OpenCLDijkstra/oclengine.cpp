@@ -0,0 +1,1726 @@
+//
+//  oclengine.cpp
+//  OpenCLDijkstra
+//
+
+#include "oclengine.hpp"
+#include "utility.hpp"
+#include "oclprogramcache.hpp"
+#include "metric.hpp"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+
+// kernel.cl is embedded in every build. The Embed kernel source phase of the project generates this header, and any
+// other build has to run xxd -i kernel.cl > kernelsource.h into its include path before compiling this file.
+#if defined(__has_include)
+#if !__has_include("kernelsource.h")
+#error "kernelsource.h is missing: generate it with xxd -i kernel.cl > kernelsource.h"
+#endif
+#endif
+#include "kernelsource.h"
+
+#define KERNEL_PATH_VARIABLE "OPENCL_DIJKSTRA_KERNEL"  // Environment variable overriding where kernel.cl is read from
+#define checkError(a, b) checkErrorFileLine(a, b, __FILE__ , __LINE__)
+#define NUM_ASYNCHRONOUS_ITERATIONS 20  // Number of async loop iterations before attempting to read results back
+#define LEVEL_ITERATIONS_PER_READ 4  // Launches of a cyclic level between reads of its changed flag
+#define HUB_DEGREE 32  // Out-degree from which the degree-bucketed worklist relaxes a vertex with a whole work-group
+#define HUB_WORK_GROUP_SIZE 64  // Work-items sharing the out-edges of one such vertex
+
+///
+//  Utility functions adapted from NVIDIA GPU Computing SDK
+//
+cl_device_id getFirstDev(cl_context cxGPUContext);
+void bindSlot(OCLSession *session, int slot);
+bool selectProgramVariant(OCLSession *session);
+void bindDistributions(OCLSession *session);
+cl_event* profileEvent(OCLSession *session, cl_command_queue queue, OCLPhase phase, const char *name);
+
+///
+//  Namespaces
+//
+using namespace std;
+
+///
+//  Globals
+//
+pthread_mutex_t mutex1 = PTHREAD_MUTEX_INITIALIZER;
+
+
+bool readKernelFile(const char *filePath, std::string *source)
+{
+    std::ifstream kernelFile(filePath, std::ios::in);
+    if (!kernelFile.is_open())
+    {
+        return false;
+    }
+    std::ostringstream oss;
+    oss << kernelFile.rdbuf();
+    *source = oss.str();
+    return true;
+}
+
+///
+/// The source of the kernels, embedded in the executable, unless KERNEL_PATH_VARIABLE names a kernel file to read it
+/// from instead, e.g. to try out changes to the kernels without rebuilding. Returns false if that file cannot be read.
+///
+bool getKernelSource(std::string *source)
+{
+    const char *variablePath = getenv(KERNEL_PATH_VARIABLE);
+    if (variablePath != NULL && variablePath[0] != '\0') {
+        if (readKernelFile(variablePath, source)) {
+            return true;
+        }
+        std::cerr << "Failed to open file for reading: " << variablePath << std::endl;
+        return false;
+    }
+    source->assign((const char *)kernel_cl, kernel_cl_len);
+    return true;
+}
+
+///
+/// Load and build the kernels, from the program cache if they have been built with the same options before
+/// \param gpuContext GPU context on which to load and build the program
+/// \param options Build options, e.g. preprocessor definitions, or NULL
+/// \return Handle to the program
+///
+cl_program loadAndBuildProgram( cl_context gpuContext, const char *options )
+{
+    pthread_mutex_lock(&mutex1);
+
+    std::string kernelSource;
+    if (!getKernelSource(&kernelSource))
+    {
+        pthread_mutex_unlock(&mutex1);
+        return NULL;
+    }
+    // The metrics are generated from metric.hpp rather than defined in kernel.cl
+    std::string source = std::string(getMetricKernelPrelude()) + kernelSource;
+    cl_program program = buildCachedOCLProgram(gpuContext, getFirstDev(gpuContext), source.c_str(), source.size(), options);
+
+    pthread_mutex_unlock(&mutex1);
+    return program;
+}
+
+///
+/// Gets the id of the first device from the context (from the NVIDIA SDK)
+///
+cl_device_id getFirstDev(cl_context cxGPUContext)
+{
+    size_t szParmDataBytes;
+    cl_device_id* cdDevices;
+
+    // get the list of GPU devices associated with context
+    clGetContextInfo(cxGPUContext, CL_CONTEXT_DEVICES, 0, NULL, &szParmDataBytes);
+    cdDevices = (cl_device_id*) malloc(szParmDataBytes);
+
+    clGetContextInfo(cxGPUContext, CL_CONTEXT_DEVICES, szParmDataBytes, cdDevices, NULL);
+
+    cl_device_id first = cdDevices[0];
+    free(cdDevices);
+
+    return first;
+}
+
+
+///
+/// The device sessions run on by default: the first GPU.
+///
+int getDefaultComputeDevice(cl_device_id *device_id) {
+    // Connect to a compute device
+    //
+    int gpu = 1;
+    int err = clGetDeviceIDs(NULL, gpu ? CL_DEVICE_TYPE_GPU : CL_DEVICE_TYPE_CPU, 1, device_id, NULL);
+    if (err != CL_SUCCESS)
+    {
+        printf("Error: Failed to create a device group!\n");
+        return EXIT_FAILURE;
+    }
+    return CL_SUCCESS;
+}
+
+///
+/// Find every OpenCL device of every platform, and write up to maxDeviceCount of them to deviceArray. CPU devices
+/// are split into one sub-device per NUMA node where the implementation supports it, so that each node gets a
+/// queue and buffers of its own. Returns the number of devices found.
+///
+int getComputeDevices(cl_device_id *deviceArray, int maxDeviceCount) {
+    cl_platform_id platformArray[16];
+    cl_uint platformCount = 0;
+    if (clGetPlatformIDs(16, platformArray, &platformCount) != CL_SUCCESS) {
+        return 0;
+    }
+
+    int deviceCount = 0;
+    for (cl_uint iPlatform = 0; iPlatform < platformCount; iPlatform++) {
+        cl_device_id platformDeviceArray[16];
+        cl_uint platformDeviceCount = 0;
+        if (clGetDeviceIDs(platformArray[iPlatform], CL_DEVICE_TYPE_ALL, 16, platformDeviceArray, &platformDeviceCount) != CL_SUCCESS) {
+            continue;
+        }
+        for (cl_uint iDevice = 0; iDevice < platformDeviceCount && deviceCount < maxDeviceCount; iDevice++) {
+            cl_device_id device = platformDeviceArray[iDevice];
+            cl_device_type type;
+            clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+
+            cl_uint subDeviceCount = 0;
+            if (type & CL_DEVICE_TYPE_CPU) {
+                cl_device_partition_property properties[] = {CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN, CL_DEVICE_AFFINITY_DOMAIN_NUMA, 0};
+                cl_device_id subDeviceArray[16];
+                if (clCreateSubDevices(device, properties, 16, subDeviceArray, &subDeviceCount) != CL_SUCCESS) {
+                    subDeviceCount = 0;
+                }
+                // A single node gains nothing from being partitioned
+                for (cl_uint iSubDevice = 0; iSubDevice < subDeviceCount; iSubDevice++) {
+                    if (subDeviceCount > 1 && deviceCount < maxDeviceCount) {
+                        deviceArray[deviceCount++] = subDeviceArray[iSubDevice];
+                    }
+                    else {
+                        clReleaseDevice(subDeviceArray[iSubDevice]);
+                    }
+                }
+                if (subDeviceCount <= 1) {
+                    subDeviceCount = 0;
+                }
+            }
+            if (subDeviceCount == 0) {
+                deviceArray[deviceCount++] = device;
+            }
+        }
+    }
+    return deviceCount;
+}
+
+
+int  initializeComputing(cl_device_id device_id, cl_context *context, cl_command_queue *commands) {
+    int err;
+
+    // Create a compute context
+    //
+    *context = clCreateContext(0, 1, &device_id, NULL, NULL, &err);
+    if (!*context)
+    {
+        printf("Error: Failed to create a compute context!\n");
+        return EXIT_FAILURE;
+    }
+
+    // Create a command commands
+    //
+    *commands = clCreateCommandQueue(*context, device_id, CL_QUEUE_PROFILING_ENABLE, &err);
+    if (!*commands)
+    {
+        printf("Error: Failed to create a command commands!\n");
+        return EXIT_FAILURE;
+    }
+
+    return CL_SUCCESS;
+}
+
+int createKernels(cl_kernel *initializeKernel, cl_kernel *ssspKernel1, cl_kernel *ssspKernel2, cl_kernel *shortestParentsKernel, cl_kernel *ssspQueueKernel1, cl_kernel *ssspQueueKernel2, cl_kernel *ssspHubKernel1, cl_kernel *sampleWeightsKernel, cl_kernel *levelKernel, cl_kernel *resetVerticesKernel, cl_kernel *updateLevelKernel, cl_kernel *updateShortestParentsKernel, cl_kernel *scatterWeightsKernel, cl_kernel *scenarioLevelKernel, cl_kernel *gatherTargetsKernel, cl_program *program) {
+
+    int errNum;
+
+    // Create the compute kernel in the program we wish to run
+    *initializeKernel = clCreateKernel(*program, "initializeBuffers", &errNum);
+    if (!initializeKernel || errNum != CL_SUCCESS)
+    {
+        printf("Error: Failed to create initializeKernel initializeBuffers!\n");
+        exit(1);
+    }
+
+    // Kernel 1
+    *ssspKernel1 = clCreateKernel(*program, "OCL_SSSP_KERNEL1", &errNum);
+    if (!ssspKernel1 || errNum != CL_SUCCESS)
+    {
+        printf("Error: Failed to create ssspKernel1 initializeBuffers!\n");
+        exit(1);
+    }
+
+    // Kernel 2
+    *ssspKernel2 = clCreateKernel(*program, "OCL_SSSP_KERNEL2", &errNum);
+    if (!ssspKernel2 || errNum != CL_SUCCESS)
+    {
+        printf("Error: Failed to create ssspKernel2 initializeBuffers!\n");
+        exit(1);
+    }
+
+    // Shortest parent kernel
+    *shortestParentsKernel = clCreateKernel(*program, "SHORTEST_PARENTS", &errNum);
+    if (!shortestParentsKernel || errNum != CL_SUCCESS)
+    {
+        printf("Error: Failed to create ssspKernel2 initializeBuffers!\n");
+        exit(1);
+    }
+
+    // Worklist kernels
+    *ssspQueueKernel1 = clCreateKernel(*program, "OCL_SSSP_QUEUE_KERNEL1", &errNum);
+    if (!ssspQueueKernel1 || errNum != CL_SUCCESS)
+    {
+        printf("Error: Failed to create ssspQueueKernel1!\n");
+        exit(1);
+    }
+    *ssspQueueKernel2 = clCreateKernel(*program, "OCL_SSSP_QUEUE_KERNEL2", &errNum);
+    if (!ssspQueueKernel2 || errNum != CL_SUCCESS)
+    {
+        printf("Error: Failed to create ssspQueueKernel2!\n");
+        exit(1);
+    }
+    *ssspHubKernel1 = clCreateKernel(*program, "OCL_SSSP_HUB_KERNEL1", &errNum);
+    if (!ssspHubKernel1 || errNum != CL_SUCCESS)
+    {
+        printf("Error: Failed to create ssspHubKernel1!\n");
+        exit(1);
+    }
+
+    // Weight sampling kernel
+    *sampleWeightsKernel = clCreateKernel(*program, "SAMPLE_WEIGHTS", &errNum);
+    if (!sampleWeightsKernel || errNum != CL_SUCCESS)
+    {
+        printf("Error: Failed to create sampleWeightsKernel!\n");
+        exit(1);
+    }
+
+    // Topological level kernel
+    *levelKernel = clCreateKernel(*program, "OCL_LEVEL_KERNEL", &errNum);
+    if (!levelKernel || errNum != CL_SUCCESS)
+    {
+        printf("Error: Failed to create levelKernel!\n");
+        exit(1);
+    }
+
+    // Kernels for incremental updates
+    *resetVerticesKernel = clCreateKernel(*program, "OCL_RESET_VERTICES", &errNum);
+    if (!resetVerticesKernel || errNum != CL_SUCCESS)
+    {
+        printf("Error: Failed to create resetVerticesKernel!\n");
+        exit(1);
+    }
+    *updateLevelKernel = clCreateKernel(*program, "OCL_UPDATE_LEVEL_KERNEL", &errNum);
+    if (!updateLevelKernel || errNum != CL_SUCCESS)
+    {
+        printf("Error: Failed to create updateLevelKernel!\n");
+        exit(1);
+    }
+    *updateShortestParentsKernel = clCreateKernel(*program, "OCL_UPDATE_SHORTEST_PARENTS", &errNum);
+    if (!updateShortestParentsKernel || errNum != CL_SUCCESS)
+    {
+        printf("Error: Failed to create updateShortestParentsKernel!\n");
+        exit(1);
+    }
+    *scatterWeightsKernel = clCreateKernel(*program, "OCL_SCATTER_WEIGHTS", &errNum);
+    if (!scatterWeightsKernel || errNum != CL_SUCCESS)
+    {
+        printf("Error: Failed to create scatterWeightsKernel!\n");
+        exit(1);
+    }
+
+    // Scenario kernels, for evaluating a batch of scenarios
+    *scenarioLevelKernel = clCreateKernel(*program, "OCL_SCENARIO_LEVEL_KERNEL", &errNum);
+    if (!scenarioLevelKernel || errNum != CL_SUCCESS)
+    {
+        printf("Error: Failed to create scenarioLevelKernel!\n");
+        exit(1);
+    }
+    *gatherTargetsKernel = clCreateKernel(*program, "OCL_GATHER_TARGETS", &errNum);
+    if (!gatherTargetsKernel || errNum != CL_SUCCESS)
+    {
+        printf("Error: Failed to create gatherTargetsKernel!\n");
+        exit(1);
+    }
+return errNum;
+}
+
+
+///
+///  Allocate the buffers whose size depends on the number of samples, session->graphCount, along with the rest
+///  of the traversal state. The buffers that are uploaded or read back are allocated for every slot, and those
+///  of slot 0 are bound.
+///
+void allocateSampleBuffers(OCLSession *session)
+{
+    cl_int errNum;
+    cl_context gpuContext = session->context;
+    int totalVertexCount = session->graphCount * session->vertexCount;
+    int totalEdgeCount = session->graphCount * session->edgeCount;
+
+    // Per-sample input and result buffers of each slot
+    for (int iSlot = 0; iSlot < session->pipelineDepth; iSlot++) {
+        OCLSampleSlot *slot = &session->slotArray[iSlot];
+        slot->weightArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_ONLY, sizeof(int) * totalEdgeCount, NULL, &errNum);
+        checkError(errNum, CL_SUCCESS);
+        slot->sourceArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_ONLY, sizeof(int) * totalVertexCount, NULL, &errNum);
+        checkError(errNum, CL_SUCCESS);
+        slot->maxCostArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_WRITE, sizeof(int) * totalVertexCount, NULL, &errNum);
+        checkError(errNum, CL_SUCCESS);
+        slot->sumCostArrayDevice = NULL;
+        slot->shortestParentsArrayDevice = NULL;
+        if (session->computeSumCosts) {
+            slot->sumCostArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_WRITE, sizeof(int) * totalVertexCount, NULL, &errNum);
+            checkError(errNum, CL_SUCCESS);
+        }
+        if (session->computeShortestParents) {
+            slot->shortestParentsArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_WRITE, sizeof(int) * totalEdgeCount, NULL, &errNum);
+            checkError(errNum, CL_SUCCESS);
+        }
+        slot->readDone = NULL;
+
+        // The arrays of the graph are converted to and from the interleaved layout through host copies
+        slot->weightArray = NULL;
+        slot->sourceArray = NULL;
+        slot->costArray = NULL;
+        slot->sumCostArray = NULL;
+        slot->shortestParentsArray = NULL;
+        slot->graph = NULL;
+        if (session->useInterleavedLayout) {
+            slot->weightArray = (int*) malloc(sizeof(int) * totalEdgeCount);
+            slot->sourceArray = (int*) malloc(sizeof(int) * totalVertexCount);
+            slot->costArray = (int*) malloc(sizeof(int) * totalVertexCount);
+            if (session->computeSumCosts) {
+                slot->sumCostArray = (int*) malloc(sizeof(int) * totalVertexCount);
+            }
+            if (session->computeShortestParents) {
+                slot->shortestParentsArray = (int*) malloc(sizeof(int) * totalEdgeCount);
+            }
+        }
+    }
+
+    // Traversal state
+    session->maskArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_WRITE, sizeof(int) * totalVertexCount, NULL, &errNum);
+    checkError(errNum, CL_SUCCESS);
+    session->maxUpdatingCostArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_WRITE, sizeof(int) * totalVertexCount, NULL, &errNum);
+    checkError(errNum, CL_SUCCESS);
+    session->sumUpdatingCostArrayDevice = NULL;
+    if (session->computeSumCosts) {
+        session->sumUpdatingCostArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_WRITE, sizeof(int) * totalVertexCount, NULL, &errNum);
+        checkError(errNum, CL_SUCCESS);
+    }
+    session->parentCountArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_WRITE, sizeof(int) * totalVertexCount, NULL, &errNum);
+    checkError(errNum, CL_SUCCESS);
+    session->traversedEdgeCountArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_WRITE, sizeof(int) * totalEdgeCount, NULL, &errNum);
+    checkError(errNum, CL_SUCCESS);
+
+    // A vertex is put in the frontier at most once per iteration, so the queue never exceeds the vertex count
+    session->frontierArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_WRITE, sizeof(int) * totalVertexCount, NULL, &errNum);
+    checkError(errNum, CL_SUCCESS);
+    session->frontierCountDevice = clCreateBuffer(gpuContext, CL_MEM_READ_WRITE, 2 * sizeof(int), NULL, &errNum);
+    checkError(errNum, CL_SUCCESS);
+
+    for (int iFlag = 0; iFlag < 2; iFlag++) {
+        session->changedFlagDevice[iFlag] = clCreateBuffer(gpuContext, CL_MEM_READ_WRITE, sizeof(int), NULL, &errNum);
+        checkError(errNum, CL_SUCCESS);
+    }
+
+    session->boundSlot = -1;
+    bindSlot(session, 0);
+}
+
+///
+///  Release the buffers allocated by allocateSampleBuffers. All runs must have been finished.
+///
+void releaseSampleBuffers(OCLSession *session)
+{
+    for (int iSlot = 0; iSlot < session->pipelineDepth; iSlot++) {
+        OCLSampleSlot *slot = &session->slotArray[iSlot];
+        clReleaseMemObject(slot->weightArrayDevice);
+        clReleaseMemObject(slot->sourceArrayDevice);
+        clReleaseMemObject(slot->maxCostArrayDevice);
+        if (slot->sumCostArrayDevice != NULL) {
+            clReleaseMemObject(slot->sumCostArrayDevice);
+        }
+        if (slot->shortestParentsArrayDevice != NULL) {
+            clReleaseMemObject(slot->shortestParentsArrayDevice);
+        }
+        free(slot->weightArray);
+        free(slot->sourceArray);
+        free(slot->costArray);
+        free(slot->sumCostArray);
+        free(slot->shortestParentsArray);
+    }
+    clReleaseMemObject(session->maskArrayDevice);
+    clReleaseMemObject(session->maxUpdatingCostArrayDevice);
+    if (session->sumUpdatingCostArrayDevice != NULL) {
+        clReleaseMemObject(session->sumUpdatingCostArrayDevice);
+    }
+    clReleaseMemObject(session->parentCountArrayDevice);
+    clReleaseMemObject(session->traversedEdgeCountArrayDevice);
+    clReleaseMemObject(session->frontierArrayDevice);
+    clReleaseMemObject(session->frontierCountDevice);
+    clReleaseMemObject(session->changedFlagDevice[0]);
+    clReleaseMemObject(session->changedFlagDevice[1]);
+}
+
+
+///
+///  Allocate the device buffers of a session and upload the topology of the graph. The per-sample buffers
+///  are only allocated here; runOCLSession fills them.
+///
+void allocateOCLBuffers(OCLSession *session, GraphData *graph)
+{
+    cl_int errNum;
+    cl_context gpuContext = session->context;
+
+    // Topology buffers, shared by all samples
+    session->vertexArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_ONLY, sizeof(int) * graph->vertexCount, NULL, &errNum);
+    checkError(errNum, CL_SUCCESS);
+    session->inverseVertexArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_ONLY, sizeof(int) * graph->vertexCount, NULL, &errNum);
+    checkError(errNum, CL_SUCCESS);
+    session->edgeArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_ONLY, sizeof(int) * graph->edgeCount, NULL, &errNum);
+    checkError(errNum, CL_SUCCESS);
+    session->inverseEdgeArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_ONLY, sizeof(int) * graph->edgeCount, NULL, &errNum);
+    checkError(errNum, CL_SUCCESS);
+    session->initialParentCountArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_ONLY, sizeof(int) * graph->vertexCount, NULL, &errNum);
+    checkError(errNum, CL_SUCCESS);
+    session->maxVertexArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_ONLY, sizeof(int) * graph->vertexCount, NULL, &errNum);
+    checkError(errNum, CL_SUCCESS);
+    session->inverseEdgeMapArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_ONLY, sizeof(int) * graph->edgeCount, NULL, &errNum);
+    checkError(errNum, CL_SUCCESS);
+    session->topologicalOrderArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_ONLY, sizeof(int) * graph->vertexCount, NULL, &errNum);
+    checkError(errNum, CL_SUCCESS);
+
+    // Now queue up the topology to be copied to the device
+    errNum = clEnqueueWriteBuffer(session->commandQueue, session->vertexArrayDevice, CL_FALSE, 0,
+                                  sizeof(int) * graph->vertexCount, graph->vertexArray, 0, NULL, NULL);
+    checkError(errNum, CL_SUCCESS);
+    errNum = clEnqueueWriteBuffer(session->commandQueue, session->inverseVertexArrayDevice, CL_FALSE, 0,
+                                  sizeof(int) * graph->vertexCount, graph->inverseVertexArray, 0, NULL, NULL);
+    checkError(errNum, CL_SUCCESS);
+    errNum = clEnqueueWriteBuffer(session->commandQueue, session->edgeArrayDevice, CL_FALSE, 0,
+                                  sizeof(int) * graph->edgeCount, graph->edgeArray, 0, NULL, NULL);
+    checkError(errNum, CL_SUCCESS);
+    errNum = clEnqueueWriteBuffer(session->commandQueue, session->inverseEdgeArrayDevice, CL_FALSE, 0,
+                                  sizeof(int) * graph->edgeCount, graph->inverseEdgeArray, 0, NULL, NULL);
+    checkError(errNum, CL_SUCCESS);
+    errNum = clEnqueueWriteBuffer(session->commandQueue, session->initialParentCountArrayDevice, CL_FALSE, 0,
+                                  sizeof(int) * graph->vertexCount, graph->parentCountArray, 0, NULL, NULL);
+    checkError(errNum, CL_SUCCESS);
+    errNum = clEnqueueWriteBuffer(session->commandQueue, session->maxVertexArrayDevice, CL_FALSE, 0,
+                                  sizeof(int) * graph->vertexCount, graph->maxVertexArray, 0, NULL, NULL);
+    checkError(errNum, CL_SUCCESS);
+    errNum = clEnqueueWriteBuffer(session->commandQueue, session->inverseEdgeMapArrayDevice, CL_FALSE, 0,
+                                  sizeof(int) * graph->edgeCount, graph->inverseEdgeMapArray, 0, NULL, NULL);
+    checkError(errNum, CL_SUCCESS);
+    errNum = clEnqueueWriteBuffer(session->commandQueue, session->topologicalOrderArrayDevice, CL_FALSE, 0,
+                                  sizeof(int) * graph->vertexCount, graph->topologicalOrderArray, 0, NULL, NULL);
+    checkError(errNum, CL_SUCCESS);
+
+    // The graph may be modified by the caller once the session has been created
+    clFinish(session->commandQueue);
+
+    allocateSampleBuffers(session);
+}
+
+
+///
+/// Bind the session buffers to the kernels. As the buffers live as long as the session, this is only done once.
+/// The source count of initializeKernel is set by runOCLSession.
+///
+int setKernelArguments(OCLSession *session) {
+
+    int graphCount = session->graphCount;
+    int vertexCount = session->vertexCount;
+    int edgeCount = session->edgeCount;
+    int totalVertexCount = graphCount * vertexCount;
+
+    // Set the arguments to initializeKernel
+    //
+    int errNum = 0;
+    errNum |= clSetKernelArg(session->initializeKernel, 0, sizeof(cl_mem), &session->maskArrayDevice);
+    errNum |= clSetKernelArg(session->initializeKernel, 1, sizeof(cl_mem), &session->maxCostArrayDevice);
+    errNum |= clSetKernelArg(session->initializeKernel, 2, sizeof(cl_mem), &session->maxUpdatingCostArrayDevice);
+    errNum |= clSetKernelArg(session->initializeKernel, 3, sizeof(cl_mem), &session->sumCostArrayDevice);
+    errNum |= clSetKernelArg(session->initializeKernel, 4, sizeof(cl_mem), &session->sumUpdatingCostArrayDevice);
+    errNum |= clSetKernelArg(session->initializeKernel, 5, sizeof(int), &vertexCount);
+    errNum |= clSetKernelArg(session->initializeKernel, 7, sizeof(cl_mem), &session->sourceArrayDevice);
+    errNum |= clSetKernelArg(session->initializeKernel, 8, sizeof(cl_mem), &session->parentCountArrayDevice);
+    errNum |= clSetKernelArg(session->initializeKernel, 9, sizeof(cl_mem), &session->initialParentCountArrayDevice);
+    errNum |= clSetKernelArg(session->initializeKernel, 10, sizeof(int), &graphCount);
+
+    // Set the arguments to ssspKernel1
+    errNum |= clSetKernelArg(session->ssspKernel1, 0, sizeof(cl_mem), &session->vertexArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel1, 1, sizeof(cl_mem), &session->inverseVertexArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel1, 2, sizeof(cl_mem), &session->edgeArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel1, 3, sizeof(cl_mem), &session->inverseEdgeArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel1, 4, sizeof(cl_mem), &session->weightArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel1, 5, sizeof(cl_mem), &session->inverseEdgeMapArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel1, 6, sizeof(cl_mem), &session->maskArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel1, 7, sizeof(cl_mem), &session->maxCostArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel1, 8, sizeof(cl_mem), &session->maxUpdatingCostArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel1, 9, sizeof(cl_mem), &session->sumCostArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel1, 10, sizeof(cl_mem), &session->sumUpdatingCostArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel1, 11, sizeof(int), &vertexCount);
+    errNum |= clSetKernelArg(session->ssspKernel1, 12, sizeof(int), &edgeCount);
+    errNum |= clSetKernelArg(session->ssspKernel1, 13, sizeof(cl_mem), &session->traversedEdgeCountArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel1, 14, sizeof(cl_mem), &session->parentCountArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel1, 15, sizeof(cl_mem), &session->maxVertexArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel1, 16, sizeof(cl_mem), &session->shortestParentsArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel1, 17, sizeof(int), &graphCount);
+
+    // Set the arguments to ssspKernel2
+    errNum |= clSetKernelArg(session->ssspKernel2, 0, sizeof(cl_mem), &session->vertexArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel2, 1, sizeof(cl_mem), &session->edgeArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel2, 2, sizeof(cl_mem), &session->weightArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel2, 3, sizeof(cl_mem), &session->maskArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel2, 4, sizeof(cl_mem), &session->maxCostArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel2, 5, sizeof(cl_mem), &session->maxUpdatingCostArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel2, 6, sizeof(cl_mem), &session->sumCostArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel2, 7, sizeof(cl_mem), &session->sumUpdatingCostArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel2, 8, sizeof(int), &totalVertexCount);
+    errNum |= clSetKernelArg(session->ssspKernel2, 9, sizeof(cl_mem), &session->maxVertexArrayDevice);
+
+    // The changed flag of ssspKernel2 (argument 10) alternates between batches and is set when they are enqueued
+
+    // Set the arguments to ssspQueueKernel1. The frontier size is set for every launch.
+    errNum |= clSetKernelArg(session->ssspQueueKernel1, 0, sizeof(cl_mem), &session->vertexArrayDevice);
+    errNum |= clSetKernelArg(session->ssspQueueKernel1, 1, sizeof(cl_mem), &session->inverseVertexArrayDevice);
+    errNum |= clSetKernelArg(session->ssspQueueKernel1, 2, sizeof(cl_mem), &session->edgeArrayDevice);
+    errNum |= clSetKernelArg(session->ssspQueueKernel1, 3, sizeof(cl_mem), &session->inverseEdgeArrayDevice);
+    errNum |= clSetKernelArg(session->ssspQueueKernel1, 4, sizeof(cl_mem), &session->weightArrayDevice);
+    errNum |= clSetKernelArg(session->ssspQueueKernel1, 5, sizeof(cl_mem), &session->inverseEdgeMapArrayDevice);
+    errNum |= clSetKernelArg(session->ssspQueueKernel1, 6, sizeof(cl_mem), &session->maskArrayDevice);
+    errNum |= clSetKernelArg(session->ssspQueueKernel1, 7, sizeof(cl_mem), &session->maxCostArrayDevice);
+    errNum |= clSetKernelArg(session->ssspQueueKernel1, 8, sizeof(cl_mem), &session->maxUpdatingCostArrayDevice);
+    errNum |= clSetKernelArg(session->ssspQueueKernel1, 9, sizeof(cl_mem), &session->sumCostArrayDevice);
+    errNum |= clSetKernelArg(session->ssspQueueKernel1, 10, sizeof(cl_mem), &session->sumUpdatingCostArrayDevice);
+    errNum |= clSetKernelArg(session->ssspQueueKernel1, 11, sizeof(int), &vertexCount);
+    errNum |= clSetKernelArg(session->ssspQueueKernel1, 12, sizeof(int), &edgeCount);
+    errNum |= clSetKernelArg(session->ssspQueueKernel1, 13, sizeof(cl_mem), &session->traversedEdgeCountArrayDevice);
+    errNum |= clSetKernelArg(session->ssspQueueKernel1, 14, sizeof(cl_mem), &session->parentCountArrayDevice);
+    errNum |= clSetKernelArg(session->ssspQueueKernel1, 15, sizeof(cl_mem), &session->maxVertexArrayDevice);
+    errNum |= clSetKernelArg(session->ssspQueueKernel1, 16, sizeof(cl_mem), &session->frontierArrayDevice);
+    errNum |= clSetKernelArg(session->ssspQueueKernel1, 18, sizeof(int), &graphCount);
+
+    // Set the arguments to ssspHubKernel1, which takes the same arguments as ssspQueueKernel1 up to the frontier
+    errNum |= clSetKernelArg(session->ssspHubKernel1, 0, sizeof(cl_mem), &session->vertexArrayDevice);
+    errNum |= clSetKernelArg(session->ssspHubKernel1, 1, sizeof(cl_mem), &session->inverseVertexArrayDevice);
+    errNum |= clSetKernelArg(session->ssspHubKernel1, 2, sizeof(cl_mem), &session->edgeArrayDevice);
+    errNum |= clSetKernelArg(session->ssspHubKernel1, 3, sizeof(cl_mem), &session->inverseEdgeArrayDevice);
+    errNum |= clSetKernelArg(session->ssspHubKernel1, 4, sizeof(cl_mem), &session->weightArrayDevice);
+    errNum |= clSetKernelArg(session->ssspHubKernel1, 5, sizeof(cl_mem), &session->inverseEdgeMapArrayDevice);
+    errNum |= clSetKernelArg(session->ssspHubKernel1, 6, sizeof(cl_mem), &session->maskArrayDevice);
+    errNum |= clSetKernelArg(session->ssspHubKernel1, 7, sizeof(cl_mem), &session->maxCostArrayDevice);
+    errNum |= clSetKernelArg(session->ssspHubKernel1, 8, sizeof(cl_mem), &session->maxUpdatingCostArrayDevice);
+    errNum |= clSetKernelArg(session->ssspHubKernel1, 9, sizeof(cl_mem), &session->sumCostArrayDevice);
+    errNum |= clSetKernelArg(session->ssspHubKernel1, 10, sizeof(cl_mem), &session->sumUpdatingCostArrayDevice);
+    errNum |= clSetKernelArg(session->ssspHubKernel1, 11, sizeof(int), &vertexCount);
+    errNum |= clSetKernelArg(session->ssspHubKernel1, 12, sizeof(int), &edgeCount);
+    errNum |= clSetKernelArg(session->ssspHubKernel1, 13, sizeof(cl_mem), &session->traversedEdgeCountArrayDevice);
+    errNum |= clSetKernelArg(session->ssspHubKernel1, 14, sizeof(cl_mem), &session->parentCountArrayDevice);
+    errNum |= clSetKernelArg(session->ssspHubKernel1, 15, sizeof(cl_mem), &session->maxVertexArrayDevice);
+    errNum |= clSetKernelArg(session->ssspHubKernel1, 16, sizeof(cl_mem), &session->frontierArrayDevice);
+    errNum |= clSetKernelArg(session->ssspHubKernel1, 17, sizeof(int), &totalVertexCount);
+    errNum |= clSetKernelArg(session->ssspHubKernel1, 18, sizeof(int), &graphCount);
+
+    // Set the arguments to sampleWeightsKernel. The seed, sample offset and distributions are set by setOCLWeightModel and runOCLSession.
+    errNum |= clSetKernelArg(session->sampleWeightsKernel, 0, sizeof(int), &edgeCount);
+    errNum |= clSetKernelArg(session->sampleWeightsKernel, 5, sizeof(cl_mem), &session->weightArrayDevice);
+    errNum |= clSetKernelArg(session->sampleWeightsKernel, 6, sizeof(int), &graphCount);
+
+    // Set the arguments to levelKernel. The level start and size are set for every launch.
+    errNum |= clSetKernelArg(session->levelKernel, 0, sizeof(cl_mem), &session->inverseVertexArrayDevice);
+    errNum |= clSetKernelArg(session->levelKernel, 1, sizeof(cl_mem), &session->inverseEdgeArrayDevice);
+    errNum |= clSetKernelArg(session->levelKernel, 2, sizeof(cl_mem), &session->inverseEdgeMapArrayDevice);
+    errNum |= clSetKernelArg(session->levelKernel, 3, sizeof(cl_mem), &session->sourceArrayDevice);
+    errNum |= clSetKernelArg(session->levelKernel, 4, sizeof(cl_mem), &session->maxCostArrayDevice);
+    errNum |= clSetKernelArg(session->levelKernel, 5, sizeof(cl_mem), &session->sumCostArrayDevice);
+    errNum |= clSetKernelArg(session->levelKernel, 6, sizeof(int), &vertexCount);
+    errNum |= clSetKernelArg(session->levelKernel, 7, sizeof(int), &edgeCount);
+    errNum |= clSetKernelArg(session->levelKernel, 8, sizeof(cl_mem), &session->maxVertexArrayDevice);
+    errNum |= clSetKernelArg(session->levelKernel, 9, sizeof(cl_mem), &session->topologicalOrderArrayDevice);
+    errNum |= clSetKernelArg(session->levelKernel, 12, sizeof(cl_mem), &session->changedFlagDevice[0]);
+    errNum |= clSetKernelArg(session->levelKernel, 13, sizeof(cl_mem), &session->weightArrayDevice);
+    errNum |= clSetKernelArg(session->levelKernel, 14, sizeof(int), &graphCount);
+
+    // Set the arguments to resetVerticesKernel. The list start and size are set for every launch.
+    errNum |= clSetKernelArg(session->resetVerticesKernel, 3, sizeof(int), &vertexCount);
+    errNum |= clSetKernelArg(session->resetVerticesKernel, 4, sizeof(cl_mem), &session->maxCostArrayDevice);
+    errNum |= clSetKernelArg(session->resetVerticesKernel, 5, sizeof(int), &graphCount);
+
+    // Set the arguments to ssspQueueKernel2. The hub degree is set by iterateWorklist.
+    errNum |= clSetKernelArg(session->ssspQueueKernel2, 0, sizeof(cl_mem), &session->maskArrayDevice);
+    errNum |= clSetKernelArg(session->ssspQueueKernel2, 1, sizeof(cl_mem), &session->maxCostArrayDevice);
+    errNum |= clSetKernelArg(session->ssspQueueKernel2, 2, sizeof(cl_mem), &session->maxUpdatingCostArrayDevice);
+    errNum |= clSetKernelArg(session->ssspQueueKernel2, 3, sizeof(cl_mem), &session->sumCostArrayDevice);
+    errNum |= clSetKernelArg(session->ssspQueueKernel2, 4, sizeof(cl_mem), &session->sumUpdatingCostArrayDevice);
+    errNum |= clSetKernelArg(session->ssspQueueKernel2, 5, sizeof(int), &totalVertexCount);
+    errNum |= clSetKernelArg(session->ssspQueueKernel2, 6, sizeof(cl_mem), &session->frontierArrayDevice);
+    errNum |= clSetKernelArg(session->ssspQueueKernel2, 7, sizeof(cl_mem), &session->frontierCountDevice);
+    errNum |= clSetKernelArg(session->ssspQueueKernel2, 8, sizeof(cl_mem), &session->vertexArrayDevice);
+    errNum |= clSetKernelArg(session->ssspQueueKernel2, 9, sizeof(int), &vertexCount);
+    errNum |= clSetKernelArg(session->ssspQueueKernel2, 10, sizeof(int), &edgeCount);
+    errNum |= clSetKernelArg(session->ssspQueueKernel2, 12, sizeof(int), &graphCount);
+
+    // Set the arguments to shortestParentsKernel
+    errNum |= clSetKernelArg(session->shortestParentsKernel, 0, sizeof(int), &vertexCount);
+    errNum |= clSetKernelArg(session->shortestParentsKernel, 1, sizeof(int), &edgeCount);
+    errNum |= clSetKernelArg(session->shortestParentsKernel, 2, sizeof(cl_mem), &session->vertexArrayDevice);
+    errNum |= clSetKernelArg(session->shortestParentsKernel, 3, sizeof(cl_mem), &session->inverseVertexArrayDevice);
+    errNum |= clSetKernelArg(session->shortestParentsKernel, 4, sizeof(cl_mem), &session->edgeArrayDevice);
+    errNum |= clSetKernelArg(session->shortestParentsKernel, 5, sizeof(cl_mem), &session->inverseEdgeArrayDevice);
+    errNum |= clSetKernelArg(session->shortestParentsKernel, 6, sizeof(cl_mem), &session->weightArrayDevice);
+    errNum |= clSetKernelArg(session->shortestParentsKernel, 7, sizeof(cl_mem), &session->inverseEdgeMapArrayDevice);
+    errNum |= clSetKernelArg(session->shortestParentsKernel, 8, sizeof(cl_mem), &session->maxCostArrayDevice);
+    errNum |= clSetKernelArg(session->shortestParentsKernel, 9, sizeof(cl_mem), &session->maxUpdatingCostArrayDevice);
+    errNum |= clSetKernelArg(session->shortestParentsKernel, 10, sizeof(cl_mem), &session->maxVertexArrayDevice);
+    errNum |= clSetKernelArg(session->shortestParentsKernel, 11, sizeof(cl_mem), &session->shortestParentsArrayDevice);
+    // All vertices, in topological order, unless an update narrows them down
+    errNum |= clSetKernelArg(session->shortestParentsKernel, 12, sizeof(cl_mem), &session->topologicalOrderArrayDevice);
+    errNum |= clSetKernelArg(session->shortestParentsKernel, 13, sizeof(int), &vertexCount);
+    errNum |= clSetKernelArg(session->shortestParentsKernel, 14, sizeof(int), &graphCount);
+
+    if (errNum != CL_SUCCESS)
+    {
+        printf("Error: Failed to set kernel arguments! %d\n", errNum);
+    }
+    return errNum;
+}
+
+///
+/// Bind the buffers of slot to the kernels, unless they already are
+///
+void bindSlot(OCLSession *session, int slot) {
+    if (slot == session->boundSlot) {
+        return;
+    }
+    OCLSampleSlot *sampleSlot = &session->slotArray[slot];
+    session->weightArrayDevice = sampleSlot->weightArrayDevice;
+    session->sourceArrayDevice = sampleSlot->sourceArrayDevice;
+    session->maxCostArrayDevice = sampleSlot->maxCostArrayDevice;
+    session->sumCostArrayDevice = sampleSlot->sumCostArrayDevice;
+    session->shortestParentsArrayDevice = sampleSlot->shortestParentsArrayDevice;
+    session->boundSlot = slot;
+    int errNum = setKernelArguments(session);
+    checkError(errNum, CL_SUCCESS);
+}
+
+///
+/// Enqueue NUM_ASYNCHRONOUS_ITERATIONS iterations of OCL_SSSP_KERNEL1 and OCL_SSSP_KERNEL2 over all vertices.
+/// changedFlag is cleared before the last OCL_SSSP_KERNEL2, so afterwards it is 0 only if no vertex is left
+/// marked for update.
+///
+void enqueueBatch(OCLSession *session, cl_mem changedFlag) {
+    int errNum;
+    cl_command_queue commandQueue = session->commandQueue;
+    size_t global = session->graphCount * session->vertexCount;
+    int zero = 0;
+
+    errNum = clSetKernelArg(session->ssspKernel2, 10, sizeof(cl_mem), &changedFlag);
+    checkError(errNum, CL_SUCCESS);
+
+    for(int asyncIter = 0; asyncIter < NUM_ASYNCHRONOUS_ITERATIONS; asyncIter++)
+    {
+        errNum = clEnqueueNDRangeKernel(commandQueue, session->ssspKernel1, 1, 0, &global, NULL, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_ITERATE, "OCL_SSSP_KERNEL1"));
+        checkError(errNum, CL_SUCCESS);
+
+        if (asyncIter == NUM_ASYNCHRONOUS_ITERATIONS - 1) {
+            errNum = clEnqueueFillBuffer(commandQueue, changedFlag, &zero, sizeof(int), 0, sizeof(int), 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_ITERATE, "Clear changed flag"));
+            checkError(errNum, CL_SUCCESS);
+        }
+
+        errNum = clEnqueueNDRangeKernel(commandQueue, session->ssspKernel2, 1, 0, &global, NULL, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_ITERATE, "OCL_SSSP_KERNEL2"));
+        checkError(errNum, CL_SUCCESS);
+    }
+}
+
+///
+/// Run OCL_SSSP_KERNEL1 and OCL_SSSP_KERNEL2 over all vertices until no vertex is marked for update.
+/// Returns the number of iterations.
+///
+int iterateAllVertices(OCLSession *session) {
+    int errNum;
+    cl_command_queue commandQueue = session->commandQueue;
+    int changedFlagHost[2];
+    cl_event readDone[2];
+
+    // In order to improve performance, we run some number of iterations
+    // without reading the results.  This might result in running more iterations
+    // than necessary at times, but it will in most cases be faster because
+    // we are doing less stalling of the GPU waiting for results.
+    // Only the 4 byte changed flag of each batch is read back, and the next batch is
+    // enqueued before waiting for it, so that the device is kept busy during the read.
+
+    int current = 0;
+    enqueueBatch(session, session->changedFlagDevice[current]);
+    errNum = clEnqueueReadBuffer(commandQueue, session->changedFlagDevice[current], CL_FALSE, 0, sizeof(int), &changedFlagHost[current], 0, NULL, &readDone[current]);
+    checkError(errNum, CL_SUCCESS);
+    recordOCLEvent(session->profiler, session->profilerDevice, 0, OCL_PHASE_ITERATE, "Read changed flag", readDone[current]);
+
+    int count = NUM_ASYNCHRONOUS_ITERATIONS;
+    while (true)
+    {
+        int next = 1 - current;
+        enqueueBatch(session, session->changedFlagDevice[next]);
+        errNum = clEnqueueReadBuffer(commandQueue, session->changedFlagDevice[next], CL_FALSE, 0, sizeof(int), &changedFlagHost[next], 0, NULL, &readDone[next]);
+        checkError(errNum, CL_SUCCESS);
+        recordOCLEvent(session->profiler, session->profilerDevice, 0, OCL_PHASE_ITERATE, "Read changed flag", readDone[next]);
+        count += NUM_ASYNCHRONOUS_ITERATIONS;
+
+        clWaitForEvents(1, &readDone[current]);
+        clReleaseEvent(readDone[current]);
+        if (changedFlagHost[current] == 0) {
+            // The batch in flight has nothing left to do, let it finish
+            clWaitForEvents(1, &readDone[next]);
+            clReleaseEvent(readDone[next]);
+            break;
+        }
+        current = next;
+    }
+    return count;
+}
+
+///
+/// Run the worklist kernels until the frontier is empty. Each OCL_SSSP_QUEUE_KERNEL1 is only launched over the
+/// vertices that the preceding OCL_SSSP_QUEUE_KERNEL2 put in the frontier. With degree buckets, vertices of at
+/// least HUB_DEGREE out-edges are relaxed by OCL_SSSP_HUB_KERNEL1 instead, one work-group each. Returns the number
+/// of iterations.
+///
+int iterateWorklist(OCLSession *session) {
+    int errNum;
+    cl_command_queue commandQueue = session->commandQueue;
+    size_t global = session->graphCount * session->vertexCount;
+    size_t hubLocal = HUB_WORK_GROUP_SIZE;
+    int zero[2] = {0, 0};
+    int frontierSize[2];
+
+    // Without degree buckets, no vertex is a hub
+    int hubDegree = session->useDegreeBuckets ? HUB_DEGREE : INT_MAX;
+    errNum = clSetKernelArg(session->ssspQueueKernel2, 11, sizeof(int), &hubDegree);
+    checkError(errNum, CL_SUCCESS);
+
+    // The first frontier consists of the sources marked by initializeBuffers
+    errNum = clEnqueueFillBuffer(commandQueue, session->frontierCountDevice, zero, sizeof(zero), 0, sizeof(zero), 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_ITERATE, "Clear frontier size"));
+    checkError(errNum, CL_SUCCESS);
+    errNum = clEnqueueNDRangeKernel(commandQueue, session->ssspQueueKernel2, 1, 0, &global, NULL, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_ITERATE, "OCL_SSSP_QUEUE_KERNEL2"));
+    checkError(errNum, CL_SUCCESS);
+    errNum = clEnqueueReadBuffer(commandQueue, session->frontierCountDevice, CL_TRUE, 0, sizeof(frontierSize), frontierSize, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_ITERATE, "Read frontier size"));
+    checkError(errNum, CL_SUCCESS);
+
+    int count = 0;
+    while (frontierSize[0] + frontierSize[1] > 0)
+    {
+        count ++;
+        if (frontierSize[0] > 0) {
+            size_t frontierGlobal = frontierSize[0];
+            errNum = clSetKernelArg(session->ssspQueueKernel1, 17, sizeof(int), &frontierSize[0]);
+            checkError(errNum, CL_SUCCESS);
+            errNum = clEnqueueNDRangeKernel(commandQueue, session->ssspQueueKernel1, 1, 0, &frontierGlobal, NULL, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_ITERATE, "OCL_SSSP_QUEUE_KERNEL1"));
+            checkError(errNum, CL_SUCCESS);
+        }
+        if (frontierSize[1] > 0) {
+            size_t hubGlobal = (size_t)frontierSize[1] * HUB_WORK_GROUP_SIZE;
+            errNum = clEnqueueNDRangeKernel(commandQueue, session->ssspHubKernel1, 1, 0, &hubGlobal, &hubLocal, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_ITERATE, "OCL_SSSP_HUB_KERNEL1"));
+            checkError(errNum, CL_SUCCESS);
+        }
+
+        errNum = clEnqueueFillBuffer(commandQueue, session->frontierCountDevice, zero, sizeof(zero), 0, sizeof(zero), 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_ITERATE, "Clear frontier size"));
+        checkError(errNum, CL_SUCCESS);
+        errNum = clEnqueueNDRangeKernel(commandQueue, session->ssspQueueKernel2, 1, 0, &global, NULL, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_ITERATE, "OCL_SSSP_QUEUE_KERNEL2"));
+        checkError(errNum, CL_SUCCESS);
+
+        errNum = clEnqueueReadBuffer(commandQueue, session->frontierCountDevice, CL_TRUE, 0, sizeof(frontierSize), frontierSize, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_ITERATE, "Read frontier size"));
+        checkError(errNum, CL_SUCCESS);
+    }
+    return count;
+}
+
+///
+/// Run levelKernel, OCL_LEVEL_KERNEL or OCL_SCENARIO_LEVEL_KERNEL, over the levelSize vertices from levelStart
+/// of the vertex list bound to it, which all belong to one level, in instanceCount samples or scenario samples.
+/// An acyclic level is launched once. A cyclic level is launched LEVEL_ITERATIONS_PER_READ
+/// times at a time, with its changed flag cleared before the last launch, until the flag stays 0. Nothing is
+/// read back for acyclic levels. Returns the number of launches.
+///
+int evaluateLevel(OCLSession *session, cl_kernel levelKernel, int instanceCount, int levelStart, int levelSize, bool cyclic) {
+    int errNum;
+    cl_command_queue commandQueue = session->commandQueue;
+    size_t global = (size_t)instanceCount * levelSize;
+    int zero = 0;
+    int count = 0;
+    const char *name = (levelKernel == session->levelKernel) ? "OCL_LEVEL_KERNEL" : (levelKernel == session->updateLevelKernel) ? "OCL_UPDATE_LEVEL_KERNEL" : "OCL_SCENARIO_LEVEL_KERNEL";
+
+    // Kernel arguments are captured when the kernel is enqueued, so they can be changed for the next level right away
+    errNum = clSetKernelArg(levelKernel, 10, sizeof(int), &levelStart);
+    errNum |= clSetKernelArg(levelKernel, 11, sizeof(int), &levelSize);
+    checkError(errNum, CL_SUCCESS);
+
+    if (!cyclic) {
+        errNum = clEnqueueNDRangeKernel(commandQueue, levelKernel, 1, 0, &global, NULL, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_ITERATE, name));
+        checkError(errNum, CL_SUCCESS);
+        return 1;
+    }
+
+    int changedFlagHost = 1;
+    while (changedFlagHost != 0) {
+        for (int iIteration = 0; iIteration < LEVEL_ITERATIONS_PER_READ; iIteration++) {
+            if (iIteration == LEVEL_ITERATIONS_PER_READ - 1) {
+                errNum = clEnqueueFillBuffer(commandQueue, session->changedFlagDevice[0], &zero, sizeof(int), 0, sizeof(int), 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_ITERATE, "Clear changed flag"));
+                checkError(errNum, CL_SUCCESS);
+            }
+            errNum = clEnqueueNDRangeKernel(commandQueue, levelKernel, 1, 0, &global, NULL, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_ITERATE, name));
+            checkError(errNum, CL_SUCCESS);
+            count++;
+        }
+        errNum = clEnqueueReadBuffer(commandQueue, session->changedFlagDevice[0], CL_TRUE, 0, sizeof(int), &changedFlagHost, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_ITERATE, "Read changed flag"));
+        checkError(errNum, CL_SUCCESS);
+    }
+    return count;
+}
+
+///
+/// Run OCL_LEVEL_KERNEL over the topological levels, in order. Returns the number of launches.
+///
+int iterateLevels(OCLSession *session) {
+    int errNum;
+    cl_command_queue commandQueue = session->commandQueue;
+    int infinity = INT_MAX;
+    int count = 0;
+
+    // The vertices of cyclic levels are evaluated from their current costs, which must start out as unreached
+    if (session->cyclicLevelCount > 0) {
+        errNum = clEnqueueFillBuffer(commandQueue, session->maxCostArrayDevice, &infinity, sizeof(int), 0, sizeof(int) * session->graphCount * session->vertexCount, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_SETUP, "Reset costs"));
+        checkError(errNum, CL_SUCCESS);
+    }
+
+    for (int iLevel = 0; iLevel < session->levelCount; iLevel++) {
+        int levelStart = session->levelStartArray[iLevel];
+        int levelSize = session->levelStartArray[iLevel + 1] - levelStart;
+        count += evaluateLevel(session, session->levelKernel, session->graphCount, levelStart, levelSize, session->cyclicLevelArray[iLevel]);
+    }
+    return count;
+}
+
+///
+/// Set up the OpenCL device, build the program and upload the topology of graph. The session can then be
+/// run on any graph with the same graph, vertex and edge counts and the same topology, e.g. after
+/// updateGraphWithNewRandomWeights.
+///
+OCLSession* createOCLSession(GraphData *graph) {
+    cl_device_id deviceId;
+    if (getDefaultComputeDevice(&deviceId) != CL_SUCCESS) {
+        exit(1);
+    }
+    return createOCLSessionOnDevice(graph, deviceId);
+}
+
+///
+/// Create a session as createOCLSession does, but on the given device.
+///
+OCLSession* createOCLSessionOnDevice(GraphData *graph, cl_device_id deviceId) {
+    OCLSession *session = (OCLSession*) malloc(sizeof(OCLSession));
+    session->deviceId = deviceId;
+    session->graphCount = graph->graphCount;
+    session->vertexCount = graph->vertexCount;
+    session->edgeCount = graph->edgeCount;
+    session->useWorklist = false;
+    session->useDegreeBuckets = false;
+    session->weightModel = NULL;
+    session->firstSample = 0;
+    session->distributionTypeArrayDevice = NULL;
+    session->distributionParameterArrayDevice = NULL;
+    session->levelCount = graph->levelCount;
+    session->cyclicLevelCount = graph->cyclicLevelCount;
+    session->levelStartArray = (int*) malloc((graph->levelCount + 1) * sizeof(int));
+    session->cyclicLevelArray = (int*) malloc(graph->levelCount * sizeof(int));
+    memcpy(session->levelStartArray, graph->levelStartArray, (graph->levelCount + 1) * sizeof(int));
+    memcpy(session->cyclicLevelArray, graph->cyclicLevelArray, graph->levelCount * sizeof(int));
+    session->useLevels = true;
+    session->useInterleavedLayout = false;
+    session->useSpecializedProgram = true;
+    session->computeSumCosts = true;
+    session->computeShortestParents = true;
+    session->program = NULL;
+    session->programVariantCount = 0;
+    session->pipelineDepth = 1;
+    session->profiler = NULL;
+    session->profilerDevice = 0;
+
+    // Set up OpenCL computing environment, getting command queue and context
+    if (initializeComputing(session->deviceId, &session->context, &session->commandQueue) != CL_SUCCESS) {
+        exit(1);
+    }
+    int errNum;
+    session->transferQueue = clCreateCommandQueue(session->context, session->deviceId, CL_QUEUE_PROFILING_ENABLE, &errNum);
+    checkError(errNum, CL_SUCCESS);
+
+    // Build the program (kernel.cl) for the session and create its kernels
+    selectProgramVariant(session);
+
+    // Allocate buffers in Device memory, upload the topology and set the kernel arguments
+    allocateOCLBuffers(session, graph);
+
+    return session;
+}
+
+///
+/// Finish all runs and reallocate the per-sample buffers after a change of the sample count, pipeline depth or
+/// any other configuration they depend on. The program is switched to the variant of the new configuration.
+///
+void reallocateSampleBuffers(OCLSession *session, int graphCount, int pipelineDepth) {
+    for (int iSlot = 0; iSlot < session->pipelineDepth; iSlot++) {
+        finishOCLSession(session, iSlot);
+    }
+    clFinish(session->commandQueue);
+    releaseSampleBuffers(session);
+    session->graphCount = graphCount;
+    session->pipelineDepth = pipelineDepth;
+    selectProgramVariant(session);
+    allocateSampleBuffers(session);
+    bindDistributions(session);
+}
+
+///
+/// Change the number of samples the session runs to graphCount. The buffers that depend on it are reallocated,
+/// and their contents are lost.
+///
+void resizeOCLSession(OCLSession *session, int graphCount) {
+    if (graphCount != session->graphCount) {
+        reallocateSampleBuffers(session, graphCount, session->pipelineDepth);
+    }
+}
+
+///
+/// Set the number of runs that can be in flight at once, from 1 to OCL_MAX_PIPELINE_DEPTH. Each slot beyond the
+/// first costs another set of the input and result buffers.
+///
+void setOCLPipelineDepth(OCLSession *session, int pipelineDepth) {
+    if (pipelineDepth < 1 || pipelineDepth > OCL_MAX_PIPELINE_DEPTH) {
+        printf("Error: Pipeline depth must be between 1 and %i!\n", OCL_MAX_PIPELINE_DEPTH);
+        exit(1);
+    }
+    if (pipelineDepth != session->pipelineDepth) {
+        reallocateSampleBuffers(session, session->graphCount, pipelineDepth);
+    }
+}
+
+///
+/// Draw the weights of subsequent runs from model on the device instead of uploading them. The distributions are
+/// uploaded here; the seed and sample offset are read from model at every run, so the caller can advance
+/// model->sampleOffset between runs. The model must outlive the session. NULL restores uploading.
+///
+void setOCLWeightModel(OCLSession *session, WeightModel *model) {
+    int errNum;
+
+    if (session->distributionTypeArrayDevice != NULL) {
+        clReleaseMemObject(session->distributionTypeArrayDevice);
+        clReleaseMemObject(session->distributionParameterArrayDevice);
+        session->distributionTypeArrayDevice = NULL;
+        session->distributionParameterArrayDevice = NULL;
+    }
+    session->weightModel = model;
+    if (model == NULL) {
+        return;
+    }
+    if (model->edgeCount != session->edgeCount) {
+        printf("Error: Weight model does not match the edge count of the OpenCL session!\n");
+        exit(1);
+    }
+
+    session->distributionTypeArrayDevice = clCreateBuffer(session->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(int) * model->edgeCount, model->distributionTypeArray, &errNum);
+    checkError(errNum, CL_SUCCESS);
+    session->distributionParameterArrayDevice = clCreateBuffer(session->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, 2 * sizeof(float) * model->edgeCount, model->distributionParameterArray, &errNum);
+    checkError(errNum, CL_SUCCESS);
+    bindDistributions(session);
+}
+
+///
+/// Bind the distributions of the weight model to SAMPLE_WEIGHTS, if there is one
+///
+void bindDistributions(OCLSession *session) {
+    if (session->distributionTypeArrayDevice == NULL) {
+        return;
+    }
+    int errNum = clSetKernelArg(session->sampleWeightsKernel, 3, sizeof(cl_mem), &session->distributionTypeArrayDevice);
+    errNum |= clSetKernelArg(session->sampleWeightsKernel, 4, sizeof(cl_mem), &session->distributionParameterArrayDevice);
+    checkError(errNum, CL_SUCCESS);
+}
+
+///
+/// Release the kernels of the session. The programs they were created from are kept as its variants.
+///
+void releaseKernels(OCLSession *session) {
+    clReleaseKernel(session->initializeKernel);
+    clReleaseKernel(session->ssspKernel1);
+    clReleaseKernel(session->ssspKernel2);
+    clReleaseKernel(session->shortestParentsKernel);
+    clReleaseKernel(session->ssspQueueKernel1);
+    clReleaseKernel(session->ssspQueueKernel2);
+    clReleaseKernel(session->ssspHubKernel1);
+    clReleaseKernel(session->sampleWeightsKernel);
+    clReleaseKernel(session->levelKernel);
+    clReleaseKernel(session->resetVerticesKernel);
+    clReleaseKernel(session->updateLevelKernel);
+    clReleaseKernel(session->updateShortestParentsKernel);
+    clReleaseKernel(session->scatterWeightsKernel);
+    clReleaseKernel(session->scenarioLevelKernel);
+    clReleaseKernel(session->gatherTargetsKernel);
+}
+
+///
+/// Build options of the program variant that the configuration of the session needs
+///
+void getProgramOptions(OCLSession *session, char *options, size_t size) {
+    int length = 0;
+    options[0] = '\0';
+    if (session->useInterleavedLayout) {
+        length += snprintf(options + length, size - length, " -D SAMPLE_INTERLEAVED");
+    }
+    if (session->useSpecializedProgram) {
+        length += snprintf(options + length, size - length, " -D VERTEX_COUNT=%i -D EDGE_COUNT=%i -D GRAPH_COUNT=%i", session->vertexCount, session->edgeCount, session->graphCount);
+    }
+    if (!session->computeSumCosts) {
+        length += snprintf(options + length, size - length, " -D NO_SUM_COSTS");
+    }
+}
+
+///
+/// Switch the session to the program variant of its configuration, building it unless it is among the variants
+/// the session already has, and recreate the kernels from it. Returns false if the session already uses it. The
+/// arguments of new kernels are unset, so the caller has to bind the buffers again. No run may be in flight.
+///
+bool selectProgramVariant(OCLSession *session) {
+    char options[OCL_MAX_BUILD_OPTIONS];
+    getProgramOptions(session, options, sizeof(options));
+    int count = session->programVariantCount;
+    OCLProgramVariant *variantArray = session->programVariantArray;
+    if (count > 0 && strcmp(variantArray[count - 1].options, options) == 0) {
+        return false;
+    }
+    if (session->program != NULL) {
+        releaseKernels(session);
+    }
+
+    // Take the variant out of the list, or make room for it, and put it last as the most recently used
+    OCLProgramVariant variant;
+    int iVariant = 0;
+    while (iVariant < count && strcmp(variantArray[iVariant].options, options) != 0) {
+        iVariant++;
+    }
+    if (iVariant < count) {
+        variant = variantArray[iVariant];
+    }
+    else {
+        snprintf(variant.options, sizeof(variant.options), "%s", options);
+        variant.program = loadAndBuildProgram(session->context, options);
+        if (!variant.program) {
+            printf("Error: Failed to create compute program!\n");
+            exit(1);
+        }
+        if (count == OCL_MAX_PROGRAM_VARIANTS) {
+            clReleaseProgram(variantArray[0].program);
+            iVariant = 0;
+        }
+        else {
+            count++;
+        }
+    }
+    memmove(&variantArray[iVariant], &variantArray[iVariant + 1], (count - 1 - iVariant) * sizeof(OCLProgramVariant));
+    variantArray[count - 1] = variant;
+    session->programVariantCount = count;
+    session->program = variant.program;
+
+    createKernels(&session->initializeKernel, &session->ssspKernel1, &session->ssspKernel2, &session->shortestParentsKernel, &session->ssspQueueKernel1, &session->ssspQueueKernel2, &session->ssspHubKernel1, &session->sampleWeightsKernel, &session->levelKernel, &session->resetVerticesKernel, &session->updateLevelKernel, &session->updateShortestParentsKernel, &session->scatterWeightsKernel, &session->scenarioLevelKernel, &session->gatherTargetsKernel, &session->program);
+    return true;
+}
+
+///
+/// Lay the per-sample buffers of subsequent runs out interleaved, the entries of all samples for a vertex or edge
+/// side by side, or sample-major. The program is switched to a variant with or without SAMPLE_INTERLEAVED, and the
+/// per-sample buffers are reallocated, so their contents are lost. The arrays of the graph stay sample-major either
+/// way.
+///
+void setOCLInterleavedLayout(OCLSession *session, bool interleaved) {
+    if (interleaved == session->useInterleavedLayout) {
+        return;
+    }
+    for (int iSlot = 0; iSlot < session->pipelineDepth; iSlot++) {
+        finishOCLSession(session, iSlot);
+    }
+    session->useInterleavedLayout = interleaved;
+    reallocateSampleBuffers(session, session->graphCount, session->pipelineDepth);
+}
+
+///
+/// Build the program of the session for its vertex, edge and sample counts, which is the default, or for any
+/// dimensions. A specialized program is rebuilt, or taken from the variants of the session, whenever the sample
+/// count changes. The results of the last run are kept.
+///
+void setOCLSpecialization(OCLSession *session, bool specialized) {
+    if (specialized == session->useSpecializedProgram) {
+        return;
+    }
+    for (int iSlot = 0; iSlot < session->pipelineDepth; iSlot++) {
+        finishOCLSession(session, iSlot);
+    }
+    clFinish(session->commandQueue);
+    session->useSpecializedProgram = specialized;
+    if (selectProgramVariant(session)) {
+        session->boundSlot = -1;
+        bindSlot(session, 0);
+        bindDistributions(session);
+    }
+}
+
+///
+/// Choose whether subsequent runs compute the sum costs and the shortest parents besides the costs. Results that
+/// are not computed are neither allocated on the device nor read back, and their arrays in the graph are left as
+/// they are. Turning off the sum costs switches to a program variant without them. The per-sample buffers are
+/// reallocated, so their contents are lost.
+///
+void setOCLResults(OCLSession *session, bool sumCosts, bool shortestParents) {
+    if (sumCosts == session->computeSumCosts && shortestParents == session->computeShortestParents) {
+        return;
+    }
+    for (int iSlot = 0; iSlot < session->pipelineDepth; iSlot++) {
+        finishOCLSession(session, iSlot);
+    }
+    session->computeSumCosts = sumCosts;
+    session->computeShortestParents = shortestParents;
+    reallocateSampleBuffers(session, session->graphCount, session->pipelineDepth);
+}
+
+///
+/// Record the commands of the session in profiler from now on, as those of device, or stop recording them if
+/// profiler is NULL. The profiler must outlive the session.
+///
+void setOCLProfiler(OCLSession *session, OCLProfiler *profiler, int device) {
+    collectOCLProfile(session->profiler, session->profilerDevice, true);
+    session->profiler = profiler;
+    session->profilerDevice = device;
+}
+
+// Event to enqueue a command on queue with, recorded as name in phase if the session is profiled, or NULL
+cl_event* profileEvent(OCLSession *session, cl_command_queue queue, OCLPhase phase, const char *name) {
+    return profileOCLCommand(session->profiler, session->profilerDevice, (queue == session->transferQueue) ? 1 : 0, phase, name);
+}
+
+///
+/// Upload the weights and sources of graph to the bound slot, or draw the weights on the device if the session
+/// has a weight model. In the interleaved layout, they are converted into the host copies of the slot first. The
+/// computations enqueued after this wait for the uploads.
+///
+void enqueueInputs(OCLSession *session, GraphData *graph) {
+    int errNum;
+    cl_command_queue commandQueue = session->commandQueue;
+    cl_command_queue transferQueue = session->transferQueue;
+    int totalVertexCount = graph->graphCount * graph->vertexCount;
+    int totalEdgeCount = graph->graphCount * graph->edgeCount;
+    int *weightArray = graph->weightArray;
+    int *sourceArray = graph->sourceArray;
+
+    if (session->useInterleavedLayout) {
+        OCLSampleSlot *slot = &session->slotArray[session->boundSlot];
+        if (session->weightModel == NULL) {
+            interleaveSamples(slot->weightArray, graph->weightArray, graph->graphCount, graph->edgeCount);
+        }
+        interleaveSamples(slot->sourceArray, graph->sourceArray, graph->graphCount, graph->vertexCount);
+        weightArray = slot->weightArray;
+        sourceArray = slot->sourceArray;
+    }
+
+    // Upload the inputs that change from run to run. The weights are either drawn on the device or uploaded.
+    errNum = clSetKernelArg(session->initializeKernel, 6, sizeof(int), &graph->sourceCount);
+    checkError(errNum, CL_SUCCESS);
+    if (session->weightModel == NULL) {
+        errNum = clEnqueueWriteBuffer(transferQueue, session->weightArrayDevice, CL_FALSE, 0, sizeof(int) * totalEdgeCount, weightArray, 0, NULL, profileEvent(session, transferQueue, OCL_PHASE_UPLOAD, "Upload weights"));
+        checkError(errNum, CL_SUCCESS);
+    }
+    cl_event uploadDone;
+    errNum = clEnqueueWriteBuffer(transferQueue, session->sourceArrayDevice, CL_FALSE, 0, sizeof(int) * totalVertexCount, sourceArray, 0, NULL, &uploadDone);
+    checkError(errNum, CL_SUCCESS);
+    recordOCLEvent(session->profiler, session->profilerDevice, 1, OCL_PHASE_UPLOAD, "Upload sources", uploadDone);
+    clFlush(transferQueue);
+
+    // The transfer queue is in order, so the last upload completes after the others
+    errNum = clEnqueueBarrierWithWaitList(commandQueue, 1, &uploadDone, NULL);
+    checkError(errNum, CL_SUCCESS);
+    clReleaseEvent(uploadDone);
+
+    if (session->weightModel != NULL) {
+        size_t edgeGlobal = totalEdgeCount;
+        errNum = clSetKernelArg(session->sampleWeightsKernel, 1, sizeof(cl_uint), &session->weightModel->seed);
+        int sampleOffset = session->weightModel->sampleOffset + session->firstSample;
+        errNum |= clSetKernelArg(session->sampleWeightsKernel, 2, sizeof(int), &sampleOffset);
+        checkError(errNum, CL_SUCCESS);
+        errNum = clEnqueueNDRangeKernel(commandQueue, session->sampleWeightsKernel, 1, NULL, &edgeGlobal, NULL, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_UPLOAD, "SAMPLE_WEIGHTS"));
+        checkError(errNum, CL_SUCCESS);
+    }
+}
+
+///
+/// Enqueue the computation of costArray, sumCostArray and shortestParentsArray of graph in slot of the session.
+/// Only the weights and sources are uploaded; the rest of the state is reset on the device. The call returns
+/// once everything is enqueued, and finishOCLSession waits for the results. Until then, the per-sample arrays of
+/// graph must be left alone. If the slot still holds an unfinished run, that run is finished first.
+///
+void enqueueOCLSession(OCLSession *session, GraphData *graph, int slot, bool debug) {
+
+    int errNum;                            // error code returned from api calls
+    size_t global;                      // global domain size for our calculation
+    cl_command_queue commandQueue = session->commandQueue;
+    cl_command_queue transferQueue = session->transferQueue;
+
+    if (graph->graphCount != session->graphCount || graph->vertexCount != session->vertexCount || graph->edgeCount != session->edgeCount) {
+        printf("Error: Graph does not match the dimensions of the OpenCL session!\n");
+        exit(1);
+    }
+    if (slot < 0 || slot >= session->pipelineDepth) {
+        printf("Error: Slot %i is outside the pipeline of the OpenCL session!\n", slot);
+        exit(1);
+    }
+    finishOCLSession(session, slot);
+    bindSlot(session, slot);
+
+    int totalVertexCount = graph->graphCount * graph->vertexCount;
+    int totalEdgeCount = graph->graphCount * graph->edgeCount;
+    int zero = 0;
+
+    enqueueInputs(session, graph);
+
+    // Execute the kernel over the entire range of our 1d input data set
+    // using the maximum number of work group items for this device
+    //
+    global = totalVertexCount;
+
+    int count;
+    if (session->useLevels) {
+        // Every vertex is written by its level, so there is no traversal state to reset
+        count = iterateLevels(session);
+        if (debug) {
+            printf("Evaluated %i topological levels (%i cyclic) in %i launches.\n", session->levelCount, session->cyclicLevelCount, count);
+        }
+    }
+    else {
+        // Initially, no edges have been travelled
+        errNum = clEnqueueFillBuffer(commandQueue, session->traversedEdgeCountArrayDevice, &zero, sizeof(int), 0, sizeof(int) * totalEdgeCount, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_SETUP, "Reset traversed edges"));
+        checkError(errNum, CL_SUCCESS);
+
+        errNum = clEnqueueNDRangeKernel(commandQueue, session->initializeKernel, 1, NULL, &global, NULL, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_INIT, "initializeBuffers"));
+        checkError(errNum, CL_SUCCESS);
+
+        if (session->useWorklist) {
+            count = iterateWorklist(session);
+        }
+        else {
+            count = iterateAllVertices(session);
+        }
+        if (debug) {
+            printf("Converged after %i iterations.\n", count);
+        }
+    }
+
+    if (session->computeShortestParents) {
+        errNum = clEnqueueNDRangeKernel(commandQueue, session->shortestParentsKernel, 1, 0, &global, NULL, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_SHORTEST_PARENTS, "SHORTEST_PARENTS"));
+        checkError(errNum, CL_SUCCESS);
+    }
+    cl_event computeDone;
+    errNum = clEnqueueMarkerWithWaitList(commandQueue, 0, NULL, &computeDone);
+    checkError(errNum, CL_SUCCESS);
+    clFlush(commandQueue);
+
+    // Read back the results from the device, while the next run may already compute. In the interleaved layout,
+    // finishOCLSession converts them into the arrays of the graph.
+    OCLSampleSlot *sampleSlot = &session->slotArray[slot];
+    int *costArray = graph->costArray;
+    int *sumCostArray = graph->sumCostArray;
+    int *shortestParentsArray = graph->shortestParentsArray;
+    if (session->useInterleavedLayout) {
+        costArray = sampleSlot->costArray;
+        sumCostArray = sampleSlot->sumCostArray;
+        shortestParentsArray = sampleSlot->shortestParentsArray;
+        sampleSlot->graph = graph;
+    }
+    errNum = clEnqueueReadBuffer(transferQueue, session->maxCostArrayDevice, CL_FALSE, 0, sizeof(int) * totalVertexCount, costArray, 1, &computeDone, profileEvent(session, transferQueue, OCL_PHASE_READBACK, "Read costs"));
+    checkError(errNum, CL_SUCCESS);
+    if (session->computeSumCosts) {
+        errNum = clEnqueueReadBuffer(transferQueue, session->sumCostArrayDevice, CL_FALSE, 0, sizeof(int) * totalVertexCount, sumCostArray, 0, NULL, profileEvent(session, transferQueue, OCL_PHASE_READBACK, "Read sum costs"));
+        checkError(errNum, CL_SUCCESS);
+    }
+    if (session->computeShortestParents) {
+        errNum = clEnqueueReadBuffer(transferQueue, session->shortestParentsArrayDevice, CL_FALSE, 0, sizeof(int) * totalEdgeCount, shortestParentsArray, 0, NULL, profileEvent(session, transferQueue, OCL_PHASE_READBACK, "Read shortest parents"));
+        checkError(errNum, CL_SUCCESS);
+    }
+    // The transfer queue is in order, so the marker completes with the last of the reads, whichever it is
+    errNum = clEnqueueMarkerWithWaitList(transferQueue, 0, NULL, &sampleSlot->readDone);
+    checkError(errNum, CL_SUCCESS);
+    clFlush(transferQueue);
+    clReleaseEvent(computeDone);
+}
+
+///
+/// Wait until the results of the run in slot have been read back, and in the interleaved layout convert them into
+/// the arrays of its graph. Does nothing if there is none.
+///
+void finishOCLSession(OCLSession *session, int slot) {
+    OCLSampleSlot *sampleSlot = &session->slotArray[slot];
+    if (sampleSlot->readDone != NULL) {
+        int errNum = clWaitForEvents(1, &sampleSlot->readDone);
+        checkError(errNum, CL_SUCCESS);
+        clReleaseEvent(sampleSlot->readDone);
+        sampleSlot->readDone = NULL;
+    }
+    collectOCLProfile(session->profiler, session->profilerDevice, false);
+    if (sampleSlot->graph != NULL) {
+        GraphData *graph = sampleSlot->graph;
+        deinterleaveSamples(graph->costArray, sampleSlot->costArray, graph->graphCount, graph->vertexCount);
+        if (sampleSlot->sumCostArray != NULL) {
+            deinterleaveSamples(graph->sumCostArray, sampleSlot->sumCostArray, graph->graphCount, graph->vertexCount);
+        }
+        if (sampleSlot->shortestParentsArray != NULL) {
+            deinterleaveSamples(graph->shortestParentsArray, sampleSlot->shortestParentsArray, graph->graphCount, graph->edgeCount);
+        }
+        sampleSlot->graph = NULL;
+    }
+}
+
+///
+/// Compute costArray, sumCostArray and shortestParentsArray of graph on the device of the session, and wait
+/// for the results.
+///
+void runOCLSession(OCLSession *session, GraphData *graph, bool debug) {
+    enqueueOCLSession(session, graph, 0, debug);
+    finishOCLSession(session, 0);
+}
+
+///
+/// Apply the weight changes to graph, whose results are those of the last run in slot 0, and bring the results
+/// up to date. graph must hold the weights of that run, so after a run with a weight model they must first be
+/// drawn with sampleWeightsOnCPU. The costs still on the device are kept, and only the vertices that
+/// collectAffectedVertices finds are re-evaluated, by OCL_UPDATE_LEVEL_KERNEL, in the changed samples only.
+/// Affected cyclic components are reset to unreached first, unless no weight that matters was raised. The changes
+/// are uploaded in one buffer and scattered into the weights by OCL_SCATTER_WEIGHTS, and in the sample-major
+/// layout only the results of the changed samples are read back.
+///
+void updateOCLSession(OCLSession *session, GraphData *graph, WeightChange *changeArray, int changeCount, bool debug) {
+    int errNum;
+    cl_command_queue commandQueue = session->commandQueue;
+    int vertexCount = session->vertexCount;
+    int edgeCount = session->edgeCount;
+    int graphCount = session->graphCount;
+
+    if (graph->graphCount != graphCount || graph->vertexCount != vertexCount || graph->edgeCount != edgeCount) {
+        printf("Error: Graph does not match the dimensions of the OpenCL session!\n");
+        exit(1);
+    }
+    if (changeCount == 0) {
+        return;
+    }
+    finishOCLSession(session, 0);
+    bindSlot(session, 0);
+
+    // The affected vertices are found from the old weights and costs
+    int *affectedArray = (int*) malloc(vertexCount * sizeof(int));
+    int *sampleArray = (int*) malloc(changeCount * sizeof(int));
+    bool reset;
+    int affectedCount = collectAffectedVertices(graph, changeArray, changeCount, affectedArray, &reset);
+    int sampleCount = collectChangedSamples(changeArray, changeCount, sampleArray);
+    applyWeightChanges(graph, changeArray, changeCount);
+
+    // Upload the changes as pairs of a weight index and a weight. The weights are taken from graph, so that
+    // repeated changes of the same weight all scatter the last one.
+    int *stagingArray = (int*) malloc(2 * changeCount * sizeof(int));
+    for (int iChange = 0; iChange < changeCount; iChange++) {
+        WeightChange *change = &changeArray[iChange];
+        stagingArray[2*iChange] = (session->useInterleavedLayout) ? change->edge * graphCount + change->sample : change->sample * edgeCount + change->edge;
+        stagingArray[2*iChange + 1] = graph->weightArray[(long)change->sample * edgeCount + change->edge];
+    }
+    cl_mem stagingArrayDevice = clCreateBuffer(session->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, 2 * changeCount * sizeof(int), stagingArray, &errNum);
+    checkError(errNum, CL_SUCCESS);
+    size_t changeGlobal = changeCount;
+    errNum = clSetKernelArg(session->scatterWeightsKernel, 0, sizeof(cl_mem), &stagingArrayDevice);
+    errNum |= clSetKernelArg(session->scatterWeightsKernel, 1, sizeof(cl_mem), &session->weightArrayDevice);
+    checkError(errNum, CL_SUCCESS);
+    errNum = clEnqueueNDRangeKernel(commandQueue, session->scatterWeightsKernel, 1, 0, &changeGlobal, NULL, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_UPLOAD, "OCL_SCATTER_WEIGHTS"));
+    checkError(errNum, CL_SUCCESS);
+
+    cl_mem affectedArrayDevice = NULL;
+    cl_mem sampleArrayDevice = clCreateBuffer(session->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(int) * sampleCount, sampleArray, &errNum);
+    checkError(errNum, CL_SUCCESS);
+    if (affectedCount > 0) {
+        affectedArrayDevice = clCreateBuffer(session->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(int) * affectedCount, affectedArray, &errNum);
+        checkError(errNum, CL_SUCCESS);
+    }
+
+    // Evaluate the affected vertices of the changed samples level by level, as runs of the affected list. The
+    // level start and size are set for every launch.
+    if (affectedCount > 0) {
+        errNum = clSetKernelArg(session->updateLevelKernel, 0, sizeof(cl_mem), &session->inverseVertexArrayDevice);
+        errNum |= clSetKernelArg(session->updateLevelKernel, 1, sizeof(cl_mem), &session->inverseEdgeArrayDevice);
+        errNum |= clSetKernelArg(session->updateLevelKernel, 2, sizeof(cl_mem), &session->inverseEdgeMapArrayDevice);
+        errNum |= clSetKernelArg(session->updateLevelKernel, 3, sizeof(cl_mem), &session->sourceArrayDevice);
+        errNum |= clSetKernelArg(session->updateLevelKernel, 4, sizeof(cl_mem), &session->maxCostArrayDevice);
+        errNum |= clSetKernelArg(session->updateLevelKernel, 5, sizeof(cl_mem), &session->sumCostArrayDevice);
+        errNum |= clSetKernelArg(session->updateLevelKernel, 6, sizeof(int), &vertexCount);
+        errNum |= clSetKernelArg(session->updateLevelKernel, 7, sizeof(int), &edgeCount);
+        errNum |= clSetKernelArg(session->updateLevelKernel, 8, sizeof(cl_mem), &session->maxVertexArrayDevice);
+        errNum |= clSetKernelArg(session->updateLevelKernel, 9, sizeof(cl_mem), &affectedArrayDevice);
+        errNum |= clSetKernelArg(session->updateLevelKernel, 12, sizeof(cl_mem), &session->changedFlagDevice[0]);
+        errNum |= clSetKernelArg(session->updateLevelKernel, 13, sizeof(cl_mem), &session->weightArrayDevice);
+        errNum |= clSetKernelArg(session->updateLevelKernel, 14, sizeof(int), &graphCount);
+        errNum |= clSetKernelArg(session->updateLevelKernel, 15, sizeof(cl_mem), &sampleArrayDevice);
+        errNum |= clSetKernelArg(session->updateLevelKernel, 16, sizeof(int), &sampleCount);
+        errNum |= clSetKernelArg(session->resetVerticesKernel, 0, sizeof(cl_mem), &affectedArrayDevice);
+        errNum |= clSetKernelArg(session->resetVerticesKernel, 6, sizeof(cl_mem), &sampleArrayDevice);
+        errNum |= clSetKernelArg(session->resetVerticesKernel, 7, sizeof(int), &sampleCount);
+        checkError(errNum, CL_SUCCESS);
+    }
+    int count = 0;
+    int iAffected = 0;
+    int iLevel = 0;
+    while (iAffected < affectedCount) {
+        int position = graph->topologicalPositionArray[affectedArray[iAffected]];
+        while (session->levelStartArray[iLevel + 1] <= position) {
+            iLevel++;
+        }
+        int segmentStart = iAffected;
+        while (iAffected < affectedCount && graph->topologicalPositionArray[affectedArray[iAffected]] < session->levelStartArray[iLevel + 1]) {
+            iAffected++;
+        }
+        int segmentSize = iAffected - segmentStart;
+        if (session->cyclicLevelArray[iLevel] && reset) {
+            size_t global = (size_t)sampleCount * segmentSize;
+            errNum = clSetKernelArg(session->resetVerticesKernel, 1, sizeof(int), &segmentStart);
+            errNum |= clSetKernelArg(session->resetVerticesKernel, 2, sizeof(int), &segmentSize);
+            checkError(errNum, CL_SUCCESS);
+            errNum = clEnqueueNDRangeKernel(commandQueue, session->resetVerticesKernel, 1, 0, &global, NULL, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_SETUP, "OCL_RESET_VERTICES"));
+            checkError(errNum, CL_SUCCESS);
+        }
+        count += evaluateLevel(session, session->updateLevelKernel, sampleCount, segmentStart, segmentSize, session->cyclicLevelArray[iLevel]);
+    }
+
+    // Shortest parents only change on the edges into affected vertices
+    if (affectedCount > 0 && session->computeShortestParents) {
+        size_t global = (size_t)sampleCount * affectedCount;
+        errNum = clSetKernelArg(session->updateShortestParentsKernel, 0, sizeof(int), &vertexCount);
+        errNum |= clSetKernelArg(session->updateShortestParentsKernel, 1, sizeof(int), &edgeCount);
+        errNum |= clSetKernelArg(session->updateShortestParentsKernel, 2, sizeof(cl_mem), &session->inverseVertexArrayDevice);
+        errNum |= clSetKernelArg(session->updateShortestParentsKernel, 3, sizeof(cl_mem), &session->inverseEdgeArrayDevice);
+        errNum |= clSetKernelArg(session->updateShortestParentsKernel, 4, sizeof(cl_mem), &session->weightArrayDevice);
+        errNum |= clSetKernelArg(session->updateShortestParentsKernel, 5, sizeof(cl_mem), &session->inverseEdgeMapArrayDevice);
+        errNum |= clSetKernelArg(session->updateShortestParentsKernel, 6, sizeof(cl_mem), &session->maxCostArrayDevice);
+        errNum |= clSetKernelArg(session->updateShortestParentsKernel, 7, sizeof(cl_mem), &session->maxVertexArrayDevice);
+        errNum |= clSetKernelArg(session->updateShortestParentsKernel, 8, sizeof(cl_mem), &session->shortestParentsArrayDevice);
+        errNum |= clSetKernelArg(session->updateShortestParentsKernel, 9, sizeof(cl_mem), &affectedArrayDevice);
+        errNum |= clSetKernelArg(session->updateShortestParentsKernel, 10, sizeof(int), &affectedCount);
+        errNum |= clSetKernelArg(session->updateShortestParentsKernel, 11, sizeof(int), &graphCount);
+        errNum |= clSetKernelArg(session->updateShortestParentsKernel, 12, sizeof(cl_mem), &sampleArrayDevice);
+        errNum |= clSetKernelArg(session->updateShortestParentsKernel, 13, sizeof(int), &sampleCount);
+        checkError(errNum, CL_SUCCESS);
+        errNum = clEnqueueNDRangeKernel(commandQueue, session->updateShortestParentsKernel, 1, 0, &global, NULL, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_SHORTEST_PARENTS, "OCL_UPDATE_SHORTEST_PARENTS"));
+        checkError(errNum, CL_SUCCESS);
+    }
+    if (debug) {
+        printf("Updated %i affected vertices in %i samples in %i launches.\n", affectedCount, sampleCount, count);
+    }
+
+    // Read back the changed samples, the others are as they were. In the interleaved layout the samples are not
+    // contiguous, so everything is read back through the host copies of slot 0 and converted.
+    if (session->useInterleavedLayout) {
+        OCLSampleSlot *slot = &session->slotArray[0];
+        size_t totalVertexCount = (size_t)session->graphCount * vertexCount;
+        size_t totalEdgeCount = (size_t)session->graphCount * edgeCount;
+        errNum = clEnqueueReadBuffer(commandQueue, session->maxCostArrayDevice, CL_FALSE, 0, sizeof(int) * totalVertexCount, slot->costArray, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_READBACK, "Read costs"));
+        checkError(errNum, CL_SUCCESS);
+        if (session->computeSumCosts) {
+            errNum = clEnqueueReadBuffer(commandQueue, session->sumCostArrayDevice, CL_FALSE, 0, sizeof(int) * totalVertexCount, slot->sumCostArray, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_READBACK, "Read sum costs"));
+            checkError(errNum, CL_SUCCESS);
+        }
+        if (session->computeShortestParents) {
+            errNum = clEnqueueReadBuffer(commandQueue, session->shortestParentsArrayDevice, CL_FALSE, 0, sizeof(int) * totalEdgeCount, slot->shortestParentsArray, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_READBACK, "Read shortest parents"));
+            checkError(errNum, CL_SUCCESS);
+        }
+        slot->graph = graph;
+    }
+    else {
+        for (int iSample = 0; iSample < sampleCount; iSample++) {
+            size_t vertexOffset = (size_t)sampleArray[iSample] * vertexCount;
+            size_t edgeOffset = (size_t)sampleArray[iSample] * edgeCount;
+            errNum = clEnqueueReadBuffer(commandQueue, session->maxCostArrayDevice, CL_FALSE, sizeof(int) * vertexOffset, sizeof(int) * vertexCount, graph->costArray + vertexOffset, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_READBACK, "Read costs"));
+            checkError(errNum, CL_SUCCESS);
+            if (session->computeSumCosts) {
+                errNum = clEnqueueReadBuffer(commandQueue, session->sumCostArrayDevice, CL_FALSE, sizeof(int) * vertexOffset, sizeof(int) * vertexCount, graph->sumCostArray + vertexOffset, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_READBACK, "Read sum costs"));
+                checkError(errNum, CL_SUCCESS);
+            }
+            if (session->computeShortestParents) {
+                errNum = clEnqueueReadBuffer(commandQueue, session->shortestParentsArrayDevice, CL_FALSE, sizeof(int) * edgeOffset, sizeof(int) * edgeCount, graph->shortestParentsArray + edgeOffset, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_READBACK, "Read shortest parents"));
+                checkError(errNum, CL_SUCCESS);
+            }
+        }
+    }
+    clFinish(commandQueue);
+    finishOCLSession(session, 0);
+
+    if (affectedArrayDevice != NULL) {
+        clReleaseMemObject(affectedArrayDevice);
+    }
+    clReleaseMemObject(sampleArrayDevice);
+    clReleaseMemObject(stagingArrayDevice);
+    free(stagingArray);
+    free(affectedArray);
+    free(sampleArray);
+}
+
+///
+/// Evaluate every scenario of batch on the samples of graph, and add the costs at its targets to the aggregates of
+/// batch. The weights and sources are uploaded, or drawn, once, and shared by all scenarios. The scenarios are run
+/// in chunks of as many as fit in one device buffer of costs, all samples of all scenarios of a chunk in the same
+/// launches of OCL_SCENARIO_LEVEL_KERNEL. Only the costs at the targets are read back. The results of the last run
+/// of the session are lost.
+///
+void runOCLScenarios(OCLSession *session, GraphData *graph, ScenarioBatch *batch, bool debug) {
+    int errNum;
+    cl_command_queue commandQueue = session->commandQueue;
+    int graphCount = session->graphCount;
+    int vertexCount = session->vertexCount;
+    int edgeCount = session->edgeCount;
+    int maskWordCount = batch->maskWordCount;
+    int targetCount = batch->targetCount;
+
+    if (graph->graphCount != graphCount || graph->vertexCount != vertexCount || graph->edgeCount != edgeCount || batch->edgeCount != edgeCount) {
+        printf("Error: Graph does not match the dimensions of the OpenCL session!\n");
+        exit(1);
+    }
+    for (int iSlot = 0; iSlot < session->pipelineDepth; iSlot++) {
+        finishOCLSession(session, iSlot);
+    }
+    bindSlot(session, 0);
+    enqueueInputs(session, graph);
+
+    // As many scenarios per chunk as fit in one buffer, and in the int range of the kernels' work-item ids
+    cl_ulong maxAllocSize;
+    errNum = clGetDeviceInfo(session->deviceId, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &maxAllocSize, NULL);
+    checkError(errNum, CL_SUCCESS);
+    long scenarioVertexCount = (long)graphCount * vertexCount;
+    long chunkSize = (long)(maxAllocSize / (sizeof(int) * scenarioVertexCount));
+    if (chunkSize > INT_MAX / scenarioVertexCount) {
+        chunkSize = INT_MAX / scenarioVertexCount;
+    }
+    if (chunkSize > batch->scenarioCount) {
+        chunkSize = batch->scenarioCount;
+    }
+    if (chunkSize < 1) {
+        printf("Error: The samples of one scenario do not fit in the memory of the device!\n");
+        exit(1);
+    }
+
+    cl_mem costArrayDevice = clCreateBuffer(session->context, CL_MEM_READ_WRITE, sizeof(int) * chunkSize * scenarioVertexCount, NULL, &errNum);
+    checkError(errNum, CL_SUCCESS);
+    // One word more than the masks, as a graph without edges has none
+    cl_mem maskArrayDevice = clCreateBuffer(session->context, CL_MEM_READ_ONLY, sizeof(cl_uint) * (chunkSize * maskWordCount + 1), NULL, &errNum);
+    checkError(errNum, CL_SUCCESS);
+    cl_mem targetArrayDevice = clCreateBuffer(session->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(int) * targetCount, batch->targetArray, &errNum);
+    checkError(errNum, CL_SUCCESS);
+    cl_mem targetCostArrayDevice = clCreateBuffer(session->context, CL_MEM_WRITE_ONLY, sizeof(int) * chunkSize * graphCount * targetCount, NULL, &errNum);
+    checkError(errNum, CL_SUCCESS);
+    int *targetCostArray = (int*) malloc(sizeof(int) * chunkSize * graphCount * targetCount);
+
+    // Everything but the costs and the masks is shared with OCL_LEVEL_KERNEL
+    errNum = clSetKernelArg(session->scenarioLevelKernel, 0, sizeof(cl_mem), &session->inverseVertexArrayDevice);
+    errNum |= clSetKernelArg(session->scenarioLevelKernel, 1, sizeof(cl_mem), &session->inverseEdgeArrayDevice);
+    errNum |= clSetKernelArg(session->scenarioLevelKernel, 2, sizeof(cl_mem), &session->inverseEdgeMapArrayDevice);
+    errNum |= clSetKernelArg(session->scenarioLevelKernel, 3, sizeof(cl_mem), &session->sourceArrayDevice);
+    errNum |= clSetKernelArg(session->scenarioLevelKernel, 4, sizeof(cl_mem), &costArrayDevice);
+    errNum |= clSetKernelArg(session->scenarioLevelKernel, 5, sizeof(cl_mem), &session->sumCostArrayDevice);
+    errNum |= clSetKernelArg(session->scenarioLevelKernel, 6, sizeof(int), &vertexCount);
+    errNum |= clSetKernelArg(session->scenarioLevelKernel, 7, sizeof(int), &edgeCount);
+    errNum |= clSetKernelArg(session->scenarioLevelKernel, 8, sizeof(cl_mem), &session->maxVertexArrayDevice);
+    errNum |= clSetKernelArg(session->scenarioLevelKernel, 9, sizeof(cl_mem), &session->topologicalOrderArrayDevice);
+    errNum |= clSetKernelArg(session->scenarioLevelKernel, 12, sizeof(cl_mem), &session->changedFlagDevice[0]);
+    errNum |= clSetKernelArg(session->scenarioLevelKernel, 13, sizeof(int), &graphCount);
+    errNum |= clSetKernelArg(session->scenarioLevelKernel, 14, sizeof(cl_mem), &maskArrayDevice);
+    errNum |= clSetKernelArg(session->scenarioLevelKernel, 15, sizeof(int), &maskWordCount);
+    errNum |= clSetKernelArg(session->scenarioLevelKernel, 16, sizeof(cl_mem), &session->weightArrayDevice);
+    errNum |= clSetKernelArg(session->gatherTargetsKernel, 0, sizeof(cl_mem), &costArrayDevice);
+    errNum |= clSetKernelArg(session->gatherTargetsKernel, 1, sizeof(int), &vertexCount);
+    errNum |= clSetKernelArg(session->gatherTargetsKernel, 2, sizeof(cl_mem), &targetArrayDevice);
+    errNum |= clSetKernelArg(session->gatherTargetsKernel, 3, sizeof(int), &targetCount);
+    errNum |= clSetKernelArg(session->gatherTargetsKernel, 4, sizeof(cl_mem), &targetCostArrayDevice);
+    checkError(errNum, CL_SUCCESS);
+
+    int infinity = INT_MAX;
+    int count = 0;
+    for (int firstScenario = 0; firstScenario < batch->scenarioCount; firstScenario += chunkSize) {
+        int scenarioCount = (int)(batch->scenarioCount - firstScenario < chunkSize ? batch->scenarioCount - firstScenario : chunkSize);
+        int instanceCount = scenarioCount * graphCount;
+        errNum = clSetKernelArg(session->scenarioLevelKernel, 17, sizeof(int), &instanceCount);
+        errNum |= clSetKernelArg(session->gatherTargetsKernel, 5, sizeof(int), &instanceCount);
+        checkError(errNum, CL_SUCCESS);
+
+        if (maskWordCount > 0) {
+            errNum = clEnqueueWriteBuffer(commandQueue, maskArrayDevice, CL_FALSE, 0, sizeof(cl_uint) * scenarioCount * maskWordCount, batch->disabledEdgeMaskArray + (long)firstScenario * maskWordCount, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_UPLOAD, "Upload scenario masks"));
+            checkError(errNum, CL_SUCCESS);
+        }
+        if (session->cyclicLevelCount > 0) {
+            errNum = clEnqueueFillBuffer(commandQueue, costArrayDevice, &infinity, sizeof(int), 0, sizeof(int) * instanceCount * vertexCount, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_SETUP, "Reset costs"));
+            checkError(errNum, CL_SUCCESS);
+        }
+        for (int iLevel = 0; iLevel < session->levelCount; iLevel++) {
+            int levelStart = session->levelStartArray[iLevel];
+            int levelSize = session->levelStartArray[iLevel + 1] - levelStart;
+            count += evaluateLevel(session, session->scenarioLevelKernel, instanceCount, levelStart, levelSize, session->cyclicLevelArray[iLevel]);
+        }
+
+        size_t global = (size_t)instanceCount * targetCount;
+        if (global > 0) {
+            errNum = clEnqueueNDRangeKernel(commandQueue, session->gatherTargetsKernel, 1, 0, &global, NULL, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_READBACK, "OCL_GATHER_TARGETS"));
+            checkError(errNum, CL_SUCCESS);
+            errNum = clEnqueueReadBuffer(commandQueue, targetCostArrayDevice, CL_TRUE, 0, sizeof(int) * global, targetCostArray, 0, NULL, profileEvent(session, commandQueue, OCL_PHASE_READBACK, "Read target costs"));
+            checkError(errNum, CL_SUCCESS);
+        }
+        accumulateScenarioCosts(batch, firstScenario, scenarioCount, graphCount, targetCostArray);
+    }
+    batch->sampleCount += graphCount;
+    if (debug) {
+        printf("Evaluated %i scenarios of %i samples in chunks of %li, in %i launches.\n", batch->scenarioCount, graphCount, chunkSize, count);
+    }
+
+    clReleaseMemObject(costArrayDevice);
+    clReleaseMemObject(maskArrayDevice);
+    clReleaseMemObject(targetArrayDevice);
+    clReleaseMemObject(targetCostArrayDevice);
+    free(targetCostArray);
+}
+
+void releaseOCLSession(OCLSession *session) {
+    for (int iSlot = 0; iSlot < session->pipelineDepth; iSlot++) {
+        finishOCLSession(session, iSlot);
+    }
+    clFinish(session->commandQueue);
+    collectOCLProfile(session->profiler, session->profilerDevice, true);
+    clReleaseMemObject(session->vertexArrayDevice);
+    clReleaseMemObject(session->inverseVertexArrayDevice);
+    clReleaseMemObject(session->edgeArrayDevice);
+    clReleaseMemObject(session->inverseEdgeArrayDevice);
+    clReleaseMemObject(session->initialParentCountArrayDevice);
+    clReleaseMemObject(session->maxVertexArrayDevice);
+    clReleaseMemObject(session->inverseEdgeMapArrayDevice);
+    clReleaseMemObject(session->topologicalOrderArrayDevice);
+    if (session->distributionTypeArrayDevice != NULL) {
+        clReleaseMemObject(session->distributionTypeArrayDevice);
+        clReleaseMemObject(session->distributionParameterArrayDevice);
+    }
+    releaseSampleBuffers(session);
+
+    releaseKernels(session);
+    for (int iVariant = 0; iVariant < session->programVariantCount; iVariant++) {
+        clReleaseProgram(session->programVariantArray[iVariant].program);
+    }
+    clReleaseCommandQueue(session->commandQueue);
+    clReleaseCommandQueue(session->transferQueue);
+    clReleaseContext(session->context);
+    clReleaseDevice(session->deviceId);
+    free(session->levelStartArray);
+    free(session->cyclicLevelArray);
+    free(session);
+}
+
+///
+/// One-off computation of graph. Callers computing several weight samplings of the same graph should keep an
+/// OCLSession instead, so that the device setup is only done once.
+///
+void calculateGraphs(GraphData *graph, bool debug) {
+    OCLSession *session = createOCLSession(graph);
+    runOCLSession(session, graph, debug);
+    releaseOCLSession(session);
+}
@@ -0,0 +1,204 @@
+//
+//  oclengine.hpp
+//  OpenCLDijkstra
+//
+
+#ifndef oclengine_hpp
+#define oclengine_hpp
+
+#include <stdio.h>
+#include "graph.hpp"
+#include "weightmodel.hpp"
+#include "scenario.hpp"
+#include "oclprofiler.hpp"
+
+#define __CL_ENABLE_EXCEPTIONS
+#if defined(__APPLE__) || defined(__MACOSX)
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.hpp>
+#endif
+
+
+///
+//  Types
+//
+//
+//  An OpenCL session holds everything that only depends on the topology of a
+//  graph, so that it can be run for any number of weight samplings of the
+//  same graph. Each run uploads the weights and sources, evaluates the graph
+//  on the device and reads back the results.
+//
+
+#define OCL_MAX_PIPELINE_DEPTH 4
+#define OCL_MAX_PROGRAM_VARIANTS 4
+#define OCL_MAX_BUILD_OPTIONS 256
+
+typedef struct
+{
+    char options[OCL_MAX_BUILD_OPTIONS];
+    cl_program program;
+} OCLProgramVariant;
+
+typedef struct
+{
+    // Inputs, uploaded for every run. One entry per vertex or edge of every sample.
+    cl_mem weightArrayDevice;
+    cl_mem sourceArrayDevice;
+
+    // Results, read back after every run. The sum costs and shortest parents are NULL if they are not computed.
+    cl_mem maxCostArrayDevice;
+    cl_mem sumCostArrayDevice;
+    cl_mem shortestParentsArrayDevice;
+
+    // Completion of the readback of the last run enqueued in the slot, or NULL once it has been finished
+    cl_event readDone;
+
+    // In the interleaved layout, host copies of the inputs and results of the slot in that layout, and the graph
+    // the results of its last run are converted into when it is finished. NULL otherwise.
+    int *weightArray;
+    int *sourceArray;
+    int *costArray;
+    int *sumCostArray;
+    int *shortestParentsArray;
+    GraphData *graph;
+
+} OCLSampleSlot;
+
+typedef struct
+{
+    // Dimensions the session was created for
+    int graphCount;
+    int vertexCount;
+    int edgeCount;
+
+    cl_device_id deviceId;
+    cl_context context;
+    cl_command_queue commandQueue;
+    cl_command_queue transferQueue;
+    cl_program program;
+
+    cl_kernel initializeKernel;
+    cl_kernel ssspKernel1;
+    cl_kernel ssspKernel2;
+    cl_kernel shortestParentsKernel;
+    cl_kernel ssspQueueKernel1;
+    cl_kernel ssspQueueKernel2;
+    cl_kernel ssspHubKernel1;
+
+    cl_kernel sampleWeightsKernel;
+    cl_kernel levelKernel;
+    cl_kernel resetVerticesKernel;
+    cl_kernel updateLevelKernel;
+    cl_kernel updateShortestParentsKernel;
+    cl_kernel scatterWeightsKernel;
+    cl_kernel scenarioLevelKernel;
+    cl_kernel gatherTargetsKernel;
+
+    // Relax only the vertices in the frontier queue rather than all vertices. Pays off when frontiers are small,
+    // e.g. on deep, sparse graphs.
+    bool useWorklist;
+
+    // In worklist mode, relax vertices of high out-degree with a work-group each rather than a work-item
+    bool useDegreeBuckets;
+
+    // Evaluate the graph level by level, in topological order of its strongly connected components, rather than
+    // iterating over all vertices. Only cyclic levels are launched more than once.
+    bool useLevels;
+
+    // Lay the per-sample buffers out sample-interleaved rather than sample-major. Set by setOCLInterleavedLayout.
+    bool useInterleavedLayout;
+
+    // Build the program for the dimensions of the session. Set by setOCLSpecialization.
+    bool useSpecializedProgram;
+
+    // Results computed besides the costs. Set by setOCLResults.
+    bool computeSumCosts;
+    bool computeShortestParents;
+
+    // Programs built for the configurations used so far, the least recently used first. The last one is program.
+    int programVariantCount;
+    OCLProgramVariant programVariantArray[OCL_MAX_PROGRAM_VARIANTS];
+
+    // Topological levels of the components of the graph, as in GraphData
+    int levelCount;
+    int *levelStartArray;
+    int *cyclicLevelArray;
+    int cyclicLevelCount;
+
+    // Distributions to draw the weights from, or NULL to upload the weights of the graph
+    WeightModel *weightModel;
+
+    // Index of the first sample of the session among all samples drawn from weightModel, for sessions that
+    // only run a share of the samples
+    int firstSample;
+
+    // Topology, uploaded once. One entry per vertex or edge of a single sample.
+    cl_mem vertexArrayDevice;
+    cl_mem inverseVertexArrayDevice;
+    cl_mem edgeArrayDevice;
+    cl_mem inverseEdgeArrayDevice;
+    cl_mem initialParentCountArrayDevice;
+    cl_mem maxVertexArrayDevice;
+    cl_mem inverseEdgeMapArrayDevice;
+    cl_mem topologicalOrderArrayDevice;
+
+    // Distribution of each edge, uploaded by setOCLWeightModel
+    cl_mem distributionTypeArrayDevice;
+    cl_mem distributionParameterArrayDevice;
+
+    // Buffers of each slot, and the slot whose buffers are bound to the kernels. Runs are pipelined over the slots
+    // by enqueueOCLSession and finishOCLSession, with transfers on transferQueue and computations on commandQueue.
+    int pipelineDepth;
+    OCLSampleSlot slotArray[OCL_MAX_PIPELINE_DEPTH];
+    int boundSlot;
+
+    // The buffers of the bound slot
+    cl_mem weightArrayDevice;
+    cl_mem sourceArrayDevice;
+    cl_mem maxCostArrayDevice;
+    cl_mem sumCostArrayDevice;
+    cl_mem shortestParentsArrayDevice;
+
+    // Traversal state, reset on the device for every run and shared by the slots. The costs stay on the device
+    // after a run, for updateOCLSession.
+    cl_mem maskArrayDevice;
+    cl_mem maxUpdatingCostArrayDevice;
+    cl_mem sumUpdatingCostArrayDevice;
+    cl_mem traversedEdgeCountArrayDevice;
+    cl_mem parentCountArrayDevice;
+
+    // Frontier queue of the worklist mode, and the number of vertices in it
+    cl_mem frontierArrayDevice;
+    cl_mem frontierCountDevice;
+
+    // Profiler recording the commands of the session, or NULL, and the device number they are recorded under
+    OCLProfiler *profiler;
+    int profilerDevice;
+
+    // Convergence flags raised by OCL_SSSP_KERNEL2. Batches alternate between them so that the flag of one
+    // batch can be read back while the next batch runs.
+    cl_mem changedFlagDevice[2];
+
+} OCLSession;
+
+int getDefaultComputeDevice(cl_device_id *device_id);
+int getComputeDevices(cl_device_id *deviceArray, int maxDeviceCount);
+OCLSession* createOCLSession(GraphData *graph);
+OCLSession* createOCLSessionOnDevice(GraphData *graph, cl_device_id deviceId);
+void resizeOCLSession(OCLSession *session, int graphCount);
+void setOCLPipelineDepth(OCLSession *session, int pipelineDepth);
+void setOCLWeightModel(OCLSession *session, WeightModel *model);
+void setOCLInterleavedLayout(OCLSession *session, bool interleaved);
+void setOCLSpecialization(OCLSession *session, bool specialized);
+void setOCLResults(OCLSession *session, bool sumCosts, bool shortestParents);
+void setOCLProfiler(OCLSession *session, OCLProfiler *profiler, int device);
+void enqueueOCLSession(OCLSession *session, GraphData *graph, int slot, bool debug);
+void finishOCLSession(OCLSession *session, int slot);
+void runOCLSession(OCLSession *session, GraphData *graph, bool debug);
+void updateOCLSession(OCLSession *session, GraphData *graph, WeightChange *changeArray, int changeCount, bool debug);
+void runOCLScenarios(OCLSession *session, GraphData *graph, ScenarioBatch *batch, bool debug);
+void releaseOCLSession(OCLSession *session);
+void calculateGraphs(GraphData *graph, bool debug);
+
+#endif /* oclengine_hpp */
@@ -0,0 +1,266 @@
+//
+//  oclprofiler.cpp
+//  OpenCLDijkstra
+//
+
+#include "oclprofiler.hpp"
+#include <stdlib.h>
+#include <string.h>
+
+#define checkError(a, b) checkErrorFileLine(a, b, __FILE__ , __LINE__)
+#define MAX_PROFILE_NAMES 64  // Distinct command names summarized by printOCLProfileSummary
+#define MAX_PROFILE_DEVICES 16  // Devices whose timestamps are offset separately in the trace
+
+void checkErrorFileLine(int errNum, int expected, const char* file, const int lineNumber);
+
+///
+//  Namespaces
+//
+using namespace std;
+
+static const char *phaseNameArray[OCL_PHASE_COUNT] = {"setup", "upload", "init", "iterate", "shortest-parents", "readback"};
+
+OCLProfiler* createOCLProfiler()
+{
+    OCLProfiler *profiler = (OCLProfiler*) malloc(sizeof(OCLProfiler));
+    pthread_mutex_init(&profiler->mutex, NULL);
+    profiler->firstBlock = NULL;
+    profiler->lastBlock = NULL;
+    return profiler;
+}
+
+///
+/// Release the profiler and the events it still holds. The sessions it is attached to must be released first.
+///
+void releaseOCLProfiler(OCLProfiler *profiler)
+{
+    OCLProfileBlock *block = profiler->firstBlock;
+    while (block != NULL) {
+        for (int iRecord = 0; iRecord < block->recordCount; iRecord++) {
+            if (block->recordArray[iRecord].event != NULL) {
+                clReleaseEvent(block->recordArray[iRecord].event);
+            }
+        }
+        OCLProfileBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    pthread_mutex_destroy(&profiler->mutex);
+    free(profiler);
+}
+
+OCLProfileRecord* addRecord(OCLProfiler *profiler, int device, int queue, OCLPhase phase, const char *name)
+{
+    pthread_mutex_lock(&profiler->mutex);
+    if (profiler->lastBlock == NULL || profiler->lastBlock->recordCount == OCL_PROFILE_BLOCK_SIZE) {
+        OCLProfileBlock *block = (OCLProfileBlock*) malloc(sizeof(OCLProfileBlock));
+        block->recordCount = 0;
+        block->next = NULL;
+        if (profiler->lastBlock != NULL) {
+            profiler->lastBlock->next = block;
+        }
+        else {
+            profiler->firstBlock = block;
+        }
+        profiler->lastBlock = block;
+    }
+    OCLProfileRecord *record = &profiler->lastBlock->recordArray[profiler->lastBlock->recordCount++];
+    record->name = name;
+    record->phase = phase;
+    record->device = device;
+    record->queue = queue;
+    record->event = NULL;
+    record->queued = record->submit = record->start = record->end = 0;
+    pthread_mutex_unlock(&profiler->mutex);
+    return record;
+}
+
+///
+/// Event to pass to the next command enqueued on queue of device, which is recorded as name in phase. Returns
+/// NULL if profiler is NULL, so that commands can be enqueued the same way whether they are profiled or not.
+///
+cl_event* profileOCLCommand(OCLProfiler *profiler, int device, int queue, OCLPhase phase, const char *name)
+{
+    if (profiler == NULL) {
+        return NULL;
+    }
+    return &addRecord(profiler, device, queue, phase, name)->event;
+}
+
+///
+/// Record a command whose event the caller needs for itself. The profiler keeps a reference of its own.
+///
+void recordOCLEvent(OCLProfiler *profiler, int device, int queue, OCLPhase phase, const char *name, cl_event event)
+{
+    if (profiler == NULL) {
+        return;
+    }
+    clRetainEvent(event);
+    addRecord(profiler, device, queue, phase, name)->event = event;
+}
+
+///
+/// Read the timestamps of the completed commands of device, or of all devices if device is -1, and release their
+/// events. With wait, the commands that have not completed yet are waited for; then no commands of those devices
+/// may be enqueued concurrently. Without, they are left for a later call.
+///
+void collectOCLProfile(OCLProfiler *profiler, int device, bool wait)
+{
+    if (profiler == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&profiler->mutex);
+    for (OCLProfileBlock *block = profiler->firstBlock; block != NULL; block = block->next) {
+        for (int iRecord = 0; iRecord < block->recordCount; iRecord++) {
+            OCLProfileRecord *record = &block->recordArray[iRecord];
+            if (record->event == NULL || (device >= 0 && record->device != device)) {
+                continue;
+            }
+            if (wait) {
+                int errNum = clWaitForEvents(1, &record->event);
+                checkError(errNum, CL_SUCCESS);
+            }
+            cl_int status;
+            int errNum = clGetEventInfo(record->event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status, NULL);
+            checkError(errNum, CL_SUCCESS);
+            if (status != CL_COMPLETE) {
+                continue;
+            }
+            errNum = clGetEventProfilingInfo(record->event, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &record->queued, NULL);
+            errNum |= clGetEventProfilingInfo(record->event, CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &record->submit, NULL);
+            errNum |= clGetEventProfilingInfo(record->event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &record->start, NULL);
+            errNum |= clGetEventProfilingInfo(record->event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &record->end, NULL);
+            checkError(errNum, CL_SUCCESS);
+            clReleaseEvent(record->event);
+            record->event = NULL;
+        }
+    }
+    pthread_mutex_unlock(&profiler->mutex);
+}
+
+///
+/// Print the device time of the collected commands by phase and by command name. Busy time is the sum of the
+/// execution times of the commands, and wait the mean time from being queued to starting. The span of each device
+/// is from its first command being queued to its last ending, so busy time well below it means the device was
+/// kept waiting by the host, e.g. on reads of convergence flags.
+///
+void printOCLProfileSummary(OCLProfiler *profiler)
+{
+    long phaseCountArray[OCL_PHASE_COUNT] = {0};
+    double phaseBusyArray[OCL_PHASE_COUNT] = {0};
+    double phaseWaitArray[OCL_PHASE_COUNT] = {0};
+    const char *nameArray[MAX_PROFILE_NAMES];
+    long nameCountArray[MAX_PROFILE_NAMES] = {0};
+    double nameBusyArray[MAX_PROFILE_NAMES] = {0};
+    int nameCount = 0;
+    cl_ulong firstArray[MAX_PROFILE_DEVICES];
+    cl_ulong lastArray[MAX_PROFILE_DEVICES];
+    int deviceCount = 0;
+    double totalBusy = 0;
+
+    for (OCLProfileBlock *block = profiler->firstBlock; block != NULL; block = block->next) {
+        for (int iRecord = 0; iRecord < block->recordCount; iRecord++) {
+            OCLProfileRecord *record = &block->recordArray[iRecord];
+            if (record->event != NULL || record->end == 0) {
+                continue;
+            }
+            double busy = (record->end - record->start) * 1e-6;
+            phaseCountArray[record->phase]++;
+            phaseBusyArray[record->phase] += busy;
+            phaseWaitArray[record->phase] += (record->start - record->queued) * 1e-6;
+            totalBusy += busy;
+
+            int iName = 0;
+            while (iName < nameCount && strcmp(nameArray[iName], record->name) != 0) {
+                iName++;
+            }
+            if (iName == nameCount && nameCount < MAX_PROFILE_NAMES) {
+                nameArray[nameCount++] = record->name;
+            }
+            if (iName < nameCount) {
+                nameCountArray[iName]++;
+                nameBusyArray[iName] += busy;
+            }
+
+            if (record->device < MAX_PROFILE_DEVICES) {
+                while (deviceCount <= record->device) {
+                    firstArray[deviceCount] = ~(cl_ulong)0;
+                    lastArray[deviceCount] = 0;
+                    deviceCount++;
+                }
+                if (record->queued < firstArray[record->device]) {
+                    firstArray[record->device] = record->queued;
+                }
+                if (record->end > lastArray[record->device]) {
+                    lastArray[record->device] = record->end;
+                }
+            }
+        }
+    }
+
+    printf("\nphase              commands    busy ms   share  mean wait ms\n");
+    for (int iPhase = 0; iPhase < OCL_PHASE_COUNT; iPhase++) {
+        long count = phaseCountArray[iPhase];
+        printf("%-18s %8li %10.2f %6.1f%% %13.3f\n", phaseNameArray[iPhase], count, phaseBusyArray[iPhase], totalBusy > 0 ? 100 * phaseBusyArray[iPhase] / totalBusy : 0.0, count > 0 ? phaseWaitArray[iPhase] / count : 0.0);
+    }
+    printf("\ncommand                            count    busy ms   mean us\n");
+    for (int iName = 0; iName < nameCount; iName++) {
+        printf("%-32s %7li %10.2f %9.1f\n", nameArray[iName], nameCountArray[iName], nameBusyArray[iName], 1000 * nameBusyArray[iName] / nameCountArray[iName]);
+    }
+    for (int iDevice = 0; iDevice < deviceCount; iDevice++) {
+        if (lastArray[iDevice] > 0) {
+            printf("Device %i: %.2f ms from the first command queued to the last completed.\n", iDevice, (lastArray[iDevice] - firstArray[iDevice]) * 1e-6);
+        }
+    }
+}
+
+///
+/// Write the collected commands as a Chrome trace. The timestamps of each device are relative to its first
+/// command being queued, as devices have clocks of their own. Returns false if the file cannot be written.
+///
+bool writeOCLProfileTrace(OCLProfiler *profiler, const char *filePath)
+{
+    FILE *file = fopen(filePath, "w");
+    if (file == NULL) {
+        printf("Unable to write %s.\n", filePath);
+        return false;
+    }
+    cl_ulong firstArray[MAX_PROFILE_DEVICES];
+    int deviceCount = 0;
+    for (OCLProfileBlock *block = profiler->firstBlock; block != NULL; block = block->next) {
+        for (int iRecord = 0; iRecord < block->recordCount; iRecord++) {
+            OCLProfileRecord *record = &block->recordArray[iRecord];
+            if (record->event != NULL || record->end == 0 || record->device >= MAX_PROFILE_DEVICES) {
+                continue;
+            }
+            while (deviceCount <= record->device) {
+                firstArray[deviceCount++] = ~(cl_ulong)0;
+            }
+            if (record->queued < firstArray[record->device]) {
+                firstArray[record->device] = record->queued;
+            }
+        }
+    }
+
+    fprintf(file, "{\"traceEvents\": [\n");
+    for (int iDevice = 0; iDevice < deviceCount; iDevice++) {
+        fprintf(file, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %i, \"args\": {\"name\": \"Device %i\"}},\n", iDevice, iDevice);
+        fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %i, \"tid\": 0, \"args\": {\"name\": \"Command queue\"}},\n", iDevice);
+        fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %i, \"tid\": 1, \"args\": {\"name\": \"Transfer queue\"}}%s\n", iDevice, (iDevice + 1 < deviceCount) ? "," : "");
+    }
+    const char *separator = (deviceCount > 0) ? ",\n" : "";
+    for (OCLProfileBlock *block = profiler->firstBlock; block != NULL; block = block->next) {
+        for (int iRecord = 0; iRecord < block->recordCount; iRecord++) {
+            OCLProfileRecord *record = &block->recordArray[iRecord];
+            if (record->event != NULL || record->end == 0 || record->device >= MAX_PROFILE_DEVICES) {
+                continue;
+            }
+            cl_ulong first = firstArray[record->device];
+            fprintf(file, "%s{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": %i, \"tid\": %i, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"queued_us\": %.3f, \"submit_us\": %.3f}}", separator, record->name, phaseNameArray[record->phase], record->device, record->queue, (record->start - first) * 1e-3, (record->end - record->start) * 1e-3, (record->queued - first) * 1e-3, (record->submit - first) * 1e-3);
+            separator = ",\n";
+        }
+    }
+    fprintf(file, "\n], \"displayTimeUnit\": \"ms\"}\n");
+    fclose(file);
+    return true;
+}
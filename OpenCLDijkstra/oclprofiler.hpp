@@ -0,0 +1,93 @@
+//
+//  oclprofiler.hpp
+//  OpenCLDijkstra
+//
+
+#ifndef oclprofiler_hpp
+#define oclprofiler_hpp
+
+#include <stdio.h>
+#include <pthread.h>
+
+#define __CL_ENABLE_EXCEPTIONS
+#if defined(__APPLE__) || defined(__MACOSX)
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.hpp>
+#endif
+
+
+///
+//  Types
+//
+//
+//  A profiler records the device timestamps of the commands that the
+//  sessions it is attached to enqueue: when each was queued, submitted,
+//  started and ended. Every command belongs to a phase of a run, and the
+//  profiler can summarize the time spent in each, and write all commands as
+//  a Chrome trace (chrome://tracing or Perfetto) with one process per device
+//  and one thread per command queue.
+//
+//  The commands are enqueued with an event from profileOCLCommand. The
+//  events are only queried once they have completed, by collectOCLProfile,
+//  so that profiling does not hold up the queues. Sessions on different
+//  devices may share a profiler from different threads. The records are
+//  allocated in blocks that never move, so an event can be written into its
+//  record while other threads add records of their own.
+//
+
+#define OCL_PROFILE_BLOCK_SIZE 4096
+
+typedef enum
+{
+    OCL_PHASE_SETUP,              // Resetting the traversal state on the device
+    OCL_PHASE_UPLOAD,             // Uploading or drawing the weights and sources
+    OCL_PHASE_INIT,               // initializeBuffers
+    OCL_PHASE_ITERATE,            // The traversal, and reading back its convergence flags and frontier sizes
+    OCL_PHASE_SHORTEST_PARENTS,   // SHORTEST_PARENTS
+    OCL_PHASE_READBACK,           // Reading back the results
+    OCL_PHASE_COUNT
+} OCLPhase;
+
+typedef struct
+{
+    const char *name;
+    OCLPhase phase;
+    int device;
+
+    // 0 for the command queue of a session, 1 for its transfer queue
+    int queue;
+
+    // Event of the command until it has been collected, then NULL
+    cl_event event;
+
+    // Device timestamps in nanoseconds, valid once collected
+    cl_ulong queued;
+    cl_ulong submit;
+    cl_ulong start;
+    cl_ulong end;
+} OCLProfileRecord;
+
+typedef struct OCLProfileBlock
+{
+    OCLProfileRecord recordArray[OCL_PROFILE_BLOCK_SIZE];
+    int recordCount;
+    struct OCLProfileBlock *next;
+} OCLProfileBlock;
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+    OCLProfileBlock *firstBlock;
+    OCLProfileBlock *lastBlock;
+} OCLProfiler;
+
+OCLProfiler* createOCLProfiler();
+void releaseOCLProfiler(OCLProfiler *profiler);
+cl_event* profileOCLCommand(OCLProfiler *profiler, int device, int queue, OCLPhase phase, const char *name);
+void recordOCLEvent(OCLProfiler *profiler, int device, int queue, OCLPhase phase, const char *name, cl_event event);
+void collectOCLProfile(OCLProfiler *profiler, int device, bool wait);
+void printOCLProfileSummary(OCLProfiler *profiler);
+bool writeOCLProfileTrace(OCLProfiler *profiler, const char *filePath);
+
+#endif /* oclprofiler_hpp */
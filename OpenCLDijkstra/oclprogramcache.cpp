@@ -0,0 +1,305 @@
+//
+//  oclprogramcache.cpp
+//  OpenCLDijkstra
+//
+
+#include "oclprogramcache.hpp"
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+#define checkError(a, b) checkErrorFileLine(a, b, __FILE__ , __LINE__)
+#define MAX_CACHE_PATH 1024
+
+void checkErrorFileLine(int errNum, int expected, const char* file, const int lineNumber);
+
+///
+//  Namespaces
+//
+using namespace std;
+
+///
+//  Globals
+//
+static char cacheDirectory[MAX_CACHE_PATH] = "";
+static bool cacheDisabled = false;
+
+///
+/// Cache the program binaries in directory rather than in the user's cache directory, or not at all if directory is
+/// NULL. Must not be called while programs are being built.
+///
+void setOCLProgramCacheDirectory(const char *directory)
+{
+    cacheDisabled = (directory == NULL);
+    snprintf(cacheDirectory, sizeof(cacheDirectory), "%s", directory != NULL ? directory : "");
+}
+
+///
+/// The directory to cache the binaries in, created if missing. Returns false if caching is disabled or there is no
+/// home directory to put the cache in.
+///
+bool getCacheDirectory(char *path, size_t size)
+{
+    if (cacheDisabled) {
+        return false;
+    }
+    if (cacheDirectory[0] != '\0') {
+        snprintf(path, size, "%s", cacheDirectory);
+    }
+    else {
+        const char *home = getenv("HOME");
+        if (home == NULL) {
+            return false;
+        }
+#if defined(__APPLE__) || defined(__MACOSX)
+        snprintf(path, size, "%s/Library/Caches/OpenCLDijkstra", home);
+#else
+        const char *cacheHome = getenv("XDG_CACHE_HOME");
+        if (cacheHome != NULL && cacheHome[0] != '\0') {
+            snprintf(path, size, "%s/opencldijkstra", cacheHome);
+        }
+        else {
+            snprintf(path, size, "%s/.cache", home);
+            mkdir(path, 0755);
+            snprintf(path, size, "%s/.cache/opencldijkstra", home);
+        }
+#endif
+    }
+    // Already existing is fine; a directory that cannot be created shows when the binaries cannot be written
+    mkdir(path, 0755);
+    return true;
+}
+
+// FNV-1a, over the bytes of data
+uint64_t hashBytes(uint64_t hash, const void *data, size_t length)
+{
+    const unsigned char *bytes = (const unsigned char*) data;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Strings are hashed with their terminators, so that consecutive strings cannot run into each other
+uint64_t hashString(uint64_t hash, const char *string)
+{
+    return hashBytes(hash, string, strlen(string) + 1);
+}
+
+uint64_t hashDeviceInfo(uint64_t hash, cl_device_id device, cl_device_info param)
+{
+    char info[1024] = "";
+    clGetDeviceInfo(device, param, sizeof(info) - 1, info, NULL);
+    return hashString(hash, info);
+}
+
+uint64_t hashPlatformInfo(uint64_t hash, cl_platform_id platform, cl_platform_info param)
+{
+    char info[1024] = "";
+    clGetPlatformInfo(platform, param, sizeof(info) - 1, info, NULL);
+    return hashString(hash, info);
+}
+
+///
+/// Hash of everything that the binary of a program depends on.
+///
+uint64_t getProgramHash(cl_device_id device, const char *source, size_t sourceLength, const char *options)
+{
+    int version = OCL_PROGRAM_CACHE_VERSION;
+    uint64_t hash = 14695981039346656037ULL;
+    hash = hashBytes(hash, &version, sizeof(version));
+    hash = hashBytes(hash, source, sourceLength);
+    hash = hashString(hash, options != NULL ? options : "");
+
+    cl_platform_id platform = NULL;
+    clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(cl_platform_id), &platform, NULL);
+    hash = hashPlatformInfo(hash, platform, CL_PLATFORM_NAME);
+    hash = hashPlatformInfo(hash, platform, CL_PLATFORM_VERSION);
+    hash = hashDeviceInfo(hash, device, CL_DEVICE_VENDOR);
+    hash = hashDeviceInfo(hash, device, CL_DEVICE_NAME);
+    hash = hashDeviceInfo(hash, device, CL_DEVICE_VERSION);
+    hash = hashDeviceInfo(hash, device, CL_DRIVER_VERSION);
+    return hash;
+}
+
+///
+/// Load the program from the binary at filePath and build it. Returns NULL if there is no binary, or if the driver
+/// does not accept it.
+///
+cl_program loadProgramBinary(cl_context context, cl_device_id device, const char *filePath, const char *options)
+{
+    FILE *file = fopen(filePath, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (fileSize <= 0) {
+        fclose(file);
+        return NULL;
+    }
+    size_t binarySize = fileSize;
+    unsigned char *binary = (unsigned char*) malloc(binarySize);
+    size_t readSize = fread(binary, 1, binarySize, file);
+    fclose(file);
+    if (readSize != binarySize) {
+        free(binary);
+        return NULL;
+    }
+
+    cl_int binaryStatus = CL_SUCCESS;
+    cl_int errNum;
+    cl_program program = clCreateProgramWithBinary(context, 1, &device, &binarySize, (const unsigned char **)&binary, &binaryStatus, &errNum);
+    free(binary);
+    if (errNum != CL_SUCCESS || binaryStatus != CL_SUCCESS) {
+        if (program != NULL) {
+            clReleaseProgram(program);
+        }
+        return NULL;
+    }
+    // Binaries have to be built too, but only get linked for the device
+    errNum = clBuildProgram(program, 1, &device, options, NULL, NULL);
+    if (errNum != CL_SUCCESS) {
+        clReleaseProgram(program);
+        return NULL;
+    }
+    // The modification time orders the binaries by their last use, for pruneProgramCache
+    utime(filePath, NULL);
+    return program;
+}
+
+///
+/// Write the binary of the built program to filePath. The binary is written to a file of its own first and then
+/// renamed, so that processes building the same program at once never see a partial binary.
+///
+void saveProgramBinary(cl_program program, const char *filePath)
+{
+    size_t binarySize = 0;
+    int errNum = clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &binarySize, NULL);
+    if (errNum != CL_SUCCESS || binarySize == 0) {
+        return;
+    }
+    unsigned char *binary = (unsigned char*) malloc(binarySize);
+    errNum = clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char*), &binary, NULL);
+    if (errNum != CL_SUCCESS) {
+        free(binary);
+        return;
+    }
+
+    char temporaryPath[MAX_CACHE_PATH + 32];
+    snprintf(temporaryPath, sizeof(temporaryPath), "%s.%i.tmp", filePath, (int)getpid());
+    FILE *file = fopen(temporaryPath, "wb");
+    if (file == NULL) {
+        free(binary);
+        return;
+    }
+    bool written = fwrite(binary, 1, binarySize, file) == binarySize;
+    written &= fclose(file) == 0;
+    free(binary);
+    if (!written || rename(temporaryPath, filePath) != 0) {
+        remove(temporaryPath);
+    }
+}
+
+typedef struct
+{
+    char name[64];
+    time_t lastUse;
+} CachedBinary;
+
+int compareCachedBinaries(const void *a, const void *b)
+{
+    time_t lastUseA = ((const CachedBinary*) a)->lastUse;
+    time_t lastUseB = ((const CachedBinary*) b)->lastUse;
+    return (lastUseA > lastUseB) - (lastUseA < lastUseB);
+}
+
+///
+/// Delete the binaries in directory beyond the OCL_PROGRAM_CACHE_MAX_BINARIES used most recently. Only files named
+/// like the binaries are considered, and files that disappear meanwhile, pruned by another process, are skipped.
+///
+void pruneProgramCache(const char *directory)
+{
+    DIR *dir = opendir(directory);
+    if (dir == NULL) {
+        return;
+    }
+    int binaryCount = 0;
+    int binaryCapacity = OCL_PROGRAM_CACHE_MAX_BINARIES + 1;
+    CachedBinary *binaryArray = (CachedBinary*) malloc(sizeof(CachedBinary) * binaryCapacity);
+    char filePath[MAX_CACHE_PATH];
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        if (length != 20 || strcmp(entry->d_name + 16, ".bin") != 0) {
+            continue;
+        }
+        struct stat status;
+        snprintf(filePath, sizeof(filePath), "%s/%s", directory, entry->d_name);
+        if (stat(filePath, &status) != 0) {
+            continue;
+        }
+        if (binaryCount == binaryCapacity) {
+            binaryCapacity *= 2;
+            binaryArray = (CachedBinary*) realloc(binaryArray, sizeof(CachedBinary) * binaryCapacity);
+        }
+        snprintf(binaryArray[binaryCount].name, sizeof(binaryArray[binaryCount].name), "%s", entry->d_name);
+        binaryArray[binaryCount].lastUse = status.st_mtime;
+        binaryCount++;
+    }
+    closedir(dir);
+
+    if (binaryCount > OCL_PROGRAM_CACHE_MAX_BINARIES) {
+        qsort(binaryArray, binaryCount, sizeof(CachedBinary), compareCachedBinaries);
+        for (int i = 0; i < binaryCount - OCL_PROGRAM_CACHE_MAX_BINARIES; i++) {
+            snprintf(filePath, sizeof(filePath), "%s/%s", directory, binaryArray[i].name);
+            remove(filePath);
+        }
+    }
+    free(binaryArray);
+}
+
+///
+/// Build the program from source for device, or load it from the cache if it has been built before with the same
+/// options on the same device and driver. Newly built programs are added to the cache. Build errors are fatal, after
+/// printing the build log.
+///
+cl_program buildCachedOCLProgram(cl_context context, cl_device_id device, const char *source, size_t sourceLength, const char *options)
+{
+    char directory[MAX_CACHE_PATH];
+    char filePath[MAX_CACHE_PATH];
+    bool useCache = getCacheDirectory(directory, sizeof(directory));
+    if (useCache) {
+        snprintf(filePath, sizeof(filePath), "%s/%016llx.bin", directory, (unsigned long long)getProgramHash(device, source, sourceLength, options));
+        cl_program program = loadProgramBinary(context, device, filePath, options);
+        if (program != NULL) {
+            return program;
+        }
+    }
+
+    cl_int errNum;
+    cl_program program = clCreateProgramWithSource(context, 1, &source, &sourceLength, &errNum);
+    checkError(errNum, CL_SUCCESS);
+    errNum = clBuildProgram(program, 1, &device, options, NULL, NULL);
+    if (errNum != CL_SUCCESS)
+    {
+        char cBuildLog[20240];
+        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, sizeof(cBuildLog), cBuildLog, NULL );
+
+        cerr << cBuildLog << endl;
+        printf("%i\n\n", errNum);
+        checkError(errNum, CL_SUCCESS);
+    }
+
+    if (useCache) {
+        saveProgramBinary(program, filePath);
+        pruneProgramCache(directory);
+    }
+    return program;
+}
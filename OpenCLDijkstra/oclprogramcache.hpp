@@ -0,0 +1,39 @@
+//
+//  oclprogramcache.hpp
+//  OpenCLDijkstra
+//
+
+#ifndef oclprogramcache_hpp
+#define oclprogramcache_hpp
+
+#include <stdio.h>
+
+#define __CL_ENABLE_EXCEPTIONS
+#if defined(__APPLE__) || defined(__MACOSX)
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.hpp>
+#endif
+
+
+///
+//  Compiled programs are cached on disk, one file per program binary, named
+//  by a hash of everything the binary depends on: the source, the build
+//  options, the platform, the device and its driver version. A program that
+//  is built again with the same inputs, in this or a later run, is loaded
+//  from its binary rather than compiled. A driver update changes the hash,
+//  and a binary that the driver rejects is rebuilt from source and replaced.
+//  As specialized programs differ for every graph size, the cache keeps only
+//  the OCL_PROGRAM_CACHE_MAX_BINARIES binaries used most recently, and
+//  deletes the others whenever a binary is added.
+//
+//  Bump this when the format of the cache or the inputs to the hash change,
+//  so that stale binaries are not picked up.
+//
+#define OCL_PROGRAM_CACHE_VERSION 1
+#define OCL_PROGRAM_CACHE_MAX_BINARIES 64
+
+void setOCLProgramCacheDirectory(const char *directory);
+cl_program buildCachedOCLProgram(cl_context context, cl_device_id device, const char *source, size_t sourceLength, const char *options);
+
+#endif /* oclprogramcache_hpp */
@@ -0,0 +1,254 @@
+//
+//  scenario.cpp
+//  OpenCLDijkstra
+//
+
+#include "scenario.hpp"
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string.h>
+#include <math.h>
+
+///
+//  Namespaces
+//
+using namespace std;
+
+
+///
+/// Batch of scenarioCount scenarios that disable nothing yet, scored at the targetCount vertices of targetArray
+///
+ScenarioBatch* createScenarioBatch(GraphData *graph, int scenarioCount, int *targetArray, int targetCount)
+{
+    ScenarioBatch *batch = (ScenarioBatch*) malloc(sizeof(ScenarioBatch));
+    batch->scenarioCount = scenarioCount;
+    batch->edgeCount = graph->edgeCount;
+    batch->descriptionArray = (char**) calloc(scenarioCount, sizeof(char*));
+    batch->maskWordCount = (graph->edgeCount + 31) / 32;
+    batch->disabledEdgeMaskArray = (unsigned int*) calloc((long)scenarioCount * batch->maskWordCount, sizeof(unsigned int));
+    batch->targetCount = targetCount;
+    batch->targetArray = (int*) malloc(targetCount * sizeof(int));
+    memcpy(batch->targetArray, targetArray, targetCount * sizeof(int));
+    batch->sampleCount = 0;
+    batch->targetCostSumArray = (double*) calloc((long)scenarioCount * targetCount, sizeof(double));
+    batch->targetReachedCountArray = (long*) calloc((long)scenarioCount * targetCount, sizeof(long));
+    batch->cheapestCostSumArray = (double*) calloc(scenarioCount, sizeof(double));
+    batch->anyReachedCountArray = (long*) calloc(scenarioCount, sizeof(long));
+    return batch;
+}
+
+void releaseScenarioBatch(ScenarioBatch *batch)
+{
+    for (int iScenario = 0; iScenario < batch->scenarioCount; iScenario++) {
+        free(batch->descriptionArray[iScenario]);
+    }
+    free(batch->descriptionArray);
+    free(batch->disabledEdgeMaskArray);
+    free(batch->targetArray);
+    free(batch->targetCostSumArray);
+    free(batch->targetReachedCountArray);
+    free(batch->cheapestCostSumArray);
+    free(batch->anyReachedCountArray);
+    free(batch);
+}
+
+void disableInverseEdge(ScenarioBatch *batch, int scenario, int inverseEdge)
+{
+    batch->disabledEdgeMaskArray[(long)scenario * batch->maskWordCount + inverseEdge / 32] |= 1u << (inverseEdge % 32);
+}
+
+///
+/// Disable the forward edge in scenario
+///
+void disableScenarioEdge(ScenarioBatch *batch, GraphData *graph, int scenario, int edge)
+{
+    disableInverseEdge(batch, scenario, getInverseEdge(graph, edge));
+}
+
+///
+/// Disable all edges into and out of vertex in scenario
+///
+void disableScenarioVertex(ScenarioBatch *batch, GraphData *graph, int scenario, int vertex)
+{
+    int vertexCount = graph->vertexCount;
+    int inverseEdgeEnd = (vertex + 1 < vertexCount) ? graph->inverseVertexArray[vertex + 1] : graph->edgeCount;
+    for (int inverseEdge = graph->inverseVertexArray[vertex]; inverseEdge < inverseEdgeEnd; inverseEdge++) {
+        disableInverseEdge(batch, scenario, inverseEdge);
+    }
+    int edgeEnd = (vertex + 1 < vertexCount) ? graph->vertexArray[vertex + 1] : graph->edgeCount;
+    for (int edge = graph->vertexArray[vertex]; edge < edgeEnd; edge++) {
+        disableScenarioEdge(batch, graph, scenario, edge);
+    }
+}
+
+///
+/// Disable the edges from parent to child in scenario. Returns false if there are none.
+///
+bool disableScenarioEdgeBetween(ScenarioBatch *batch, GraphData *graph, int scenario, int parent, int child)
+{
+    bool found = false;
+    int edgeEnd = (parent + 1 < graph->vertexCount) ? graph->vertexArray[parent + 1] : graph->edgeCount;
+    for (int edge = graph->vertexArray[parent]; edge < edgeEnd; edge++) {
+        if (graph->edgeArray[edge] == child) {
+            disableScenarioEdge(batch, graph, scenario, edge);
+            found = true;
+        }
+    }
+    return found;
+}
+
+///
+/// Read a scenario file with one scenario per line. Each line lists what the scenario disables, separated by
+/// spaces: "v12" disables vertex 12 and "3-7" the edges from vertex 3 to vertex 7. A line consisting of "none"
+/// is a scenario that disables nothing, as a baseline. Empty lines and lines starting with # are skipped.
+/// Returns NULL if the file cannot be read or refers to vertices or edges that the graph does not have.
+///
+ScenarioBatch* readScenarioFile(GraphData *graph, const char *filePath, int *targetArray, int targetCount)
+{
+    ifstream myfile;
+    myfile.open(filePath);
+    if (!myfile.is_open()) {
+        cout << "Unable to open file";
+        return NULL;
+    }
+    int scenarioCount = 0;
+    string line;
+    while (getline(myfile, line)) {
+        if (!line.empty() && line[0] != '#') {
+            scenarioCount++;
+        }
+    }
+    myfile.clear();
+    myfile.seekg(0);
+
+    ScenarioBatch *batch = createScenarioBatch(graph, scenarioCount, targetArray, targetCount);
+    int iScenario = 0;
+    while (getline(myfile, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        batch->descriptionArray[iScenario] = strdup(line.c_str());
+        istringstream items(line);
+        string item;
+        while (items >> item) {
+            int parent, child, vertex;
+            bool valid;
+            if (item == "none") {
+                valid = true;
+            }
+            else if (sscanf(item.c_str(), "v%d", &vertex) == 1) {
+                valid = vertex >= 0 && vertex < graph->vertexCount;
+                if (valid) {
+                    disableScenarioVertex(batch, graph, iScenario, vertex);
+                }
+            }
+            else if (sscanf(item.c_str(), "%d-%d", &parent, &child) == 2) {
+                valid = parent >= 0 && parent < graph->vertexCount && disableScenarioEdgeBetween(batch, graph, iScenario, parent, child);
+            }
+            else {
+                valid = false;
+            }
+            if (!valid) {
+                printf("Error: Scenario %i refers to %s, which is not in the graph.\n", iScenario, item.c_str());
+                releaseScenarioBatch(batch);
+                return NULL;
+            }
+        }
+        iScenario++;
+    }
+    myfile.close();
+    return batch;
+}
+
+///
+/// Fold the target costs of graphCount samples under scenarios [firstScenario, firstScenario + scenarioCount)
+/// into the aggregates of batch. targetCostArray holds targetCount costs for each scenario and sample, numbered
+/// (iScenario - firstScenario)*graphCount + iGraph. The caller adds graphCount to batch->sampleCount once all
+/// scenarios have been accumulated.
+///
+void accumulateScenarioCosts(ScenarioBatch *batch, int firstScenario, int scenarioCount, int graphCount, int *targetCostArray)
+{
+    int targetCount = batch->targetCount;
+    for (int iScenario = 0; iScenario < scenarioCount; iScenario++) {
+        long scenario = firstScenario + iScenario;
+        for (int iGraph = 0; iGraph < graphCount; iGraph++) {
+            int *targetCosts = targetCostArray + ((long)iScenario * graphCount + iGraph) * targetCount;
+            int cheapestCost = INT_MAX;
+            for (int iTarget = 0; iTarget < targetCount; iTarget++) {
+                int cost = targetCosts[iTarget];
+                if (cost == INT_MAX) {
+                    continue;
+                }
+                batch->targetCostSumArray[scenario * targetCount + iTarget] += cost;
+                batch->targetReachedCountArray[scenario * targetCount + iTarget]++;
+                if (cost < cheapestCost) {
+                    cheapestCost = cost;
+                }
+            }
+            if (cheapestCost != INT_MAX) {
+                batch->cheapestCostSumArray[scenario] += cheapestCost;
+                batch->anyReachedCountArray[scenario]++;
+            }
+        }
+    }
+}
+
+// Mean cost of the cheapest target in the samples where one is reached, or NAN if none is
+double getScenarioCost(ScenarioBatch *batch, int scenario)
+{
+    long reachedCount = batch->anyReachedCountArray[scenario];
+    return reachedCount > 0 ? batch->cheapestCostSumArray[scenario] / reachedCount : NAN;
+}
+
+// Fraction of the samples in which any target is reached
+double getScenarioReachedFraction(ScenarioBatch *batch, int scenario)
+{
+    return batch->sampleCount > 0 ? (double)batch->anyReachedCountArray[scenario] / batch->sampleCount : 0.0;
+}
+
+// Better scenarios leave the targets unreached more often, and cost more otherwise
+int compareScenarios(ScenarioBatch *batch, int a, int b)
+{
+    double reachedA = getScenarioReachedFraction(batch, a);
+    double reachedB = getScenarioReachedFraction(batch, b);
+    if (reachedA != reachedB) {
+        return reachedA < reachedB ? -1 : 1;
+    }
+    double costA = getScenarioCost(batch, a);
+    double costB = getScenarioCost(batch, b);
+    if (isnan(costA) || isnan(costB)) {
+        return isnan(costA) ? (isnan(costB) ? 0 : -1) : 1;
+    }
+    return costA > costB ? -1 : (costA < costB ? 1 : 0);
+}
+
+///
+/// Print the scenarios from best to worst, i.e. by how rarely and how expensively the cheapest target is reached
+///
+void printScenarioRanking(ScenarioBatch *batch)
+{
+    int *orderArray = (int*) malloc(batch->scenarioCount * sizeof(int));
+    for (int iScenario = 0; iScenario < batch->scenarioCount; iScenario++) {
+        orderArray[iScenario] = iScenario;
+    }
+    // Insertion sort, as there are no more scenarios than fit in a batch
+    for (int iOrdered = 1; iOrdered < batch->scenarioCount; iOrdered++) {
+        int scenario = orderArray[iOrdered];
+        int iInsert = iOrdered;
+        while (iInsert > 0 && compareScenarios(batch, scenario, orderArray[iInsert - 1]) < 0) {
+            orderArray[iInsert] = orderArray[iInsert - 1];
+            iInsert--;
+        }
+        orderArray[iInsert] = scenario;
+    }
+
+    printf("\n%i scenarios over %li samples, from best to worst:\n", batch->scenarioCount, batch->sampleCount);
+    printf("rank scenario   reached  mean cost  disables\n");
+    for (int iOrdered = 0; iOrdered < batch->scenarioCount; iOrdered++) {
+        int scenario = orderArray[iOrdered];
+        const char *description = batch->descriptionArray[scenario] != NULL ? batch->descriptionArray[scenario] : "";
+        printf("%4i %8i %8.1f%% %10.1f  %s\n", iOrdered + 1, scenario, 100.0 * getScenarioReachedFraction(batch, scenario), getScenarioCost(batch, scenario), description);
+    }
+    free(orderArray);
+}
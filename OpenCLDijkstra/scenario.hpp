@@ -0,0 +1,69 @@
+//
+//  scenario.hpp
+//  OpenCLDijkstra
+//
+
+#ifndef scenario_hpp
+#define scenario_hpp
+
+#include <stdio.h>
+#include "graph.hpp"
+
+
+///
+//  Types
+//
+//
+//  A scenario batch describes scenarioCount variants of a graph, e.g. one per
+//  countermeasure, each disabling some edges and vertices. All scenarios are
+//  evaluated with the same topology, weights and sources, so every sample is
+//  solved once per scenario. A disabled edge counts as infinitely expensive,
+//  and disabling a vertex disables all of its incoming and outgoing edges.
+//
+//  The disabled edges of each scenario are kept as a bitmask over the inverse
+//  edges, maskWordCount 32 bit words per scenario. The results are aggregated
+//  over the samples at the target vertices only.
+//
+
+typedef struct
+{
+    int scenarioCount;
+    int edgeCount;
+
+    // What each scenario disables, as given in a scenario file, or NULL
+    char **descriptionArray;
+
+    // Words of the bitmask of each scenario
+    int maskWordCount;
+
+    // Bit i of the bitmask of scenario s is disabledEdgeMaskArray[s*maskWordCount + i/32] >> (i%32) & 1
+    unsigned int *disabledEdgeMaskArray;
+
+    // Vertices at which the scenarios are scored
+    int targetCount;
+    int *targetArray;
+
+    // Number of samples accumulated so far
+    long sampleCount;
+
+    // Per scenario and target, scenario-major: the sum of the finite costs and the number of samples reaching it
+    double *targetCostSumArray;
+    long *targetReachedCountArray;
+
+    // Per scenario: the sum of the cost of the cheapest reached target, and the number of samples reaching any
+    double *cheapestCostSumArray;
+    long *anyReachedCountArray;
+
+} ScenarioBatch;
+
+ScenarioBatch* createScenarioBatch(GraphData *graph, int scenarioCount, int *targetArray, int targetCount);
+void releaseScenarioBatch(ScenarioBatch *batch);
+void disableScenarioEdge(ScenarioBatch *batch, GraphData *graph, int scenario, int edge);
+void disableScenarioVertex(ScenarioBatch *batch, GraphData *graph, int scenario, int vertex);
+ScenarioBatch* readScenarioFile(GraphData *graph, const char *filePath, int *targetArray, int targetCount);
+void accumulateScenarioCosts(ScenarioBatch *batch, int firstScenario, int scenarioCount, int graphCount, int *targetCostArray);
+double getScenarioCost(ScenarioBatch *batch, int scenario);
+double getScenarioReachedFraction(ScenarioBatch *batch, int scenario);
+void printScenarioRanking(ScenarioBatch *batch);
+
+#endif /* scenario_hpp */
@@ -0,0 +1,252 @@
+//
+//  statistics.cpp
+//  OpenCLDijkstra
+//
+
+#include "statistics.hpp"
+#include "threadpool.hpp"
+#include <math.h>
+
+#define STATISTICS_CHUNK_SIZE 1024  // Vertices per task when accumulating
+
+typedef struct
+{
+    VertexStatistics *statistics;
+    int *costArray;
+    int graphCount;
+} AccumulateContext;
+
+
+// Bucket of cost among the buckets of all finite costs
+int getCostBucket(VertexStatistics *statistics, int cost)
+{
+    return (int)(log2((double)cost + 1.0) * statistics->bucketsPerOctave);
+}
+
+// Smallest cost of bucket, as a real number
+double getBucketStart(VertexStatistics *statistics, int bucket)
+{
+    return exp2((double)bucket / statistics->bucketsPerOctave) - 1.0;
+}
+
+// Halve the counts of histogram, rounding up so that no bucket is emptied
+void halveHistogram(VertexStatistics *statistics, uint16_t *histogram)
+{
+    for (int iBucket = 0; iBucket < statistics->bucketCount; iBucket++) {
+        histogram[iBucket] = (histogram[iBucket] + 1) / 2;
+    }
+}
+
+///
+/// Count cost in the histogram of iVertex. If cost is above its buckets, they are moved up to end with the bucket of
+/// cost, and those that fall off the bottom are merged into the lowest one.
+///
+void addToHistogram(VertexStatistics *statistics, int iVertex, int cost)
+{
+    uint16_t *histogram = statistics->histogramArray + (long)iVertex * statistics->bucketCount;
+    int bucketCount = statistics->bucketCount;
+    int bucket = getCostBucket(statistics, cost);
+    int lowestBucket = statistics->lowestBucketArray[iVertex];
+    if (lowestBucket < 0) {
+        lowestBucket = (bucket >= bucketCount) ? bucket - bucketCount + 1 : 0;
+    }
+    int shift = bucket - (lowestBucket + bucketCount - 1);
+    if (shift > 0) {
+        long merged = 0;
+        for (int iBucket = 0; iBucket <= shift && iBucket < bucketCount; iBucket++) {
+            merged += histogram[iBucket];
+        }
+        for (int iBucket = 1; iBucket < bucketCount; iBucket++) {
+            histogram[iBucket] = (iBucket + shift < bucketCount) ? histogram[iBucket + shift] : 0;
+        }
+        while (merged > UINT16_MAX) {
+            halveHistogram(statistics, histogram);
+            merged = (merged + 1) / 2;
+        }
+        histogram[0] = (uint16_t)merged;
+        lowestBucket += shift;
+    }
+    statistics->lowestBucketArray[iVertex] = lowestBucket;
+    int iBucket = (bucket > lowestBucket) ? bucket - lowestBucket : 0;
+    if (histogram[iBucket] == UINT16_MAX) {
+        halveHistogram(statistics, histogram);
+    }
+    histogram[iBucket]++;
+}
+
+VertexStatistics* createVertexStatistics(int vertexCount, int bucketsPerOctave)
+{
+    VertexStatistics *statistics = (VertexStatistics*) malloc(sizeof(VertexStatistics));
+    statistics->vertexCount = vertexCount;
+    statistics->bucketsPerOctave = bucketsPerOctave;
+    statistics->bucketCount = STATISTICS_HISTOGRAM_OCTAVES * bucketsPerOctave;
+    statistics->sampleCount = 0;
+    statistics->infiniteCountArray = (long*) calloc(vertexCount, sizeof(long));
+    statistics->minArray = (int*) malloc(vertexCount * sizeof(int));
+    statistics->maxArray = (int*) malloc(vertexCount * sizeof(int));
+    statistics->meanArray = (double*) calloc(vertexCount, sizeof(double));
+    statistics->squaredDeviationArray = (double*) calloc(vertexCount, sizeof(double));
+    statistics->histogramArray = (uint16_t*) calloc((long)vertexCount * statistics->bucketCount, sizeof(uint16_t));
+    statistics->lowestBucketArray = (int*) malloc(vertexCount * sizeof(int));
+    for (int iVertex = 0; iVertex < vertexCount; iVertex++) {
+        statistics->minArray[iVertex] = INT_MAX;
+        statistics->maxArray[iVertex] = 0;
+        statistics->lowestBucketArray[iVertex] = -1;
+    }
+    return statistics;
+}
+
+void releaseVertexStatistics(VertexStatistics *statistics)
+{
+    free(statistics->infiniteCountArray);
+    free(statistics->minArray);
+    free(statistics->maxArray);
+    free(statistics->meanArray);
+    free(statistics->squaredDeviationArray);
+    free(statistics->histogramArray);
+    free(statistics->lowestBucketArray);
+    free(statistics);
+}
+
+void accumulateVertexStatisticsTask(int iTask, int iThread, void *context)
+{
+    VertexStatistics *statistics = ((AccumulateContext*) context)->statistics;
+    int *costArray = ((AccumulateContext*) context)->costArray;
+    int graphCount = ((AccumulateContext*) context)->graphCount;
+    int vertexCount = statistics->vertexCount;
+    int vertexStart = iTask * STATISTICS_CHUNK_SIZE;
+    int vertexEnd = vertexStart + STATISTICS_CHUNK_SIZE;
+    if (vertexEnd > vertexCount) {
+        vertexEnd = vertexCount;
+    }
+    for (int iVertex = vertexStart; iVertex < vertexEnd; iVertex++) {
+        long finiteCount = statistics->sampleCount - statistics->infiniteCountArray[iVertex];
+        for (int iGraph = 0; iGraph < graphCount; iGraph++) {
+            int cost = costArray[(long)iGraph * vertexCount + iVertex];
+            if (cost == INT_MAX) {
+                statistics->infiniteCountArray[iVertex]++;
+                continue;
+            }
+            finiteCount++;
+            double delta = cost - statistics->meanArray[iVertex];
+            statistics->meanArray[iVertex] += delta / finiteCount;
+            statistics->squaredDeviationArray[iVertex] += delta * (cost - statistics->meanArray[iVertex]);
+            if (cost < statistics->minArray[iVertex]) {
+                statistics->minArray[iVertex] = cost;
+            }
+            if (cost > statistics->maxArray[iVertex]) {
+                statistics->maxArray[iVertex] = cost;
+            }
+            addToHistogram(statistics, iVertex, cost);
+        }
+    }
+}
+
+///
+/// Fold the costs of graphCount samples, laid out like GraphData::costArray, into statistics.
+///
+void accumulateVertexStatistics(VertexStatistics *statistics, int *costArray, int graphCount)
+{
+    AccumulateContext context;
+    context.statistics = statistics;
+    context.costArray = costArray;
+    context.graphCount = graphCount;
+    int chunkCount = (statistics->vertexCount + STATISTICS_CHUNK_SIZE - 1) / STATISTICS_CHUNK_SIZE;
+    parallelFor(defaultThreadPool(), chunkCount, accumulateVertexStatisticsTask, &context);
+    statistics->sampleCount += graphCount;
+}
+
+// Mean of the finite costs of iVertex, or NAN if there are none
+double getVertexMean(VertexStatistics *statistics, int iVertex)
+{
+    long finiteCount = statistics->sampleCount - statistics->infiniteCountArray[iVertex];
+    return finiteCount > 0 ? statistics->meanArray[iVertex] : NAN;
+}
+
+// Sample variance of the finite costs of iVertex, or NAN if there are fewer than two
+double getVertexVariance(VertexStatistics *statistics, int iVertex)
+{
+    long finiteCount = statistics->sampleCount - statistics->infiniteCountArray[iVertex];
+    return finiteCount > 1 ? statistics->squaredDeviationArray[iVertex] / (finiteCount - 1) : NAN;
+}
+
+double getInfiniteFraction(VertexStatistics *statistics, int iVertex)
+{
+    return statistics->sampleCount > 0 ? (double)statistics->infiniteCountArray[iVertex] / statistics->sampleCount : 0.0;
+}
+
+///
+/// Approximate quantile in [0, 1] of the costs of iVertex, interpolated within its histogram bucket and clamped to
+/// the observed min and max. INT_MAX if the quantile falls among the infinite costs or nothing has been accumulated.
+/// The rank among the finite costs is scaled to the total of the histogram, which is less once it has been halved.
+///
+int getVertexQuantile(VertexStatistics *statistics, int iVertex, double quantile)
+{
+    long finiteCount = statistics->sampleCount - statistics->infiniteCountArray[iVertex];
+    double rank = quantile * (statistics->sampleCount - 1);
+    if (finiteCount == 0 || rank > finiteCount - 1) {
+        return INT_MAX;
+    }
+    uint16_t *histogram = statistics->histogramArray + (long)iVertex * statistics->bucketCount;
+    int lowestBucket = statistics->lowestBucketArray[iVertex];
+    long totalCount = 0;
+    for (int iBucket = 0; iBucket < statistics->bucketCount; iBucket++) {
+        totalCount += histogram[iBucket];
+    }
+    rank = rank * totalCount / finiteCount;
+    long cumulativeCount = 0;
+    int bucket = 0;
+    while (bucket < statistics->bucketCount - 1 && cumulativeCount + histogram[bucket] <= rank) {
+        cumulativeCount += histogram[bucket];
+        bucket++;
+    }
+    // The lowest bucket also holds the costs below it, down to the min
+    double start = (bucket == 0 && lowestBucket > 0) ? statistics->minArray[iVertex] : getBucketStart(statistics, lowestBucket + bucket);
+    double end = getBucketStart(statistics, lowestBucket + bucket + 1);
+    double fraction = (rank - cumulativeCount + 0.5) / histogram[bucket];
+    double cost = start + (end - start) * (fraction < 1.0 ? fraction : 1.0);
+    if (cost < statistics->minArray[iVertex]) {
+        return statistics->minArray[iVertex];
+    }
+    if (cost > statistics->maxArray[iVertex]) {
+        return statistics->maxArray[iVertex];
+    }
+    return (int)lrint(cost);
+}
+
+///
+/// Write the quantile of every vertex into costArray, which must hold vertexCount ints.
+///
+void getQuantileCosts(VertexStatistics *statistics, double quantile, int *costArray)
+{
+    for (int iVertex = 0; iVertex < statistics->vertexCount; iVertex++) {
+        costArray[iVertex] = getVertexQuantile(statistics, iVertex, quantile);
+    }
+}
+
+void printCostColumn(int cost)
+{
+    if (cost == INT_MAX) {
+        printf(" %10s", "inf");
+    }
+    else {
+        printf(" %10i", cost);
+    }
+}
+
+void printVertexStatistics(VertexStatistics *statistics, const char *name, int verticesToPrint)
+{
+    if (verticesToPrint > statistics->vertexCount) {
+        verticesToPrint = statistics->vertexCount;
+    }
+    printf("\n%s over %li samples:\n", name, statistics->sampleCount);
+    printf("vertex       mean      stdev        min     median        p90        max  infinite\n");
+    for (int iVertex = 0; iVertex < verticesToPrint; iVertex++) {
+        printf("%6i %10.1f %10.1f", iVertex, getVertexMean(statistics, iVertex), sqrt(getVertexVariance(statistics, iVertex)));
+        printCostColumn(statistics->minArray[iVertex]);
+        printCostColumn(getVertexQuantile(statistics, iVertex, 0.5));
+        printCostColumn(getVertexQuantile(statistics, iVertex, 0.9));
+        printCostColumn(statistics->maxArray[iVertex]);
+        printf(" %8.1f%%\n", 100.0 * getInfiniteFraction(statistics, iVertex));
+    }
+}
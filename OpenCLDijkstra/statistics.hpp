@@ -0,0 +1,79 @@
+//
+//  statistics.hpp
+//  OpenCLDijkstra
+//
+
+#ifndef statistics_hpp
+#define statistics_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include "graph.hpp"
+
+
+///
+//  Types
+//
+//
+//  Streaming per-vertex statistics of the costs of any number of samples.
+//  Each batch of samples is folded into fixed-size aggregates and can then be
+//  discarded, so memory is O(V) regardless of how many samples are run.
+//
+//  Infinite costs (INT_MAX, the vertex was not reached) are only counted.
+//  Mean and variance (Welford), min and max are over the finite costs.
+//  Quantiles are read from a histogram with logarithmic buckets,
+//  bucketsPerOctave buckets per doubling of the cost, and are therefore
+//  approximate within the width of a bucket, about 100*(2^(1/bucketsPerOctave)-1)
+//  percent of the cost. They count infinite costs as larger than all others.
+//
+//  To keep the histograms small on large graphs, each vertex only has
+//  buckets for the STATISTICS_HISTOGRAM_OCTAVES octaves up to its highest
+//  cost so far, with 16-bit counts. Costs below them are counted in the
+//  lowest bucket, which makes only the low quantiles of vertices with very
+//  spread out costs coarser. When a count would overflow, all counts of the
+//  vertex are halved, which keeps their proportions.
+//
+
+#define STATISTICS_DEFAULT_BUCKETS_PER_OCTAVE 8
+#define STATISTICS_HISTOGRAM_OCTAVES 8
+
+typedef struct
+{
+    int vertexCount;
+
+    int bucketsPerOctave;
+
+    // Number of histogram buckets per vertex, STATISTICS_HISTOGRAM_OCTAVES octaves
+    int bucketCount;
+
+    // Number of samples accumulated so far, the same for all vertices
+    long sampleCount;
+
+    // Per vertex aggregates
+    long *infiniteCountArray;
+    int *minArray;
+    int *maxArray;
+    double *meanArray;
+
+    // Sum of squared deviations from the mean
+    double *squaredDeviationArray;
+
+    // bucketCount counts for each vertex, vertex-major
+    uint16_t *histogramArray;
+
+    // Per vertex, the bucket of all finite costs that its first count is for, or -1 before its first finite cost
+    int *lowestBucketArray;
+
+} VertexStatistics;
+
+VertexStatistics* createVertexStatistics(int vertexCount, int bucketsPerOctave);
+void releaseVertexStatistics(VertexStatistics *statistics);
+void accumulateVertexStatistics(VertexStatistics *statistics, int *costArray, int graphCount);
+double getVertexMean(VertexStatistics *statistics, int iVertex);
+double getVertexVariance(VertexStatistics *statistics, int iVertex);
+double getInfiniteFraction(VertexStatistics *statistics, int iVertex);
+int getVertexQuantile(VertexStatistics *statistics, int iVertex, double quantile);
+void getQuantileCosts(VertexStatistics *statistics, double quantile, int *costArray);
+void printVertexStatistics(VertexStatistics *statistics, const char *name, int verticesToPrint);
+
+#endif /* statistics_hpp */
@@ -0,0 +1,268 @@
+//
+//  threadpool.cpp
+//  OpenCLDijkstra
+//
+
+#include "threadpool.hpp"
+#include <unistd.h>
+
+///
+//  Globals
+//
+pthread_mutex_t defaultPoolMutex = PTHREAD_MUTEX_INITIALIZER;
+ThreadPool *defaultPool = NULL;
+int defaultThreadCount = 0;
+
+typedef struct
+{
+    ThreadPool *pool;
+    int iThread;
+} WorkerArgument;
+
+
+int getHardwareThreadCount()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (count < 1) {
+        return 1;
+    }
+    return (int)count;
+}
+
+///
+/// Take the next task from the front of a range. Returns -1 if the range is empty.
+///
+int popTask(TaskRange *range)
+{
+    int iTask = -1;
+    pthread_mutex_lock(&range->lock);
+    if (range->next < range->end) {
+        iTask = range->next;
+        range->next++;
+    }
+    pthread_mutex_unlock(&range->lock);
+    return iTask;
+}
+
+///
+/// Move the back half of the largest remaining range of another thread into the range of thread iThread. The
+/// ranges are sized under their locks and may shrink before the largest is stolen from, in which case they are
+/// sized again. Returns false if no other thread had any tasks left.
+///
+bool stealTasks(ThreadPool *pool, int iThread)
+{
+    while (true) {
+        TaskRange *victim = NULL;
+        int largestRemaining = 0;
+        for (int offset = 1; offset < pool->threadCount; offset++) {
+            TaskRange *range = &pool->rangeArray[(iThread + offset) % pool->threadCount];
+            pthread_mutex_lock(&range->lock);
+            int remaining = range->end - range->next;
+            pthread_mutex_unlock(&range->lock);
+            if (remaining > largestRemaining) {
+                victim = range;
+                largestRemaining = remaining;
+            }
+        }
+        if (victim == NULL) {
+            return false;
+        }
+
+        pthread_mutex_lock(&victim->lock);
+        int remaining = victim->end - victim->next;
+        if (remaining > 0) {
+            int stolenEnd = victim->end;
+            victim->end = victim->end - (remaining + 1) / 2;
+            int stolenStart = victim->end;
+            pthread_mutex_unlock(&victim->lock);
+
+            TaskRange *own = &pool->rangeArray[iThread];
+            pthread_mutex_lock(&own->lock);
+            own->next = stolenStart;
+            own->end = stolenEnd;
+            pthread_mutex_unlock(&own->lock);
+            return true;
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+}
+
+///
+/// Run tasks until neither the own range nor any other range has tasks left.
+///
+void runTasks(ThreadPool *pool, int iThread)
+{
+    while (true) {
+        int iTask = popTask(&pool->rangeArray[iThread]);
+        if (iTask < 0) {
+            if (!stealTasks(pool, iThread)) {
+                return;
+            }
+            continue;
+        }
+        pool->task(iTask, iThread, pool->context);
+    }
+}
+
+void* workerMain(void *argument)
+{
+    ThreadPool *pool = ((WorkerArgument*)argument)->pool;
+    int iThread = ((WorkerArgument*)argument)->iThread;
+    free(argument);
+
+    // Workers are started before the first parallelFor, so generation 0 never carries work
+    int seenGeneration = 0;
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (!pool->shuttingDown && pool->generation == seenGeneration) {
+            pthread_cond_wait(&pool->workReady, &pool->lock);
+        }
+        if (pool->shuttingDown) {
+            break;
+        }
+        seenGeneration = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        runTasks(pool, iThread);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->activeWorkerCount--;
+        if (pool->activeWorkerCount == 0) {
+            pthread_cond_signal(&pool->workDone);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+///
+/// Create a pool with threadCount threads in total. The thread calling parallelFor is one of them,
+/// so threadCount - 1 worker threads are started. A threadCount below 1 means one thread per core.
+///
+ThreadPool* createThreadPool(int threadCount)
+{
+    if (threadCount < 1) {
+        threadCount = getHardwareThreadCount();
+    }
+    ThreadPool *pool = (ThreadPool*) malloc(sizeof(ThreadPool));
+    pool->threadCount = threadCount;
+    pool->threadArray = (pthread_t*) malloc(threadCount * sizeof(pthread_t));
+    pool->rangeArray = (TaskRange*) malloc(threadCount * sizeof(TaskRange));
+    pthread_mutex_init(&pool->submitLock, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->workReady, NULL);
+    pthread_cond_init(&pool->workDone, NULL);
+    pool->generation = 0;
+    pool->activeWorkerCount = 0;
+    pool->shuttingDown = false;
+    pool->task = NULL;
+    pool->context = NULL;
+
+    for (int iThread = 0; iThread < threadCount; iThread++) {
+        pthread_mutex_init(&pool->rangeArray[iThread].lock, NULL);
+        pool->rangeArray[iThread].next = 0;
+        pool->rangeArray[iThread].end = 0;
+    }
+    for (int iThread = 1; iThread < threadCount; iThread++) {
+        WorkerArgument *argument = (WorkerArgument*) malloc(sizeof(WorkerArgument));
+        argument->pool = pool;
+        argument->iThread = iThread;
+        if (pthread_create(&pool->threadArray[iThread], NULL, workerMain, argument) != 0) {
+            printf("Error: Failed to create worker thread!\n");
+            exit(1);
+        }
+    }
+    return pool;
+}
+
+void releaseThreadPool(ThreadPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->shuttingDown = true;
+    pthread_cond_broadcast(&pool->workReady);
+    pthread_mutex_unlock(&pool->lock);
+    for (int iThread = 1; iThread < pool->threadCount; iThread++) {
+        pthread_join(pool->threadArray[iThread], NULL);
+    }
+    for (int iThread = 0; iThread < pool->threadCount; iThread++) {
+        pthread_mutex_destroy(&pool->rangeArray[iThread].lock);
+    }
+    pthread_mutex_destroy(&pool->submitLock);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->workReady);
+    pthread_cond_destroy(&pool->workDone);
+    free(pool->threadArray);
+    free(pool->rangeArray);
+    free(pool);
+}
+
+///
+/// The process wide pool, created on first use with the count given to setDefaultThreadCount (default: one per core).
+///
+ThreadPool* defaultThreadPool()
+{
+    pthread_mutex_lock(&defaultPoolMutex);
+    if (defaultPool == NULL) {
+        defaultPool = createThreadPool(defaultThreadCount);
+    }
+    pthread_mutex_unlock(&defaultPoolMutex);
+    return defaultPool;
+}
+
+///
+/// Must not be called while the default pool is running tasks.
+///
+void setDefaultThreadCount(int threadCount)
+{
+    pthread_mutex_lock(&defaultPoolMutex);
+    defaultThreadCount = threadCount;
+    if (defaultPool != NULL) {
+        releaseThreadPool(defaultPool);
+        defaultPool = NULL;
+    }
+    pthread_mutex_unlock(&defaultPoolMutex);
+}
+
+///
+/// Run task(iTask, iThread, context) for every iTask in [0, taskCount) and return when all have finished.
+/// Tasks must not call parallelFor on the same pool.
+///
+void parallelFor(ThreadPool *pool, int taskCount, ParallelTask task, void *context)
+{
+    if (taskCount <= 0) {
+        return;
+    }
+    if (pool->threadCount == 1 || taskCount == 1) {
+        for (int iTask = 0; iTask < taskCount; iTask++) {
+            task(iTask, 0, context);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&pool->submitLock);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->context = context;
+    for (int iThread = 0; iThread < pool->threadCount; iThread++) {
+        TaskRange *range = &pool->rangeArray[iThread];
+        pthread_mutex_lock(&range->lock);
+        range->next = (int)((long)taskCount * iThread / pool->threadCount);
+        range->end = (int)((long)taskCount * (iThread + 1) / pool->threadCount);
+        pthread_mutex_unlock(&range->lock);
+    }
+    pool->activeWorkerCount = pool->threadCount - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->workReady);
+    pthread_mutex_unlock(&pool->lock);
+
+    runTasks(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->activeWorkerCount > 0) {
+        pthread_cond_wait(&pool->workDone, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    pthread_mutex_unlock(&pool->submitLock);
+}
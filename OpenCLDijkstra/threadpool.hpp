@@ -0,0 +1,78 @@
+//
+//  threadpool.hpp
+//  OpenCLDijkstra
+//
+
+#ifndef threadpool_hpp
+#define threadpool_hpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+
+///
+//  Types
+//
+//
+//  A persistent pool of worker threads executing indexed tasks. Each worker
+//  owns a contiguous range of task indices that it consumes from the front.
+//  A worker that runs dry steals the back half of the largest remaining range
+//  of another worker, so uneven task costs (e.g. samples that converge at
+//  different speeds) are balanced without a central queue.
+//
+
+// Called once for every task index. iThread is in [0, threadCount) and can be used to index per-thread scratch buffers.
+typedef void (*ParallelTask)(int iTask, int iThread, void *context);
+
+typedef struct
+{
+    pthread_mutex_t lock;
+
+    // Next task index to run
+    int next;
+
+    // One past the last task index owned by this worker
+    int end;
+
+} TaskRange;
+
+typedef struct
+{
+    // Number of threads, including the thread calling parallelFor
+    int threadCount;
+
+    // Worker threads (threadCount - 1 of them)
+    pthread_t *threadArray;
+
+    // Task range owned by each thread
+    TaskRange *rangeArray;
+
+    // Serializes parallelFor calls made from different threads
+    pthread_mutex_t submitLock;
+
+    pthread_mutex_t lock;
+    pthread_cond_t workReady;
+    pthread_cond_t workDone;
+
+    // Incremented for every parallelFor so that sleeping workers can tell new work from spurious wakeups
+    int generation;
+
+    // Workers still running tasks of the current generation
+    int activeWorkerCount;
+
+    bool shuttingDown;
+
+    ParallelTask task;
+    void *context;
+
+} ThreadPool;
+
+int getHardwareThreadCount();
+ThreadPool* createThreadPool(int threadCount);
+void releaseThreadPool(ThreadPool *pool);
+ThreadPool* defaultThreadPool();
+void setDefaultThreadCount(int threadCount);
+void parallelFor(ThreadPool *pool, int taskCount, ParallelTask task, void *context);
+
+#endif /* threadpool_hpp */
@@ -8,6 +8,8 @@
 
 #include "utility.hpp"
 #include "graph.hpp"
+#include "statistics.hpp"
+#include <time.h>
 
 ///
 //  Macros
@@ -26,6 +28,14 @@ using namespace std;
 void checkErrorFileLine(int errNum, int expected, const char* file, const int lineNumber);
 
 
+// Wall-clock seconds since an arbitrary point, for timing
+double getMonotonicSeconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
 void printCostOfRandomVertices(int *costArrayHost, int verticesToPrint, int totalVerticeCount) {
     for(int i = 0; i < verticesToPrint; i++)
     {
@@ -91,7 +101,7 @@ void printInverseGraph(GraphData *graph) {
         }
         printf("Vertex %i has %i parents\n", iNode, nParents);
         for (int iParent=0; iParent<nParents; iParent++) {
-            printf("Vertex %i is child to vertex %i with edge weight of %i\n", iNode, graph->inverseEdgeArray[graph->inverseVertexArray[iNode]+iParent], graph->inverseWeightArray[graph->inverseVertexArray[iNode]+iParent]);
+            printf("Vertex %i is child to vertex %i with edge weight of %i\n", iNode, graph->inverseEdgeArray[graph->inverseVertexArray[iNode]+iParent], graph->weightArray[graph->inverseEdgeMapArray[graph->inverseVertexArray[iNode]+iParent]]);
         }
     }
 }
@@ -116,7 +126,8 @@ void printWeights(GraphData *graph) {
 
 void printInverseWeights(GraphData *graph) {
     for (int i = 0; i < graph->graphCount*graph->edgeCount; i++) {
-        printf("inverseWeightArray[%i] = %i\n", i, graph->inverseWeightArray[i]);
+        int inverseWeight = graph->weightArray[(i / graph->edgeCount) * graph->edgeCount + graph->inverseEdgeMapArray[i % graph->edgeCount]];
+        printf("Weight of inverse edge %i = %i\n", i, inverseWeight);
     }
 }
 
@@ -147,14 +158,14 @@ void dumpBuffers(GraphData *graph, cl_command_queue *commandQueue, cl_mem *maskA
     int *costArrayHost = (int*) malloc(sizeof(int) * totalVertexCount);
     int *updatingCostArrayHost = (int*) malloc(sizeof(int) * totalVertexCount);
     int *weightArrayHost = (int*) malloc(sizeof(int) * totalEdgeCount);
-    int *maxVertexArrayHost = (int*) malloc(sizeof(int) * totalVertexCount);
+    int *maxVertexArrayHost = (int*) malloc(sizeof(int) * graph->vertexCount);
     int *parentCountArrayHost = (int*) malloc(sizeof(int) * totalVertexCount);
     int *maskArrayHost = (int*) malloc(sizeof(int) * totalVertexCount);
     
     
     errNum = clEnqueueReadBuffer(*commandQueue, *costArrayDevice, CL_FALSE, 0, sizeof(int) * totalVertexCount, costArrayHost, 0, NULL, &readDone);
     checkError(errNum, CL_SUCCESS);
-    errNum = clEnqueueReadBuffer(*commandQueue, *maxVerticeArrayDevice, CL_FALSE, 0, sizeof(int) * totalVertexCount, maxVertexArrayHost, 0, NULL, &readDone);
+    errNum = clEnqueueReadBuffer(*commandQueue, *maxVerticeArrayDevice, CL_FALSE, 0, sizeof(int) * graph->vertexCount, maxVertexArrayHost, 0, NULL, &readDone);
     checkError(errNum, CL_SUCCESS);
     errNum = clEnqueueReadBuffer(*commandQueue, *weightArrayDevice, CL_FALSE, 0, sizeof(int) * totalEdgeCount, weightArrayHost, 0, NULL, &readDone);
     checkError(errNum, CL_SUCCESS);
@@ -171,7 +182,7 @@ void dumpBuffers(GraphData *graph, cl_command_queue *commandQueue, cl_mem *maskA
         int iGraph = tid / graph -> vertexCount;
         
         if (tid == iVertex || iVertex == -1) {
-            printf("Node %i: Mask: %i, Cost: %i, updatingCost: %i, max: %i, parentCount: %i.\n", tid, maskArrayHost[tid], costArrayHost[tid], updatingCostArrayHost[tid], maxVertexArrayHost[tid], parentCountArrayHost[tid]);
+            printf("Node %i: Mask: %i, Cost: %i, updatingCost: %i, max: %i, parentCount: %i.\n", tid, maskArrayHost[tid], costArrayHost[tid], updatingCostArrayHost[tid], maxVertexArrayHost[tid % graph->vertexCount], parentCountArrayHost[tid]);
             
             int edgeStart = graph->vertexArray[localTid];
             int edgeEnd;
@@ -203,7 +214,7 @@ void printAfterUpdating(GraphData *graph, cl_command_queue *commandQueue, int *m
     int *costArrayHost = (int*) malloc(sizeof(int) * totalVertexCount);
     int *updatingCostArrayHost = (int*) malloc(sizeof(int) * totalVertexCount);
     int *weightArrayHost = (int*) malloc(sizeof(int) * totalEdgeCount);
-    int *maxVertexArrayHost = (int*) malloc(sizeof(int) * totalVertexCount);
+    int *maxVertexArrayHost = (int*) malloc(sizeof(int) * graph->vertexCount);
     int *parentCountArrayHost = (int*) malloc(sizeof(int) * graph->graphCount*graph->vertexCount);
     
     
@@ -211,7 +222,7 @@ void printAfterUpdating(GraphData *graph, cl_command_queue *commandQueue, int *m
     checkError(errNum, CL_SUCCESS);
     errNum = clEnqueueReadBuffer(*commandQueue, *updatingCostArrayDevice, CL_FALSE, 0, sizeof(int) * totalVertexCount, updatingCostArrayHost, 0, NULL, &readDone);
     checkError(errNum, CL_SUCCESS);
-    errNum = clEnqueueReadBuffer(*commandQueue, *maxVerticeArrayDevice, CL_FALSE, 0, sizeof(int) * totalVertexCount, maxVertexArrayHost, 0, NULL, &readDone);
+    errNum = clEnqueueReadBuffer(*commandQueue, *maxVerticeArrayDevice, CL_FALSE, 0, sizeof(int) * graph->vertexCount, maxVertexArrayHost, 0, NULL, &readDone);
     checkError(errNum, CL_SUCCESS);
     errNum = clEnqueueReadBuffer(*commandQueue, *weightArrayDevice, CL_FALSE, 0, sizeof(int) * totalEdgeCount, weightArrayHost, 0, NULL, &readDone);
     checkError(errNum, CL_SUCCESS);
@@ -222,8 +233,8 @@ void printAfterUpdating(GraphData *graph, cl_command_queue *commandQueue, int *m
     printf("%i vertices.\n", totalVertexCount);
     for (int tid = 0; tid < totalVertexCount; tid++) {
         if ( maskArrayHost[tid] != 0 ) {
-            printf("Vertex %i, (max: %i, %i remaining parents) is considered for updating.\n", tid, maxVertexArrayHost[tid], parentCountArrayHost[tid]);
-            if (maxVertexArrayHost[tid]<0 || parentCountArrayHost[tid]==0) {
+            printf("Vertex %i, (max: %i, %i remaining parents) is considered for updating.\n", tid, maxVertexArrayHost[tid % graph->vertexCount], parentCountArrayHost[tid]);
+            if (maxVertexArrayHost[tid % graph->vertexCount]<0 || parentCountArrayHost[tid]==0) {
                 
                 int iGraph = tid / graph->vertexCount;
                 int localTid = tid % graph->vertexCount;
@@ -244,14 +255,14 @@ void printAfterUpdating(GraphData *graph, cl_command_queue *commandQueue, int *m
                     int nid = iGraph*graph->vertexCount + graph->edgeArray[edge];
                     int eid = iGraph*graph->edgeCount + edge;
                     
-                    printf("Node %i (of cost %i and updatingCost %i) updated node %i (of max %i with %i remaining parents) by edge %i with weight %i. Node %i now has cost %i and updatingCost %i.\n", tid, costArrayHost[tid], updatingCostArrayHost[tid], nid, maxVertexArrayHost[nid], parentCountArrayHost[nid], edge, graph->weightArray[eid], nid, costArrayHost[nid], updatingCostArrayHost[nid]);
+                    printf("Node %i (of cost %i and updatingCost %i) updated node %i (of max %i with %i remaining parents) by edge %i with weight %i. Node %i now has cost %i and updatingCost %i.\n", tid, costArrayHost[tid], updatingCostArrayHost[tid], nid, maxVertexArrayHost[nid % graph->vertexCount], parentCountArrayHost[nid], edge, graph->weightArray[eid], nid, costArrayHost[nid], updatingCostArrayHost[nid]);
                     
-                    if (maxVertexArrayHost[nid]>=0)
+                    if (maxVertexArrayHost[nid % graph->vertexCount]>=0)
                     {
                         printf("Updated a max node.\n");
-                        printf("Perhaps maxVertexArray was increased. It is now %i.\n", maxVertexArrayHost[nid]);
+                        printf("Perhaps maxVertexArray was increased. It is now %i.\n", maxVertexArrayHost[nid % graph->vertexCount]);
                         if (parentCountArrayHost[nid]==0) {
-                            printf("All parents visited. Set updatingCostArray[nid] (%i) to maxVertexArray[nid] (%i).\n", updatingCostArrayHost[nid], maxVertexArrayHost[nid]);
+                            printf("All parents visited. Set updatingCostArray[nid] (%i) to maxVertexArray[nid] (%i).\n", updatingCostArrayHost[nid], maxVertexArrayHost[nid % graph->vertexCount]);
                         }
                     }
                 }
@@ -271,28 +282,13 @@ const char* costToString(int cost) {
     return str;
 }
 
-int compare(const void * a, const void * b)
-{
-    return ( *(int*)a - *(int*)b );
-}
-
-int median(int array[], int nArray)
-{
-    qsort (array, nArray, sizeof(int), compare);
-    for (int i = 0; i < nArray; i++) {
-    }
-    return array[nArray/2];
-}
-
-// This function is destructuve, overwriting the first sample of costs with median values.
+// This function is destructuve, overwriting the first sample of costs with median values. The medians are
+// read from streaming statistics, so they are approximate within a histogram bucket (see statistics.hpp).
 void getMedianGraph(GraphData *graph) {
-    int *costSampleArray = (int*) malloc(sizeof(int) * graph->graphCount);
-    for (int iVertex = 0; iVertex < graph->vertexCount; iVertex++) {
-        for (int iGraph = 0; iGraph < graph->graphCount; iGraph++) {
-            costSampleArray[iGraph] = graph->costArray[iGraph*graph->vertexCount + iVertex];
-        }
-        graph->costArray[iVertex] = median(costSampleArray, graph->graphCount);
-    }
+    VertexStatistics *statistics = createVertexStatistics(graph->vertexCount, STATISTICS_DEFAULT_BUCKETS_PER_OCTAVE);
+    accumulateVertexStatistics(statistics, graph->costArray, graph->graphCount);
+    getQuantileCosts(statistics, 0.5, graph->costArray);
+    releaseVertexStatistics(statistics);
 }
 
 void printMathematicaString(GraphData *graph, int iGraph, bool printSum) {
@@ -408,20 +404,19 @@ void printVisitedParents(cl_command_queue *commandQueue, GraphData *graph, cl_me
     }
 }
 
+// The device holds one max flag per vertex, shared by all samples
 void printMaxVertices(cl_command_queue *commandQueue, GraphData *graph, cl_mem *maxVertexArrayDevice) {
-    int *maxVertexArrayHost = (int*) malloc(sizeof(int) * graph->graphCount*graph->vertexCount);
+    int *maxVertexArrayHost = (int*) malloc(sizeof(int) * graph->vertexCount);
     cl_event readDone;
     
-    int errNum = clEnqueueReadBuffer(*commandQueue, *maxVertexArrayDevice, CL_FALSE, 0, sizeof(int) * graph->graphCount*graph->vertexCount, maxVertexArrayHost, 0, NULL, &readDone);
+    int errNum = clEnqueueReadBuffer(*commandQueue, *maxVertexArrayDevice, CL_FALSE, 0, sizeof(int) * graph->vertexCount, maxVertexArrayHost, 0, NULL, &readDone);
     checkError(errNum, CL_SUCCESS);
     clWaitForEvents(1, &readDone);
     
-    for (int iGraph=0; iGraph < graph->graphCount; iGraph++) {
-        for (int iVertex=0; iVertex<graph->vertexCount; iVertex++) {
-            int iGlobalVertex =iGraph * graph->vertexCount + iVertex;
-            printf("Max of vertex %i is %i.\n",iGlobalVertex, maxVertexArrayHost[iGlobalVertex]);
-        }
+    for (int iVertex=0; iVertex<graph->vertexCount; iVertex++) {
+        printf("Max of vertex %i is %i.\n",iVertex, maxVertexArrayHost[iVertex]);
     }
+    free(maxVertexArrayHost);
 }
 
 // A utility function to print the constructed distance array
@@ -439,27 +434,31 @@ void compareToCPUComputation(GraphData *graph, bool verbose, int nGraphsToCheck)
     printf("Checking correctness against sequential implementation in %i graphs.\n", nGraphsToCheck);
     int nInfinite = 0;
     int iErrors = 0;
+    int *dist = (int*) malloc(sizeof(int) * graph->vertexCount);
+    DijkstraWorkspace *workspace = createDijkstraWorkspace(graph);
     for (int iCheck = 0; iCheck<nGraphsToCheck; iCheck++) {
         //int iGraph = rand() % graph->graphCount;
         int iGraph = iCheck;
         //printf("Checking graph %i.\n", iGraph);
-        int *dist = dijkstra(graph, iGraph, verbose);
+        dijkstraWithWorkspace(graph, iGraph, workspace, dist, verbose);
         for (int iVertex = 0; iVertex < graph->vertexCount; iVertex++) {
             if (verbose) {
-                printf("%i: CPU=%i, GPU=%i\n", iVertex, dist[iVertex], graph->costArray[iGraph*graph->vertexCount + iVertex]);
+                printf("%i: CPU=%i, GPU=%i\n", iVertex, dist[iVertex], graph->costArray[(long)iGraph*graph->vertexCount + iVertex]);
             }
-            if (dist[iVertex] != graph->costArray[iGraph*graph->vertexCount + iVertex] || graph->costArray[iGraph*graph->vertexCount + iVertex] != dist[iVertex]) {
-                printf("CPU computed %i for vertex %i while GPU computed %i\n", dist[iVertex], iVertex, graph->costArray[iGraph*graph->vertexCount + iVertex]);
+            if (dist[iVertex] != graph->costArray[(long)iGraph*graph->vertexCount + iVertex]) {
+                printf("CPU computed %i for vertex %i while GPU computed %i\n", dist[iVertex], iVertex, graph->costArray[(long)iGraph*graph->vertexCount + iVertex]);
                 iErrors++;
                 // exit(1);
             }
-            if (graph->costArray[iGraph*graph->vertexCount + iVertex] == INT_MAX) {
+            if (graph->costArray[(long)iGraph*graph->vertexCount + iVertex] == INT_MAX) {
                 nInfinite++;
             }
         }
     }
+    releaseDijkstraWorkspace(workspace);
+    free(dist);
     printf("%i errors.\n", iErrors);
-    printf("On average %.0f%% infinite-time attack steps.\n", 100*(float)nInfinite/(nGraphsToCheck*graph->vertexCount));
+    printf("On average %.0f%% infinite-time attack steps.\n", 100*(float)nInfinite/((float)nGraphsToCheck*graph->vertexCount));
 }
 
 #define PRECISION 1000
@@ -495,9 +494,17 @@ void maxSumDifference(GraphData *graph) {
     printf("The biggeste single difference was %.2f%% in node %i (%i).\n", maxDiff, iMaxDiff % graph->graphCount, iMaxDiff);
 }
 
-void writeGraphToFile(GraphData *graph, char filePath[512]) {
+///
+/// Write graph in the CSV format, with the costs and shortest parents that are not NULL. Returns false if the file
+/// could not be written.
+///
+bool writeGraphToFile(GraphData *graph, char filePath[512]) {
     ofstream myfile;
     myfile.open (filePath);
+    if (!myfile.is_open()) {
+        printf("Error: Unable to open %s for writing!\n", filePath);
+        return false;
+    }
     myfile << graph->graphCount << "," << graph->vertexCount << "," << graph->edgeCount << "," << graph->graphCount << ",\n";
     for (int iVertex = 0; iVertex < graph->vertexCount - 1; iVertex++) {
         myfile << graph->vertexArray[iVertex] << ",";
@@ -524,17 +531,28 @@ void writeGraphToFile(GraphData *graph, char filePath[512]) {
     }
     myfile << graph->weightArray[graph->graphCount * graph->edgeCount - 1] << ",\n";
 
-    for (int iVertex = 0; iVertex < graph->graphCount * graph->vertexCount - 1; iVertex++) {
-        myfile << graph->costArray[iVertex] << ",";
+    // A graph that has not been computed, e.g. converted from a binary file without results, ends here, and one
+    // computed with -costs-only after its costs
+    if (graph->costArray != NULL) {
+        for (int iVertex = 0; iVertex < graph->graphCount * graph->vertexCount - 1; iVertex++) {
+            myfile << graph->costArray[iVertex] << ",";
+        }
+        myfile << graph->costArray[graph->graphCount * graph->vertexCount - 1] << ",\n";
     }
-    myfile << graph->costArray[graph->graphCount * graph->vertexCount - 1] << ",\n";
 
-    for (int iShortestParent = 0; iShortestParent < graph->graphCount * graph->edgeCount- 1; iShortestParent++) {
-        myfile << graph->shortestParentsArray[iShortestParent] << ",";
+    if (graph->costArray != NULL && graph->shortestParentsArray != NULL) {
+        for (int iShortestParent = 0; iShortestParent < graph->graphCount * graph->edgeCount- 1; iShortestParent++) {
+            myfile << graph->shortestParentsArray[iShortestParent] << ",";
+        }
+        myfile << graph->shortestParentsArray[graph->graphCount * graph->edgeCount - 1] << ",\n";
     }
-    myfile << graph->shortestParentsArray[graph->graphCount * graph->edgeCount - 1] << ",\n";
 
     myfile.close();
+    if (myfile.fail()) {
+        printf("Error: Failed to write %s!\n", filePath);
+        return false;
+    }
+    return true;
 }
 
 void readGraphFromFile(GraphData *graph, char filePath[512]) {
@@ -0,0 +1,187 @@
+//
+//  weightmodel.cpp
+//  OpenCLDijkstra
+//
+
+#include "weightmodel.hpp"
+#include "threadpool.hpp"
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+
+#define MAX_GAMMA_ATTEMPTS 32
+
+typedef struct
+{
+    GraphData *graph;
+    WeightModel *model;
+} SampleWeightsContext;
+
+
+WeightModel* createWeightModel(int edgeCount, unsigned int seed, DistributionType type, float parameter1, float parameter2)
+{
+    WeightModel *model = (WeightModel*) malloc(sizeof(WeightModel));
+    model->edgeCount = edgeCount;
+    model->distributionTypeArray = (int*) malloc(edgeCount * sizeof(int));
+    model->distributionParameterArray = (float*) malloc(2 * edgeCount * sizeof(float));
+    model->seed = seed;
+    model->sampleOffset = 0;
+    for (int iEdge = 0; iEdge < edgeCount; iEdge++) {
+        setEdgeDistribution(model, iEdge, type, parameter1, parameter2);
+    }
+    return model;
+}
+
+void releaseWeightModel(WeightModel *model)
+{
+    free(model->distributionTypeArray);
+    free(model->distributionParameterArray);
+    free(model);
+}
+
+void setEdgeDistribution(WeightModel *model, int edge, DistributionType type, float parameter1, float parameter2)
+{
+    model->distributionTypeArray[edge] = type;
+    model->distributionParameterArray[2 * edge] = parameter1;
+    model->distributionParameterArray[2 * edge + 1] = parameter2;
+}
+
+///
+/// Philox4x32-10 of Salmon et al., a counter-based generator: 128 random bits that depend only on the counter and
+/// the key, so any draw can be made on any thread in any order.
+///
+PhiloxCounter philox4x32_10(PhiloxCounter counter, uint32_t key0, uint32_t key1)
+{
+    for (int iRound = 0; iRound < 10; iRound++) {
+        uint64_t product0 = (uint64_t)0xD2511F53u * counter.x;
+        uint64_t product1 = (uint64_t)0xCD9E8D57u * counter.z;
+        PhiloxCounter next;
+        next.x = (uint32_t)(product1 >> 32) ^ counter.y ^ key0;
+        next.y = (uint32_t)product1;
+        next.z = (uint32_t)(product0 >> 32) ^ counter.w ^ key1;
+        next.w = (uint32_t)product0;
+        counter = next;
+        key0 += 0x9E3779B9u;
+        key1 += 0xBB67AE85u;
+    }
+    return counter;
+}
+
+// Uniform float in the open interval (0, 1)
+float uniformFromBits(uint32_t bits)
+{
+    return (float)(bits >> 8) * (1.0f / 16777216.0f) + (0.5f / 16777216.0f);
+}
+
+float standardNormal(float u1, float u2)
+{
+    return sqrtf(-2.0f * logf(u1)) * cosf(6.28318530718f * u2);
+}
+
+///
+/// Host twin of sampleEdgeWeight in kernel.cl. Any change must be made to both.
+///
+int sampleEdgeWeight(unsigned int seed, int sample, int edge, int distributionType, float parameter1, float parameter2)
+{
+    PhiloxCounter counter = {(uint32_t)edge, (uint32_t)sample, 0, 0};
+    float value;
+
+    if (distributionType == DISTRIBUTION_FIXED) {
+        value = parameter1;
+    }
+    else if (distributionType == DISTRIBUTION_UNIFORM) {
+        PhiloxCounter bits = philox4x32_10(counter, seed, 0);
+        value = floorf(parameter1 + uniformFromBits(bits.x) * (parameter2 - parameter1));
+    }
+    else if (distributionType == DISTRIBUTION_EXPONENTIAL) {
+        PhiloxCounter bits = philox4x32_10(counter, seed, 0);
+        value = -parameter1 * logf(uniformFromBits(bits.x));
+    }
+    else if (distributionType == DISTRIBUTION_LOGNORMAL) {
+        PhiloxCounter bits = philox4x32_10(counter, seed, 0);
+        value = expf(parameter1 + parameter2 * standardNormal(uniformFromBits(bits.x), uniformFromBits(bits.y)));
+    }
+    else {
+        float shape = parameter1 < 1.0f ? parameter1 + 1.0f : parameter1;
+        float d = shape - 1.0f / 3.0f;
+        float c = 1.0f / sqrtf(9.0f * d);
+        value = d;
+        for (int attempt = 0; attempt < MAX_GAMMA_ATTEMPTS; attempt++) {
+            counter.z = attempt;
+            PhiloxCounter bits = philox4x32_10(counter, seed, 0);
+            float x = standardNormal(uniformFromBits(bits.x), uniformFromBits(bits.y));
+            float v = 1.0f + c * x;
+            if (v <= 0.0f) {
+                continue;
+            }
+            v = v * v * v;
+            value = d * v;
+            float u = uniformFromBits(bits.z);
+            if (logf(u) < 0.5f * x * x + d - d * v + d * logf(v)) {
+                if (parameter1 < 1.0f) {
+                    value = value * powf(uniformFromBits(bits.w), 1.0f / parameter1);
+                }
+                break;
+            }
+        }
+        value = value * parameter2;
+    }
+
+    if (!(value > 0.0f)) {
+        return 0;
+    }
+    if (value >= 2147483520.0f) {
+        return INT_MAX;
+    }
+    return (int)rintf(value);
+}
+
+void sampleWeightsTask(int iGraph, int iThread, void *context)
+{
+    GraphData *graph = ((SampleWeightsContext*)context)->graph;
+    WeightModel *model = ((SampleWeightsContext*)context)->model;
+    int *weightArray = graph->weightArray + (long)iGraph * graph->edgeCount;
+    for (int iEdge = 0; iEdge < graph->edgeCount; iEdge++) {
+        weightArray[iEdge] = sampleEdgeWeight(model->seed, model->sampleOffset + iGraph, iEdge, model->distributionTypeArray[iEdge],
+                                              model->distributionParameterArray[2 * iEdge], model->distributionParameterArray[2 * iEdge + 1]);
+    }
+}
+
+///
+/// Draw weightArray of all samples of graph from model on the host. Gives the same weights
+/// as SAMPLE_WEIGHTS for the same seed and sampleOffset.
+///
+void sampleWeightsOnCPU(GraphData *graph, WeightModel *model)
+{
+    if (model->edgeCount != graph->edgeCount) {
+        printf("Error: Weight model does not match the edge count of the graph!\n");
+        exit(1);
+    }
+    SampleWeightsContext context;
+    context.graph = graph;
+    context.model = model;
+    parallelFor(defaultThreadPool(), graph->graphCount, sampleWeightsTask, &context);
+}
+
+///
+/// Parse a distribution given as name:parameter1[:parameter2], e.g. "exponential:200" or "lognormal:5:0.5".
+/// Returns false for unknown names or missing parameters.
+///
+bool parseDistribution(const char *text, DistributionType *type, float *parameter1, float *parameter2)
+{
+    const char *nameArray[] = {"fixed", "uniform", "exponential", "lognormal", "gamma"};
+    int parameterCountArray[] = {1, 2, 1, 2, 2};
+    const char *separator = strchr(text, ':');
+    if (separator == NULL) {
+        return false;
+    }
+    for (int iType = 0; iType < 5; iType++) {
+        if (strlen(nameArray[iType]) == (size_t)(separator - text) && strncmp(text, nameArray[iType], separator - text) == 0) {
+            *type = (DistributionType)iType;
+            *parameter2 = 0.0f;
+            int parsed = sscanf(separator + 1, "%f:%f", parameter1, parameter2);
+            return parsed >= parameterCountArray[iType];
+        }
+    }
+    return false;
+}
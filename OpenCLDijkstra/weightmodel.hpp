@@ -0,0 +1,69 @@
+//
+//  weightmodel.hpp
+//  OpenCLDijkstra
+//
+
+#ifndef weightmodel_hpp
+#define weightmodel_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include "graph.hpp"
+
+
+///
+//  Types
+//
+//
+//  A weight model describes the time-to-compromise of each edge as a
+//  distribution rather than as stored samples. Weights are drawn with a
+//  counter-based generator, so the weight of an edge in a sample only depends
+//  on (seed, sample, edge). The OpenCL session draws them on the device with
+//  SAMPLE_WEIGHTS, and sampleWeightsOnCPU draws the same weights on the host.
+//  The two agree up to the rounding of log/exp on the device, which OpenCL
+//  allows to differ by a few ulp from the host.
+//
+
+// Must match the DISTRIBUTION_ defines in kernel.cl
+typedef enum
+{
+    DISTRIBUTION_FIXED = 0,         // parameter1 is the weight
+    DISTRIBUTION_UNIFORM = 1,       // Integer weights in [parameter1, parameter2)
+    DISTRIBUTION_EXPONENTIAL = 2,   // parameter1 is the mean
+    DISTRIBUTION_LOGNORMAL = 3,     // parameter1 and parameter2 are the mean and standard deviation of the log
+    DISTRIBUTION_GAMMA = 4          // parameter1 is the shape, parameter2 the scale
+} DistributionType;
+
+typedef struct
+{
+    uint32_t x, y, z, w;
+} PhiloxCounter;
+
+typedef struct
+{
+    int edgeCount;
+
+    // DistributionType of each edge
+    int *distributionTypeArray;
+
+    // parameter1 and parameter2 of each edge, interleaved
+    float *distributionParameterArray;
+
+    unsigned int seed;
+
+    // Index of sample 0 of the graph in the overall sequence of samples. Advance it by graphCount to draw the
+    // next set of samples of the same graph.
+    int sampleOffset;
+
+} WeightModel;
+
+PhiloxCounter philox4x32_10(PhiloxCounter counter, uint32_t key0, uint32_t key1);
+float uniformFromBits(uint32_t bits);
+WeightModel* createWeightModel(int edgeCount, unsigned int seed, DistributionType type, float parameter1, float parameter2);
+void releaseWeightModel(WeightModel *model);
+void setEdgeDistribution(WeightModel *model, int edge, DistributionType type, float parameter1, float parameter2);
+int sampleEdgeWeight(unsigned int seed, int sample, int edge, int distributionType, float parameter1, float parameter2);
+void sampleWeightsOnCPU(GraphData *graph, WeightModel *model);
+bool parseDistribution(const char *text, DistributionType *type, float *parameter1, float *parameter2);
+
+#endif /* weightmodel_hpp */